@@ -3,7 +3,12 @@
 #include <pybind11/functional.h>
 #include "../include/BinaryFuseWrapper.hpp"
 #include "../include/MortonFilterWrapper.hpp"
+#include "../include/l3_stream_builder.hpp"
+#include "../include/ip_prefix_table.hpp"
 #include "../include/numa_optimized_filter.hpp"
+#include "../include/pattern_matcher.hpp"
+#include "../include/tiny_bloom_filter.hpp"
+#include "../include/url_canonicalizer.hpp"
 
 namespace py = pybind11;
 
@@ -11,21 +16,94 @@ namespace py = pybind11;
 PYBIND11_MODULE(llamashield_py, m) {
     m.doc() = "LlamaShield high-performance URL filtering engine";
     
+    // HashedKey binding: hash a URL once and pass it to any layer
+    py::class_<HashedKey>(m, "HashedKey")
+        .def_static("of", py::overload_cast<std::string_view>(&HashedKey::of))
+        .def_static("of_raw", [](const std::string& data) { return HashedKey::of_raw(data.data(), data.size()); })
+        .def_readonly("key", &HashedKey::key)
+        .def_readonly("route", &HashedKey::route)
+        .def("partition", &HashedKey::partition);
+
+    // Canonical form of a URL (the string HashedKey.of hashes), or None
+    m.def("canonicalize_url", [](const std::string& url) -> py::object {
+        char canonical[kCanonicalUrlStackBytes];
+        size_t size = 0;
+        if (!canonicalize_url(url.data(), url.size(), canonical, sizeof(canonical), size)) return py::none();
+        return py::str(canonical, size);
+    });
+
     // BinaryFuseWrapper binding
     py::class_<BinaryFuseWrapper>(m, "BinaryFuseWrapper")
-        .def(py::init<>())
+        .def(py::init<uint32_t>(), py::arg("fingerprint_bits") = 8)
         .def("build_from_keys", &BinaryFuseWrapper::build_from_keys)
-        .def("contains", &BinaryFuseWrapper::contains)
+        .def("build_sharded", &BinaryFuseWrapper::build_sharded,
+             py::arg("keys"), py::arg("shard_bits"), py::arg("num_threads") = 0,
+             py::call_guard<py::gil_scoped_release>())
+        .def("shard_count", &BinaryFuseWrapper::shard_count)
+        .def("fingerprint_bits", &BinaryFuseWrapper::fingerprint_bits)
+        .def("set_exact_verification", &BinaryFuseWrapper::set_exact_verification)
+        .def("has_exact_verification", &BinaryFuseWrapper::has_exact_verification)
+        .def("get_memory_usage", &BinaryFuseWrapper::get_memory_usage)
+        .def("get_verifier_memory_usage", &BinaryFuseWrapper::get_verifier_memory_usage)
+        .def("contains", py::overload_cast<uint64_t>(&BinaryFuseWrapper::contains, py::const_))
+        .def("contains", py::overload_cast<const HashedKey&>(&BinaryFuseWrapper::contains, py::const_))
+        .def("contains_batch", [](const BinaryFuseWrapper& self, const std::vector<uint64_t>& keys) {
+            std::vector<uint8_t> hits(keys.size());
+            self.contains_batch(keys.data(), keys.size(), hits.data());
+            return std::vector<bool>(hits.begin(), hits.end());
+        })
         .def("save_to_file", &BinaryFuseWrapper::save_to_file)
-        .def("load_from_file", &BinaryFuseWrapper::load_from_file)
+        .def("load_from_file", &BinaryFuseWrapper::load_from_file,
+             py::arg("path"), py::arg("verify_checksum") = true)
         .def_static("hash_url", &BinaryFuseWrapper::hash_url);
     
+    // L3StreamBuilder binding
+    py::class_<L3StreamBuilder>(m, "L3StreamBuilder")
+        .def(py::init([](size_t memory_budget, const std::string& spill_dir, unsigned num_threads,
+                         bool exact_keys, uint32_t fingerprint_bits) {
+                 L3StreamBuilder::Options options;
+                 options.memory_budget = memory_budget;
+                 options.spill_dir = spill_dir;
+                 options.num_threads = num_threads;
+                 options.exact_keys = exact_keys;
+                 options.fingerprint_bits = fingerprint_bits;
+                 return std::make_unique<L3StreamBuilder>(options);
+             }),
+             py::arg("memory_budget") = size_t{256} << 20, py::arg("spill_dir") = "",
+             py::arg("num_threads") = 1, py::arg("exact_keys") = false, py::arg("fingerprint_bits") = 8)
+        .def("add_key_file", &L3StreamBuilder::add_key_file)
+        .def("add_url_file", &L3StreamBuilder::add_url_file)
+        .def("build_to_file", &L3StreamBuilder::build_to_file, py::call_guard<py::gil_scoped_release>())
+        .def("build", &L3StreamBuilder::build, py::call_guard<py::gil_scoped_release>())
+        .def("get_input_keys", &L3StreamBuilder::get_input_keys)
+        .def("get_unique_keys", &L3StreamBuilder::get_unique_keys);
+    
     // MortonFilterWrapper binding  
     py::class_<MortonFilterWrapper>(m, "MortonFilterWrapper")
         .def(py::init<>())
-        .def("initialize", &MortonFilterWrapper::initialize)
-        .def("insert", &MortonFilterWrapper::insert)
-        .def("contains", &MortonFilterWrapper::contains)
+        .def("initialize", py::overload_cast<size_t, double>(&MortonFilterWrapper::initialize),
+             py::arg("capacity"), py::arg("false_positive_rate") = 0.01)
+        .def("initialize_with_ttl",
+             [](MortonFilterWrapper& self, size_t capacity, double false_positive_rate,
+                int64_t ttl_ms, uint32_t generations) {
+                 return self.initialize(capacity, false_positive_rate,
+                                        std::chrono::milliseconds(ttl_ms), generations);
+             },
+             py::arg("capacity"), py::arg("false_positive_rate"), py::arg("ttl_ms"),
+             py::arg("generations") = 4)
+        .def("expire", &MortonFilterWrapper::expire)
+        .def("get_generations", &MortonFilterWrapper::get_generations)
+        .def("consolidate", &MortonFilterWrapper::consolidate)
+        .def("get_stage_count", &MortonFilterWrapper::get_stage_count)
+        .def("insert", py::overload_cast<std::string_view>(&MortonFilterWrapper::insert))
+        .def("insert", py::overload_cast<const HashedKey&>(&MortonFilterWrapper::insert))
+        .def("contains", py::overload_cast<std::string_view>(&MortonFilterWrapper::contains, py::const_))
+        .def("contains", py::overload_cast<const HashedKey&>(&MortonFilterWrapper::contains, py::const_))
+        .def("remove", py::overload_cast<std::string_view>(&MortonFilterWrapper::remove))
+        .def("remove", py::overload_cast<const HashedKey&>(&MortonFilterWrapper::remove))
+        .def("insert_key", [](MortonFilterWrapper& self, uint64_t key) { return self.insert_key(key); })
+        .def("contains_key", &MortonFilterWrapper::contains_key)
+        .def("remove_key", &MortonFilterWrapper::remove_key)
         .def("insert_batch", &MortonFilterWrapper::insert_batch)
         .def("contains_batch", &MortonFilterWrapper::contains_batch)
         .def("get_count", &MortonFilterWrapper::get_count)
@@ -33,13 +111,109 @@ PYBIND11_MODULE(llamashield_py, m) {
         .def("save_to_file", &MortonFilterWrapper::save_to_file)
         .def("load_from_file", &MortonFilterWrapper::load_from_file);
     
+    // TinyBloomFilter binding (L1)
+    py::class_<TinyBloomFilter>(m, "TinyBloomFilter")
+        .def(py::init<>())
+        .def("initialize", &TinyBloomFilter::initialize,
+             py::arg("bytes") = TinyBloomFilter::kDefaultBytes, py::arg("bits_per_key") = 16)
+        .def("contains", &TinyBloomFilter::contains)
+        .def("promote", [](TinyBloomFilter& self, uint64_t key) { self.promote(key, self.epoch()); })
+        .def("invalidate", &TinyBloomFilter::invalidate)
+        .def("get_count", &TinyBloomFilter::get_count)
+        .def("get_capacity", &TinyBloomFilter::get_capacity)
+        .def("get_memory_usage", &TinyBloomFilter::get_memory_usage)
+        .def("kernel_name", &TinyBloomFilter::kernel_name);
+
+    // IP networks; lookup returns the longest matching prefix length or -1
+    py::class_<IpPrefixTable>(m, "IpPrefixTable")
+        .def(py::init<>())
+        .def("build", py::overload_cast<const std::vector<std::string>&>(&IpPrefixTable::build))
+        .def("load_list", &IpPrefixTable::load_list)
+        .def("save_to_file", &IpPrefixTable::save_to_file)
+        .def("load_from_file", &IpPrefixTable::load_from_file, py::arg("path"), py::arg("verify_checksum") = true)
+        .def("lookup", [](const IpPrefixTable& self, const std::string& host) { return self.lookup(host); })
+        .def("lookup_v4", &IpPrefixTable::lookup_v4)
+        .def("size", &IpPrefixTable::size)
+        .def("get_memory_usage", &IpPrefixTable::get_memory_usage);
+
+    // Substring rules; find returns the matching pattern or None
+    py::class_<PatternMatcher>(m, "PatternMatcher")
+        .def(py::init<>())
+        .def("build", &PatternMatcher::build)
+        .def("load_from_file", &PatternMatcher::load_from_file)
+        .def("find", [](const PatternMatcher& self, const std::string& text) -> py::object {
+            const uint32_t pattern = self.find(text.data(), text.size());
+            if (pattern == PatternMatcher::kNoMatch) return py::none();
+            return py::str(self.get_pattern(pattern));
+        })
+        .def("find_in_url", [](const PatternMatcher& self, const std::string& url) -> py::object {
+            const uint32_t pattern = self.find_in_url(url);
+            if (pattern == PatternMatcher::kNoMatch) return py::none();
+            return py::str(self.get_pattern(pattern));
+        })
+        .def("size", &PatternMatcher::size)
+        .def("get_memory_usage", &PatternMatcher::get_memory_usage)
+        .def("kernel_name", &PatternMatcher::kernel_name);
+
+    // Hierarchical lookup results
+    py::enum_<MatchGranularity>(m, "MatchGranularity")
+        .value("NONE", MatchGranularity::kNone)
+        .value("URL", MatchGranularity::kUrl)
+        .value("PATH", MatchGranularity::kPath)
+        .value("HOST", MatchGranularity::kHost)
+        .value("DOMAIN", MatchGranularity::kDomain)
+        .value("CIDR", MatchGranularity::kIpPrefix)
+        .value("PATTERN", MatchGranularity::kPattern);
+
+    py::class_<UrlMatch>(m, "UrlMatch")
+        .def_readonly("granularity", &UrlMatch::granularity)
+        .def_readonly("layer", &UrlMatch::layer)
+        .def_readonly("candidate", &UrlMatch::candidate)
+        .def_readonly("pattern", &UrlMatch::pattern)
+        .def_readonly("prefix_length", &UrlMatch::prefix_length)
+        .def("__bool__", [](const UrlMatch& match) { return match.layer != 0; });
+
+    // Public suffix rules; registrable_domain returns None for a public suffix
+    py::class_<PublicSuffixTable>(m, "PublicSuffixTable")
+        .def(py::init<>())
+        .def("add_rule", [](PublicSuffixTable& self, const std::string& rule) { return self.add_rule(rule); })
+        .def("load_from_file", &PublicSuffixTable::load_from_file)
+        .def("registrable_domain", [](const PublicSuffixTable& self, const std::string& host) -> py::object {
+            const size_t offset = self.registrable_offset(host);
+            if (offset == std::string::npos) return py::none();
+            return py::str(host.substr(offset));
+        })
+        .def("size", &PublicSuffixTable::size);
+
+    // The keys a hierarchical lookup probes, as (text, granularity) pairs
+    m.def("url_candidates", [](const std::string& url) {
+        auto candidates = std::make_unique<UrlCandidates>();
+        candidates->parse(url);
+        std::vector<std::pair<std::string, MatchGranularity>> result;
+        for (size_t i = 0; i < candidates->size(); ++i) {
+            result.emplace_back(std::string(candidates->text(i)), candidates->granularity(i));
+        }
+        return result;
+    });
+
     // NUMAOptimizedFilter binding
     py::class_<NUMAOptimizedFilter>(m, "NUMAOptimizedFilter")
         .def(py::init<>())
-        .def("initialize", &NUMAOptimizedFilter::initialize)
-        .def("contains", &NUMAOptimizedFilter::contains)
+        .def("initialize", &NUMAOptimizedFilter::initialize,
+             py::arg("total_capacity"), py::arg("journal_dir") = "")
+        .def("contains", py::overload_cast<std::string_view>(&NUMAOptimizedFilter::contains))
+        .def("contains", py::overload_cast<const HashedKey&>(&NUMAOptimizedFilter::contains))
+        .def("match", &NUMAOptimizedFilter::match)
+        .def("set_ip_prefixes", &NUMAOptimizedFilter::set_ip_prefixes)
+        .def("load_ip_prefixes", &NUMAOptimizedFilter::load_ip_prefixes)
+        .def("load_replicated_l3", &NUMAOptimizedFilter::load_replicated_l3)
+        .def("is_replicated", &NUMAOptimizedFilter::is_replicated)
+        .def("load_patterns", &NUMAOptimizedFilter::load_patterns)
+        .def("set_patterns", &NUMAOptimizedFilter::set_patterns)
         .def("check_url", &NUMAOptimizedFilter::check_url)
         .def("insert", &NUMAOptimizedFilter::insert)
-        .def("insert_batch", &NUMAOptimizedFilter::insert_batch)
+        .def("insert_batch", py::overload_cast<const std::vector<std::string>&>(&NUMAOptimizedFilter::insert_batch))
+        .def("remove", &NUMAOptimizedFilter::remove)
+        .def("request_compaction", &NUMAOptimizedFilter::request_compaction)
         .def("print_stats", &NUMAOptimizedFilter::print_stats);
 }
\ No newline at end of file
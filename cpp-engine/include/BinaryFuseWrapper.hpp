@@ -1,31 +1,136 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <vector>
 #include <string>
+#include <string_view>
+#include "hashed_key.hpp"
 
-// Forward declaration
+// Forward declarations
 struct binfuse_handle_t;
+class MappedFile;
 
+// Lookups may run concurrently with build_*/load_from_file: a new filter is
+// built aside and published atomically, and the one it replaces is freed
+// (via EpochReclaimer) only after in-flight lookups have finished.
+//
+// Fingerprints are 8, 16 or 32 bits wide (false-positive rate about 2^-bits
+// at 1.125 * bits bits per key). The width is fixed per wrapper for builds
+// and taken from the file header on load; each width has its own fully
+// specialised lookup path.
 class BinaryFuseWrapper {
 private:
-    binfuse_handle_t* handle_;
+    std::atomic<binfuse_handle_t*> handle_;
+    uint32_t fingerprint_bits_ = 8;
+    bool exact_verification_ = false;
 
 public:
-    BinaryFuseWrapper();
+    explicit BinaryFuseWrapper(uint32_t fingerprint_bits = 8);
     ~BinaryFuseWrapper();
 
+    BinaryFuseWrapper(const BinaryFuseWrapper&) = delete;
+    BinaryFuseWrapper& operator=(const BinaryFuseWrapper&) = delete;
+
+    // Key sets above kAutoShardThreshold are built sharded (see below)
     bool build_from_keys(const std::vector<uint64_t>& keys);
+
+    // Partitions keys by their top shard_bits into 2^shard_bits independent
+    // filters and builds them on num_threads threads (0 = hardware
+    // concurrency). Shards are scattered and built in waves of num_threads
+    // shards, so scratch memory stays near one wave's keys plus its build
+    // state instead of a copy of the whole key set. Each wave rescans keys:
+    // 2^shard_bits / num_threads scans in all. Building with
+    // LLAMASHIELD_MAX_SCATTER_PASSES=p caps that at p scans by widening the
+    // waves to 2^shard_bits / p shards, i.e. about n / p keys held at once.
+    // shard_bits == 0 builds one filter.
+    bool build_sharded(const std::vector<uint64_t>& keys, uint32_t shard_bits, unsigned num_threads = 0);
+
+    // Rebuilds the current filter, which must have exact keys (or be
+    // empty), with added inserted and removed dropped; both sorted. Each
+    // shard is merged straight from the current exact keys (on disk for a
+    // mapped file), so the only copy of the key set made is the new
+    // filter's own. The result keeps exact keys whatever
+    // set_exact_verification says.
+    bool rebuild_exact(const std::vector<uint64_t>& added, const std::vector<uint64_t>& removed = {},
+                       unsigned num_threads = 0);
+
     bool contains(uint64_t key) const;
+    bool contains(const HashedKey& hash) const { return contains(hash.key); }
+
+    // Checks n keys, writing 1 (possibly present) or 0 to out[i]. Positions
+    // for a window of keys are computed and prefetched before any
+    // fingerprint is read, so the DRAM misses of the window overlap.
+    bool contains_batch(const uint64_t* keys, size_t n, uint8_t* out) const;
+
+    // Versioned binary format (see fuse_layout.hpp). Loading maps the file
+    // read-only and queries the fingerprints in place.
     bool save_to_file(const std::string& path) const;
-    bool load_from_file(const std::string& path);
-    
-    static uint64_t hash_url(const std::string& url);
+    bool load_from_file(const std::string& path, bool verify_checksum = true);
+
+    // Same from image (an L3 file already mapped), copied into memory
+    // local to numa_node, so lookups on that node never leave it; one
+    // image can seed a replica per node
+    bool load_replica(const MappedFile& image, int numa_node, bool verify_checksum = true);
+
+    size_t shard_count() const;
+
+    // Width of the current filter, or the one the next build will use
+    uint32_t fingerprint_bits() const;
+
+    static constexpr bool is_supported_width(uint32_t bits) {
+        return bits == 8 || bits == 16 || bits == 32;
+    }
+
+    // Exact-match tier: also keep each shard's sorted 64-bit keys and confirm
+    // every fingerprint hit against them, so contains() has no false
+    // positives (short of a 64-bit hash collision) at 8 extra bytes per key.
+    // Applies to subsequent builds; a loaded file carries its own setting.
+    void set_exact_verification(bool enabled) { exact_verification_ = enabled; }
+    bool has_exact_verification() const;
+
+    // Copies the current filter's exact keys, sorted and unique, into keys;
+    // false if it has none (a loaded file may carry them, see above)
+    bool get_exact_keys(std::vector<uint64_t>& keys) const;
+
+    // Keys in the current filter (unique ones if it has exact keys)
+    size_t key_count() const;
+
+    // Bytes held by the fingerprint arrays and by the verifier, respectively
+    size_t get_memory_usage() const;
+    size_t get_verifier_memory_usage() const;
+
+    // Fills keys with the keys of one shard (top shard_bits bits == shard),
+    // sorted and unique. Returns false to abort.
+    using shard_source_fn = std::function<bool(uint32_t shard, std::vector<uint64_t>& keys)>;
+
+    // Builds a sharded filter straight into an L3 file, pulling one wave of
+    // num_threads shards from source at a time, so neither the key set nor
+    // the finished filter has to fit in memory. Map it with load_from_file.
+    // exact_keys also stores each shard's keys for exact verification.
+    static bool write_sharded_file(const std::string& path, uint32_t shard_bits,
+                                   const shard_source_fn& source, unsigned num_threads = 1,
+                                   bool exact_keys = false, uint32_t fingerprint_bits = 8);
+
+    // Filter key of a URL: HashedKey::of(url).key
+    static uint64_t hash_url(std::string_view url);
+
+    static constexpr size_t kAutoShardThreshold = size_t{1} << 24;
+    static constexpr size_t kTargetShardKeys = size_t{1} << 22;
 
 private:
+    // Swaps in h (may be null) and retires the previous handle
+    void publish(binfuse_handle_t* h);
+
+    // Validates an L3 file held by file and publishes a handle viewing it;
+    // source names it in messages
+    bool load_image(MappedFile&& file, bool verify_checksum, const std::string& source);
+
     bool adapter_build(binfuse_handle_t** out_handle, const uint64_t* keys, size_t n);
     bool adapter_free(binfuse_handle_t* h);
     bool adapter_contains(binfuse_handle_t* h, uint64_t key) const;
     bool adapter_serialize(binfuse_handle_t* h, std::ostream& out) const;
     binfuse_handle_t* adapter_deserialize(std::istream& in) const;
-};
\ No newline at end of file
+};
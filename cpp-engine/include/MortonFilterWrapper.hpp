@@ -1,49 +1,144 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <shared_mutex>
+#include "hashed_key.hpp"
 
 // Forward declaration - no external includes
-struct morton_handle_t;
+struct morton_stages_t;
+struct morton_generation_t;
 
+// Fingerprint filter in the style of Morton filters (Breslow & Jayasena):
+// each 64-byte block holds 32 logical buckets whose fingerprints are packed
+// into a shared storage array, so a probe touches one cache line and only
+// spills to the alternate block when the overflow bit says it must.
+//
+// With a TTL the filter is a ring of generations, each a filter of its own:
+// inserts go to the newest, lookups probe every live one, and every
+// ttl / (generations - 1) the oldest is dropped whole and reused as the new
+// newest. An entry therefore lives at least ttl and at most
+// ttl * generations / (generations - 1), and expiry never walks entries.
+//
+// Filters grow instead of overfilling (scalable Bloom filters, Almeida et
+// al.): once the newest sub-filter holds its capacity, a twice as large one
+// with half the FPR is appended and takes further inserts. Lookups probe
+// every sub-filter, so the compound FPR stays below 2x the configured one,
+// and inserts fail only past kMaxStages sub-filters. consolidate() folds
+// the sub-filters back into one when the caller still has the keys.
+//
+// Concurrency: lookups take no lock. Each block carries a seqlock version;
+// a reader copies the block and retries if a writer touched it meanwhile,
+// so it never sees a torn bucket. Inserts and removes lock only the block
+// they edit and run in parallel; the rare insert that must displace
+// entries, growth, consolidation and generation rotation run alone. The
+// sub-filter lists are swapped under epoch reclamation, so a lookup never
+// sees one freed. initialize and load_from_file must not overlap any other
+// call.
 class MortonFilterWrapper {
 public:
     MortonFilterWrapper();
     ~MortonFilterWrapper();
-    
+
     // Initialize with expected capacity and false positive rate
     bool initialize(size_t capacity, double false_positive_rate = 0.01);
-    
+
+    // Initialize with expiry: capacity is the live set over one ttl, split
+    // evenly across 2..255 generations
+    bool initialize(size_t capacity, double false_positive_rate,
+                    std::chrono::milliseconds ttl, uint32_t generations = 4);
+
     // Single element operations
-    bool insert(const std::string& element);
-    bool contains(const std::string& element) const;
-    
+    bool insert(std::string_view element);
+    bool contains(std::string_view element) const;
+
+    // Inserts succeed if the element's fingerprint is already present (it
+    // is then reported either way) and fail only past kMaxStages
+    // sub-filters.
+    //
+    // Removes the element's fingerprint from every generation holding it.
+    // Only remove elements whose insert stored them (see insert_key):
+    // removing anything else can evict a different element that shares the
+    // fingerprint, including one whose insert found it already present.
+    bool remove(std::string_view element);
+
+    // Same operations on pre-hashed keys (HashedKey::key of the element,
+    // i.e. BinaryFuseWrapper::hash_url), for callers that already hold the hash
+    // stored, if given, says whether this insert placed a fingerprint
+    // rather than finding an equal one already there
+    bool insert_key(uint64_t key, bool* stored = nullptr);
+    bool contains_key(uint64_t key) const;
+    bool remove_key(uint64_t key);
+
+    // Two keys can share a fingerprint entry, in any sub-filter, only if
+    // one's class is among the other's collision_classes (its own first).
+    // A caller that tracks its keys by class can then find every key a
+    // remove_key() may have erased along with the removed one.
+    static constexpr size_t kCollisionClasses = 8192;
+    static std::array<uint32_t, 3> collision_classes(uint64_t key);
+
+    // Prefetches the primary block of each key in every sub-filter, for
+    // a caller about to look up a small batch of keys
+    void prefetch(const uint64_t* keys, size_t n) const;
+
+    bool insert(const HashedKey& hash) { return insert_key(hash.key); }
+    bool contains(const HashedKey& hash) const { return contains_key(hash.key); }
+    bool remove(const HashedKey& hash) { return remove_key(hash.key); }
+
     // Batch operations
     bool insert_batch(const std::vector<std::string>& elements);
-    bool contains_batch(const std::vector<std::string>& elements, 
+    bool contains_batch(const std::vector<std::string>& elements,
                        std::vector<bool>& results) const;
-    
+
+    // Drops every generation whose time is up; returns how many were
+    // reclaimed. Inserts call this themselves; lookups never rotate, so a
+    // read-mostly owner should call it periodically. No-op without a TTL.
+    size_t expire();
+    std::chrono::milliseconds get_ttl() const;
+    uint32_t get_generations() const;
+    // Generations reclaimed so far. A key stored when this read r is gone
+    // once it reaches r + get_generations().
+    uint64_t get_rotations() const;
+
+    // Replaces every sub-filter with a single one holding exactly keys,
+    // sized for the larger of keys and the configured capacity. keys must
+    // cover everything the filter should still report. Not available with
+    // a TTL, where expiry drops grown sub-filters anyway.
+    bool consolidate(const std::vector<uint64_t>& keys);
+
+    // Sub-filters across all generations (== get_generations() until growth)
+    size_t get_stage_count() const;
+
     // Memory management
     size_t get_memory_usage() const;
     size_t get_count() const;
-    
+
     // Save/load for persistence
     bool save_to_file(const std::string& path) const;
     bool load_from_file(const std::string& path);
 
 private:
-    morton_handle_t* handle_;
-    
-    // Remove the adapter function declarations since we're using stub implementation
-    // bool adapter_initialize(size_t capacity, double false_positive_rate);
-    // bool adapter_insert(const char* data, size_t length);
-    // bool adapter_contains(const char* data, size_t length) const;
-    // bool adapter_insert_batch(const std::vector<const char*>& data_ptrs, 
-    //                          const std::vector<size_t>& lengths);
-    // bool adapter_contains_batch(const std::vector<const char*>& data_ptrs,
-    //                            const std::vector<size_t>& lengths,
-    //                            std::vector<bool>& results) const;
-    // void adapter_free();
-};
\ No newline at end of file
+    size_t rotate(std::vector<std::unique_ptr<morton_stages_t>> fresh);
+    bool grow(morton_generation_t& generation);
+
+    // Ring of generations; generations_[active_] takes inserts and the one
+    // after it (cyclically) is the oldest. A single entry without a TTL.
+    std::vector<std::unique_ptr<morton_generation_t>> generations_;
+    size_t active_ = 0;
+    size_t capacity_ = 0;
+    double false_positive_rate_ = 0.0;
+    std::chrono::milliseconds ttl_{0};
+    std::chrono::steady_clock::duration interval_{0};
+    std::atomic<std::chrono::steady_clock::time_point> rotated_at_{};
+    std::atomic<uint64_t> rotations_{0};
+
+    // Shared by inserts and removes; exclusive for displacement, rotation
+    // and reconfiguration. Lookups never take it.
+    mutable std::shared_mutex write_mutex_;
+};
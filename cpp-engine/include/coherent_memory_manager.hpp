@@ -1,77 +1,54 @@
 #pragma once
 
-#include <iostream>
+#include <cstddef>
+#include <string>
 #include <vector>
-#include <cstring>
-#include <memory>
-
-// Windows NUMA support
-#ifdef _WIN32
-#include <windows.h>
-#include <winnt.h>
-#endif
 
+// NUMA topology, thread placement and node-local memory.
+//
+// Nodes are numbered densely from 0 (the index NUMAOptimizedFilter uses);
+// get_os_node_id maps one to the operating system's id, which may be
+// sparse. On Linux the topology comes from sysfs (/sys/devices/system/node),
+// keeping only nodes with CPUs this process may run on, memory is bound
+// with mbind and threads are pinned to every allowed CPU of their node. On
+// Windows the same comes from the NUMA API. Elsewhere, or if discovery
+// fails, there is one node holding every CPU.
+//
+// A fake topology splits this machine's CPUs into pretend nodes, so
+// multi-node code paths run on a single-node box: set_fake_topology, or
+// the LLAMASHIELD_FAKE_NUMA environment variable read by initialize().
+// The spec is either a node count ("2": the allowed CPUs split into that
+// many contiguous groups, shared round-robin if there are fewer CPUs) or
+// one Linux cpulist per node separated by ';' ("0-3,8-11;4-7,12-15").
+// Fake nodes pin threads for real but do not bind memory.
 class CoherentMemoryManager {
 public:
-    // Initialize NUMA system - call this first
-    static bool initialize() {
-#ifdef _WIN32
-        // Check if NUMA is available on Windows
-        DWORD highestNodeNumber;
-        if (!GetNumaHighestNodeNumber(&highestNodeNumber)) {
-            std::cout << "[NUMA] Running in single-node mode on Windows" << std::endl;
-            return false;
-        }
-        std::cout << "[NUMA] Windows system with " << highestNodeNumber + 1 << " nodes" << std::endl;
-        return true;
-#else
-        std::cout << "[NUMA] Running on non-Windows system, using fallback" << std::endl;
-        return false;
-#endif
-    }
+    // Discovers the topology (or applies LLAMASHIELD_FAKE_NUMA); call this
+    // first. False if it fell back to a single node it could not discover.
+    static bool initialize();
+
+    // Replaces the topology with a fake one (see above), or rediscovers the
+    // real one if spec is empty. False, leaving the topology alone, if the
+    // spec does not parse.
+    static bool set_fake_topology(const std::string& spec);
+    static bool is_fake_topology();
 
     // Get number of NUMA nodes
-    static int get_num_numa_nodes() {
-#ifdef _WIN32
-        DWORD highestNodeNumber;
-        if (GetNumaHighestNodeNumber(&highestNodeNumber)) {
-            return highestNodeNumber + 1;
-        }
-#endif
-        return 1; // Single node fallback
-    }
+    static int get_num_numa_nodes();
 
-    // Pin thread to specific CPU cores of a NUMA node (Windows version)
-    static bool pin_thread_to_numa(int numa_node) {
-#ifdef _WIN32
-        DWORD_PTR processAffinity, systemAffinity;
-        if (!GetProcessAffinityMask(GetCurrentProcess(), &processAffinity, &systemAffinity)) {
-            return false;
-        }
-        
-        // Set thread affinity to first CPU in the node (simplified)
-        DWORD_PTR affinityMask = 1ULL << numa_node;
-        return SetThreadAffinityMask(GetCurrentThread(), affinityMask) != 0;
-#else
-        (void)numa_node;
-        return false;
-#endif
-    }
+    // CPUs of a node (empty if out of range), and the OS id of a node
+    static std::vector<int> get_node_cpus(int numa_node);
+    static int get_os_node_id(int numa_node);
 
-    // Allocate memory - simplified for Windows
-    static void* allocate_numa_local(size_t size, int numa_node) {
-        (void)numa_node; // NUMA allocation not implemented for Windows yet
-        return malloc(size);
-    }
+    // Restricts the calling thread to the CPUs of a node
+    static bool pin_thread_to_numa(int numa_node);
 
-    // Free memory
-    static void free_numa_local(void* ptr, size_t size) {
-        (void)size;
-        free(ptr);
-    }
+    // Page-granular memory preferring the node's local memory (falling back
+    // to other nodes rather than failing when it is full); null on failure.
+    // Release with free_numa_local and the same size.
+    static void* allocate_numa_local(size_t size, int numa_node);
+    static void free_numa_local(void* ptr, size_t size);
 
-    // Get current NUMA node
-    static int get_current_numa_node() {
-        return 0; // Simplified
-    }
-};
\ No newline at end of file
+    // Node of the CPU the calling thread is running on now
+    static int get_current_numa_node();
+};
@@ -0,0 +1,8 @@
+#pragma once
+
+// SIMD support of the running CPU, for choosing kernels at run time. A
+// feature counts only if the OS also saves its register state. Probed once
+// per process; always false on non-x86 builds.
+bool cpu_has_avx2();
+bool cpu_has_avx512f();
+bool cpu_has_avx512dq();
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for read-mostly structures that are replaced
+// wholesale (the L3 filter). Readers wrap each access in an EpochGuard: one
+// store on entry and one on exit, no locks and no shared counters. Writers
+// publish a new object with an atomic exchange, then retire() the old one;
+// it is freed once every reader that could still see it has left.
+class EpochReclaimer {
+public:
+    using deleter_fn = void (*)(void*);
+
+    // Process-wide domain shared by all guarded structures. Never destroyed:
+    // thread-local slot holders may outlive static teardown.
+    static EpochReclaimer& global() {
+        static EpochReclaimer* instance = new EpochReclaimer();
+        return *instance;
+    }
+
+    // Queues ptr for deletion and frees whatever is already safe
+    void retire(void* ptr, deleter_fn deleter);
+
+    // Frees retired objects no reader can still hold; never blocks
+    size_t try_reclaim();
+
+    // Waits until every reader active at the time of the call has left, then
+    // frees everything retired before the call. Must not be called from
+    // inside an EpochGuard.
+    void synchronize();
+
+    // True if the calling thread is inside an EpochGuard
+    bool in_critical_section() const;
+
+    size_t pending() const;
+
+private:
+    friend class EpochGuard;
+
+    struct alignas(64) slot_t {
+        std::atomic<uint64_t> epoch{0};     // 0 = quiescent
+        std::atomic<bool> in_use{false};
+        slot_t* next = nullptr;
+        uint32_t depth = 0;                 // touched only by the owning thread
+    };
+
+    struct retired_t {
+        void* ptr;
+        deleter_fn deleter;
+        uint64_t epoch;
+    };
+
+    EpochReclaimer();
+
+    slot_t& local_slot() {
+        slot_t* slot = tls_slot_;
+        return slot ? *slot : register_thread();
+    }
+    slot_t& register_thread();
+    slot_t* acquire_slot();
+    void heavy_barrier() const;
+    uint64_t oldest_active_epoch() const;
+    size_t reclaim_before(uint64_t epoch);
+
+    bool asymmetric_ = false;               // readers may skip the store-load fence
+    std::atomic<uint64_t> global_epoch_{1};
+    std::atomic<slot_t*> slots_{nullptr};   // push-only list, slots are reused
+
+    mutable std::mutex retired_mutex_;
+    std::vector<retired_t> retired_;
+
+    static inline thread_local slot_t* tls_slot_ = nullptr;
+};
+
+// Marks the calling thread as reading guarded pointers. Nests.
+// Inline: lookups take one of these per call.
+class EpochGuard {
+public:
+    EpochGuard() : slot_(EpochReclaimer::global().local_slot()) {
+        if (slot_.depth++ == 0) {
+            EpochReclaimer& reclaimer = EpochReclaimer::global();
+            const uint64_t epoch = reclaimer.global_epoch_.load(std::memory_order_acquire);
+            if (reclaimer.asymmetric_) {
+                slot_.epoch.store(epoch, std::memory_order_relaxed);
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            } else {
+                slot_.epoch.store(epoch);
+            }
+        }
+    }
+
+    ~EpochGuard() {
+        if (--slot_.depth == 0) {
+            slot_.epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+    EpochReclaimer::slot_t& slot_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Sorted, unique 64-bit keys answering exact membership. L3 consults one
+// only after its filter reports a hit, to turn that hit into a certainty.
+struct exact_view_t {
+    const uint64_t* keys = nullptr;
+    uint64_t count = 0;
+};
+
+// Interpolation search: the keys are hashes, so they are close to uniform
+// and each probe lands near the target (about log log n probes). After a
+// few probes, or once the range is small, a binary search finishes the job
+// so skewed inputs stay O(log n).
+inline bool exact_contains(const exact_view_t& set, uint64_t key) {
+    constexpr int kMaxInterpolationSteps = 4;
+    constexpr size_t kBinaryBelow = 16;
+
+    const uint64_t* keys = set.keys;
+    size_t lo = 0;
+    size_t hi = set.count;   // [lo, hi)
+
+    for (int step = 0; step < kMaxInterpolationSteps && hi - lo > kBinaryBelow; ++step) {
+        const uint64_t first = keys[lo];
+        const uint64_t last = keys[hi - 1];
+        if (key < first || key > last) return false;
+
+        const double fraction = static_cast<double>(key - first) / static_cast<double>(last - first);
+        size_t pos = lo + static_cast<size_t>(fraction * static_cast<double>(hi - 1 - lo));
+        pos = std::min(pos, hi - 1);
+
+        if (keys[pos] == key) return true;
+        if (keys[pos] < key) {
+            lo = pos + 1;
+        } else {
+            hi = pos;
+        }
+    }
+
+    const uint64_t* it = std::lower_bound(keys + lo, keys + hi, key);
+    return it != keys + hi && *it == key;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "fuse_layout.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Fingerprint array built in-process, with kGatherPadding zero bytes after
+// it so the SIMD kernels may gather. Move-only; frees the array.
+template <typename fp_t>
+struct fuse_array_t {
+    uint64_t seed = 0;
+    uint32_t segment_length = 0;
+    uint32_t segment_length_mask = 0;
+    uint32_t segment_count_length = 0;
+    uint32_t array_length = 0;   // entries
+    fp_t* fingerprints = nullptr;
+
+    fuse_array_t() = default;
+    fuse_array_t(fuse_array_t&& other) noexcept { *this = static_cast<fuse_array_t&&>(other); }
+    fuse_array_t& operator=(fuse_array_t&& other) noexcept;
+    fuse_array_t(const fuse_array_t&) = delete;
+    fuse_array_t& operator=(const fuse_array_t&) = delete;
+    ~fuse_array_t() { reset(); }
+
+    // Zeroed array of length entries plus padding; false if out of memory
+    bool allocate(uint32_t length);
+    void reset();
+
+    size_t bytes() const { return size_t{array_length} * sizeof(fp_t); }
+
+    basic_fuse_view_t<fp_t> view() const {
+        basic_fuse_view_t<fp_t> v;
+        v.seed = seed;
+        v.segment_length = segment_length;
+        v.segment_length_mask = segment_length_mask;
+        v.segment_count_length = segment_count_length;
+        v.array_length = array_length;
+        v.fingerprints = fingerprints;
+        v.gather_safe = true;
+        return v;
+    }
+};
+
+// Builds a filter over keys[0, n). 8- and 16-bit filters come from the
+// vendored binary_fuse{8,16}_populate; xor_singleheader has no 32-bit
+// variant, so that one is peeled here with the same sizing and hashing.
+// n == 0 yields a minimal all-zero filter (every probe lands on 0..2).
+// Instantiated for uint8_t, uint16_t and uint32_t.
+template <typename fp_t>
+bool fuse_build(const uint64_t* keys, size_t n, fuse_array_t<fp_t>& out);
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// L3 on-disk format and in-place query view.
+//
+// File layout (little-endian):
+//   [0, 128)                      l3_file_header_t
+//   [shard_table_offset, +64*S)   one l3_shard_desc_t per shard
+//   per shard, 64-byte aligned:   fingerprint array, then >= kArrayPadding
+//                                 zero bytes so SIMD gathers may over-read;
+//                                 with kFlagExactKeys, then (64-byte aligned)
+//                                 the shard's sorted keys as uint64
+//
+// Keys are routed to shard (key >> (64 - shard_bits)). fingerprint_bits
+// (8, 16 or 32) fixes the entry type of every array; array_length counts
+// entries. An array is laid out exactly as binary_fuse{8,16}_populate
+// would fill it, so a mapped file can be queried without copying.
+
+namespace l3_format {
+
+constexpr char kMagic[8] = {'L', 'S', 'H', 'F', 'U', 'S', 'E', '\0'};
+// v4: keys are the low half of XXH3-128 (HashedKey) of the canonical URL
+// (url_canonicalizer.hpp). v3 files hash URLs as given, v2 files hold
+// XXH3-64 keys and v1 has no shard table; none is read.
+constexpr uint32_t kVersion = 4;
+constexpr size_t kHeaderSize = 128;
+constexpr size_t kShardDescSize = 64;
+constexpr size_t kArrayAlignment = 64;
+constexpr size_t kArrayPadding = 64;
+constexpr uint32_t kMaxShardBits = 16;
+
+// Header flags
+constexpr uint32_t kFlagExactKeys = 1u << 0;   // shards carry an exact key set
+constexpr uint32_t kKnownFlags = kFlagExactKeys;
+
+struct l3_file_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t fingerprint_bits;
+    uint32_t shard_bits;
+    uint32_t shard_count;
+    uint64_t key_count;
+    uint64_t shard_table_offset;
+    uint32_t flags;             // kFlag* bits
+    uint32_t reserved0;
+    uint64_t reserved[8];
+    uint64_t shard_table_checksum;   // XXH3-64 of the shard table
+    uint64_t header_checksum;        // XXH3-64 of all preceding header bytes
+};
+
+struct l3_shard_desc_t {
+    uint64_t seed;
+    uint32_t segment_length;
+    uint32_t segment_length_mask;
+    uint32_t segment_count;
+    uint32_t segment_count_length;
+    uint32_t array_length;
+    uint32_t reserved0;
+    uint64_t key_count;
+    uint64_t array_offset;
+    uint64_t array_checksum;    // XXH3-64 of the fingerprint array, then of the
+                                // exact keys seeded with it when present
+    uint64_t exact_keys_offset; // kFlagExactKeys only: key_count sorted keys
+};
+
+static_assert(sizeof(l3_file_header_t) == kHeaderSize, "L3 header must stay 128 bytes");
+static_assert(offsetof(l3_file_header_t, header_checksum) == kHeaderSize - 8, "header_checksum must be last");
+static_assert(sizeof(l3_shard_desc_t) == kShardDescSize, "L3 shard descriptor must stay 64 bytes");
+
+} // namespace l3_format
+
+// Everything needed to answer a query, independent of who owns the memory.
+// fp_t is the fingerprint type: uint8_t, uint16_t or uint32_t.
+template <typename fp_t>
+struct basic_fuse_view_t {
+    using fingerprint_type = fp_t;
+
+    uint64_t seed = 0;
+    uint32_t segment_length = 0;
+    uint32_t segment_length_mask = 0;
+    uint32_t segment_count_length = 0;
+    uint32_t array_length = 0;  // entries, not bytes
+    const fp_t* fingerprints = nullptr;
+    bool gather_safe = false;   // >= kGatherPadding readable bytes follow the array
+};
+
+using fuse_view_t = basic_fuse_view_t<uint8_t>;
+using fuse_view16_t = basic_fuse_view_t<uint16_t>;
+using fuse_view32_t = basic_fuse_view_t<uint32_t>;
+
+// Gathers load 4 bytes at each fingerprint index
+constexpr size_t kGatherPadding = 4;
+static_assert(l3_format::kArrayPadding >= kGatherPadding, "file padding must cover gathers");
+
+inline uint64_t fuse_mulhi(uint64_t a, uint64_t b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return __umulh(a, b);
+#else
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#endif
+}
+
+// Same mixing as binary_fuse_mix_split (murmur64 finalizer over key + seed)
+inline uint64_t fuse_mix(uint64_t key, uint64_t seed) {
+    uint64_t h = key + seed;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// The three array positions and the fingerprint a key resolves to
+template <typename fp_t>
+struct basic_fuse_probe_t {
+    uint32_t h0;
+    uint32_t h1;
+    uint32_t h2;
+    fp_t fingerprint;
+};
+
+using fuse_probe_t = basic_fuse_probe_t<uint8_t>;
+
+// Mirrors binary_fuse8_hash_batch (the positions do not depend on the width);
+// must stay in sync with the builders
+template <typename fp_t>
+inline basic_fuse_probe_t<fp_t> fuse_probe_hash(const basic_fuse_view_t<fp_t>& v, uint64_t hash) {
+    basic_fuse_probe_t<fp_t> p;
+    p.fingerprint = static_cast<fp_t>(hash ^ (hash >> 32));
+    p.h0 = static_cast<uint32_t>(fuse_mulhi(hash, v.segment_count_length));
+    p.h1 = p.h0 + v.segment_length;
+    p.h2 = p.h1 + v.segment_length;
+    p.h1 ^= static_cast<uint32_t>(hash >> 18) & v.segment_length_mask;
+    p.h2 ^= static_cast<uint32_t>(hash) & v.segment_length_mask;
+    return p;
+}
+
+template <typename fp_t>
+inline basic_fuse_probe_t<fp_t> fuse_probe(const basic_fuse_view_t<fp_t>& v, uint64_t key) {
+    return fuse_probe_hash(v, fuse_mix(key, v.seed));
+}
+
+template <typename fp_t>
+inline bool fuse_resolve(const basic_fuse_view_t<fp_t>& v, const basic_fuse_probe_t<fp_t>& p) {
+    return (p.fingerprint ^ v.fingerprints[p.h0] ^ v.fingerprints[p.h1] ^ v.fingerprints[p.h2]) == 0;
+}
+
+// Shard a key belongs to; (key >> 1) >> 63 keeps shard_bits == 0 well defined
+inline uint32_t fuse_shard_index(uint64_t key, uint32_t shard_bits) {
+    return static_cast<uint32_t>((key >> 1) >> (63 - shard_bits));
+}
+
+// Mirrors binary_fuse8_contain / binary_fuse16_contain
+template <typename fp_t>
+inline bool fuse_contains(const basic_fuse_view_t<fp_t>& v, uint64_t key) {
+    return fuse_resolve(v, fuse_probe(v, key));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "fuse_layout.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Batched L3 lookup kernels. The SIMD variants hash and map several keys per
+// instruction (vector multiply-high for the segment positions) and fetch the
+// three fingerprints with gathers; they require view.gather_safe.
+using fuse_batch_fn = void (*)(const fuse_view_t& view, const uint64_t* keys, size_t n, uint8_t* out);
+
+struct fuse_batch_kernel_t {
+    const char* name;
+    fuse_batch_fn fn;
+};
+
+// Kernels the running CPU supports, fastest first; the last one is scalar
+std::vector<fuse_batch_kernel_t> fuse_available_kernels();
+
+// Chosen once by CPUID
+const fuse_batch_kernel_t& fuse_best_kernel();
+
+void fuse_contains_batch_scalar(const fuse_view_t& view, const uint64_t* keys, size_t n, uint8_t* out);
+
+// Prefetch pipeline over a sharded filter; each key picks its own shard view.
+// Instantiated for 8-, 16- and 32-bit fingerprints; shard_bits may be 0.
+template <typename fp_t>
+void fuse_contains_batch_sharded(const basic_fuse_view_t<fp_t>* shards, uint32_t shard_bits,
+                                 const uint64_t* keys, size_t n, uint8_t* out);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "fuse_layout.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// XXH3-128 of a URL, computed once where the URL enters the engine and
+// passed along instead of the string. The two halves are independent, so
+// each consumer takes its own slice and none has to rehash:
+//   key   - low half: the filter key of L2 and L3 (BinaryFuseWrapper::hash_url)
+//   route - high half: NUMA node / queue selection, uncorrelated with where
+//           the key lands inside a filter or which L3 shard holds it
+struct HashedKey {
+    uint64_t key = 0;
+    uint64_t route = 0;
+
+    // Hash of the URL's canonical form (canonicalize_url), built in a stack
+    // buffer, so spelling variants of one address share a key. Input that
+    // does not canonicalize is hashed as given.
+    static HashedKey of(const char* data, size_t size);
+    static HashedKey of(std::string_view url) { return of(url.data(), url.size()); }
+
+    // Hash of exactly these bytes, for input that is already canonical
+    static HashedKey of_raw(const char* data, size_t size);
+
+    // Partition in [0, n) taken from the routing half, without a division
+    size_t partition(size_t n) const { return static_cast<size_t>(fuse_mulhi(route, n)); }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Forward declaration
+struct ip_table_t;
+
+// An IPv4 or IPv6 network. IPv4 addresses use the first four bytes;
+// IPv4-mapped IPv6 (::ffff:a.b.c.d) is parsed as IPv4.
+struct IpPrefix {
+    uint8_t address[16] = {};   // network byte order, host bits zero
+    uint8_t length = 0;         // prefix bits
+    bool v6 = false;
+};
+
+// An IP literal as a URL host may spell it: a dotted IPv4 address (parts
+// in decimal, octal "0.." or hex "0x..", the last filling the remaining
+// bytes, as browsers read them) or an IPv6 address, with or without
+// brackets. Sets length to 32 or 128.
+bool parse_ip_address(std::string_view text, IpPrefix& out);
+
+// "address/length", or a bare address as a host prefix
+bool parse_ip_prefix(std::string_view text, IpPrefix& out);
+
+// Longest-prefix matching over IPv4 and IPv6 networks, for blocking URLs
+// whose host is an IP literal by subnet rather than exact string.
+//
+// A poptrie: the first 16 bits index a direct table, every further byte a
+// node whose 256 slots are compressed into two bitmaps (children, and
+// where a run of equal results starts) with popcounts selecting among
+// contiguous children and results. An IPv4 lookup is at most three
+// dependent loads and a node is two cache lines however sparse, so
+// millions of prefixes stay within tens of bytes each.
+//
+// Lookups may run concurrently with build/load_from_file: a new table is
+// built aside and published atomically, and the one it replaces is freed
+// (via EpochReclaimer) after in-flight lookups have finished, as in
+// BinaryFuseWrapper. Saved tables are mapped read-only and queried in place.
+class IpPrefixTable {
+public:
+    IpPrefixTable();
+    ~IpPrefixTable();
+
+    IpPrefixTable(const IpPrefixTable&) = delete;
+    IpPrefixTable& operator=(const IpPrefixTable&) = delete;
+
+    // Replaces the table; duplicates are harmless. An empty list clears it.
+    bool build(std::vector<IpPrefix> prefixes);
+
+    // Same from text (see parse_ip_prefix); lines that do not parse are
+    // skipped and reported
+    bool build(const std::vector<std::string>& prefixes);
+
+    // One prefix per line, surrounding whitespace trimmed; blank lines and
+    // lines starting with '#' are skipped
+    bool load_list(const std::string& path);
+
+    // Versioned binary image, written via a temporary file and renamed
+    bool save_to_file(const std::string& path) const;
+    bool load_from_file(const std::string& path, bool verify_checksum = true);
+
+    // Length of the longest prefix holding the address, or -1
+    int lookup(const IpPrefix& address) const;
+    int lookup_v4(uint32_t address) const;   // host byte order
+    int lookup_v6(const uint8_t address[16]) const;
+
+    // Same for a URL host (see parse_ip_address); -1 if it is not an IP literal
+    int lookup(std::string_view host) const;
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // Bytes of the direct tables, nodes and results
+    size_t get_memory_usage() const;
+
+private:
+    // Swaps in table (may be null) and retires the previous one
+    void publish(ip_table_t* table);
+
+    std::atomic<ip_table_t*> table_;
+};
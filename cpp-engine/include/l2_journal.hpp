@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class JournalOp : uint8_t {
+    kInsert = 1,
+    kRemove = 2,
+    kInsertExpiring = 3,   // inserted while L2 had a TTL
+};
+
+struct JournalRecord {
+    uint64_t key;
+    uint32_t unix_seconds;   // wall clock at append; ages expiring inserts on replay
+    JournalOp op;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(JournalRecord) == 16, "journal records are persisted as-is");
+
+// Write-ahead journal of L2 inserts and removes, with compact snapshots of
+// the key set, kept together in one directory:
+//   snapshot.bin        sorted keys, covering every record before its seq
+//   journal-<seq>.log   framed records from seq on; one segment per snapshot
+// append() only buffers. A flusher thread writes everything buffered as one
+// checksummed frame and fsyncs it every flush_interval (group commit), so a
+// crash loses at most that window; wait_durable() closes it for callers
+// that need to. Replay is the snapshot plus the segments after it and stops
+// at the first torn frame, so recovery is bounded by the snapshot size and
+// the journal written since it.
+class L2Journal {
+public:
+    struct Options {
+        // Upper bound on how long an appended record stays unsynced
+        std::chrono::milliseconds flush_interval{10};
+        // Flush early once this many records are buffered
+        size_t group_records = 4096;
+        // append() returns only once its frame is synced
+        bool synchronous = false;
+        // Segments a snapshot covers are kept this long (L2's TTL), since
+        // expiring inserts are replayed from the journal, not the snapshot
+        std::chrono::milliseconds retain{0};
+    };
+
+    L2Journal();
+    explicit L2Journal(Options options);
+    ~L2Journal();
+
+    L2Journal(const L2Journal&) = delete;
+    L2Journal& operator=(const L2Journal&) = delete;
+
+    // Replays dir (created if missing), then starts a new segment for
+    // appends. on_snapshot gets the snapshot keys, if there is a snapshot;
+    // on_record gets every journaled record in order, flagged when the
+    // snapshot already covers it (only retained segments have those).
+    bool open(const std::string& dir,
+              const std::function<void(std::vector<uint64_t>&&)>& on_snapshot,
+              const std::function<void(const JournalRecord&, bool covered)>& on_record);
+    // Flushes and stops the flusher
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    // Buffers a record and returns its sequence number
+    uint64_t append(JournalOp op, uint64_t key);
+    // Blocks until every record up to seq is synced; false on an I/O error
+    bool wait_durable(uint64_t seq);
+    bool flush();
+
+    // Starts a new segment, then calls copy_keys for the caller's key set.
+    // Records appended before the call must already be reflected in that
+    // set; later ones may be, as long as replaying them is harmless. Writes
+    // the keys as the new snapshot and drops the segments it covers.
+    // Appends continue throughout.
+    bool snapshot(const std::function<std::vector<uint64_t>()>& copy_keys);
+
+    uint64_t get_durable_seq() const;
+    uint64_t get_bytes_since_snapshot() const;
+    uint64_t get_snapshots() const;
+
+private:
+    void run();
+    bool write_frame(const JournalRecord* records, size_t n, uint64_t first_seq);
+    bool flush_buffer();
+    bool start_segment(uint64_t first_seq);
+    bool replay_segment(const std::string& path, uint64_t first_seq, uint64_t snapshot_seq,
+                        const std::function<void(const JournalRecord&, bool covered)>& on_record);
+    void drop_segments(uint64_t before_seq);
+
+    Options options_;
+    std::string dir_;
+    int fd_ = -1;                        // current segment
+    uint64_t segment_seq_ = 0;           // its first seq
+
+    // Guards the buffer and counters; io_mutex_ serializes writes to fd_
+    // and is taken first
+    mutable std::mutex mutex_;
+    std::mutex io_mutex_;
+    std::mutex snapshot_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable synced_;
+    std::vector<JournalRecord> buffer_;
+    uint64_t buffered_from_ = 1;         // seq of buffer_.front()
+    uint64_t next_seq_ = 1;
+    uint64_t durable_seq_ = 1;           // every seq below it is synced
+    uint64_t waiting_for_ = 0;           // highest seq a wait_durable caller needs
+    uint64_t bytes_since_snapshot_ = 0;
+    uint64_t snapshots_ = 0;
+    bool failed_ = false;
+    bool running_ = false;
+    std::thread flusher_;
+};
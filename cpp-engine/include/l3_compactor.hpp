@@ -0,0 +1,71 @@
+#pragma once
+
+#include "performance_optimized_filter.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Background service that periodically folds a filter's L2 into its L3
+// (PerformanceOptimizedFilter::compact_l2), so L2 stays small and cache
+// resident and long-lived entries move to the denser static layer. Each
+// poll also advances L2 expiry when L2 has a TTL, and snapshots the
+// filter's journal when it has one.
+class L3Compactor {
+public:
+    struct Options {
+        // Upper bound between passes while L2 holds anything
+        std::chrono::milliseconds interval{std::chrono::seconds(60)};
+        // Compact early once L2 reaches this fraction of its capacity
+        double l2_fill_trigger = 0.5;
+        // Poll period for the fill trigger and L2 expiry
+        std::chrono::milliseconds poll{100};
+        // Merge L2's grown sub-filters back into one on each pass
+        bool consolidate_l2 = true;
+        // Snapshot the filter's journal this often, or sooner once the
+        // journal since the last snapshot passes snapshot_journal_bytes;
+        // together they bound recovery time
+        std::chrono::milliseconds snapshot_interval{std::chrono::minutes(5)};
+        uint64_t snapshot_journal_bytes = uint64_t{64} << 20;
+        // Pin the service to this NUMA node, so the L3 filters it rebuilds
+        // are allocated there (-1: unpinned)
+        int numa_node = -1;
+    };
+
+    explicit L3Compactor(PerformanceOptimizedFilter& filter);
+    L3Compactor(PerformanceOptimizedFilter& filter, Options options);
+    ~L3Compactor();
+
+    L3Compactor(const L3Compactor&) = delete;
+    L3Compactor& operator=(const L3Compactor&) = delete;
+
+    bool start();
+    void stop();
+
+    // Wakes the service for an immediate pass
+    void request_compaction();
+
+    uint64_t get_compactions() const { return compactions_.load(std::memory_order_relaxed); }
+    uint64_t get_absorbed() const { return absorbed_.load(std::memory_order_relaxed); }
+    uint64_t get_snapshots() const { return snapshots_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    bool due(std::chrono::steady_clock::time_point last) const;
+    bool snapshot_due(std::chrono::steady_clock::time_point last) const;
+
+    PerformanceOptimizedFilter& filter_;
+    Options options_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    bool requested_ = false;
+
+    std::atomic<uint64_t> compactions_{0};
+    std::atomic<uint64_t> absorbed_{0};
+    std::atomic<uint64_t> snapshots_{0};
+};
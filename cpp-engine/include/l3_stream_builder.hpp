@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BinaryFuseWrapper.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Builds an L3 filter from key feeds that need not fit in memory. Input keys
+// are radix-partitioned by their top spill_bits bits into spill files as
+// they stream in; building then loads one partition group (= one L3 shard)
+// at a time, sorts and deduplicates it, and writes the shard straight into
+// the output file. Resident memory stays within roughly memory_budget
+// regardless of the feed size.
+class L3StreamBuilder {
+public:
+    struct Options {
+        size_t memory_budget = size_t{256} << 20;
+        std::string spill_dir;     // empty: the system temp directory
+        uint32_t spill_bits = 8;   // 2^spill_bits spill files, at most 16 bits
+        unsigned num_threads = 1;  // shards built concurrently (each within budget)
+        bool exact_keys = false;   // store keys for exact verification (+8 B/key on disk)
+        uint32_t fingerprint_bits = 8;   // 8, 16 or 32
+    };
+
+    L3StreamBuilder();
+    explicit L3StreamBuilder(Options options);
+    ~L3StreamBuilder();
+
+    L3StreamBuilder(const L3StreamBuilder&) = delete;
+    L3StreamBuilder& operator=(const L3StreamBuilder&) = delete;
+
+    // Raw little-endian uint64 keys, already hashed
+    bool add_key_file(const std::string& path);
+    // One URL per line, hashed with BinaryFuseWrapper::hash_url
+    bool add_url_file(const std::string& path);
+    bool add_keys(const uint64_t* keys, size_t n);
+
+    // Deduplicates and writes the filter to out_path; the builder is spent
+    // afterwards. build() also maps the result into filter.
+    bool build_to_file(const std::string& out_path);
+    bool build(BinaryFuseWrapper& filter, const std::string& out_path);
+
+    uint64_t get_input_keys() const { return input_keys_; }
+    uint64_t get_unique_keys() const { return unique_keys_; }
+
+private:
+    bool open_spill_files();
+    bool flush_bucket(size_t bucket);
+    bool read_bucket(size_t bucket, std::vector<uint64_t>& keys) const;
+    uint32_t choose_shard_bits() const;
+    void remove_spill_files();
+
+    Options options_;
+    std::string spill_prefix_;
+    size_t buffer_keys_ = 0;
+    std::vector<std::ofstream> spill_files_;
+    std::vector<std::vector<uint64_t>> buffers_;
+    std::vector<uint64_t> bucket_counts_;   // before deduplication
+    uint64_t input_keys_ = 0;
+    uint64_t unique_keys_ = 0;
+    bool open_ = false;
+    bool finished_ = false;
+};
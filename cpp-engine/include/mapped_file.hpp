@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only, shared file mapping. Pages come from the OS page cache, so every
+// process mapping the same file shares one physical copy. open_copy holds a
+// private copy instead, in one NUMA node's memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path);
+
+    // A copy of size bytes at data in memory local to numa_node (see
+    // CoherentMemoryManager::allocate_numa_local), e.g. of another mapping
+    // whose pages live on a different node
+    bool open_copy(const uint8_t* data, size_t size, int numa_node);
+
+    void close();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool is_open() const { return data_ != nullptr; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool copy_ = false;        // from open_copy
+#ifdef _WIN32
+    void* file_ = nullptr;     // HANDLE
+    void* mapping_ = nullptr;  // HANDLE
+#endif
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Per-thread cache of keys that every layer recently reported absent
+// (allowed URLs), so repeat lookups of hot benign sites cost one cache-line
+// probe instead of a walk through L1, L2 and L3.
+//
+// Two-way set-associative with LRU replacement; each 32-byte set holds
+// two (key, generation) entries. An entry counts only while its generation
+// equals the one the filter tags the key with now. A filter takes a new
+// generation whenever many keys may have become present (L3 rebuild, new
+// rules), so one store invalidates every thread's entries for that filter
+// at once; a single insert only moves its key's tag (VerdictStamps).
+// Generations are unique process-wide, so filters can share a thread's cache.
+class NegativeVerdictCache {
+public:
+    static constexpr size_t kSets = 4096;   // 8192 keys, 128 KiB per thread
+
+    // The calling thread's cache, allocated on first use
+    static NegativeVerdictCache& local();
+
+    // A generation no filter has used before
+    static uint64_t next_generation();
+
+    bool contains(uint64_t key, uint64_t generation);
+    void insert(uint64_t key, uint64_t generation);
+
+    uint64_t get_hits() const { return hits_; }
+    uint64_t get_misses() const { return misses_; }
+
+private:
+    struct entry_t {
+        uint64_t key;
+        uint64_t generation;   // 0: empty
+    };
+    struct alignas(32) set_t {
+        entry_t ways[2];       // ways[0] is the most recently used
+    };
+
+    NegativeVerdictCache();
+
+    std::unique_ptr<set_t[]> sets_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// A filter's per-key part of the tag: keys hash to kSlots stamps, and a
+// key's tag is its stamp folded into the filter's generation. An insert
+// bumps only its key's stamp, so cached verdicts of the other keys (all
+// but about 1 in kSlots) survive it.
+class VerdictStamps {
+public:
+    static constexpr size_t kSlots = 4096;
+    static constexpr int kGenerationBits = 40;   // stamps use the rest
+
+    VerdictStamps();
+
+    // What to cache key's verdict under, and check it against, given the
+    // filter's generation. Read before probing, like the generation.
+    uint64_t tag(uint64_t key, uint64_t generation) const;
+
+    // After key became present
+    void invalidate(uint64_t key);
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> stamps_;
+};
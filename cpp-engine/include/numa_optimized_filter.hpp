@@ -3,48 +3,137 @@
 #include "concurrentqueue.h"
 #include "coherent_memory_manager.hpp"
 #include "performance_optimized_filter.hpp"
+#include "l3_compactor.hpp"
 #include <vector>
 #include <thread>
+#include <span>
 #include <string>
+#include <string_view>
 #include <atomic>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <algorithm>
+#include <cstring>
+
+// A queued URL with the hash computed for it at ingress; workers and
+// filters use the hash and keep the URL only for logging, so its first
+// kLoggedBytes travel inline and enqueueing never allocates. Two cache
+// lines per item.
+struct IngressItem {
+    static constexpr size_t kLoggedBytes = 108;
+
+    HashedKey hash;
+    uint32_t url_size = 0;   // of the whole URL
+    char url[kLoggedBytes];
+
+    IngressItem() = default;
+    IngressItem(std::string_view full_url, const HashedKey& url_hash)
+        : hash(url_hash), url_size(static_cast<uint32_t>(full_url.size())) {
+        std::memcpy(url, full_url.data(), logged_url().size());
+    }
+
+    // The kept part of the URL; truncated() if that is not all of it
+    std::string_view logged_url() const { return {url, std::min<size_t>(url_size, kLoggedBytes)}; }
+    bool truncated() const { return url_size > kLoggedBytes; }
+};
+
+// How an idle worker waits for its queue: a short spin, then a few
+// yields, then parked on epoch (std::atomic::wait, a futex on Linux). A
+// producer bumps epoch and notifies only if the worker is parked, so while
+// it is busy a wakeup costs a fence and one load.
+struct alignas(64) WorkerWakeup {
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> parked{0};
+    std::atomic<uint64_t> parks{0};   // times the worker went to sleep
+};
 
 class NUMAOptimizedFilter {
 public:
     NUMAOptimizedFilter();
     ~NUMAOptimizedFilter();
     
-    // Initialize the system with total capacity
-    bool initialize(size_t total_capacity);
+    // Initialize the system with total capacity. With a journal_dir, each
+    // node journals to journal_dir/node-<n> and recovers from it first;
+    // recovery needs the same node count as the run that wrote it.
+    bool initialize(size_t total_capacity, const std::string& journal_dir = "");
     
     // Check if URL exists in filters
-    bool contains(const std::string& url);
+    bool contains(std::string_view url);
+    bool contains(const HashedKey& hash);
     
+    // Hierarchical lookup (see PerformanceOptimizedFilter::match). Each
+    // candidate lives on the node its own hash routes to, so every node
+    // holding one probes its share as a batch.
+    UrlMatch match(std::string_view url);
+
+    // Replicated mode: every node's filter gets its own copy of the L3 file
+    // at path, in that node's memory, and queries then go to the filter of
+    // the node the calling thread runs on, so reads stay on-socket.
+    // Inserts and removes from then on are applied on every node, so each
+    // L2 holds the whole (small) dynamic set; the keys the nodes held
+    // before are spread the same way. If the file stores its exact keys,
+    // each node's compactor and retractions rebuild that node's replica on
+    // the node; otherwise the replicas are static (see
+    // PerformanceOptimizedFilter::load_l3_replica). Meant to be called
+    // after initialize, before serving.
+    bool load_replicated_l3(const std::string& path);
+    bool is_replicated() const { return replicated_.load(std::memory_order_acquire); }
+
+    // Gives every node's filter the same IP networks. A saved table
+    // (PerformanceOptimizedFilter::save_ip_prefixes) is mapped, so the
+    // nodes share one copy of its pages.
+    bool set_ip_prefixes(const std::vector<std::string>& prefixes);
+    bool load_ip_prefixes(const std::string& path);
+
+    // Gives every node's filter the same substring rules; each scans its
+    // own copy
+    bool load_patterns(const std::string& path);
+    bool set_patterns(const std::vector<std::string>& patterns);
+
     // Add URL to filters (will route to appropriate NUMA node)
-    void insert(const std::string& url);
+    void insert(std::string_view url);
     
-    // Process URLs in batch (more efficient)
+    // Retract a URL from its node's filter (L2 and L3)
+    bool remove(std::string_view url);
+    
+    // Process URLs in batch (more efficient). Either form is grouped by
+    // node on the stack, a window at a time, so only the queues copy.
     void insert_batch(const std::vector<std::string>& urls);
+    void insert_batch(std::span<const std::string_view> urls);
     
     // Get statistics
     void print_stats() const;
+    // URLs the workers have applied, over all nodes
+    uint64_t get_processed_count() const;
     
     // Public method to dispatch a URL for checking
-    void check_url(const std::string& url);
+    void check_url(std::string_view url);
+
+    // Wakes every node's compactor to fold L2 into L3 now
+    void request_compaction();
 
 private:
     void worker_loop(int numa_node);
-    size_t route_to_numa(const std::string& url) const;
+    // Wakes numa_node's worker if it is parked; call after enqueueing
+    void wake(size_t numa_node);
+    template <typename Urls>
+    void enqueue_urls(const Urls& urls);
+    size_t route_to_numa(const HashedKey& hash) const;
+    // Node whose filter answers a lookup of hash: its own, or in
+    // replicated mode the caller's
+    size_t query_node(const HashedKey& hash) const;
     
     int num_numa_nodes_;
     std::vector<std::unique_ptr<PerformanceOptimizedFilter>> per_node_filters_;
-    std::vector<moodycamel::ConcurrentQueue<std::string>> per_node_queues_;
+    std::vector<moodycamel::ConcurrentQueue<IngressItem>> per_node_queues_;
     std::vector<std::thread> worker_threads_;
+    std::vector<std::unique_ptr<L3Compactor>> compactors_;
     std::atomic<bool> running_{true};
+    std::atomic<bool> replicated_{false};
     
     // FIX: Use unique_ptr to array instead of vector for atomics
     std::unique_ptr<std::atomic<uint64_t>[]> processed_counts_;
     size_t processed_counts_size_{0};
+    std::unique_ptr<WorkerWakeup[]> wakeups_;
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Forward declaration
+struct pattern_set_t;
+
+// Substring rules ("paypal-verify", "/wp-admin/.env") over URLs, for
+// threats no exact, path or domain key covers. Patterns are compiled into
+// an Aho-Corasick DFA over case-folded byte classes, which only verifies:
+// a prefilter finds the few positions where a pattern can start, so clean
+// text is scanned at GB/s instead of one dependent table load per byte.
+//   - up to kTeddyMaxPatterns, with AVX2: Teddy (nibble shuffles over the
+//     first three bytes of every pattern, 32 positions per step)
+//   - otherwise: one bit per hash of each pattern's first four bytes,
+//     tested at every position
+//
+// Matching is ASCII case-insensitive. find_in_url matches the URL's
+// canonical form (see canonicalize_url), so write patterns the way they
+// appear there: lowercase host, escapes in upper-case hex.
+//
+// Lookups may run concurrently with build/load_from_file: a new set is
+// compiled aside and published atomically, and the one it replaces is
+// freed (via EpochReclaimer) after in-flight lookups have finished.
+class PatternMatcher {
+public:
+    static constexpr uint32_t kNoMatch = UINT32_MAX;
+    // Above this, Teddy's eight buckets pass most positions
+    static constexpr size_t kTeddyMaxPatterns = 64;
+
+    PatternMatcher();
+    ~PatternMatcher();
+
+    PatternMatcher(const PatternMatcher&) = delete;
+    PatternMatcher& operator=(const PatternMatcher&) = delete;
+
+    // Compiles and publishes patterns; empty ones are skipped. An empty
+    // list clears the matcher.
+    bool build(const std::vector<std::string>& patterns);
+
+    // One pattern per line, surrounding whitespace trimmed; blank lines and
+    // lines starting with '#' are skipped
+    bool load_from_file(const std::string& path);
+
+    // Index of a pattern occurring in text (the one ending first), or kNoMatch
+    uint32_t find(const char* text, size_t size) const;
+
+    // Same over url's canonical form, or its raw bytes if it has none
+    uint32_t find_in_url(const char* url, size_t size) const;
+    uint32_t find_in_url(const std::string& url) const { return find_in_url(url.data(), url.size()); }
+
+    // Copy of pattern index of the current set, empty if out of range
+    std::string get_pattern(uint32_t index) const;
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // Bytes held by the DFA and the pattern texts
+    size_t get_memory_usage() const;
+
+    // Prefilter of the current set: "teddy-avx2", "prefix-bitmap" or "none"
+    const char* kernel_name() const;
+
+private:
+    // Swaps in set (may be null) and retires the previous one
+    void publish(pattern_set_t* set);
+
+    std::atomic<pattern_set_t*> set_;
+};
@@ -3,23 +3,119 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <span>
+#include <string_view>
 #include "BinaryFuseWrapper.hpp"
 #include "MortonFilterWrapper.hpp"
+#include "epoch_reclaimer.hpp"
+#include "ip_prefix_table.hpp"
+#include "l2_journal.hpp"
+#include "mapped_file.hpp"
+#include "negative_verdict_cache.hpp"
+#include "pattern_matcher.hpp"
+#include "tiny_bloom_filter.hpp"
+#include "url_candidates.hpp"
+
+// Result of one L2 -> L3 compaction pass
+struct CompactionResult {
+    bool ok = false;
+    size_t absorbed = 0;     // L2 keys moved into L3
+    size_t l3_keys = 0;      // L3 size after the pass
+    size_t l2_remaining = 0;
+};
+
+// Result of a hierarchical lookup (PerformanceOptimizedFilter::match)
+struct UrlMatch {
+    MatchGranularity granularity = MatchGranularity::kNone;
+    int layer = 0;          // 1, 2 or 3; 4 for an IP prefix, 5 for a pattern; 0 if nothing matched
+    size_t candidate = 0;   // index into the UrlCandidates probed
+    uint32_t pattern = PatternMatcher::kNoMatch;   // for kPattern
+    int prefix_length = -1;                        // for kIpPrefix
+};
 
 class PerformanceOptimizedFilter {
 private:
     BinaryFuseWrapper binary_fuse_filter_;  // L3: Static historical threats
     MortonFilterWrapper morton_filter_;     // L2: Dynamic recent threats
+    // L1: Hottest threats, promoted from L2/L3 hits by lookups (hence
+    // mutable) and invalidated whenever a key can leave L2 or L3
+    mutable TinyBloomFilter l1_filter_;
+    // Rules checked on URLs every layer misses: networks for IP-literal
+    // hosts, then substrings
+    IpPrefixTable ip_prefixes_;
+    PatternMatcher pattern_matcher_;
+
+    // Tags lookups' NegativeVerdictCache entries; replaced after anything
+    // that can make many absent keys present, which drops them all. An
+    // L2 insert only bumps its key's stamp.
+    std::atomic<uint64_t> verdict_generation_{NegativeVerdictCache::next_generation()};
+    VerdictStamps verdict_stamps_;
     size_t capacity_;
-    
+    size_t l2_capacity_ = 0;
+
+    // L2 stores fingerprints only, so the keys it holds are logged here for
+    // compaction, each with the number of inserts since it was last
+    // compacted. Keys inserted while L2 has a TTL are not logged: they
+    // expire instead, and l2_expiring_ only remembers the generation each
+    // went into (the Morton rotation count then), so a removal can tell
+    // whether L2 still holds it. morton_filter_ synchronizes itself
+    // (lookups are lock-free); l2_log_mutex_ guards only the log and is
+    // held by compaction while it trims L2 to match. With a TTL it is also
+    // held around every rotation, so no stamp is ever a generation off.
+    std::unordered_map<uint64_t, uint64_t> l2_keys_;
+    std::unordered_map<uint64_t, uint64_t> l2_expiring_;
+    uint64_t l2_expiring_rotations_ = 0;   // when l2_expiring_ was last pruned
+    // Keys L2 holds (logged or expiring) by Morton collision class, so a
+    // removal re-places only those that may have shared the erased entry.
+    // Keys that have left L2 may still be listed until their class is next
+    // visited.
+    std::vector<std::vector<uint64_t>> l2_classes_ =
+        std::vector<std::vector<uint64_t>>(MortonFilterWrapper::kCollisionClasses);
+    std::mutex l2_log_mutex_;
+
+    // L3 keeps its exact keys, which are also its source set: rebuilds merge
+    // into them shard by shard (BinaryFuseWrapper::rebuild_exact) instead of
+    // from a resident copy. L3 is static when loaded from an image without
+    // exact keys, so there is no key set to rebuild from. Rebuilt under
+    // compaction_mutex_.
+    std::atomic<bool> l3_static_{false};
+    // Keys retracted from L3 since its last rebuild, sorted; null while
+    // there are none. Lookups that hit L3 check them, and the next
+    // compact_l2 drops them in its rebuild, so a retraction never rebuilds
+    // L3 itself. Replaced copy-on-write under compaction_mutex_ and retired
+    // through EpochReclaimer.
+    std::atomic<std::vector<uint64_t>*> l3_retracted_{nullptr};
+    std::mutex compaction_mutex_;   // one rebuild at a time
+
+    // Write-ahead journal of inserts and removes; null until open_journal.
+    // Its snapshots hold every non-expiring key (L3 and the L2 log), so
+    // compaction moving keys between layers is never journaled.
+    std::unique_ptr<L2Journal> journal_;
+
 public:
-    PerformanceOptimizedFilter() : capacity_(0) {}
+    // l3_fingerprint_bits: 8, 16 or 32 (see BinaryFuseWrapper)
+    explicit PerformanceOptimizedFilter(uint32_t l3_fingerprint_bits = 8)
+        : binary_fuse_filter_(l3_fingerprint_bits), capacity_(0) {
+        binary_fuse_filter_.set_exact_verification(true);
+    }
+
+    ~PerformanceOptimizedFilter() {
+        delete l3_retracted_.load(std::memory_order_relaxed);
+    }
     
     bool initialize(size_t capacity) {
         capacity_ = capacity;
         
-        std::cout << "[PerformanceFilter] Initializing L2+L3 filters with capacity: " 
+        std::cout << "[PerformanceFilter] Initializing L1+L2+L3 filters with capacity: " 
                   << capacity << std::endl;
+
+        bool l1_ok = l1_filter_.initialize();
         
         // Initialize L3 with some test data (in real usage, this would be loaded from disk)
         std::vector<uint64_t> l3_test_keys = {
@@ -28,71 +124,870 @@ public:
             BinaryFuseWrapper::hash_url("https://malware.org")
         };
         
-        bool l3_ok = binary_fuse_filter_.build_from_keys(l3_test_keys);
+        bool l3_ok = set_l3_keys(std::move(l3_test_keys));
         
-        // Initialize L2 Morton Filter
-        bool l2_ok = morton_filter_.initialize(capacity / 10, 0.01); // 10% of capacity
+        // Initialize L2 Morton Filter; it grows sub-filters past this
+        l2_capacity_ = capacity / 10; // 10% of capacity
+        bool l2_ok = morton_filter_.initialize(l2_capacity_, 0.01);
         
         std::cout << "[PerformanceFilter] L3 (BinaryFuse): " << (l3_ok ? "OK" : "FAIL") 
-                  << ", L2 (Morton): " << (l2_ok ? "OK" : "FAIL") << std::endl;
+                  << ", L2 (Morton): " << (l2_ok ? "OK" : "FAIL")
+                  << ", L1 (Bloom): " << (l1_ok ? "OK" : "FAIL") << std::endl;
         
-        return l3_ok && l2_ok;
+        return l3_ok && l2_ok && l1_ok;
+    }
+    
+    // Gives L2 entries a lifetime of ttl (up to one generation longer, see
+    // MortonFilterWrapper), for threats that should lapse rather than be
+    // compacted into L3. Anything already in L2 is compacted first; a zero
+    // ttl turns expiry back off. Reinitializes L2, so call it before serving
+    // lookups.
+    bool set_l2_ttl(std::chrono::milliseconds ttl, uint32_t generations = 4) {
+        if (!compact_l2().ok) return false;
+
+        std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        bool ok = ttl.count() > 0 ? morton_filter_.initialize(l2_capacity_, 0.01, ttl, generations)
+                                  : morton_filter_.initialize(l2_capacity_, 0.01);
+        // Keys logged since the compaction above stay logged for the next one
+        for (const auto& [key, count] : l2_keys_) {
+            morton_filter_.insert_key(key);
+        }
+        l2_expiring_.clear();
+        index_l2();
+        l1_filter_.invalidate();
+        publish_verdicts();
+        return ok;
+    }
+
+    // Advances L2 expiry; L3Compactor calls this on every poll. Returns the
+    // number of generations reclaimed.
+    size_t expire_l2() {
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        const size_t expired = morton_filter_.expire();
+        if (expired > 0) {
+            l1_filter_.invalidate();
+            forget_expired_l2();
+        }
+        return expired;
+    }
+
+    // Retracts a URL from both layers. L3 only marks it retracted until the
+    // next compaction rebuilds L3 without it.
+    bool remove(std::string_view url) {
+        const bool removed = remove(HashedKey::of(url));
+        if (removed) {
+            std::cout << "[PerformanceFilter] Retracted: " << url << std::endl;
+        }
+        return removed;
+    }
+
+    bool remove(const HashedKey& hash) {
+        const uint64_t key = hash.key;
+
+        // Held throughout so a concurrent compaction cannot carry the key
+        // back into L3
+        std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+        bool removed = remove_l2(key);
+        // Journaled even if absent here: replaying it is harmless
+        if (journal_) journal_->append(JournalOp::kRemove, key);
+
+        // Unless static, L3 verifies hits against its keys, so a hit is exact
+        if (!l3_static_ && binary_fuse_filter_.contains(key) && !l3_retracted(key)) {
+            const std::vector<uint64_t>* current = l3_retracted_.load(std::memory_order_relaxed);
+            auto next = current ? std::make_unique<std::vector<uint64_t>>(*current)
+                                : std::make_unique<std::vector<uint64_t>>();
+            next->insert(std::upper_bound(next->begin(), next->end(), key), key);
+            publish_l3_retracted(next.release());
+            removed = true;
+        } else if (l3_static_ && binary_fuse_filter_.contains(key)) {
+            std::cerr << "[PerformanceFilter] L3 is static (image without exact keys); retraction not applied to L3"
+                      << std::endl;
+            return false;
+        }
+        // After L2 and L3, so a lookup racing the removal cannot re-promote it
+        l1_filter_.invalidate();
+        return removed;
+    }
+
+    // Replaces the L3 source set and publishes a filter built from it
+    bool set_l3_keys(const std::vector<uint64_t>& keys) {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        if (!binary_fuse_filter_.build_from_keys(keys)) return false;
+        publish_l3_retracted(nullptr);
+        l3_static_ = false;
+        l1_filter_.invalidate();
+        publish_verdicts();
+        return true;
+    }
+
+    // Replaces L3 with a copy of image, an L3 file, in numa_node's memory
+    // (see BinaryFuseWrapper::load_replica), keeping the keys of the L3 it
+    // replaces and extra_keys. If image stores its exact keys, they become
+    // L3's source set and the kept keys are rebuilt into it, so compaction
+    // and retraction work as before; a rebuild allocates on the calling
+    // thread, so run them on numa_node to keep L3 local. Otherwise L3 is
+    // static until set_l3_keys: compaction is off, retracting a key it
+    // holds fails, and the kept keys go to L2.
+    bool load_l3_replica(const MappedFile& image, int numa_node, const std::vector<uint64_t>& extra_keys = {}) {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        std::vector<uint64_t> kept = current_l3_keys();
+        if (!binary_fuse_filter_.load_replica(image, numa_node)) return false;
+        publish_l3_retracted(nullptr);
+
+        kept.insert(kept.end(), extra_keys.begin(), extra_keys.end());
+        std::sort(kept.begin(), kept.end());
+        kept.erase(std::unique(kept.begin(), kept.end()), kept.end());
+
+        const bool rebuildable = binary_fuse_filter_.has_exact_verification();
+        std::vector<uint64_t> missing;   // kept keys the image lacks
+        for (uint64_t key : kept) {
+            // An image without exact keys can only tell possibly present
+            if (!binary_fuse_filter_.contains(key) || !rebuildable) missing.push_back(key);
+        }
+        if (rebuildable) {
+            if (missing.empty() || binary_fuse_filter_.rebuild_exact(missing)) {
+                missing.clear();
+            } else {
+                std::cerr << "[PerformanceFilter] L3 rebuild failed; " << missing.size()
+                          << " kept keys left in L2" << std::endl;
+            }
+        } else {
+            std::cerr << "[PerformanceFilter] L3 image has no exact keys: L3 is static, so L2 is not "
+                      << "compacted and retractions cannot reach L3" << std::endl;
+        }
+        for (uint64_t key : missing) insert_l2(key);
+        l3_static_ = !rebuildable;
+        l1_filter_.invalidate();
+        publish_verdicts();
+        return true;
+    }
+
+    // Whether L3 has no source set to rebuild from (see load_l3_replica)
+    bool is_l3_static() const {
+        return l3_static_.load(std::memory_order_relaxed);
     }
     
-    bool contains(const std::string& url) const {
-        // Fast path: Check L2 Morton filter first (dynamic threats)
-        if (morton_filter_.contains(url)) {
+    bool contains(std::string_view url) const {
+        return contains(HashedKey::of(url), url);
+    }
+
+    // contains(url) for a URL already hashed at ingress: the hash is not
+    // recomputed, and the URL is kept for the log line and for the IP
+    // prefix and pattern layers.
+    bool contains(const HashedKey& hash, std::string_view url) const {
+        switch (hit_layer(hash, &url)) {
+        case 1:
+            std::cout << "[PerformanceFilter] L1 HIT: " << url << std::endl;
+            return true;
+        case 2:
             std::cout << "[PerformanceFilter] L2 HIT: " << url << std::endl;
             return true;
-        }
-        
-        // Slow path: Check L3 Binary Fuse filter (static threats)
-        uint64_t hash = BinaryFuseWrapper::hash_url(url);
-        if (binary_fuse_filter_.contains(hash)) {
+        case 3:
             std::cout << "[PerformanceFilter] L3 HIT: " << url << std::endl;
             return true;
+        case 4:
+            std::cout << "[PerformanceFilter] CIDR HIT: " << url << std::endl;
+            return true;
+        case 5:
+            std::cout << "[PerformanceFilter] PATTERN HIT: " << url << std::endl;
+            return true;
+        default:
+            std::cout << "[PerformanceFilter] MISS: " << url << std::endl;
+            return false;
         }
-        
-        std::cout << "[PerformanceFilter] MISS: " << url << std::endl;
-        return false;
+    }
+
+    // Same check on a URL hashed at ingress, without logging. IP prefixes
+    // and patterns need the URL itself, so they are not checked here.
+    bool contains(const HashedKey& hash) const {
+        return hit_layer(hash) != 0;
     }
     
-    void insert(const std::string& url) {
+    // Layer (1-3) reporting each of n keys, or 0, as contains() decides
+    // it. One batch: keys the negative cache or L1 settle are done first,
+    // then the L2 blocks and L3 slots of the rest are all prefetched before
+    // any is read, so their cache misses overlap. IP prefixes and patterns
+    // are not checked (there is no URL), so with either loaded misses are
+    // not cached.
+    void contains_batch(const HashedKey* keys, size_t n, uint8_t* layers) const {
+        constexpr size_t kWindow = 16;
+        const uint64_t generation = verdict_generation_.load(std::memory_order_acquire);
+        const uint64_t l1_epoch = l1_filter_.epoch();
+        NegativeVerdictCache& negatives = NegativeVerdictCache::local();
+        const bool final_misses = ip_prefixes_.empty() && pattern_matcher_.empty();
+
+        for (size_t base = 0; base < n; base += kWindow) {
+            const size_t count = std::min(kWindow, n - base);
+            uint64_t pending[kWindow];
+            uint64_t tags[kWindow];
+            size_t index[kWindow];
+            size_t m = 0;
+            for (size_t i = base; i < base + count; ++i) {
+                layers[i] = 0;
+                const uint64_t tag = verdict_stamps_.tag(keys[i].key, generation);
+                if (negatives.contains(keys[i].key, tag)) continue;
+                if (l1_filter_.contains(keys[i].key)) {
+                    layers[i] = 1;
+                    continue;
+                }
+                pending[m] = keys[i].key;
+                tags[m] = tag;
+                index[m++] = i;
+            }
+            if (m == 0) continue;
+
+            // L2 lines load while L3 is probed (it prefetches its own); one
+            // guard spans the L3 probe and the retraction checks, as in
+            // hit_layer
+            EpochGuard guard;
+            uint8_t in_l3[kWindow];
+            morton_filter_.prefetch(pending, m);
+            binary_fuse_filter_.contains_batch(pending, m, in_l3);
+            for (size_t j = 0; j < m; ++j) {
+                const int layer = morton_filter_.contains_key(pending[j]) ? 2
+                                : (in_l3[j] && !l3_retracted(pending[j]) ? 3 : 0);
+                layers[index[j]] = static_cast<uint8_t>(layer);
+                if (layer != 0) l1_filter_.promote(pending[j], l1_epoch);
+                else if (final_misses) negatives.insert(pending[j], tags[j]);
+            }
+        }
+    }
+
+    // Layer (1-5) reporting each URL, or 0, as contains(url) decides it,
+    // without logging or allocating, for URLs still in a log buffer or
+    // packet: a window of them is hashed on the stack and probed as one
+    // batch, and misses not already cached as final go on to the rules.
+    void contains_batch(std::span<const std::string_view> urls, uint8_t* layers) const {
+        constexpr size_t kWindow = 64;
+        const bool rules = !ip_prefixes_.empty() || !pattern_matcher_.empty();
+        NegativeVerdictCache& negatives = NegativeVerdictCache::local();
+
+        for (size_t base = 0; base < urls.size(); base += kWindow) {
+            const size_t count = std::min(kWindow, urls.size() - base);
+            // Read before probing, as in hit_layer
+            const uint64_t generation = verdict_generation_.load(std::memory_order_acquire);
+            HashedKey keys[kWindow];
+            uint64_t tags[kWindow];
+            for (size_t i = 0; i < count; ++i) {
+                keys[i] = HashedKey::of(urls[base + i]);
+                tags[i] = verdict_stamps_.tag(keys[i].key, generation);
+            }
+            contains_batch(keys, count, layers + base);
+            if (!rules) continue;
+            for (size_t i = 0; i < count; ++i) {
+                if (layers[base + i] != 0 || negatives.contains(keys[i].key, tags[i])) continue;
+                const int layer = rule_layer(urls[base + i]);
+                layers[base + i] = static_cast<uint8_t>(layer);
+                if (layer == 0) negatives.insert(keys[i].key, tags[i]);
+            }
+        }
+    }
+
+    // Hierarchical lookup: the most specific of url's candidates (see
+    // UrlCandidates) that the filter holds, so an entry for a domain or a
+    // path prefix covers everything under it; failing that, a network
+    // holding an IP-literal host, then a pattern in the canonical URL
+    UrlMatch match(std::string_view url) const {
+        UrlCandidates candidates;
+        candidates.parse(url);
+        const UrlMatch result = match(candidates);
+        if (result.granularity == MatchGranularity::kIpPrefix) {
+            std::cout << "[PerformanceFilter] CIDR HIT (/" << result.prefix_length << "): " << url << std::endl;
+        } else if (result.granularity == MatchGranularity::kPattern) {
+            std::cout << "[PerformanceFilter] PATTERN HIT (" << pattern_matcher_.get_pattern(result.pattern)
+                      << "): " << url << std::endl;
+        } else if (result.layer != 0) {
+            std::cout << "[PerformanceFilter] L" << result.layer << " " << granularity_name(result.granularity)
+                      << " HIT (" << candidates.text(result.candidate) << "): " << url << std::endl;
+        } else {
+            std::cout << "[PerformanceFilter] MISS: " << url << std::endl;
+        }
+        return result;
+    }
+
+    // Same on candidates parsed at ingress, without logging
+    UrlMatch match(const UrlCandidates& candidates) const {
+        uint8_t layers[UrlCandidates::kMaxCandidates];
+        contains_batch(candidates.keys(), candidates.size(), layers);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (layers[i] != 0) return {candidates.granularity(i), layers[i], i};
+        }
+        return match_rules(candidates);
+    }
+
+    // The rule stages of match() alone: the host's networks, then patterns
+    // in the canonical URL (candidate 0)
+    UrlMatch match_rules(const UrlCandidates& candidates) const {
+        if (candidates.size() == 0) return {};
+        if (!candidates.host().empty() && !ip_prefixes_.empty()) {
+            const int length = ip_prefixes_.lookup(candidates.host());
+            if (length >= 0) return {MatchGranularity::kIpPrefix, 4, 0, PatternMatcher::kNoMatch, length};
+        }
+        const std::string_view text = candidates.text(0);
+        const uint32_t pattern = pattern_matcher_.find(text.data(), text.size());
+        if (pattern == PatternMatcher::kNoMatch) return {};
+        return {MatchGranularity::kPattern, 5, 0, pattern};
+    }
+
+    // Replaces the networks checked, after every layer misses, for URLs
+    // whose host is an IP literal (see IpPrefixTable); an empty list turns
+    // the stage off
+    bool set_ip_prefixes(const std::vector<std::string>& prefixes) {
+        if (!ip_prefixes_.build(prefixes)) return false;
+        publish_verdicts();   // cached misses predate the new networks
+        return true;
+    }
+
+    // A text list, one prefix per line
+    bool load_ip_prefix_list(const std::string& path) {
+        if (!ip_prefixes_.load_list(path)) return false;
+        publish_verdicts();
+        return true;
+    }
+
+    // A table written by save_ip_prefixes, mapped in place; filters
+    // loading the same file share its pages
+    bool load_ip_prefixes(const std::string& path) {
+        if (!ip_prefixes_.load_from_file(path)) return false;
+        publish_verdicts();
+        return true;
+    }
+
+    bool save_ip_prefixes(const std::string& path) const {
+        return ip_prefixes_.save_to_file(path);
+    }
+
+    const IpPrefixTable& get_ip_prefixes() const {
+        return ip_prefixes_;
+    }
+
+    // Replaces the substring rules checked after every layer misses (see
+    // PatternMatcher); an empty list turns the stage off
+    bool set_patterns(const std::vector<std::string>& patterns) {
+        if (!pattern_matcher_.build(patterns)) return false;
+        publish_verdicts();   // cached misses predate the new rules
+        return true;
+    }
+
+    bool load_patterns(const std::string& path) {
+        if (!pattern_matcher_.load_from_file(path)) return false;
+        publish_verdicts();
+        return true;
+    }
+
+    const PatternMatcher& get_patterns() const {
+        return pattern_matcher_;
+    }
+
+    void insert(std::string_view url) {
         // Add to L2 Morton filter (dynamic cache)
-        if (morton_filter_.insert(url)) {
+        if (insert(HashedKey::of(url))) {
             std::cout << "[PerformanceFilter] Added to L2: " << url << std::endl;
         } else {
             std::cerr << "[PerformanceFilter] Failed to add to L2: " << url << std::endl;
         }
         
-        // Note: L3 Binary Fuse is static and not updated at runtime
-        // In production, L3 would be rebuilt periodically from updated threat intelligence
+        // L3 is static; L3Compactor periodically folds L2 into it (compact_l2)
+    }
+
+    bool insert(const HashedKey& hash) {
+        const bool expiring = morton_filter_.get_ttl().count() > 0;
+        const bool ok = insert_l2(hash.key);
+        verdict_stamps_.invalidate(hash.key);
+        // Journaled after it is applied, so a snapshot started later has it
+        if (journal_) journal_->append(expiring ? JournalOp::kInsertExpiring : JournalOp::kInsert, hash.key);
+        return ok;
+    }
+
+    // Makes this filter's verdicts survive a restart: replays dir (a
+    // snapshot, then the journal written since) into the filter, then
+    // journals every later insert and remove there. Snapshot keys go to L3
+    // in one rebuild, journaled inserts to L2 as before the crash. Call
+    // after initialize() and set_l2_ttl(), before serving; with a TTL,
+    // journal segments are kept for that long, since expiring entries are
+    // only recovered from the journal and restart their lifetime.
+    bool open_journal(const std::string& dir, L2Journal::Options options = {}) {
+        if (journal_) return false;
+        const std::chrono::milliseconds ttl = morton_filter_.get_ttl();
+        options.retain = std::max(options.retain, ttl);
+        const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::vector<uint64_t> snapshot;
+        std::vector<uint64_t> removed;   // from the snapshot, by later records
+        size_t replayed = 0;
+        auto journal = std::make_unique<L2Journal>(options);
+        const bool ok = journal->open(dir,
+            [&](std::vector<uint64_t>&& keys) { snapshot = std::move(keys); },
+            [&](const JournalRecord& record, bool covered) {
+                switch (record.op) {
+                case JournalOp::kInsert:
+                    if (!covered) insert_l2(record.key);
+                    break;
+                case JournalOp::kInsertExpiring:
+                    // Without a TTL now, expiring entries are kept like any other
+                    if (ttl.count() == 0 ? !covered
+                                         : (now - static_cast<int64_t>(record.unix_seconds)) * 1000 < ttl.count()) {
+                        insert_l2(record.key);
+                    }
+                    break;
+                case JournalOp::kRemove:
+                    remove_l2(record.key);
+                    if (!covered) removed.push_back(record.key);
+                    break;
+                }
+                ++replayed;
+            });
+        if (!ok) return false;
+
+        if (!snapshot.empty() || !removed.empty()) {
+            std::sort(removed.begin(), removed.end());
+            removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+            if (l3_static_) {
+                // Nothing to merge into: L3 becomes the recovered keys alone
+                std::vector<uint64_t> kept;
+                kept.reserve(snapshot.size());
+                std::set_difference(snapshot.begin(), snapshot.end(), removed.begin(), removed.end(),
+                                    std::back_inserter(kept));
+                if (!set_l3_keys(kept)) return false;
+            } else {
+                std::lock_guard<std::mutex> lock(compaction_mutex_);
+                if (const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_relaxed)) {
+                    std::vector<uint64_t> all;
+                    std::set_union(removed.begin(), removed.end(), retracted->begin(), retracted->end(),
+                                   std::back_inserter(all));
+                    removed = std::move(all);
+                }
+                if (!binary_fuse_filter_.rebuild_exact(snapshot, removed)) return false;
+                publish_l3_retracted(nullptr);
+                l1_filter_.invalidate();
+            }
+        }
+
+        publish_verdicts();
+        journal_ = std::move(journal);
+        std::cout << "[PerformanceFilter] Recovered " << snapshot.size() << " snapshot keys and "
+                  << replayed << " journal records from " << dir << std::endl;
+        return true;
+    }
+
+    // Writes every non-expiring key (L3 plus the L2 log) as the journal's
+    // new snapshot and drops the journal it covers. Only the copy of the
+    // L2 log blocks inserts; L3Compactor calls this periodically.
+    bool snapshot_journal() {
+        if (!journal_) return false;
+        return journal_->snapshot([this] {
+            // compaction_mutex_ keeps keys from moving between the two
+            // sets while they are copied
+            std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+            std::vector<uint64_t> keys = current_l3_keys();
+            std::lock_guard<std::mutex> lock(l2_log_mutex_);
+            keys.reserve(keys.size() + l2_keys_.size());
+            for (const auto& [key, count] : l2_keys_) keys.push_back(key);
+            return keys;
+        });
+    }
+
+    // Blocks until every insert and remove so far is on disk
+    bool sync_journal() {
+        return journal_ && journal_->flush();
+    }
+
+    bool has_journal() const {
+        return journal_ != nullptr;
+    }
+
+    uint64_t get_journal_bytes() const {
+        return journal_ ? journal_->get_bytes_since_snapshot() : 0;
     }
     
     void insert_batch(const std::vector<std::string>& urls) {
-        if (urls.empty()) return;
-        
-        std::cout << "[PerformanceFilter] Batch inserting " << urls.size() << " URLs to L2" << std::endl;
-        
-        if (morton_filter_.insert_batch(urls)) {
-            std::cout << "[PerformanceFilter] Batch insert successful" << std::endl;
-        } else {
-            std::cerr << "[PerformanceFilter] Batch insert failed" << std::endl;
+        insert_urls(urls);
+    }
+
+    // Same for URLs still in the caller's buffer; nothing is copied
+    void insert_batch(std::span<const std::string_view> urls) {
+        insert_urls(urls);
+    }
+
+    // Folds every key logged in L2 so far into a rebuilt L3, publishes it and
+    // removes those keys from L2. The rebuild runs without holding the L2
+    // lock, so lookups and inserts continue meanwhile; a key is in L2, L3 or
+    // both at every point. If L2 has grown extra sub-filters, consolidate_l2
+    // rebuilds it as a single one from the keys it keeps. Not ok while L3
+    // is static (load_l3_replica).
+    CompactionResult compact_l2(bool consolidate_l2 = true) {
+        std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+        CompactionResult result;
+        if (l3_static_) return result;
+
+        // Logged keys and their insert counts
+        std::vector<std::pair<uint64_t, uint64_t>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(l2_log_mutex_);
+            snapshot.assign(l2_keys_.begin(), l2_keys_.end());
+        }
+
+        const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_relaxed);
+        if (!snapshot.empty() || retracted) {
+            std::vector<uint64_t> absorbed;
+            absorbed.reserve(snapshot.size());
+            for (const auto& [key, count] : snapshot) absorbed.push_back(key);
+            std::sort(absorbed.begin(), absorbed.end());
+
+            // Retracted keys leave L3 in the same rebuild, unless inserted
+            // again since
+            std::vector<uint64_t> dropped;
+            if (retracted) {
+                std::set_difference(retracted->begin(), retracted->end(), absorbed.begin(), absorbed.end(),
+                                    std::back_inserter(dropped));
+            }
+            if (!binary_fuse_filter_.rebuild_exact(absorbed, dropped)) {
+                std::cerr << "[PerformanceFilter] L3 rebuild failed; L2 left untouched" << std::endl;
+                return result;
+            }
+            // rebuild_exact returns once lookups that probed the old L3
+            // are done, and each checks retractions under the same guard,
+            // so none can miss them from here on
+            publish_l3_retracted(nullptr);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(l2_log_mutex_);
+            // Keys inserted again since the snapshot stay logged for the
+            // next pass; the rest leave the log, and L2 unless they are
+            // also expiring there
+            std::vector<uint64_t> trimmed;
+            for (const auto& [key, count] : snapshot) {
+                auto it = l2_keys_.find(key);
+                if (it == l2_keys_.end()) continue;
+                if (it->second > count) {
+                    it->second -= count;
+                    continue;
+                }
+                l2_keys_.erase(it);
+                if (!holds_l2(key)) trimmed.push_back(key);
+            }
+
+            // Without a TTL the log holds everything L2 does, so a grown L2
+            // can be rebuilt from it outright
+            bool consolidated = false;
+            if (consolidate_l2 && morton_filter_.get_ttl().count() == 0 && morton_filter_.get_stage_count() > 1) {
+                std::vector<uint64_t> kept;
+                kept.reserve(l2_keys_.size());
+                for (const auto& [key, count] : l2_keys_) kept.push_back(key);
+                consolidated = morton_filter_.consolidate(kept);
+            }
+            if (consolidated) {
+                index_l2();
+            } else {
+                std::vector<bool> touched(MortonFilterWrapper::kCollisionClasses);
+                for (uint64_t key : trimmed) {
+                    morton_filter_.remove_key(key);
+                    for (uint32_t c : MortonFilterWrapper::collision_classes(key)) touched[c] = true;
+                }
+
+                // A kept key may have been suppressed as a duplicate of a
+                // trimmed fingerprint; re-placing the kept keys that could
+                // share one restores it. Keys logged but not yet stored by
+                // their inserter are either re-placed here or stored after
+                // the trim.
+                for (uint32_t c = 0; c < touched.size(); ++c) {
+                    if (touched[c]) restore_l2_class(c);
+                }
+                forget_expired_l2();
+            }
+            result.l2_remaining = morton_filter_.get_count();
         }
+
+        result.ok = true;
+        result.absorbed = snapshot.size();
+        result.l3_keys = binary_fuse_filter_.key_count();
+        return result;
+    }
+    
+    size_t get_l2_capacity() const {
+        return l2_capacity_;
     }
     
     size_t get_memory_usage() const {
-        return morton_filter_.get_memory_usage() + sizeof(BinaryFuseWrapper);
+        return l1_filter_.get_memory_usage() + morton_filter_.get_memory_usage() + sizeof(BinaryFuseWrapper) +
+               ip_prefixes_.get_memory_usage() + pattern_matcher_.get_memory_usage();
     }
     
     size_t get_l2_count() const {
         return morton_filter_.get_count();
     }
+
+    // Distinct keys logged since the last compaction; repeat inserts of a
+    // logged key do not grow it
+    size_t get_l2_log_size() {
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        return l2_keys_.size();
+    }
+
+    // Keys logged in L2 since the last compaction (without a TTL, every
+    // key L2 holds)
+    std::vector<uint64_t> get_l2_keys() {
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        std::vector<uint64_t> keys;
+        keys.reserve(l2_keys_.size());
+        for (const auto& [key, count] : l2_keys_) keys.push_back(key);
+        return keys;
+    }
+
+    size_t get_l3_count() {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_relaxed);
+        return binary_fuse_filter_.key_count() - (retracted ? retracted->size() : 0);
+    }
+
+    // Retractions from L3 not yet folded in by compaction
+    size_t get_l3_retracted_count() {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_relaxed);
+        return retracted ? retracted->size() : 0;
+    }
+
+    // Copy of L3's source set (empty while L3 is static)
+    std::vector<uint64_t> get_l3_keys() {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        return current_l3_keys();
+    }
     
     void print_stats() const {
         std::cout << "\n=== Performance Filter Statistics ===" << std::endl;
-        std::cout << "L2 (Morton) entries: " << morton_filter_.get_count() << std::endl;
+        std::cout << "L1 (Bloom) hot entries: " << l1_filter_.get_count() << " of " << l1_filter_.get_capacity()
+                  << " (" << l1_filter_.get_memory_usage() / 1024 << " KiB, " << l1_filter_.get_resets()
+                  << " resets)" << std::endl;
+        std::cout << "L2 (Morton) entries: " << morton_filter_.get_count()
+                  << " in " << morton_filter_.get_stage_count() << " sub-filter(s)" << std::endl;
         std::cout << "L2 memory usage: " << morton_filter_.get_memory_usage() << " bytes" << std::endl;
         std::cout << "L3 (BinaryFuse): Static threat database" << std::endl;
+        if (!ip_prefixes_.empty()) {
+            std::cout << "IP prefixes: " << ip_prefixes_.size() << " ("
+                      << ip_prefixes_.get_memory_usage() / 1024 << " KiB)" << std::endl;
+        }
+        if (!pattern_matcher_.empty()) {
+            std::cout << "Patterns: " << pattern_matcher_.size() << " (" << pattern_matcher_.kernel_name()
+                      << ", " << pattern_matcher_.get_memory_usage() / 1024 << " KiB)" << std::endl;
+        }
+    }
+
+private:
+    // New generation for lookups' negative caches; after the change is
+    // visible in the layers, so a lookup that tags with the new one sees it
+    void publish_verdicts() {
+        verdict_generation_.store(NegativeVerdictCache::next_generation(), std::memory_order_release);
+    }
+
+    // 1, 2 or 3 for the layer that reports the key; failing those, when
+    // url is known, 4 or 5 from rule_layer; 0 otherwise
+    int hit_layer(const HashedKey& hash, const std::string_view* url = nullptr) const {
+        // Read before probing: a miss is cached under the tag it was
+        // valid for, and a hit only stays in L1 if nothing was removed since
+        const uint64_t tag = verdict_stamps_.tag(hash.key, verdict_generation_.load(std::memory_order_acquire));
+        const uint64_t l1_epoch = l1_filter_.epoch();
+
+        // Hot benign keys: the thread's own cache of recent misses
+        NegativeVerdictCache& negatives = NegativeVerdictCache::local();
+        if (negatives.contains(hash.key, tag)) return 0;
+
+        // Hot path: one cache-resident block for recently seen threats
+        if (l1_filter_.contains(hash.key)) return 1;
+
+        // Fast path: Check L2 Morton filter (dynamic threats)
+        if (morton_filter_.contains(hash)) {
+            l1_filter_.promote(hash.key, l1_epoch);
+            return 2;
+        }
+
+        // Slow path: Check L3 Binary Fuse filter (static threats). One
+        // guard spans the probe and the retraction check (see compact_l2).
+        {
+            EpochGuard guard;
+            if (binary_fuse_filter_.contains(hash) && !l3_retracted(hash.key)) {
+                l1_filter_.promote(hash.key, l1_epoch);
+                return 3;
+            }
+        }
+
+        // Last resort: rules on the URL text. Without the text the miss is
+        // not final, so it is not cached.
+        if (!ip_prefixes_.empty() || !pattern_matcher_.empty()) {
+            if (!url) return 0;
+            if (const int layer = rule_layer(*url)) return layer;
+        }
+        negatives.insert(hash.key, tag);
+        return 0;
+    }
+
+    // Whether key was retracted from L3 since its last rebuild. Lookups
+    // call this inside the EpochGuard of their L3 probe; writers hold
+    // compaction_mutex_.
+    bool l3_retracted(uint64_t key) const {
+        const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_acquire);
+        return retracted && std::binary_search(retracted->begin(), retracted->end(), key);
+    }
+
+    // Swaps in next (null: no retractions) and retires the previous set.
+    // Caller holds compaction_mutex_.
+    void publish_l3_retracted(std::vector<uint64_t>* next) {
+        std::vector<uint64_t>* old = l3_retracted_.exchange(next, std::memory_order_acq_rel);
+        if (!old) return;
+        EpochReclaimer::global().retire(old, [](void* p) { delete static_cast<std::vector<uint64_t>*>(p); });
+    }
+
+    // L3's source set less its retractions (empty while L3 is static).
+    // Caller holds compaction_mutex_.
+    std::vector<uint64_t> current_l3_keys() const {
+        std::vector<uint64_t> keys;
+        if (l3_static_ || !binary_fuse_filter_.get_exact_keys(keys)) return keys;
+        if (const std::vector<uint64_t>* retracted = l3_retracted_.load(std::memory_order_relaxed)) {
+            std::erase_if(keys, [&](uint64_t key) {
+                return std::binary_search(retracted->begin(), retracted->end(), key);
+            });
+        }
+        return keys;
+    }
+
+    // 4 if url's host is an IP literal in one of the networks, 5 if its
+    // canonical form contains a pattern, 0 otherwise
+    int rule_layer(std::string_view url) const {
+        char canonical[kCanonicalUrlStackBytes];
+        size_t size = 0;
+        std::string_view text(url);
+        std::string_view host;
+        if (canonicalize_url(url.data(), url.size(), canonical, sizeof(canonical), size)) {
+            text = std::string_view(canonical, size);
+            host = canonical_host(text);
+        }
+        if (!host.empty() && !ip_prefixes_.empty() && ip_prefixes_.lookup(host) >= 0) return 4;
+        if (pattern_matcher_.find(text.data(), text.size()) != PatternMatcher::kNoMatch) return 5;
+        return 0;
+    }
+
+    // insert_batch over any range of URL strings
+    template <typename Urls>
+    void insert_urls(const Urls& urls) {
+        if (urls.empty()) return;
+
+        std::cout << "[PerformanceFilter] Batch inserting " << urls.size() << " URLs to L2" << std::endl;
+
+        bool all_success = true;
+        for (const auto& url : urls) {
+            all_success &= insert(HashedKey::of(url));
+        }
+        if (all_success) {
+            std::cout << "[PerformanceFilter] Batch insert successful" << std::endl;
+        } else {
+            std::cerr << "[PerformanceFilter] Batch insert failed" << std::endl;
+        }
+    }
+
+    // Removes key from L2 and its log; the caller handles L3. L2 is only
+    // touched if key was inserted there: erasing the fingerprint of a key
+    // it never stored could evict a live one that shares it. Live keys
+    // that did share the erased fingerprint are stored again.
+    bool remove_l2(uint64_t key) {
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        if (!holds_l2(key)) return false;
+
+        morton_filter_.remove_key(key);
+        l2_keys_.erase(key);
+        l2_expiring_.erase(key);
+
+        // Only keys in its collision classes can have shared the entry
+        const auto classes = MortonFilterWrapper::collision_classes(key);
+        for (size_t i = 0; i < classes.size(); ++i) {
+            if (std::find(classes.begin(), classes.begin() + i, classes[i]) == classes.begin() + i) {
+                restore_l2_class(classes[i]);
+            }
+        }
+        forget_expired_l2();
+        return true;
+    }
+
+    // Stores again every key of a collision class that L2 should hold but
+    // no longer reports (its fingerprint was erased along with another
+    // key's), and stops listing those it no longer holds. Caller holds
+    // l2_log_mutex_.
+    void restore_l2_class(uint32_t c) {
+        std::erase_if(l2_classes_[c], [this](uint64_t key) {
+            if (!holds_l2(key)) return true;
+            if (!morton_filter_.contains_key(key)) {
+                morton_filter_.insert_key(key);
+                // Back in the newest generation, so its lifetime restarts
+                auto expiring = l2_expiring_.find(key);
+                if (expiring != l2_expiring_.end()) expiring->second = morton_filter_.get_rotations();
+            }
+            return false;
+        });
+    }
+
+    // Lists a key that was not held in L2 under its collision class.
+    // Caller holds l2_log_mutex_.
+    void track_l2(uint64_t key) {
+        l2_classes_[MortonFilterWrapper::collision_classes(key)[0]].push_back(key);
+    }
+
+    // Relists exactly the keys L2 holds. Caller holds l2_log_mutex_.
+    void index_l2() {
+        for (auto& keys : l2_classes_) keys.clear();
+        for (const auto& [key, count] : l2_keys_) track_l2(key);
+        for (const auto& [key, rotation] : l2_expiring_) {
+            if (!l2_keys_.contains(key) && is_live_l2(rotation)) track_l2(key);
+        }
+    }
+
+    bool insert_l2(uint64_t key) {
+        // Logged before it is stored, and even when L2 rejects it (past its
+        // growth limit), so the next compaction still carries it into L3.
+        // Only the logging is serialized; concurrent inserters store in
+        // parallel.
+        if (morton_filter_.get_ttl().count() == 0) {
+            {
+                std::lock_guard<std::mutex> lock(l2_log_mutex_);
+                const bool held = holds_l2(key);
+                ++l2_keys_[key];
+                if (!held) track_l2(key);
+            }
+            return morton_filter_.insert_key(key);
+        }
+
+        // Expiring inserts are serialized: the insert may rotate, and the
+        // stamp must be the generation the key went into
+        std::lock_guard<std::mutex> lock(l2_log_mutex_);
+        const bool held = holds_l2(key);
+        const bool ok = morton_filter_.insert_key(key);
+        if (ok) {
+            l2_expiring_[key] = morton_filter_.get_rotations();
+            if (!held) track_l2(key);
+        }
+        forget_expired_l2();
+        return ok;
+    }
+
+    // Whether key went into L2 and has not left it since (by removal,
+    // compaction or expiry). Caller holds l2_log_mutex_.
+    bool holds_l2(uint64_t key) const {
+        if (l2_keys_.contains(key)) return true;
+        auto it = l2_expiring_.find(key);
+        return it != l2_expiring_.end() && is_live_l2(it->second);
+    }
+
+    bool is_live_l2(uint64_t rotation) const {
+        return morton_filter_.get_rotations() - rotation < morton_filter_.get_generations();
+    }
+
+    // Drops the stamps of expired keys once L2 has rotated. Caller holds
+    // l2_log_mutex_.
+    void forget_expired_l2() {
+        const uint64_t rotations = morton_filter_.get_rotations();
+        if (rotations == l2_expiring_rotations_) return;
+        l2_expiring_rotations_ = rotations;
+        std::erase_if(l2_expiring_, [&](const auto& entry) { return !is_live_l2(entry.second); });
+        index_l2();
     }
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// L1: register-blocked Bloom filter over the keys most recently found in L2
+// or L3. A key maps to one 64-byte block and sets one bit in each of its
+// eight words, so a lookup is one cache line and one 512-bit test (two
+// 256-bit ones on AVX2). The default 256 KiB stays in a core's L2 cache.
+//
+// Bloom filters cannot delete, so L1 forgets instead: once capacity keys
+// have been promoted it starts over empty and hot keys return on their
+// next L2/L3 hit, and invalidate() empties it whenever a key may have left
+// the layers below. Its false positives (about 0.1% at 16 bits per key) add
+// to those of L2 and L3.
+//
+// Thread-safe: promote() sets bits with atomic ORs; lookups read the block
+// without synchronization. Bits only go from 0 to 1 between resets, so a
+// racing lookup can only miss a key, which then falls through to L2.
+class TinyBloomFilter {
+public:
+    static constexpr size_t kBlockBytes = 64;
+    static constexpr size_t kDefaultBytes = size_t{256} << 10;
+
+    TinyBloomFilter();
+    ~TinyBloomFilter();
+
+    TinyBloomFilter(const TinyBloomFilter&) = delete;
+    TinyBloomFilter& operator=(const TinyBloomFilter&) = delete;
+
+    // bytes is rounded down to whole blocks; capacity is bytes * 8 / bits_per_key
+    bool initialize(size_t bytes = kDefaultBytes, size_t bits_per_key = 16);
+
+    bool contains(uint64_t key) const;
+
+    // Read before probing the layers below; promote() drops its key if an
+    // invalidation happened since
+    uint64_t epoch() const { return epoch_.load(std::memory_order_seq_cst); }
+    void promote(uint64_t key, uint64_t seen_epoch);
+
+    // Empties L1 so no key removed below can still hit here
+    void invalidate();
+
+    size_t get_count() const { return count_.load(std::memory_order_relaxed); }
+    size_t get_capacity() const { return capacity_; }
+    size_t get_memory_usage() const { return block_count_ * kBlockBytes; }
+    uint64_t get_resets() const { return resets_.load(std::memory_order_relaxed); }
+    // Probe kernel chosen by CPUID: "avx512", "avx2" or "scalar"
+    const char* kernel_name() const;
+
+    struct alignas(kBlockBytes) block_t {
+        uint64_t words[8];
+    };
+    using probe_fn = bool (*)(const block_t& block, uint64_t hash);
+
+private:
+    void reset();
+
+    std::unique_ptr<block_t[]> blocks_;
+    size_t block_count_ = 0;
+    size_t capacity_ = 0;
+    probe_fn probe_ = nullptr;
+    std::atomic<size_t> count_{0};
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint64_t> resets_{0};
+};
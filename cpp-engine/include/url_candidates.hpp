@@ -0,0 +1,98 @@
+#pragma once
+
+#include "hashed_key.hpp"
+#include "url_canonicalizer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// How much of a URL a blocklist entry covered, most specific first
+enum class MatchGranularity : uint8_t {
+    kNone = 0,
+    kUrl,       // the whole canonical URL
+    kPath,      // host + path without the query, or host + a directory prefix
+    kHost,      // the host
+    kDomain,    // a parent domain, down to the registrable domain
+    kIpPrefix,  // a network holding an IP-literal host (IpPrefixTable)
+    kPattern,   // a substring rule (PatternMatcher), not a candidate key
+};
+
+const char* granularity_name(MatchGranularity granularity);
+
+// Public suffix rules in the publicsuffix.org list format (plain,
+// "*.wildcard" and "!exception" rules), for finding where a host's
+// registrable domain starts. Rules are stored as hashes of their canonical
+// form, so IDN rules match punycoded hosts.
+class PublicSuffixTable {
+public:
+    // Every TLD (the list's implicit "*" rule) plus the multi-label ICANN
+    // suffixes and shared-hosting domains most blocklist hosts sit under,
+    // compiled in. Load the full list for complete coverage.
+    static const PublicSuffixTable& builtin();
+
+    bool add_rule(std::string_view rule);
+
+    // Adds every rule of a public_suffix_list.dat
+    bool load_from_file(const std::string& path);
+
+    // Offset in host (canonical, no port) where its registrable domain
+    // starts, or npos if host is a public suffix itself
+    size_t registrable_offset(std::string_view host) const;
+
+    size_t size() const { return rules_.size() + wildcards_.size() + exceptions_.size(); }
+
+private:
+    std::unordered_set<uint64_t> rules_;
+    std::unordered_set<uint64_t> wildcards_;    // "*.x" stored as x
+    std::unordered_set<uint64_t> exceptions_;   // "!x" stored as x
+};
+
+// The keys a hierarchical lookup probes for one URL, most specific first:
+//   kUrl     the canonical URL
+//   kPath    host + path without the query, then host + each directory
+//            prefix, deepest first
+//   kHost    the host
+//   kDomain  each parent domain, nearest first, down to the registrable one
+// Entries other than whole URLs carry no scheme or port: "evil.com" or
+// "evil.com/phish/" (HashedKey::of canonicalizes them to "evil.com/" and
+// "evil.com/phish/", the form of the candidates here). Parsing builds
+// everything in the object, without allocating; it is large (two URL
+// buffers), so keep one per thread or on the stack of a leaf function.
+class UrlCandidates {
+public:
+    static constexpr size_t kMaxPathPrefixes = 6;
+    static constexpr size_t kMaxParentDomains = 6;
+    static constexpr size_t kMaxCandidates = 3 + kMaxPathPrefixes + kMaxParentDomains;
+
+    UrlCandidates() = default;
+    UrlCandidates(const UrlCandidates&) = delete;
+    UrlCandidates& operator=(const UrlCandidates&) = delete;
+
+    // False if url does not canonicalize; the one candidate is then its
+    // raw bytes (as HashedKey::of hashes it)
+    bool parse(const char* url, size_t size, const PublicSuffixTable& suffixes = PublicSuffixTable::builtin());
+    bool parse(std::string_view url, const PublicSuffixTable& suffixes = PublicSuffixTable::builtin()) {
+        return parse(url.data(), url.size(), suffixes);
+    }
+
+    size_t size() const { return count_; }
+    const HashedKey* keys() const { return keys_; }
+    MatchGranularity granularity(size_t i) const { return granularities_[i]; }
+    std::string_view text(size_t i) const { return texts_[i]; }
+
+    // Host of the canonical URL, without port; empty if it did not parse
+    std::string_view host() const { return host_; }
+
+private:
+    void add(std::string_view text, MatchGranularity granularity);
+
+    char canonical_[kCanonicalUrlStackBytes];
+    char scoped_[kCanonicalUrlStackBytes];     // host + path, no scheme, port or query
+    HashedKey keys_[kMaxCandidates];
+    MatchGranularity granularities_[kMaxCandidates];
+    std::string_view texts_[kMaxCandidates];
+    std::string_view host_;
+    size_t count_ = 0;
+};
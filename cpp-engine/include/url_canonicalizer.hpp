@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Output buffer that fits the canonical form of any URL up to 1 KiB (every
+// byte escaped); HashedKey::of keeps one on the stack
+constexpr size_t kCanonicalUrlStackBytes = 4096;
+
+// Writes the canonical form of a URL to out, so spelling variants of one
+// address hash to one filter key:
+//   - scheme and host lowercased; userinfo, default port and fragment dropped
+//   - host: escapes decoded, empty labels (leading, trailing, repeated dots)
+//     dropped, non-ASCII labels case-folded and IDNA-encoded (xn--)
+//   - path: "/" if empty, repeated slashes collapsed, "." and ".." resolved,
+//     backslashes read as slashes
+//   - path and query: escapes of unreserved characters decoded, the rest in
+//     upper-case hex; spaces, controls and non-ASCII bytes escaped
+// Input without a scheme is taken as host[:port][/path]. Does not allocate.
+// False, with out unspecified, if the input is not a URL this handles (an
+// opaque scheme such as mailto:, no host, invalid UTF-8 or escapes in the
+// host) or out is too small.
+//
+// IDNA case folding covers ASCII, Latin-1, Latin Extended-A, Greek and
+// Cyrillic capitals; there is no Unicode normalization.
+bool canonicalize_url(const char* url, size_t size, char* out, size_t capacity, size_t& out_size);
+
+// Host of a canonical URL ([scheme://]host[:port]/path), without the port;
+// IPv6 literals keep their brackets
+std::string_view canonical_host(std::string_view canonical);
@@ -1,7 +1,19 @@
 #include "BinaryFuseWrapper.hpp"
+#include "fuse_layout.hpp"
+#include "fuse_build.hpp"
+#include "mapped_file.hpp"
+#include "fuse_simd.hpp"
+#include "epoch_reclaimer.hpp"
+#include "exact_set.hpp"
 #include <xxhash.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <memory>
 
@@ -10,83 +22,1031 @@
 #include <intrin.h>
 #endif
 
-// Include the actual binfuse headers
-#include "binfuse/filter.hpp"
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using l3_format::l3_file_header_t;
+using l3_format::l3_shard_desc_t;
 
-// Simple handle - store the filter directly
+// A handle either owns filters built in-process or views a mapped file.
+// The width-independent part lives here; the shards themselves are in
+// fuse_handle_t<fp_t> below, of which every handle is one.
+// exact is either empty or parallel to the shards.
 struct binfuse_handle_t {
-    binfuse::filter8 filter;
-    
-    // Constructor to properly initialize the filter
-    binfuse_handle_t(const std::vector<uint64_t>& keys) : filter(keys) {}
-    binfuse_handle_t(binfuse::filter8&& f) : filter(std::move(f)) {}
+    uint32_t fingerprint_bits = 8;
+    std::vector<exact_view_t> exact;
+    std::vector<uint64_t> shard_keys;      // keys per shard, for the file
+    uint32_t shard_bits = 0;
+    uint64_t key_count = 0;
+    std::vector<std::vector<uint64_t>> owned_exact;
+    MappedFile mapping;                    // open when loaded from disk or replicated
+
+    binfuse_handle_t() = default;
+    binfuse_handle_t(const binfuse_handle_t&) = delete;
+    binfuse_handle_t& operator=(const binfuse_handle_t&) = delete;
+    virtual ~binfuse_handle_t() = default;
+
+    size_t shard_count() const { return shard_keys.size(); }
+
+    bool has_exact() const { return !exact.empty(); }
+
+    bool verify(uint64_t key) const {
+        return exact_contains(exact[fuse_shard_index(key, shard_bits)], key);
+    }
+
+    // Takes ownership of sorted, unique per-shard key sets
+    void adopt_exact(std::vector<std::vector<uint64_t>> sets) {
+        owned_exact = std::move(sets);
+        exact.resize(owned_exact.size());
+        for (size_t s = 0; s < owned_exact.size(); ++s) {
+            exact[s] = {owned_exact[s].data(), owned_exact[s].size()};
+        }
+    }
 };
 
-BinaryFuseWrapper::BinaryFuseWrapper() : handle_(nullptr) {}
+// shards has 2^shard_bits entries; a key is answered by shards[top bits]
+template <typename fp_t>
+struct fuse_handle_t final : binfuse_handle_t {
+    std::vector<basic_fuse_view_t<fp_t>> shards;
+    std::vector<fuse_array_t<fp_t>> owned;   // arrays built/read in-process
+
+    fuse_handle_t() { fingerprint_bits = 8 * sizeof(fp_t); }
+
+    void resize(uint32_t bits) {
+        shard_bits = bits;
+        shards.assign(size_t{1} << bits, basic_fuse_view_t<fp_t>{});
+        shard_keys.assign(shards.size(), 0);
+    }
+
+    const basic_fuse_view_t<fp_t>& shard_for(uint64_t key) const {
+        return shards[fuse_shard_index(key, shard_bits)];
+    }
+
+    bool contains(uint64_t key) const {
+        return fuse_contains(shard_for(key), key) && (!has_exact() || verify(key));
+    }
+};
+
+namespace {
+
+// Calls fn with a value of the fingerprint type for bits (8, 16 or 32)
+template <typename Fn>
+decltype(auto) with_fingerprint_type(uint32_t bits, Fn&& fn) {
+    switch (bits) {
+    case 16: return fn(uint16_t{});
+    case 32: return fn(uint32_t{});
+    default: return fn(uint8_t{});
+    }
+}
+
+// Calls fn with h as the fuse_handle_t it is. Every branch runs fully
+// specialised code; this switch is the only per-call cost of the width.
+template <typename Fn>
+decltype(auto) visit(const binfuse_handle_t& h, Fn&& fn) {
+    switch (h.fingerprint_bits) {
+    case 16: return fn(static_cast<const fuse_handle_t<uint16_t>&>(h));
+    case 32: return fn(static_cast<const fuse_handle_t<uint32_t>&>(h));
+    default: return fn(static_cast<const fuse_handle_t<uint8_t>&>(h));
+    }
+}
+
+void sort_unique(std::vector<uint64_t>& keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+// Runs task(i) for i in [0, count) on up to num_threads threads
+template <typename Task>
+void run_parallel(size_t count, unsigned num_threads, Task&& task) {
+    const unsigned workers = static_cast<unsigned>(std::min<size_t>(num_threads, count));
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (unsigned t = 0; t < workers; ++t) {
+        threads.emplace_back([&] {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                task(i);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+// Optional cap on the input scans of a sharded build. 0 (the default) scans
+// once per wave of num_threads shards, so scratch memory holds about one
+// shard per thread; a cap widens the waves to shard_count / passes shards,
+// trading that memory for fewer scans.
+#ifndef LLAMASHIELD_MAX_SCATTER_PASSES
+#define LLAMASHIELD_MAX_SCATTER_PASSES 0
+#endif
+constexpr size_t kMaxScatterPasses = LLAMASHIELD_MAX_SCATTER_PASSES;
+
+uint32_t auto_shard_bits(size_t n) {
+    uint32_t bits = 0;
+    while (bits < 12 && (n >> bits) > BinaryFuseWrapper::kTargetShardKeys) ++bits;
+    return bits;
+}
+
+uint64_t header_checksum(const l3_file_header_t& header) {
+    return XXH3_64bits(&header, offsetof(l3_file_header_t, header_checksum));
+}
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// First array offset after the header and a table of shard_count entries
+uint64_t first_array_offset(size_t shard_count) {
+    return align_up(l3_format::kHeaderSize + shard_count * l3_format::kShardDescSize, l3_format::kArrayAlignment);
+}
+
+// First 64-byte boundary after an array of array_bytes and its gather padding
+uint64_t next_array_offset(uint64_t offset, uint64_t array_bytes) {
+    return align_up(offset + array_bytes + l3_format::kArrayPadding, l3_format::kArrayAlignment);
+}
+
+// Where the shard following desc may begin
+uint64_t next_shard_offset(const l3_shard_desc_t& desc, uint32_t fingerprint_bits) {
+    if (desc.exact_keys_offset == 0) {
+        return next_array_offset(desc.array_offset, uint64_t{desc.array_length} * fingerprint_bits / 8);
+    }
+    return align_up(desc.exact_keys_offset + desc.key_count * sizeof(uint64_t), l3_format::kArrayAlignment);
+}
+
+// Fingerprints first, then the exact keys (if any) seeded with that hash
+uint64_t shard_checksum(const void* fingerprints, uint64_t array_bytes, const exact_view_t* exact) {
+    const uint64_t checksum = XXH3_64bits(fingerprints, array_bytes);
+    return exact ? XXH3_64bits_withSeed(exact->keys, exact->count * sizeof(uint64_t), checksum) : checksum;
+}
+
+// exact may be null; otherwise its keys follow the fingerprint array
+template <typename fp_t>
+l3_shard_desc_t make_shard_desc(const basic_fuse_view_t<fp_t>& view, uint64_t key_count, uint64_t array_offset,
+                                const exact_view_t* exact = nullptr) {
+    const uint64_t array_bytes = uint64_t{view.array_length} * sizeof(fp_t);
+    l3_shard_desc_t desc{};
+    desc.seed = view.seed;
+    desc.segment_length = view.segment_length;
+    desc.segment_length_mask = view.segment_length_mask;
+    desc.segment_count = view.segment_length ? view.segment_count_length / view.segment_length : 0;
+    desc.segment_count_length = view.segment_count_length;
+    desc.array_length = view.array_length;
+    desc.key_count = key_count;
+    desc.array_offset = array_offset;
+    desc.array_checksum = shard_checksum(view.fingerprints, array_bytes, exact);
+    if (exact) {
+        desc.key_count = exact->count;
+        desc.exact_keys_offset = next_array_offset(array_offset, array_bytes);
+    }
+    return desc;
+}
+
+// Shard table and array offsets for a handle, in file order
+template <typename fp_t>
+std::vector<l3_shard_desc_t> make_shard_table(const fuse_handle_t<fp_t>& h) {
+    std::vector<l3_shard_desc_t> table(h.shards.size());
+    uint64_t offset = first_array_offset(table.size());
+    for (size_t s = 0; s < table.size(); ++s) {
+        table[s] = make_shard_desc(h.shards[s], h.shard_keys[s], offset, h.has_exact() ? &h.exact[s] : nullptr);
+        offset = next_shard_offset(table[s], h.fingerprint_bits);
+    }
+    return table;
+}
+
+l3_file_header_t make_header(uint32_t fingerprint_bits, uint32_t shard_bits, uint64_t key_count, uint32_t flags,
+                             const std::vector<l3_shard_desc_t>& table) {
+    l3_file_header_t header{};
+    std::memcpy(header.magic, l3_format::kMagic, sizeof(header.magic));
+    header.version = l3_format::kVersion;
+    header.fingerprint_bits = fingerprint_bits;
+    header.shard_bits = shard_bits;
+    header.shard_count = static_cast<uint32_t>(table.size());
+    header.key_count = key_count;
+    header.flags = flags;
+    header.shard_table_offset = l3_format::kHeaderSize;
+    header.shard_table_checksum = XXH3_64bits(table.data(), table.size() * sizeof(l3_shard_desc_t));
+    header.header_checksum = header_checksum(header);
+    return header;
+}
+
+// Flushes the (closed) file at path to disk, so renaming it over a target
+// never publishes a file whose contents a crash could still lose
+bool sync_file(const std::string& path) {
+#ifdef _WIN32
+    const int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    const bool ok = _commit(fd) == 0;
+    _close(fd);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    const bool ok = fsync(fd) == 0;
+    ::close(fd);
+#endif
+    return ok;
+}
+
+// Checks everything that can be checked without touching the shard table
+bool validate_header(const l3_file_header_t& header, uint64_t file_size) {
+    if (std::memcmp(header.magic, l3_format::kMagic, sizeof(header.magic)) != 0) {
+        std::cerr << "[BinaryFuseWrapper] Not an L3 filter file (bad magic)" << std::endl;
+        return false;
+    }
+    if (header.version != l3_format::kVersion ||
+        !BinaryFuseWrapper::is_supported_width(header.fingerprint_bits)) {
+        std::cerr << "[BinaryFuseWrapper] Unsupported L3 file version " << header.version
+                  << " / fingerprint bits " << header.fingerprint_bits << std::endl;
+        return false;
+    }
+    if (header.header_checksum != header_checksum(header)) {
+        std::cerr << "[BinaryFuseWrapper] L3 header checksum mismatch" << std::endl;
+        return false;
+    }
+    if (header.flags & ~l3_format::kKnownFlags) {
+        std::cerr << "[BinaryFuseWrapper] L3 file uses unknown features (flags "
+                  << header.flags << ")" << std::endl;
+        return false;
+    }
+    if (header.shard_bits > l3_format::kMaxShardBits ||
+        header.shard_count != (1u << header.shard_bits) ||
+        header.shard_table_offset < l3_format::kHeaderSize ||
+        header.shard_table_offset > file_size ||
+        uint64_t{header.shard_count} * l3_format::kShardDescSize > file_size - header.shard_table_offset) {
+        std::cerr << "[BinaryFuseWrapper] L3 header describes an invalid shard table" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Offsets are checked against file_size before anything is added to them,
+// so a corrupt descriptor cannot wrap around into range
+template <typename fp_t>
+bool validate_shard(const l3_shard_desc_t& desc, bool exact, uint64_t file_size) {
+    const uint64_t array_bytes = uint64_t{desc.array_length} * sizeof(fp_t);
+    const bool array_ok = desc.array_offset % l3_format::kArrayAlignment == 0 &&
+                          desc.array_offset <= file_size && array_bytes <= file_size - desc.array_offset;
+    const bool exact_ok = !exact ||
+        (desc.exact_keys_offset % l3_format::kArrayAlignment == 0 &&
+         desc.exact_keys_offset >= desc.array_offset + array_bytes &&
+         desc.exact_keys_offset <= file_size &&
+         desc.key_count <= (file_size - desc.exact_keys_offset) / sizeof(uint64_t));
+    if (desc.segment_length == 0 ||
+        desc.segment_length_mask != desc.segment_length - 1 ||
+        uint64_t{desc.segment_count_length} + 2ULL * desc.segment_length > desc.array_length ||
+        !array_ok ||
+        !exact_ok) {
+        std::cerr << "[BinaryFuseWrapper] L3 shard descriptor describes an invalid layout" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename fp_t>
+basic_fuse_view_t<fp_t> view_of(const l3_shard_desc_t& desc, const uint8_t* fingerprints) {
+    basic_fuse_view_t<fp_t> view;
+    view.seed = desc.seed;
+    view.segment_length = desc.segment_length;
+    view.segment_length_mask = desc.segment_length_mask;
+    view.segment_count_length = desc.segment_count_length;
+    view.array_length = desc.array_length;
+    view.fingerprints = reinterpret_cast<const fp_t*>(fingerprints);
+    view.gather_safe = false;
+    return view;
+}
+
+// One filter over keys[0, n); with exact, over a sorted unique copy that the
+// handle then keeps for verification
+template <typename fp_t>
+std::unique_ptr<binfuse_handle_t> build_single(const uint64_t* keys, size_t n, bool exact) {
+    auto h = std::make_unique<fuse_handle_t<fp_t>>();
+    h->resize(0);
+    h->owned.resize(1);
+
+    std::vector<std::vector<uint64_t>> exact_sets;
+    if (exact) {
+        exact_sets.emplace_back(keys, keys + n);
+        sort_unique(exact_sets[0]);
+        keys = exact_sets[0].data();
+        n = exact_sets[0].size();
+    }
+    if (!fuse_build(keys, n, h->owned[0])) {
+        return nullptr;
+    }
+
+    h->shards[0] = h->owned[0].view();
+    h->shard_keys[0] = n;
+    h->key_count = n;
+    if (!exact_sets.empty()) h->adopt_exact(std::move(exact_sets));
+    return h;
+}
+
+template <typename fp_t>
+std::unique_ptr<binfuse_handle_t> build_sharded_handle(const std::vector<uint64_t>& keys, uint32_t shard_bits,
+                                                       unsigned num_threads, bool exact) {
+    const size_t shard_count = size_t{1} << shard_bits;
+    const size_t n = keys.size();
+
+    // Pass 1: per-range shard histograms, so each thread can later scatter
+    // into its own precomputed slice without synchronisation
+    const size_t ranges = std::min<size_t>(num_threads, (n + 65535) / 65536);
+    const size_t range_len = (n + ranges - 1) / ranges;
+    std::vector<std::vector<size_t>> counts(ranges, std::vector<size_t>(shard_count, 0));
+    run_parallel(ranges, num_threads, [&](size_t r) {
+        const size_t end = std::min(n, (r + 1) * range_len);
+        for (size_t i = r * range_len; i < end; ++i) {
+            ++counts[r][fuse_shard_index(keys[i], shard_bits)];
+        }
+    });
+
+    auto h = std::make_unique<fuse_handle_t<fp_t>>();
+    h->resize(shard_bits);
+    h->owned.resize(shard_count);
+    h->key_count = n;
+    std::vector<std::vector<uint64_t>> exact_sets(exact ? shard_count : 0);
+    for (size_t s = 0; s < shard_count; ++s) {
+        for (size_t r = 0; r < ranges; ++r) h->shard_keys[s] += counts[r][s];
+    }
+
+    // Pass 2, one wave of shards at a time: scatter the wave's keys into
+    // per-shard buffers, build those shards, release the buffers. Each wave
+    // rescans the input; waves are only widened when the scans are capped.
+    const size_t passes = kMaxScatterPasses != 0 ? kMaxScatterPasses : shard_count;
+    const size_t wave = std::max<size_t>(num_threads, shard_count / passes);
+    std::atomic<bool> failed{false};
+    std::vector<std::vector<uint64_t>> buffers;
+    for (size_t first = 0; first < shard_count && !failed; first += wave) {
+        const size_t last = std::min(shard_count, first + wave);
+        buffers.assign(last - first, {});
+        for (size_t s = first; s < last; ++s) {
+            buffers[s - first].resize(h->shard_keys[s]);
+        }
+
+        std::vector<std::vector<size_t>> cursor(ranges, std::vector<size_t>(last - first, 0));
+        for (size_t s = first; s < last; ++s) {
+            size_t offset = 0;
+            for (size_t r = 0; r < ranges; ++r) {
+                cursor[r][s - first] = offset;
+                offset += counts[r][s];
+            }
+        }
+
+        run_parallel(ranges, num_threads, [&](size_t r) {
+            const size_t end = std::min(n, (r + 1) * range_len);
+            for (size_t i = r * range_len; i < end; ++i) {
+                const size_t s = fuse_shard_index(keys[i], shard_bits);
+                if (s < first || s >= last) continue;
+                buffers[s - first][cursor[r][s - first]++] = keys[i];
+            }
+        });
+
+        run_parallel(last - first, num_threads, [&](size_t i) {
+            std::vector<uint64_t>& shard = buffers[i];
+            if (exact) sort_unique(shard);
+            if (!fuse_build(shard.data(), shard.size(), h->owned[first + i])) {
+                failed = true;
+            }
+            if (exact) {
+                exact_sets[first + i] = std::move(shard);
+            } else {
+                std::vector<uint64_t>().swap(shard);
+            }
+        });
+    }
+
+    if (failed) {
+        std::cerr << "[BinaryFuseWrapper] Sharded build failed" << std::endl;
+        return nullptr;
+    }
+
+    for (size_t s = 0; s < shard_count; ++s) {
+        h->shards[s] = h->owned[s].view();
+    }
+    if (exact) {
+        // Duplicates were dropped, so the counts now reflect unique keys
+        h->key_count = 0;
+        for (size_t s = 0; s < shard_count; ++s) {
+            h->shard_keys[s] = exact_sets[s].size();
+            h->key_count += exact_sets[s].size();
+        }
+        h->adopt_exact(std::move(exact_sets));
+    }
+    return h;
+}
+
+// Filter over old's exact keys (old may be null: none) plus added minus
+// removed, both sorted. Each new shard merges the keys of its range
+// straight from old's shards, so only one shard per thread is copied
+// besides the exact sets the new filter keeps.
+template <typename fp_t>
+std::unique_ptr<binfuse_handle_t> merge_exact_handle(const binfuse_handle_t* old, const std::vector<uint64_t>& added,
+                                                     const std::vector<uint64_t>& removed, uint32_t shard_bits,
+                                                     unsigned num_threads) {
+    const size_t shard_count = size_t{1} << shard_bits;
+    auto h = std::make_unique<fuse_handle_t<fp_t>>();
+    h->resize(shard_bits);
+    h->owned.resize(shard_count);
+    std::vector<std::vector<uint64_t>> exact_sets(shard_count);
+
+    std::atomic<bool> failed{false};
+    run_parallel(shard_count, num_threads, [&](size_t s) {
+        // Shards split keys by their top bits: this one takes [lo, hi]
+        const uint64_t lo = shard_bits == 0 ? 0 : static_cast<uint64_t>(s) << (64 - shard_bits);
+        const uint64_t hi = lo | (~uint64_t{0} >> shard_bits);
+        auto in_range = [lo, hi](const uint64_t* first, const uint64_t* last) {
+            return std::make_pair(std::lower_bound(first, last, lo), std::upper_bound(first, last, hi));
+        };
+
+        std::vector<uint64_t> current;
+        if (old) {
+            for (uint32_t o = fuse_shard_index(lo, old->shard_bits); o <= fuse_shard_index(hi, old->shard_bits); ++o) {
+                const exact_view_t& set = old->exact[o];
+                const auto [first, last] = in_range(set.keys, set.keys + set.count);
+                current.insert(current.end(), first, last);
+            }
+        }
+        const auto [add_first, add_last] = in_range(added.data(), added.data() + added.size());
+        const auto [drop_first, drop_last] = in_range(removed.data(), removed.data() + removed.size());
+
+        std::vector<uint64_t> shard;
+        shard.reserve(current.size() + static_cast<size_t>(add_last - add_first));
+        std::set_union(current.begin(), current.end(), add_first, add_last, std::back_inserter(shard));
+        std::vector<uint64_t>().swap(current);
+        std::erase_if(shard, [&](uint64_t key) { return std::binary_search(drop_first, drop_last, key); });
+        shard.shrink_to_fit();
+
+        if (!fuse_build(shard.data(), shard.size(), h->owned[s])) {
+            failed = true;
+        }
+        exact_sets[s] = std::move(shard);
+    });
+    if (failed) {
+        std::cerr << "[BinaryFuseWrapper] Merge rebuild failed" << std::endl;
+        return nullptr;
+    }
+
+    h->key_count = 0;
+    for (size_t s = 0; s < shard_count; ++s) {
+        h->shards[s] = h->owned[s].view();
+        h->shard_keys[s] = exact_sets[s].size();
+        h->key_count += exact_sets[s].size();
+    }
+    h->adopt_exact(std::move(exact_sets));
+    return h;
+}
+
+template <typename fp_t>
+void contains_batch_impl(const fuse_handle_t<fp_t>& h, const uint64_t* keys, size_t n, uint8_t* out) {
+    if constexpr (sizeof(fp_t) == 1) {
+        // The SIMD kernels gather single bytes and cover unsharded 8-bit filters
+        if (h.shard_bits == 0) {
+            if (h.shards[0].gather_safe) {
+                fuse_best_kernel().fn(h.shards[0], keys, n, out);
+            } else {
+                fuse_contains_batch_scalar(h.shards[0], keys, n, out);
+            }
+            return;
+        }
+    }
+    fuse_contains_batch_sharded(h.shards.data(), h.shard_bits, keys, n, out);
+}
+
+// Points h at the shards of a mapped file
+template <typename fp_t>
+bool map_shards(fuse_handle_t<fp_t>& h, const std::vector<l3_shard_desc_t>& table, bool exact,
+                bool verify_checksum, const std::string& path) {
+    const MappedFile& file = h.mapping;
+    if (exact) h.exact.resize(table.size());
+    for (size_t s = 0; s < table.size(); ++s) {
+        const l3_shard_desc_t& desc = table[s];
+        if (!validate_shard<fp_t>(desc, exact, file.size())) {
+            return false;
+        }
+
+        const uint64_t array_bytes = uint64_t{desc.array_length} * sizeof(fp_t);
+        const uint8_t* fingerprints = file.data() + desc.array_offset;
+        if (exact) {
+            h.exact[s] = {reinterpret_cast<const uint64_t*>(file.data() + desc.exact_keys_offset), desc.key_count};
+        }
+        if (verify_checksum && shard_checksum(fingerprints, array_bytes, exact ? &h.exact[s] : nullptr) !=
+                                   desc.array_checksum) {
+            std::cerr << "[BinaryFuseWrapper] Fingerprint checksum mismatch in shard " << s << ": " << path << std::endl;
+            return false;
+        }
+
+        h.shards[s] = view_of<fp_t>(desc, fingerprints);
+        h.shards[s].gather_safe = kGatherPadding <= file.size() - desc.array_offset - array_bytes;
+        h.shard_keys[s] = desc.key_count;
+    }
+    return true;
+}
+
+template <typename fp_t>
+bool serialize_handle(const fuse_handle_t<fp_t>& h, std::ostream& out) {
+    const std::vector<l3_shard_desc_t> table = make_shard_table(h);
+    const l3_file_header_t header = make_header(h.fingerprint_bits, h.shard_bits, h.key_count,
+                                                h.has_exact() ? l3_format::kFlagExactKeys : 0, table);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(l3_shard_desc_t));
+
+    // Zero-fill up to each array's offset; this also provides the padding
+    // after the previous array
+    static const char zeros[l3_format::kArrayAlignment + l3_format::kArrayPadding] = {};
+    uint64_t position = l3_format::kHeaderSize + table.size() * sizeof(l3_shard_desc_t);
+    for (size_t s = 0; s < table.size(); ++s) {
+        const uint64_t array_bytes = uint64_t{table[s].array_length} * sizeof(fp_t);
+        out.write(zeros, static_cast<std::streamsize>(table[s].array_offset - position));
+        out.write(reinterpret_cast<const char*>(h.shards[s].fingerprints), static_cast<std::streamsize>(array_bytes));
+        position = table[s].array_offset + array_bytes;
+        if (h.has_exact()) {
+            const exact_view_t& exact = h.exact[s];
+            out.write(zeros, static_cast<std::streamsize>(table[s].exact_keys_offset - position));
+            out.write(reinterpret_cast<const char*>(exact.keys), static_cast<std::streamsize>(exact.count * sizeof(uint64_t)));
+            position = table[s].exact_keys_offset + exact.count * sizeof(uint64_t);
+        }
+    }
+    out.write(zeros, l3_format::kArrayPadding);
+    return out.good();
+}
+
+template <typename fp_t>
+std::unique_ptr<binfuse_handle_t> deserialize_handle(const l3_file_header_t& header,
+                                                     const std::vector<l3_shard_desc_t>& table, std::istream& in) {
+    const bool exact = header.flags & l3_format::kFlagExactKeys;
+    auto h = std::make_unique<fuse_handle_t<fp_t>>();
+    h->resize(header.shard_bits);
+    h->owned.resize(table.size());
+    h->key_count = header.key_count;
+    std::vector<std::vector<uint64_t>> exact_sets(exact ? table.size() : 0);
+
+    // Arrays are laid out in shard order, so they can be read front to back
+    uint64_t position = header.shard_table_offset + table.size() * sizeof(l3_shard_desc_t);
+    for (size_t s = 0; s < table.size(); ++s) {
+        const l3_shard_desc_t& desc = table[s];
+        if (!validate_shard<fp_t>(desc, exact, UINT64_MAX) || desc.array_offset < position) return nullptr;
+        in.ignore(static_cast<std::streamsize>(desc.array_offset - position));
+
+        fuse_array_t<fp_t>& filter = h->owned[s];
+        if (!filter.allocate(desc.array_length)) return nullptr;
+        if (!in.read(reinterpret_cast<char*>(filter.fingerprints), static_cast<std::streamsize>(filter.bytes()))) {
+            return nullptr;
+        }
+        position = desc.array_offset + filter.bytes();
+
+        if (exact) {
+            std::vector<uint64_t>& keys = exact_sets[s];
+            keys.resize(desc.key_count);
+            in.ignore(static_cast<std::streamsize>(desc.exact_keys_offset - position));
+            if (!in.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(uint64_t))) return nullptr;
+            position = desc.exact_keys_offset + keys.size() * sizeof(uint64_t);
+        }
+
+        const exact_view_t exact_view{exact ? exact_sets[s].data() : nullptr, exact ? exact_sets[s].size() : 0};
+        if (shard_checksum(filter.fingerprints, filter.bytes(), exact ? &exact_view : nullptr) != desc.array_checksum) {
+            std::cerr << "[adapter_deserialize] Fingerprint checksum mismatch in shard " << s << std::endl;
+            return nullptr;
+        }
+
+        filter.seed = desc.seed;
+        filter.segment_length = desc.segment_length;
+        filter.segment_length_mask = desc.segment_length_mask;
+        filter.segment_count_length = desc.segment_count_length;
+        h->shards[s] = filter.view();
+        h->shard_keys[s] = desc.key_count;
+    }
+    if (exact) h->adopt_exact(std::move(exact_sets));
+    return h;
+}
+
+template <typename fp_t>
+bool write_shards(std::ostream& out, uint32_t shard_bits, const BinaryFuseWrapper::shard_source_fn& source,
+                  unsigned num_threads, bool exact_keys, uint64_t& key_count, const std::string& path) {
+    // Header and table are written last, once every shard is known
+    static const char zeros[l3_format::kArrayAlignment + l3_format::kArrayPadding] = {};
+    const size_t shard_count = size_t{1} << shard_bits;
+    std::vector<l3_shard_desc_t> table(shard_count);
+    uint64_t position = 0;
+    uint64_t offset = first_array_offset(shard_count);
+    auto pad_to = [&](uint64_t target) {
+        while (position < target) {
+            const uint64_t chunk = std::min<uint64_t>(target - position, sizeof(zeros));
+            out.write(zeros, static_cast<std::streamsize>(chunk));
+            position += chunk;
+        }
+    };
+
+    std::vector<std::vector<uint64_t>> keys(num_threads);
+    std::vector<fuse_array_t<fp_t>> filters(num_threads);
+    for (size_t first = 0; first < shard_count; first += num_threads) {
+        const size_t last = std::min(shard_count, first + num_threads);
+
+        for (size_t s = first; s < last; ++s) {
+            keys[s - first].clear();
+            if (!source(static_cast<uint32_t>(s), keys[s - first])) {
+                std::cerr << "[BinaryFuseWrapper] Key source failed for shard " << s << std::endl;
+                return false;
+            }
+        }
+
+        std::atomic<bool> failed{false};
+        run_parallel(last - first, num_threads, [&](size_t i) {
+            if (exact_keys) sort_unique(keys[i]);
+            if (!fuse_build(keys[i].data(), keys[i].size(), filters[i])) failed = true;
+        });
+
+        for (size_t s = first; s < last && !failed; ++s) {
+            const fuse_array_t<fp_t>& filter = filters[s - first];
+            const std::vector<uint64_t>& shard = keys[s - first];
+            const exact_view_t exact{shard.data(), shard.size()};
+            table[s] = make_shard_desc(filter.view(), shard.size(), offset, exact_keys ? &exact : nullptr);
+            pad_to(offset);
+            out.write(reinterpret_cast<const char*>(filter.fingerprints), static_cast<std::streamsize>(filter.bytes()));
+            position += filter.bytes();
+            if (exact_keys) {
+                pad_to(table[s].exact_keys_offset);
+                out.write(reinterpret_cast<const char*>(shard.data()),
+                          static_cast<std::streamsize>(shard.size() * sizeof(uint64_t)));
+                position += shard.size() * sizeof(uint64_t);
+            }
+            offset = next_shard_offset(table[s], 8 * sizeof(fp_t));
+            key_count += shard.size();
+        }
+        for (size_t i = 0; i < last - first; ++i) {
+            filters[i].reset();
+            std::vector<uint64_t>().swap(keys[i]);
+        }
+        if (failed) {
+            std::cerr << "[BinaryFuseWrapper] Shard build failed while writing: " << path << std::endl;
+            return false;
+        }
+    }
+    pad_to(position + l3_format::kArrayPadding);
+
+    const l3_file_header_t header = make_header(8 * sizeof(fp_t), shard_bits, key_count,
+                                                exact_keys ? l3_format::kFlagExactKeys : 0, table);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(l3_shard_desc_t));
+    out.flush();
+    return out.good();
+}
+
+} // namespace
+
+BinaryFuseWrapper::BinaryFuseWrapper(uint32_t fingerprint_bits) : handle_(nullptr) {
+    if (!is_supported_width(fingerprint_bits)) {
+        std::cerr << "[BinaryFuseWrapper] Unsupported fingerprint width " << fingerprint_bits
+                  << ", using 8 bits" << std::endl;
+        fingerprint_bits = 8;
+    }
+    fingerprint_bits_ = fingerprint_bits;
+}
 
 BinaryFuseWrapper::~BinaryFuseWrapper() {
-    if (handle_) {
-        delete handle_;
+    // Destroying the wrapper while other threads still query it is a caller
+    // bug, so the last handle is freed directly rather than retired
+    if (binfuse_handle_t* h = handle_.exchange(nullptr)) {
+        adapter_free(h);
+    }
+}
+
+void BinaryFuseWrapper::publish(binfuse_handle_t* h) {
+    binfuse_handle_t* old = handle_.exchange(h);
+    if (!old) return;
+
+    EpochReclaimer& reclaimer = EpochReclaimer::global();
+    reclaimer.retire(old, [](void* p) { delete static_cast<binfuse_handle_t*>(p); });
+
+    // Old filters can be gigabytes; wait out the readers that may still hold
+    // it (lookups are nanoseconds) unless this thread is itself one of them
+    if (!reclaimer.in_critical_section()) {
+        reclaimer.synchronize();
     }
 }
 
 bool BinaryFuseWrapper::build_from_keys(const std::vector<uint64_t>& keys) {
-    if (handle_) {
-        delete handle_;
-        handle_ = nullptr;
+    if (keys.size() > kAutoShardThreshold) {
+        return build_sharded(keys, auto_shard_bits(keys.size()));
     }
-    
-    try {
-        // Use the constructor that takes keys directly
-        handle_ = new binfuse_handle_t(keys);
+
+    // An empty filter is represented by no handle; contains() then reports false
+    if (keys.empty()) {
+        publish(nullptr);
         return true;
-    } catch (const std::exception& e) {
-        std::cerr << "[BinaryFuseWrapper] Build failed: " << e.what() << std::endl;
+    }
+
+    // Build aside and swap in, so concurrent lookups never see a gap
+    binfuse_handle_t* h = nullptr;
+    if (!adapter_build(&h, keys.data(), keys.size())) {
         return false;
     }
+    publish(h);
+    return true;
+}
+
+bool BinaryFuseWrapper::build_sharded(const std::vector<uint64_t>& keys, uint32_t shard_bits, unsigned num_threads) {
+    if (shard_bits > l3_format::kMaxShardBits) {
+        std::cerr << "[BinaryFuseWrapper] shard_bits " << shard_bits << " exceeds "
+                  << l3_format::kMaxShardBits << std::endl;
+        return false;
+    }
+    if (shard_bits == 0 || keys.empty()) {
+        return build_from_keys(keys);
+    }
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::unique_ptr<binfuse_handle_t> h = with_fingerprint_type(fingerprint_bits_, [&](auto fp) {
+        return build_sharded_handle<decltype(fp)>(keys, shard_bits, num_threads, exact_verification_);
+    });
+    if (!h) {
+        return false;
+    }
+    publish(h.release());
+    return true;
+}
+
+bool BinaryFuseWrapper::rebuild_exact(const std::vector<uint64_t>& added, const std::vector<uint64_t>& removed,
+                                      unsigned num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::unique_ptr<binfuse_handle_t> h;
+    {
+        // Callers serialize builds, so old stays published while it is read
+        EpochGuard guard;
+        const binfuse_handle_t* old = handle_.load();
+        if (old && !old->has_exact()) {
+            std::cerr << "[BinaryFuseWrapper] Merge rebuild needs a filter with exact keys" << std::endl;
+            return false;
+        }
+
+        // Sharded as build_from_keys would shard the merged set, at most
+        const size_t bound = (old ? old->key_count : 0) + added.size();
+        const uint32_t shard_bits = bound > kAutoShardThreshold ? auto_shard_bits(bound) : 0;
+        h = with_fingerprint_type(old ? old->fingerprint_bits : fingerprint_bits_, [&](auto fp) {
+            return merge_exact_handle<decltype(fp)>(old, added, removed, shard_bits, num_threads);
+        });
+    }
+    if (!h) {
+        return false;
+    }
+    // An empty filter is represented by no handle, as in build_from_keys
+    if (h->key_count == 0) {
+        h.reset();
+    }
+    publish(h.release());
+    return true;
+}
+
+size_t BinaryFuseWrapper::key_count() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    return h ? h->key_count : 0;
 }
 
 bool BinaryFuseWrapper::contains(uint64_t key) const {
-    return handle_ ? handle_->filter.contains(key) : false;
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    return h ? adapter_contains(h, key) : false;
+}
+
+bool BinaryFuseWrapper::contains_batch(const uint64_t* keys, size_t n, uint8_t* out) const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    if (!h) {
+        std::fill(out, out + n, uint8_t{0});
+        return false;
+    }
+
+    visit(*h, [&](const auto& typed) { contains_batch_impl(typed, keys, n, out); });
+
+    // Hits are rare for most workloads, so verifying after the fact keeps
+    // the fingerprint pass fully vectorised
+    if (h->has_exact()) {
+        for (size_t i = 0; i < n; ++i) {
+            if (out[i]) out[i] = h->verify(keys[i]) ? 1 : 0;
+        }
+    }
+    return true;
+}
+
+size_t BinaryFuseWrapper::shard_count() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    return h ? h->shard_count() : 0;
+}
+
+uint32_t BinaryFuseWrapper::fingerprint_bits() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    return h ? h->fingerprint_bits : fingerprint_bits_;
+}
+
+bool BinaryFuseWrapper::has_exact_verification() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    return h ? h->has_exact() : exact_verification_;
+}
+
+bool BinaryFuseWrapper::get_exact_keys(std::vector<uint64_t>& keys) const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    if (!h || !h->has_exact()) return false;
+
+    // Shards split keys by their top bits, so in shard order the sorted
+    // sets concatenate sorted
+    keys.clear();
+    keys.reserve(h->key_count);
+    for (const exact_view_t& set : h->exact) keys.insert(keys.end(), set.keys, set.keys + set.count);
+    return true;
+}
+
+size_t BinaryFuseWrapper::get_memory_usage() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    if (!h) return 0;
+    return visit(*h, [](const auto& typed) {
+        size_t bytes = 0;
+        for (const auto& view : typed.shards) bytes += size_t{view.array_length} * sizeof(*view.fingerprints);
+        return bytes;
+    });
+}
+
+size_t BinaryFuseWrapper::get_verifier_memory_usage() const {
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    if (!h) return 0;
+    size_t bytes = 0;
+    for (const exact_view_t& keys : h->exact) bytes += keys.count * sizeof(uint64_t);
+    return bytes;
 }
 
 bool BinaryFuseWrapper::save_to_file(const std::string& path) const {
-    if (!handle_) return false;
-    
+    EpochGuard guard;
+    binfuse_handle_t* h = handle_.load();
+    if (!h) return false;
+
+    // Write next to the target, sync and rename, so processes that have the
+    // old file mapped never observe a partially written one, and a crash
+    // cannot leave the new name on unwritten data.
+    const std::string tmp_path = path + ".tmp";
     try {
-        std::ofstream out(path, std::ios::binary);
-        if (!out) return false;
-        
-        // For now, skip complex serialization - just create a marker file
-        out.write("BINFUSE_FILTER", 14);
-        std::cout << "[OK] Created placeholder filter file: " << path << std::endl;
-        return out.good();
-        
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            if (!adapter_serialize(h, out)) return false;
+            out.flush();
+            if (!out.good()) return false;
+        }
+        if (!sync_file(tmp_path)) {
+            std::cerr << "[BinaryFuseWrapper] Cannot sync " << tmp_path << std::endl;
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+        std::filesystem::rename(tmp_path, path);
+        std::cout << "[OK] Saved L3 filter (" << h->key_count << " keys, "
+                  << h->shard_count() << " shards) to: " << path << std::endl;
+        return true;
+
     } catch (const std::exception& e) {
         std::cerr << "[BinaryFuseWrapper] Save failed: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
         return false;
     }
 }
 
-bool BinaryFuseWrapper::load_from_file(const std::string& path) {
-    std::cout << "[INFO] Load from file skipped for now - using build_from_keys instead" << std::endl;
-    return false;
+bool BinaryFuseWrapper::load_from_file(const std::string& path, bool verify_checksum) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "[BinaryFuseWrapper] Cannot map filter file: " << path << std::endl;
+        return false;
+    }
+    return load_image(std::move(file), verify_checksum, path);
 }
 
-uint64_t BinaryFuseWrapper::hash_url(const std::string& url) {
-    return XXH3_64bits(url.data(), url.size());
+bool BinaryFuseWrapper::load_replica(const MappedFile& image, int numa_node, bool verify_checksum) {
+    const std::string source = "copy on NUMA node " + std::to_string(numa_node);
+    MappedFile copy;
+    if (!image.is_open() || !copy.open_copy(image.data(), image.size(), numa_node)) {
+        std::cerr << "[BinaryFuseWrapper] Cannot allocate L3 " << source << std::endl;
+        return false;
+    }
+    return load_image(std::move(copy), verify_checksum, source);
 }
 
-// Simplified adapter implementations
-bool BinaryFuseWrapper::adapter_build(binfuse_handle_t** out_handle, const uint64_t* keys, size_t n) {
+bool BinaryFuseWrapper::load_image(MappedFile&& file, bool verify_checksum, const std::string& source) {
+    if (file.size() < l3_format::kHeaderSize) {
+        std::cerr << "[BinaryFuseWrapper] Filter file too small: " << source << std::endl;
+        return false;
+    }
+
+    l3_file_header_t header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (!validate_header(header, file.size())) {
+        return false;
+    }
+
+    // The table is tiny, so its checksum is verified even when arrays are not
+    std::vector<l3_shard_desc_t> table(header.shard_count);
+    std::memcpy(table.data(), file.data() + header.shard_table_offset, table.size() * sizeof(l3_shard_desc_t));
+    if (XXH3_64bits(table.data(), table.size() * sizeof(l3_shard_desc_t)) != header.shard_table_checksum) {
+        std::cerr << "[BinaryFuseWrapper] L3 shard table checksum mismatch: " << source << std::endl;
+        return false;
+    }
+
+    // The width comes from the file, whatever this wrapper was built with
+    const bool exact = header.flags & l3_format::kFlagExactKeys;
+    std::unique_ptr<binfuse_handle_t> h = with_fingerprint_type(header.fingerprint_bits, [&](auto fp) {
+        auto typed = std::make_unique<fuse_handle_t<decltype(fp)>>();
+        typed->mapping = std::move(file);
+        typed->resize(header.shard_bits);
+        typed->key_count = header.key_count;
+        if (!map_shards(*typed, table, exact, verify_checksum, source)) typed.reset();
+        return std::unique_ptr<binfuse_handle_t>(std::move(typed));
+    });
+    if (!h) {
+        return false;
+    }
+
+    publish(h.release());
+
+    std::cout << "[OK] Mapped L3 filter (" << header.key_count << " keys, "
+              << header.shard_count << " shards, " << header.fingerprint_bits << "-bit"
+              << (exact ? ", exact keys" : "") << ") from: " << source << std::endl;
+    return true;
+}
+
+bool BinaryFuseWrapper::write_sharded_file(const std::string& path, uint32_t shard_bits,
+                                           const shard_source_fn& source, unsigned num_threads,
+                                           bool exact_keys, uint32_t fingerprint_bits) {
+    if (shard_bits > l3_format::kMaxShardBits) {
+        std::cerr << "[BinaryFuseWrapper] shard_bits " << shard_bits << " exceeds "
+                  << l3_format::kMaxShardBits << std::endl;
+        return false;
+    }
+    if (!is_supported_width(fingerprint_bits)) {
+        std::cerr << "[BinaryFuseWrapper] Unsupported fingerprint width " << fingerprint_bits << std::endl;
+        return false;
+    }
+    num_threads = std::max(1u, num_threads);
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    uint64_t key_count = 0;
     try {
-        std::vector<uint64_t> key_vec(keys, keys + n);
-        *out_handle = new binfuse_handle_t(key_vec);
-        return true;
+        bool written = with_fingerprint_type(fingerprint_bits, [&](auto fp) {
+            return write_shards<decltype(fp)>(out, shard_bits, source, num_threads, exact_keys, key_count, path);
+        });
+        out.close();
+        if (written && !sync_file(tmp_path)) {
+            std::cerr << "[BinaryFuseWrapper] Cannot sync " << tmp_path << std::endl;
+            written = false;
+        }
+        if (written) {
+            std::filesystem::rename(tmp_path, path);
+            std::cout << "[OK] Wrote L3 filter (" << key_count << " keys, " << (size_t{1} << shard_bits)
+                      << " shards, " << fingerprint_bits << "-bit" << (exact_keys ? ", exact keys" : "")
+                      << ") to: " << path << std::endl;
+            return true;
+        }
     } catch (const std::exception& e) {
-        std::cerr << "[adapter_build] Failed: " << e.what() << std::endl;
+        std::cerr << "[BinaryFuseWrapper] Write failed: " << e.what() << std::endl;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+}
+
+uint64_t BinaryFuseWrapper::hash_url(std::string_view url) {
+    return HashedKey::of(url).key;
+}
+
+bool BinaryFuseWrapper::adapter_build(binfuse_handle_t** out_handle, const uint64_t* keys, size_t n) {
+    std::unique_ptr<binfuse_handle_t> h = with_fingerprint_type(fingerprint_bits_, [&](auto fp) {
+        return build_single<decltype(fp)>(keys, n, exact_verification_);
+    });
+    if (!h) {
         return false;
     }
+    *out_handle = h.release();
+    return true;
 }
 
 bool BinaryFuseWrapper::adapter_free(binfuse_handle_t* h) {
@@ -95,15 +1055,27 @@ bool BinaryFuseWrapper::adapter_free(binfuse_handle_t* h) {
 }
 
 bool BinaryFuseWrapper::adapter_contains(binfuse_handle_t* h, uint64_t key) const {
-    return h->filter.contains(key);
+    return visit(*h, [key](const auto& typed) { return typed.contains(key); });
 }
 
 bool BinaryFuseWrapper::adapter_serialize(binfuse_handle_t* h, std::ostream& out) const {
-    std::cout << "[INFO] Serialization skipped for now" << std::endl;
-    return true; // Return true to indicate "success" for basic testing
+    return visit(*h, [&](const auto& typed) { return serialize_handle(typed, out); });
 }
 
 binfuse_handle_t* BinaryFuseWrapper::adapter_deserialize(std::istream& in) const {
-    std::cout << "[INFO] Deserialization skipped for now" << std::endl;
-    return nullptr;
-}
\ No newline at end of file
+    l3_file_header_t header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return nullptr;
+    if (!validate_header(header, UINT64_MAX)) return nullptr;
+
+    in.ignore(static_cast<std::streamsize>(header.shard_table_offset - l3_format::kHeaderSize));
+    std::vector<l3_shard_desc_t> table(header.shard_count);
+    if (!in.read(reinterpret_cast<char*>(table.data()), table.size() * sizeof(l3_shard_desc_t))) return nullptr;
+    if (XXH3_64bits(table.data(), table.size() * sizeof(l3_shard_desc_t)) != header.shard_table_checksum) {
+        std::cerr << "[adapter_deserialize] Shard table checksum mismatch" << std::endl;
+        return nullptr;
+    }
+
+    return with_fingerprint_type(header.fingerprint_bits, [&](auto fp) {
+        return deserialize_handle<decltype(fp)>(header, table, in);
+    }).release();
+}
@@ -1,74 +1,738 @@
 #include "MortonFilterWrapper.hpp"
-#include <iostream>
-#include <fstream>
+#include "fuse_layout.hpp"
+#include "epoch_reclaimer.hpp"
+#include "hashed_key.hpp"
+#include "prefetch.hpp"
+#include <xxhash.h>
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t kBucketsPerBlock = 32;
+constexpr uint32_t kBucketCapacity = 3;       // 2-bit fullness counters
+constexpr uint32_t kStorageBytes = 48;
+constexpr uint32_t kMaxKicks = 128;
+constexpr double kMaxLoadFactor = 0.90;
+
+// One cache line: bucket fullness counters, overflow bits and the packed
+// fingerprints of all 32 buckets (bucket 0 first).
+struct alignas(64) morton_block_t {
+    uint64_t fca;          // fullness counter array, 2 bits per bucket
+    uint16_t ota;          // overflow tracking array, bit (bucket % 16)
+    uint16_t used;         // occupied fingerprint slots
+    uint32_t version;      // seqlock: odd while a writer holds the block
+    uint8_t fsa[kStorageBytes];  // fingerprint storage array
+};
+static_assert(sizeof(morton_block_t) == 64, "Morton block must be one cache line");
+
+// Exclusive access to one block. Writers edit the block in place; readers
+// never lock, they copy it (read_block) and retry if the version moved.
+class block_write_guard {
+public:
+    explicit block_write_guard(morton_block_t& block) : version_(block.version) {
+        uint32_t v = version_.load(std::memory_order_relaxed);
+        while ((v & 1) || !version_.compare_exchange_weak(v, v + 1, std::memory_order_acquire,
+                                                          std::memory_order_relaxed)) {
+            std::this_thread::yield();
+            v = version_.load(std::memory_order_relaxed);
+        }
+        // Orders the odd version before the edits for readers (see read_block)
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    ~block_write_guard() { version_.fetch_add(1, std::memory_order_release); }
+
+    block_write_guard(const block_write_guard&) = delete;
+    block_write_guard& operator=(const block_write_guard&) = delete;
+
+private:
+    std::atomic_ref<uint32_t> version_;
+};
+
+// Consistent copy of a block that writers may be editing. One cache line,
+// so the copy costs about what probing the block in place would.
+inline void read_block(const morton_block_t& shared, morton_block_t& out) {
+    constexpr size_t kWords = sizeof(morton_block_t) / sizeof(uint64_t);
+    auto& block = const_cast<morton_block_t&>(shared);
+    auto* src = reinterpret_cast<uint64_t*>(&block);
+    auto* dst = reinterpret_cast<uint64_t*>(&out);
+    std::atomic_ref<uint32_t> version(block.version);
+
+    for (;;) {
+        const uint32_t before = version.load(std::memory_order_acquire);
+        if (!(before & 1)) {
+            for (size_t i = 0; i < kWords; ++i) {
+                dst[i] = std::atomic_ref<uint64_t>(src[i]).load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (version.load(std::memory_order_relaxed) == before) return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+struct location_t {
+    uint32_t block;
+    uint32_t bucket;
+    uint16_t fp;
+};
+
+// Offset of the alternate location: its block from the top bits, its
+// bucket (XOR) from the top five
+inline uint64_t alternate_hash(uint16_t fp) {
+    return (static_cast<uint64_t>(fp) + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t element_key(std::string_view element) {
+    return HashedKey::of(element).key;
+}
+
+inline uint32_t bucket_count(const morton_block_t& b, uint32_t bucket) {
+    return static_cast<uint32_t>(b.fca >> (2 * bucket)) & 3;
+}
+
+// Slot index of the first fingerprint of a bucket: sum of preceding counters
+inline uint32_t bucket_start(const morton_block_t& b, uint32_t bucket) {
+    if (bucket == 0) return 0;
+    uint64_t below = b.fca & (~0ULL >> (64 - 2 * bucket));
+    return static_cast<uint32_t>(std::popcount(below & 0x5555555555555555ULL) +
+                                 2 * std::popcount(below & 0xAAAAAAAAAAAAAAAAULL));
+}
+
+} // namespace
 
-// Simple stub implementation - no external dependencies
 struct morton_handle_t {
-    std::vector<std::string> elements;
-    size_t capacity;
+    std::vector<morton_block_t> blocks;
+    uint32_t fp_bytes = 1;
+    uint32_t slots_per_block = kStorageBytes;
+    uint16_t fp_mask = 0xFF;
+    std::atomic<size_t> count{0};
+    size_t capacity = 0;
+    double false_positive_rate = 0.0;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+    // Odd while a displacement chain moves entries between blocks. An entry
+    // in flight is briefly in neither block, so a negative lookup that saw
+    // this change retries.
+    std::atomic<uint64_t> moves{0};
+
+    uint16_t slot(const morton_block_t& b, uint32_t i) const {
+        if (fp_bytes == 1) return b.fsa[i];
+        return static_cast<uint16_t>(b.fsa[2 * i] | (b.fsa[2 * i + 1] << 8));
+    }
+
+    void set_slot(morton_block_t& b, uint32_t i, uint16_t fp) const {
+        if (fp_bytes == 1) {
+            b.fsa[i] = static_cast<uint8_t>(fp);
+        } else {
+            b.fsa[2 * i] = static_cast<uint8_t>(fp);
+            b.fsa[2 * i + 1] = static_cast<uint8_t>(fp >> 8);
+        }
+    }
+
+    location_t locate(uint64_t key) const {
+        return {static_cast<uint32_t>(fuse_mulhi(key, blocks.size())),
+                static_cast<uint32_t>(key & (kBucketsPerBlock - 1)),
+                static_cast<uint16_t>((key >> 8) & fp_mask)};
+    }
+
+    // Involution: alternate(alternate(x)) == x, so a displaced entry can
+    // always find its way back without knowing which side it started on.
+    location_t alternate(const location_t& loc) const {
+        uint64_t h = alternate_hash(loc.fp);
+        uint64_t n = blocks.size();
+        uint64_t offset = fuse_mulhi(h, n);
+        uint64_t alt = offset >= loc.block ? offset - loc.block : offset + n - loc.block;
+        return {static_cast<uint32_t>(alt),
+                loc.bucket ^ static_cast<uint32_t>(h >> 59),
+                loc.fp};
+    }
+
+    int find(const morton_block_t& b, uint32_t bucket, uint16_t fp) const {
+        uint32_t start = bucket_start(b, bucket);
+        uint32_t n = bucket_count(b, bucket);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (slot(b, start + i) == fp) return static_cast<int>(start + i);
+        }
+        return -1;
+    }
+
+    bool block_insert(morton_block_t& b, uint32_t bucket, uint16_t fp) const {
+        uint32_t n = bucket_count(b, bucket);
+        if (n == kBucketCapacity || b.used == slots_per_block) return false;
+
+        uint32_t pos = bucket_start(b, bucket) + n;
+        std::memmove(b.fsa + (pos + 1) * fp_bytes, b.fsa + pos * fp_bytes, (b.used - pos) * fp_bytes);
+        set_slot(b, pos, fp);
+        b.fca += 1ULL << (2 * bucket);
+        ++b.used;
+        return true;
+    }
+
+    void block_erase(morton_block_t& b, uint32_t bucket, uint32_t pos) const {
+        std::memmove(b.fsa + pos * fp_bytes, b.fsa + (pos + 1) * fp_bytes, (b.used - pos - 1) * fp_bytes);
+        b.fca -= 1ULL << (2 * bucket);
+        --b.used;
+    }
+
+    static void mark_overflow(morton_block_t& b, uint32_t bucket) {
+        b.ota |= static_cast<uint16_t>(1u << (bucket & 15));
+    }
+
+    // Lock-free; safe alongside any writer
+    bool lookup(uint64_t key) const {
+        location_t loc = locate(key);
+        morton_block_t b{};
+        for (;;) {
+            const uint64_t moves_before = moves.load(std::memory_order_acquire);
+            read_block(blocks[loc.block], b);
+            if (find(b, loc.bucket, loc.fp) >= 0) return true;
+            if (b.ota & (1u << (loc.bucket & 15))) {
+                location_t alt = alternate(loc);
+                read_block(blocks[alt.block], b);
+                if (find(b, alt.bucket, alt.fp) >= 0) return true;
+            }
+            // Hits are always genuine; only a miss can be an artifact of a move
+            if (!(moves_before & 1) && moves.load(std::memory_order_acquire) == moves_before) return false;
+            std::this_thread::yield();
+        }
+    }
+
+    uint32_t next_random() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return static_cast<uint32_t>(rng);
+    }
+
+    // Stores the key in its primary or alternate bucket if either has room.
+    // Never moves other entries, so any number of callers may place and
+    // erase concurrently.
+    bool place(uint64_t key) {
+        location_t loc = locate(key);
+        {
+            block_write_guard guard(blocks[loc.block]);
+            if (block_insert(blocks[loc.block], loc.bucket, loc.fp)) return true;
+            mark_overflow(blocks[loc.block], loc.bucket);
+        }
+        location_t alt = alternate(loc);
+        block_write_guard guard(blocks[alt.block]);
+        return block_insert(blocks[alt.block], alt.bucket, alt.fp);
+    }
+
+    // place() plus displacement; the caller must exclude every other writer
+    bool insert_key(uint64_t key);
+
+    bool erase_key(uint64_t key) {
+        location_t loc = locate(key);
+        {
+            morton_block_t& b = blocks[loc.block];
+            block_write_guard guard(b);
+            int pos = find(b, loc.bucket, loc.fp);
+            if (pos >= 0) {
+                block_erase(b, loc.bucket, static_cast<uint32_t>(pos));
+                return true;
+            }
+            // Overflow bits are shared by buckets and cannot be cleared safely;
+            // a stale bit only costs an extra probe
+            if (!(b.ota & (1u << (loc.bucket & 15)))) return false;
+        }
+
+        location_t alt = alternate(loc);
+        morton_block_t& a = blocks[alt.block];
+        block_write_guard guard(a);
+        int pos = find(a, alt.bucket, alt.fp);
+        if (pos < 0) return false;
+        block_erase(a, alt.bucket, static_cast<uint32_t>(pos));
+        return true;
+    }
+};
+
+bool morton_handle_t::insert_key(uint64_t key) {
+    if (place(key)) return true;
+    location_t loc = locate(key);
+    location_t alt = alternate(loc);
+
+    // Lookups retry negatives that overlap the chain (see moves)
+    struct moving_t {
+        std::atomic<uint64_t>& moves;
+        explicit moving_t(std::atomic<uint64_t>& m) : moves(m) { moves.fetch_add(1); }
+        ~moving_t() { moves.fetch_add(1, std::memory_order_release); }
+    } moving(moves);
+
+    // Both candidates full: displace entries cuckoo-style, keeping an undo
+    // log so a failed insert leaves every existing entry in place.
+    struct kick_t {
+        location_t placed;
+        location_t evicted;
+    };
+    std::vector<kick_t> kicks;
+    location_t pending = (next_random() & 1) ? loc : alt;
+
+    for (uint32_t k = 0; k < kMaxKicks; ++k) {
+        location_t evicted;
+        {
+            morton_block_t& b = blocks[pending.block];
+            block_write_guard guard(b);
+
+            // Evict from the target bucket if it is full, otherwise free any slot
+            uint32_t victim_bucket = pending.bucket;
+            if (bucket_count(b, victim_bucket) < kBucketCapacity) {
+                uint32_t first = next_random() & (kBucketsPerBlock - 1);
+                for (uint32_t i = 0; i < kBucketsPerBlock; ++i) {
+                    uint32_t candidate = (first + i) & (kBucketsPerBlock - 1);
+                    if (bucket_count(b, candidate) > 0) {
+                        victim_bucket = candidate;
+                        break;
+                    }
+                }
+            }
+
+            uint32_t pos = bucket_start(b, victim_bucket) + next_random() % bucket_count(b, victim_bucket);
+            evicted = {pending.block, victim_bucket, slot(b, pos)};
+            block_erase(b, victim_bucket, pos);
+            block_insert(b, pending.bucket, pending.fp);
+            mark_overflow(b, evicted.bucket);
+        }
+        kicks.push_back({pending, evicted});
+
+        location_t next = alternate(evicted);
+        {
+            block_write_guard guard(blocks[next.block]);
+            if (block_insert(blocks[next.block], next.bucket, next.fp)) return true;
+        }
+        pending = next;
+    }
+
+    for (auto it = kicks.rbegin(); it != kicks.rend(); ++it) {
+        morton_block_t& b = blocks[it->placed.block];
+        block_write_guard guard(b);
+        block_erase(b, it->placed.bucket, static_cast<uint32_t>(find(b, it->placed.bucket, it->placed.fp)));
+        block_insert(b, it->evicted.bucket, it->evicted.fp);
+    }
+    return false;
+}
+
+namespace {
+
+constexpr char kMortonMagic[8] = {'L', 'S', 'H', 'M', 'R', 'T', 'N', '\0'};
+// Version 5: keys are the low half of XXH3-128 (HashedKey) of the canonical
+// URL. Version 4 files hash URLs as given and earlier ones hold
+// fingerprints of XXH3-64 keys; neither is read.
+constexpr uint32_t kMortonVersion = 5;
+constexpr uint32_t kMaxGenerations = 255;
+
+// Growth: each appended sub-filter holds twice the previous one's capacity
+// at half its FPR, so the compound FPR stays below 2x the first one's
+constexpr uint32_t kMaxStages = 16;
+constexpr size_t kStageGrowth = 2;
+constexpr double kStageTightening = 0.5;
+
+// Followed by stage_count morton_stage_desc_t, then the block arrays in
+// the same order: oldest generation and smallest sub-filter first
+struct morton_file_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t fingerprint_bits;  // of the first sub-filter
+    uint64_t block_count;       // likewise
+    uint64_t count;
+    uint64_t capacity;
     double false_positive_rate;
+    uint64_t checksum;          // XXH3-64 of the stage table, chained as seed through each block array
+    uint32_t generations;
+    uint32_t stage_count;
+    int64_t ttl_ms;
 };
 
-MortonFilterWrapper::MortonFilterWrapper() : handle_(nullptr) {}
+struct morton_stage_desc_t {
+    uint32_t generation;
+    uint32_t fingerprint_bits;
+    uint64_t block_count;
+    uint64_t count;
+    uint64_t capacity;
+    double false_positive_rate;
+};
+
+// Expected false positive rate at load factor L: a negative probe compares
+// against the entries of at most two buckets of S*L/32 fingerprints each.
+double estimated_fpr(uint32_t fp_bits, uint32_t slots, double load) {
+    return 2.0 * load * slots / (kBucketsPerBlock * std::ldexp(1.0, fp_bits));
+}
 
-MortonFilterWrapper::~MortonFilterWrapper() {
-    if (handle_) {
-        delete handle_;
+// Empty filter for capacity elements at the requested FPR
+std::shared_ptr<morton_handle_t> make_handle(size_t capacity, double false_positive_rate) {
+    // Pick the fingerprint width and target load that reach the requested
+    // FPR with the fewest bytes per element.
+    uint32_t best_bits = 8;
+    double best_load = 0.0;
+    double best_bytes = 0.0;
+    for (uint32_t bits : {8u, 16u}) {
+        uint32_t slots = kStorageBytes / (bits / 8);
+        double load = std::min(kMaxLoadFactor, false_positive_rate / estimated_fpr(bits, slots, 1.0));
+        double bytes = sizeof(morton_block_t) / (slots * load);
+        if (best_load == 0.0 || bytes < best_bytes) {
+            best_bits = bits;
+            best_load = load;
+            best_bytes = bytes;
+        }
     }
+
+    auto handle = std::make_shared<morton_handle_t>();
+    handle->fp_bytes = best_bits / 8;
+    handle->slots_per_block = kStorageBytes / handle->fp_bytes;
+    handle->fp_mask = static_cast<uint16_t>((1u << best_bits) - 1);
+    handle->capacity = capacity;
+    handle->false_positive_rate = false_positive_rate;
+
+    size_t per_block = std::max<size_t>(1, static_cast<size_t>(handle->slots_per_block * best_load));
+    size_t block_count = std::max<size_t>(2, (capacity + per_block - 1) / per_block);
+    handle->blocks.assign(block_count, morton_block_t{});
+    return handle;
 }
 
+} // namespace
+
+// Sub-filters of one generation, first and smallest first. Immutable once
+// published; growth and reclamation publish a new list and retire this one.
+struct morton_stages_t {
+    std::vector<std::shared_ptr<morton_handle_t>> stages;
+
+    bool lookup(uint64_t key) const {
+        for (const auto& stage : stages) {
+            if (stage->count.load(std::memory_order_relaxed) > 0 && stage->lookup(key)) return true;
+        }
+        return false;
+    }
+};
+
+struct morton_generation_t {
+    std::atomic<morton_stages_t*> current{nullptr};
+
+    explicit morton_generation_t(std::shared_ptr<morton_handle_t> first)
+        : current(new morton_stages_t{{std::move(first)}}) {}
+    explicit morton_generation_t(morton_stages_t* stages) : current(stages) {}
+    ~morton_generation_t() { delete current.load(std::memory_order_relaxed); }
+
+    // Stable while the caller holds write_mutex_ (shared suffices) or an
+    // EpochGuard
+    const morton_stages_t& stages() const { return *current.load(std::memory_order_acquire); }
+
+    // Caller holds write_mutex_ exclusively; lookups in flight keep the old
+    // list until they leave their EpochGuard
+    void publish(morton_stages_t* next) {
+        morton_stages_t* old = current.exchange(next, std::memory_order_acq_rel);
+        EpochReclaimer::global().retire(old, [](void* p) { delete static_cast<morton_stages_t*>(p); });
+    }
+
+    size_t count() const {
+        size_t n = 0;
+        for (const auto& stage : stages().stages) n += stage->count.load(std::memory_order_relaxed);
+        return n;
+    }
+};
+
+MortonFilterWrapper::MortonFilterWrapper() = default;
+
+MortonFilterWrapper::~MortonFilterWrapper() = default;
+
 bool MortonFilterWrapper::initialize(size_t capacity, double false_positive_rate) {
-    if (handle_) {
-        delete handle_;
-        handle_ = nullptr;
-    }
-    
-    handle_ = new morton_handle_t{};
-    handle_->capacity = capacity;
-    handle_->false_positive_rate = false_positive_rate;
-    
-    std::cout << "[MortonFilter] Stub implementation initialized with capacity: " 
-              << capacity << ", FPR: " << false_positive_rate << std::endl;
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    generations_.clear();
+    active_ = 0;
+    ttl_ = std::chrono::milliseconds{0};
+    interval_ = std::chrono::steady_clock::duration{0};
+
+    if (capacity == 0 || !(false_positive_rate > 0.0)) {
+        std::cerr << "[MortonFilter] Invalid capacity/FPR: " << capacity
+                  << ", " << false_positive_rate << std::endl;
+        return false;
+    }
+
+    auto handle = make_handle(capacity, false_positive_rate);
+    std::cout << "[MortonFilter] Initialized with capacity: " << capacity
+              << ", FPR: " << false_positive_rate << " (" << handle->blocks.size() << " blocks, "
+              << handle->fp_bytes * 8 << "-bit fingerprints)" << std::endl;
+
+    generations_.push_back(std::make_unique<morton_generation_t>(std::move(handle)));
+    capacity_ = capacity;
+    false_positive_rate_ = false_positive_rate;
     return true;
 }
 
-bool MortonFilterWrapper::insert(const std::string& element) {
-    if (!handle_) return false;
-    
-    // Simple check to avoid duplicates
-    auto it = std::find(handle_->elements.begin(), handle_->elements.end(), element);
-    if (it == handle_->elements.end()) {
-        handle_->elements.push_back(element);
-        return true;
+bool MortonFilterWrapper::initialize(size_t capacity, double false_positive_rate,
+                                     std::chrono::milliseconds ttl, uint32_t generations) {
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    generations_.clear();
+    active_ = 0;
+    ttl_ = std::chrono::milliseconds{0};
+    interval_ = std::chrono::steady_clock::duration{0};
+
+    if (capacity == 0 || !(false_positive_rate > 0.0) || ttl.count() <= 0 ||
+        generations < 2 || generations > kMaxGenerations) {
+        std::cerr << "[MortonFilter] Invalid capacity/FPR/TTL/generations: " << capacity
+                  << ", " << false_positive_rate << ", " << ttl.count() << " ms, "
+                  << generations << std::endl;
+        return false;
+    }
+
+    const size_t per_generation = (capacity + generations - 1) / generations;
+    for (uint32_t g = 0; g < generations; ++g) {
+        generations_.push_back(std::make_unique<morton_generation_t>(
+            make_handle(per_generation, false_positive_rate)));
+    }
+    capacity_ = capacity;
+    false_positive_rate_ = false_positive_rate;
+    ttl_ = ttl;
+    interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(ttl) / static_cast<int64_t>(generations - 1);
+    rotated_at_.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+
+    const morton_handle_t& handle = *generations_.front()->stages().stages.front();
+    std::cout << "[MortonFilter] Initialized with capacity: " << capacity
+              << ", FPR: " << false_positive_rate << ", TTL: " << ttl.count() << " ms ("
+              << generations << " generations of " << handle.blocks.size() << " blocks, "
+              << handle.fp_bytes * 8 << "-bit fingerprints)" << std::endl;
+    return true;
+}
+
+bool MortonFilterWrapper::insert(std::string_view element) {
+    return insert_key(element_key(element));
+}
+
+bool MortonFilterWrapper::contains(std::string_view element) const {
+    return contains_key(element_key(element));
+}
+
+bool MortonFilterWrapper::remove(std::string_view element) {
+    return remove_key(element_key(element));
+}
+
+bool MortonFilterWrapper::insert_key(uint64_t key, bool* stored) {
+    if (stored) *stored = false;
+    expire();
+
+    // Common case: room in one of the key's two buckets of the newest
+    // sub-filter. Inserters share the lock and serialize only per block.
+    {
+        std::shared_lock<std::shared_mutex> lock(write_mutex_);
+        if (generations_.empty()) return false;
+        const morton_stages_t& active = generations_[active_]->stages();
+
+        // Simple check to avoid duplicates: the fingerprint is already there,
+        // so the key is reported from now on and the insert succeeded. A
+        // copy in an older generation does not count: re-inserting refreshes
+        // the entry's lifetime. Two threads inserting the same key at the
+        // same moment may both store it.
+        if (active.lookup(key)) return true;
+        morton_handle_t& newest = *active.stages.back();
+        if (newest.count.load(std::memory_order_relaxed) < newest.capacity && newest.place(key)) {
+            newest.count.fetch_add(1, std::memory_order_relaxed);
+            if (stored) *stored = true;
+            return true;
+        }
+    }
+
+    // Displacement moves other entries, and growth swaps the list; both run
+    // alone
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    if (generations_.empty()) return false;
+    morton_generation_t& generation = *generations_[active_];
+    if (generation.stages().lookup(key)) return true;
+
+    morton_handle_t* newest = generation.stages().stages.back().get();
+    if (newest->count.load(std::memory_order_relaxed) >= newest->capacity || !newest->insert_key(key)) {
+        // Full, or displacement could not make room: move on to a new
+        // sub-filter, which always has room for its first key
+        if (!grow(generation)) return false;
+        newest = generation.stages().stages.back().get();
+        if (!newest->insert_key(key)) return false;
+    }
+    newest->count.fetch_add(1, std::memory_order_relaxed);
+    if (stored) *stored = true;
+    return true;
+}
+
+// Appends a sub-filter to the generation. Caller holds write_mutex_
+// exclusively.
+bool MortonFilterWrapper::grow(morton_generation_t& generation) {
+    const morton_stages_t& current = generation.stages();
+    if (current.stages.size() >= kMaxStages) {
+        std::cerr << "[MortonFilter] Sub-filter limit reached (" << kMaxStages
+                  << "); insert rejected" << std::endl;
+        return false;
+    }
+
+    const morton_handle_t& last = *current.stages.back();
+    auto next = std::make_unique<morton_stages_t>(current);
+    next->stages.push_back(make_handle(last.capacity * kStageGrowth,
+                                       last.false_positive_rate * kStageTightening));
+    const morton_handle_t& added = *next->stages.back();
+    std::cout << "[MortonFilter] Grew to " << next->stages.size() << " sub-filters (+"
+              << added.capacity << " capacity, FPR " << added.false_positive_rate << ", "
+              << added.fp_bytes * 8 << "-bit fingerprints)" << std::endl;
+    generation.publish(next.release());
+    return true;
+}
+
+bool MortonFilterWrapper::consolidate(const std::vector<uint64_t>& keys) {
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    if (generations_.size() != 1) return false;
+
+    // Headroom so the merged filter does not have to grow again right away
+    auto merged = make_handle(std::max(capacity_, keys.size() * kStageGrowth), false_positive_rate_);
+    for (uint64_t key : keys) {
+        if (merged->lookup(key)) continue;
+        if (!merged->insert_key(key)) {
+            std::cerr << "[MortonFilter] Consolidation failed; sub-filters left in place" << std::endl;
+            return false;
+        }
+        merged->count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const size_t before = generations_.front()->stages().stages.size();
+    generations_.front()->publish(new morton_stages_t{{std::move(merged)}});
+    std::cout << "[MortonFilter] Consolidated " << before << " sub-filters into one ("
+              << get_count() << " elements)" << std::endl;
+    return true;
+}
+
+// Sharing an entry takes the same fingerprint, so the same key bits 8-15 at
+// either width, and the same bucket pair: the key's own bucket, or the
+// partner its alternate location XORs in at 8 or at 16 bits.
+std::array<uint32_t, 3> MortonFilterWrapper::collision_classes(uint64_t key) {
+    static_assert(kCollisionClasses == 256 * kBucketsPerBlock, "one class per low fingerprint byte and bucket");
+    const uint32_t bucket = static_cast<uint32_t>(key & (kBucketsPerBlock - 1));
+    const uint32_t low_byte = static_cast<uint32_t>((key >> 8) & 0xFF);
+    auto partner = [&](uint16_t fp_mask) {
+        return bucket ^ static_cast<uint32_t>(alternate_hash(static_cast<uint16_t>((key >> 8) & fp_mask)) >> 59);
+    };
+    return {low_byte * kBucketsPerBlock + bucket,
+            low_byte * kBucketsPerBlock + partner(0xFF),
+            low_byte * kBucketsPerBlock + partner(0xFFFF)};
+}
+
+bool MortonFilterWrapper::contains_key(uint64_t key) const {
+    EpochGuard guard;
+    for (const auto& generation : generations_) {
+        if (generation->stages().lookup(key)) return true;
     }
     return false;
 }
 
-bool MortonFilterWrapper::contains(const std::string& element) const {
-    if (!handle_) return false;
-    
-    return std::find(handle_->elements.begin(), handle_->elements.end(), element) != handle_->elements.end();
+void MortonFilterWrapper::prefetch(const uint64_t* keys, size_t n) const {
+    EpochGuard guard;
+    for (const auto& generation : generations_) {
+        for (const auto& stage : generation->stages().stages) {
+            if (stage->count.load(std::memory_order_relaxed) == 0) continue;
+            for (size_t i = 0; i < n; ++i) {
+                prefetch_read(&stage->blocks[stage->locate(keys[i]).block]);
+            }
+        }
+    }
+}
+
+bool MortonFilterWrapper::remove_key(uint64_t key) {
+    std::shared_lock<std::shared_mutex> lock(write_mutex_);
+    bool removed = false;
+    for (const auto& generation : generations_) {
+        for (const auto& stage : generation->stages().stages) {
+            if (stage->count.load(std::memory_order_relaxed) > 0 && stage->erase_key(key)) {
+                stage->count.fetch_sub(1, std::memory_order_relaxed);
+                removed = true;
+            }
+        }
+    }
+    return removed;
+}
+
+size_t MortonFilterWrapper::expire() {
+    // interval_, capacity_ and the ring size only change in initialize/load,
+    // which exclude all callers
+    if (interval_.count() == 0) return 0;
+
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - rotated_at_.load(std::memory_order_relaxed);
+    if (elapsed < interval_) return 0;
+
+    // The empty filters that replace the reclaimed generations are built
+    // before taking the lock, so writers only wait for the pointer swaps
+    const size_t n = generations_.size();
+    std::vector<std::unique_ptr<morton_stages_t>> fresh(
+        std::min<size_t>(static_cast<size_t>(elapsed / interval_), n));
+    for (auto& stages : fresh) {
+        stages.reset(new morton_stages_t{{make_handle((capacity_ + n - 1) / n, false_positive_rate_)}});
+    }
+
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    const auto rotated_at = rotated_at_.load(std::memory_order_relaxed);
+    elapsed = now - rotated_at;
+    if (elapsed < interval_) return 0;
+
+    const auto steps = elapsed / interval_;
+    rotated_at_.store(rotated_at + steps * interval_, std::memory_order_relaxed);
+    // Another caller may have rotated meanwhile, leaving fewer steps
+    fresh.resize(std::min<size_t>(static_cast<size_t>(steps), fresh.size()));
+    return rotate(std::move(fresh));
+}
+
+// Each step reclaims the oldest generation wholesale and makes it the
+// newest; no entry is visited. Its sub-filters are swapped for one of the
+// empty ones in fresh and retired once lookups in flight leave them.
+// Caller holds write_mutex_ exclusively.
+size_t MortonFilterWrapper::rotate(std::vector<std::unique_ptr<morton_stages_t>> fresh) {
+    for (auto& stages : fresh) {
+        active_ = (active_ + 1) % generations_.size();
+        generations_[active_]->publish(stages.release());
+    }
+    rotations_.fetch_add(fresh.size(), std::memory_order_relaxed);
+    return fresh.size();
+}
+
+std::chrono::milliseconds MortonFilterWrapper::get_ttl() const {
+    return ttl_;
+}
+
+uint32_t MortonFilterWrapper::get_generations() const {
+    return static_cast<uint32_t>(generations_.size());
+}
+
+uint64_t MortonFilterWrapper::get_rotations() const {
+    return rotations_.load(std::memory_order_relaxed);
+}
+
+size_t MortonFilterWrapper::get_stage_count() const {
+    std::shared_lock<std::shared_mutex> lock(write_mutex_);
+    size_t n = 0;
+    for (const auto& generation : generations_) {
+        n += generation->stages().stages.size();
+    }
+    return n;
 }
 
 bool MortonFilterWrapper::insert_batch(const std::vector<std::string>& elements) {
-    if (!handle_ || elements.empty()) return false;
-    
+    if (generations_.empty() || elements.empty()) return false;
+
     bool all_success = true;
     for (const auto& element : elements) {
         if (!insert(element)) {
             all_success = false;
         }
     }
-    
+
     std::cout << "[MortonFilter] Batch inserted " << elements.size() << " elements" << std::endl;
     return all_success;
 }
 
-bool MortonFilterWrapper::contains_batch(const std::vector<std::string>& elements, 
+bool MortonFilterWrapper::contains_batch(const std::vector<std::string>& elements,
                                        std::vector<bool>& results) const {
-    if (!handle_ || elements.empty()) return false;
-    
+    if (generations_.empty() || elements.empty()) return false;
+
     results.resize(elements.size());
     for (size_t i = 0; i < elements.size(); ++i) {
         results[i] = contains(elements[i]);
@@ -77,64 +741,154 @@ bool MortonFilterWrapper::contains_batch(const std::vector<std::string>& element
 }
 
 size_t MortonFilterWrapper::get_memory_usage() const {
-    if (!handle_) return 0;
-    
-    size_t memory = 0;
-    for (const auto& element : handle_->elements) {
-        memory += element.capacity() + sizeof(std::string);
+    std::shared_lock<std::shared_mutex> lock(write_mutex_);
+    size_t bytes = 0;
+    for (const auto& generation : generations_) {
+        for (const auto& stage : generation->stages().stages) {
+            bytes += stage->blocks.size() * sizeof(morton_block_t) + sizeof(morton_handle_t);
+        }
     }
-    return memory;
+    return bytes;
 }
 
 size_t MortonFilterWrapper::get_count() const {
-    if (!handle_) return 0;
-    return handle_->elements.size();
+    EpochGuard guard;
+    size_t count = 0;
+    for (const auto& generation : generations_) {
+        count += generation->count();
+    }
+    return count;
 }
 
 bool MortonFilterWrapper::save_to_file(const std::string& path) const {
-    if (!handle_) return false;
-    
+    // Exclusive, so the generations are saved as of one instant
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    if (generations_.empty()) return false;
+
     std::ofstream out(path, std::ios::binary);
     if (!out) return false;
-    
-    // Simple serialization: write count followed by each string
-    size_t count = handle_->elements.size();
-    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
-    
-    for (const auto& element : handle_->elements) {
-        size_t length = element.size();
-        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
-        out.write(element.data(), length);
-    }
-    
-    std::cout << "[MortonFilter] Saved " << count << " elements to " << path << std::endl;
+
+    // Oldest generation first, so a reload keeps the expiry order
+    const size_t n = generations_.size();
+    std::vector<const morton_handle_t*> ordered;
+    std::vector<morton_stage_desc_t> descs;
+    for (size_t i = 0; i < n; ++i) {
+        for (const auto& stage : generations_[(active_ + 1 + i) % n]->stages().stages) {
+            morton_stage_desc_t desc{};
+            desc.generation = static_cast<uint32_t>(i);
+            desc.fingerprint_bits = stage->fp_bytes * 8;
+            desc.block_count = stage->blocks.size();
+            desc.count = stage->count.load(std::memory_order_relaxed);
+            desc.capacity = stage->capacity;
+            desc.false_positive_rate = stage->false_positive_rate;
+            descs.push_back(desc);
+            ordered.push_back(stage.get());
+        }
+    }
+
+    morton_file_header_t header{};
+    std::memcpy(header.magic, kMortonMagic, sizeof(header.magic));
+    header.version = kMortonVersion;
+    header.fingerprint_bits = descs.front().fingerprint_bits;
+    header.block_count = descs.front().block_count;
+    for (const auto& desc : descs) header.count += desc.count;
+    header.capacity = capacity_;
+    header.false_positive_rate = false_positive_rate_;
+    header.generations = static_cast<uint32_t>(n);
+    header.stage_count = static_cast<uint32_t>(descs.size());
+    header.ttl_ms = ttl_.count();
+    header.checksum = XXH3_64bits(descs.data(), descs.size() * sizeof(morton_stage_desc_t));
+    for (const morton_handle_t* stage : ordered) {
+        header.checksum = XXH3_64bits_withSeed(stage->blocks.data(),
+                                               stage->blocks.size() * sizeof(morton_block_t), header.checksum);
+    }
+
+    // Header and stage table, then one contiguous write per block array
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(descs.data()),
+              static_cast<std::streamsize>(descs.size() * sizeof(morton_stage_desc_t)));
+    for (const morton_handle_t* stage : ordered) {
+        out.write(reinterpret_cast<const char*>(stage->blocks.data()),
+                  static_cast<std::streamsize>(stage->blocks.size() * sizeof(morton_block_t)));
+    }
+
+    std::cout << "[MortonFilter] Saved " << header.count << " elements to " << path << std::endl;
     return out.good();
 }
 
 bool MortonFilterWrapper::load_from_file(const std::string& path) {
-    if (handle_) {
-        delete handle_;
-        handle_ = nullptr;
-    }
-    
     std::ifstream in(path, std::ios::binary);
     if (!in) return false;
-    
-    handle_ = new morton_handle_t{};
-    
-    size_t count;
-    in.read(reinterpret_cast<char*>(&count), sizeof(count));
-    
-    for (size_t i = 0; i < count; ++i) {
-        size_t length;
-        in.read(reinterpret_cast<char*>(&length), sizeof(length));
-        
-        std::string element(length, '\0');
-        in.read(&element[0], length);
-        
-        handle_->elements.push_back(element);
-    }
-    
-    std::cout << "[MortonFilter] Loaded " << count << " elements from " << path << std::endl;
-    return in.good();
-}
\ No newline at end of file
+
+    morton_file_header_t header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMortonMagic, sizeof(header.magic)) != 0 ||
+        header.version != kMortonVersion ||
+        header.generations < 1 || header.generations > kMaxGenerations ||
+        (header.generations == 1) != (header.ttl_ms == 0) || header.ttl_ms < 0 ||
+        header.stage_count < header.generations || header.stage_count > header.generations * kMaxStages) {
+        std::cerr << "[MortonFilter] Unsupported or corrupt filter file: " << path << std::endl;
+        return false;
+    }
+
+    const size_t n = header.generations;
+    std::vector<morton_stage_desc_t> descs(header.stage_count);
+    if (!in.read(reinterpret_cast<char*>(descs.data()),
+                 static_cast<std::streamsize>(descs.size() * sizeof(morton_stage_desc_t)))) {
+        std::cerr << "[MortonFilter] Truncated or corrupt filter file: " << path << std::endl;
+        return false;
+    }
+    uint64_t checksum = XXH3_64bits(descs.data(), descs.size() * sizeof(morton_stage_desc_t));
+
+    std::vector<std::unique_ptr<morton_stages_t>> loaded(n);
+    for (size_t i = 0; i < descs.size(); ++i) {
+        const morton_stage_desc_t& desc = descs[i];
+        // Generations in order, each with at least one sub-filter
+        if (desc.generation >= n || (i > 0 && desc.generation < descs[i - 1].generation) ||
+            (desc.fingerprint_bits != 8 && desc.fingerprint_bits != 16) || desc.block_count == 0) {
+            std::cerr << "[MortonFilter] Unsupported or corrupt filter file: " << path << std::endl;
+            return false;
+        }
+
+        auto stage = std::make_shared<morton_handle_t>();
+        stage->fp_bytes = desc.fingerprint_bits / 8;
+        stage->slots_per_block = kStorageBytes / stage->fp_bytes;
+        stage->fp_mask = static_cast<uint16_t>((1u << desc.fingerprint_bits) - 1);
+        stage->count.store(desc.count, std::memory_order_relaxed);
+        stage->capacity = desc.capacity;
+        stage->false_positive_rate = desc.false_positive_rate;
+        stage->blocks.resize(desc.block_count);
+
+        const size_t bytes = stage->blocks.size() * sizeof(morton_block_t);
+        if (!in.read(reinterpret_cast<char*>(stage->blocks.data()), static_cast<std::streamsize>(bytes))) {
+            std::cerr << "[MortonFilter] Truncated or corrupt filter file: " << path << std::endl;
+            return false;
+        }
+        checksum = XXH3_64bits_withSeed(stage->blocks.data(), bytes, checksum);
+
+        if (!loaded[desc.generation]) loaded[desc.generation] = std::make_unique<morton_stages_t>();
+        loaded[desc.generation]->stages.push_back(std::move(stage));
+    }
+    if (checksum != header.checksum ||
+        std::any_of(loaded.begin(), loaded.end(), [](const auto& stages) { return !stages; })) {
+        std::cerr << "[MortonFilter] Truncated or corrupt filter file: " << path << std::endl;
+        return false;
+    }
+
+    // Ages are not persisted: the newest generation restarts its interval now
+    std::unique_lock<std::shared_mutex> lock(write_mutex_);
+    generations_.clear();
+    for (auto& stages : loaded) {
+        generations_.push_back(std::make_unique<morton_generation_t>(stages.release()));
+    }
+    active_ = n - 1;
+    capacity_ = header.capacity;
+    false_positive_rate_ = header.false_positive_rate;
+    ttl_ = std::chrono::milliseconds{header.ttl_ms};
+    interval_ = n > 1 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(ttl_) / static_cast<int64_t>(n - 1)
+                      : std::chrono::steady_clock::duration{0};
+    rotated_at_.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+
+    std::cout << "[MortonFilter] Loaded " << header.count << " elements from " << path << std::endl;
+    return true;
+}
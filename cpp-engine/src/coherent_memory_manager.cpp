@@ -0,0 +1,391 @@
+#include "coherent_memory_manager.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace {
+
+struct topology_t {
+    std::vector<std::vector<int>> cpus;   // per node, ascending
+    std::vector<int> os_ids;              // per node; -1 for a fake node
+    std::vector<int> node_of_cpu;         // by CPU id; -1 if on no node
+    bool fake = false;
+    bool discovered = false;              // false for the one-node fallback
+};
+
+// Published topologies stay allocated until exit, so readers need no
+// guard; replacing one (initialize, fake overrides) is rare
+std::mutex g_topology_mutex;
+std::vector<std::unique_ptr<topology_t>> g_published;
+std::atomic<const topology_t*> g_topology{nullptr};
+
+constexpr const char* kFakeEnv = "LLAMASHIELD_FAKE_NUMA";
+
+std::string_view trim(std::string_view text) {
+    const size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) return {};
+    return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+bool parse_int(std::string_view text, int& value) {
+    if (text.empty() || text.size() > 9) return false;
+    value = 0;
+    for (const char c : text) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Linux cpulist / nodelist format: "0-3,8,10-11"; empty is an empty list
+bool parse_cpulist(std::string_view text, std::vector<int>& out) {
+    out.clear();
+    text = trim(text);
+    while (!text.empty()) {
+        const size_t comma = text.find(',');
+        const std::string_view range = trim(text.substr(0, comma));
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        const size_t dash = range.find('-');
+        int first = 0;
+        int last = 0;
+        if (!parse_int(trim(range.substr(0, dash)), first)) return false;
+        if (dash == std::string_view::npos) {
+            last = first;
+        } else if (!parse_int(trim(range.substr(dash + 1)), last) || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) out.push_back(cpu);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return true;
+}
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::ostringstream text;
+    text << file.rdbuf();
+    out = text.str();
+    return true;
+}
+
+// CPUs this process may run on, ascending
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#elif defined(_WIN32)
+    DWORD_PTR process_affinity = 0;
+    DWORD_PTR system_affinity = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_affinity, &system_affinity)) {
+        for (int cpu = 0; cpu < static_cast<int>(8 * sizeof(DWORD_PTR)); ++cpu) {
+            if (process_affinity & (DWORD_PTR{1} << cpu)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        const int count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < count; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> intersect(const std::vector<int>& a, const std::vector<int>& b) {
+    std::vector<int> both;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(both));
+    return both;
+}
+
+void index_cpus(topology_t& topology) {
+    int max_cpu = -1;
+    for (const auto& cpus : topology.cpus) {
+        if (!cpus.empty()) max_cpu = std::max(max_cpu, cpus.back());
+    }
+    topology.node_of_cpu.assign(static_cast<size_t>(max_cpu + 1), -1);
+    for (size_t node = 0; node < topology.cpus.size(); ++node) {
+        for (const int cpu : topology.cpus[node]) {
+            if (topology.node_of_cpu[cpu] < 0) topology.node_of_cpu[cpu] = static_cast<int>(node);
+        }
+    }
+}
+
+// Nodes with at least one allowed CPU; memory-only nodes are left out,
+// since nothing could be pinned there
+std::unique_ptr<topology_t> discover() {
+    auto topology = std::make_unique<topology_t>();
+    const std::vector<int> allowed = allowed_cpus();
+
+#if defined(__linux__)
+    std::string text;
+    std::vector<int> node_ids;
+    if (read_file("/sys/devices/system/node/online", text) && parse_cpulist(text, node_ids)) {
+        for (const int id : node_ids) {
+            std::vector<int> cpus;
+            if (!read_file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist", text) ||
+                !parse_cpulist(text, cpus)) {
+                continue;
+            }
+            cpus = intersect(cpus, allowed);
+            if (cpus.empty()) continue;
+            topology->cpus.push_back(std::move(cpus));
+            topology->os_ids.push_back(id);
+        }
+    }
+#elif defined(_WIN32)
+    ULONG highest_node = 0;
+    if (GetNumaHighestNodeNumber(&highest_node)) {
+        for (ULONG id = 0; id <= highest_node; ++id) {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(id), &mask)) continue;
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < 64; ++cpu) {
+                if (mask & (ULONGLONG{1} << cpu)) cpus.push_back(cpu);
+            }
+            cpus = intersect(cpus, allowed);
+            if (cpus.empty()) continue;
+            topology->cpus.push_back(std::move(cpus));
+            topology->os_ids.push_back(static_cast<int>(id));
+        }
+    }
+#endif
+
+    topology->discovered = !topology->cpus.empty();
+    if (!topology->discovered) {
+        topology->cpus.push_back(allowed);
+        topology->os_ids.push_back(0);
+    }
+    index_cpus(*topology);
+    return topology;
+}
+
+// See the spec format in coherent_memory_manager.hpp
+std::unique_ptr<topology_t> fake(std::string_view spec) {
+    const std::vector<int> allowed = allowed_cpus();
+    auto topology = std::make_unique<topology_t>();
+    topology->fake = true;
+    topology->discovered = true;
+
+    int count = 0;
+    if (parse_int(trim(spec), count)) {
+        if (count < 1 || count > 1024) return nullptr;
+        const size_t n = static_cast<size_t>(count);
+        for (size_t node = 0; node < n; ++node) {
+            if (allowed.size() >= n) {
+                topology->cpus.emplace_back(allowed.begin() + node * allowed.size() / n,
+                                            allowed.begin() + (node + 1) * allowed.size() / n);
+            } else {
+                topology->cpus.push_back({allowed[node % allowed.size()]});
+            }
+        }
+    } else {
+        while (!spec.empty()) {
+            const size_t semicolon = spec.find(';');
+            std::vector<int> cpus;
+            if (!parse_cpulist(spec.substr(0, semicolon), cpus)) return nullptr;
+            cpus = intersect(cpus, allowed);
+            if (cpus.empty()) return nullptr;
+            topology->cpus.push_back(std::move(cpus));
+            spec = semicolon == std::string_view::npos ? std::string_view() : spec.substr(semicolon + 1);
+        }
+        if (topology->cpus.empty()) return nullptr;
+    }
+    topology->os_ids.assign(topology->cpus.size(), -1);
+    index_cpus(*topology);
+    return topology;
+}
+
+void log_topology(const topology_t& topology, const char* source) {
+    std::cout << "[NUMA] " << source << ": " << topology.cpus.size() << " node(s)";
+    for (size_t node = 0; node < topology.cpus.size(); ++node) {
+        std::cout << (node == 0 ? " (" : ", ") << "node " << node;
+        if (topology.os_ids[node] >= 0 && topology.os_ids[node] != static_cast<int>(node)) {
+            std::cout << " = OS node " << topology.os_ids[node];
+        }
+        std::cout << ": " << topology.cpus[node].size() << " CPUs";
+    }
+    std::cout << ")" << std::endl;
+}
+
+// Caller holds g_topology_mutex
+const topology_t* publish(std::unique_ptr<topology_t> topology) {
+    const topology_t* current = topology.get();
+    g_published.push_back(std::move(topology));
+    g_topology.store(current, std::memory_order_release);
+    return current;
+}
+
+const topology_t& current() {
+    if (const topology_t* topology = g_topology.load(std::memory_order_acquire)) return *topology;
+    CoherentMemoryManager::initialize();
+    return *g_topology.load(std::memory_order_acquire);
+}
+
+} // namespace
+
+bool CoherentMemoryManager::initialize() {
+    std::lock_guard<std::mutex> lock(g_topology_mutex);
+    if (const topology_t* topology = g_topology.load(std::memory_order_acquire)) return topology->discovered;
+
+    if (const char* spec = std::getenv(kFakeEnv); spec && *spec) {
+        if (auto topology = fake(spec)) {
+            log_topology(*topology, "Fake topology from LLAMASHIELD_FAKE_NUMA");
+            return publish(std::move(topology))->discovered;
+        }
+        std::cerr << "[NUMA] Ignoring unparsable " << kFakeEnv << "=" << spec << std::endl;
+    }
+
+    auto topology = discover();
+    if (topology->discovered) {
+        log_topology(*topology, "Discovered topology");
+    } else {
+        std::cout << "[NUMA] Topology not available, using a single node of "
+                  << topology->cpus[0].size() << " CPUs" << std::endl;
+    }
+    return publish(std::move(topology))->discovered;
+}
+
+bool CoherentMemoryManager::set_fake_topology(const std::string& spec) {
+    std::lock_guard<std::mutex> lock(g_topology_mutex);
+    if (spec.empty()) {
+        auto topology = discover();
+        log_topology(*topology, "Restored real topology");
+        publish(std::move(topology));
+        return true;
+    }
+    auto topology = fake(spec);
+    if (!topology) {
+        std::cerr << "[NUMA] Invalid fake topology: " << spec << std::endl;
+        return false;
+    }
+    log_topology(*topology, "Fake topology");
+    publish(std::move(topology));
+    return true;
+}
+
+bool CoherentMemoryManager::is_fake_topology() {
+    return current().fake;
+}
+
+int CoherentMemoryManager::get_num_numa_nodes() {
+    return static_cast<int>(current().cpus.size());
+}
+
+std::vector<int> CoherentMemoryManager::get_node_cpus(int numa_node) {
+    const topology_t& topology = current();
+    if (numa_node < 0 || numa_node >= static_cast<int>(topology.cpus.size())) return {};
+    return topology.cpus[numa_node];
+}
+
+int CoherentMemoryManager::get_os_node_id(int numa_node) {
+    const topology_t& topology = current();
+    if (numa_node < 0 || numa_node >= static_cast<int>(topology.os_ids.size())) return -1;
+    return topology.os_ids[numa_node];
+}
+
+bool CoherentMemoryManager::pin_thread_to_numa(int numa_node) {
+    const std::vector<int> cpus = get_node_cpus(numa_node);
+    if (cpus.empty()) return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (const int cpu : cpus) {
+        if (cpu < static_cast<int>(8 * sizeof(DWORD_PTR))) mask |= DWORD_PTR{1} << cpu;
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+void* CoherentMemoryManager::allocate_numa_local(size_t size, int numa_node) {
+    if (size == 0) return nullptr;
+    const int os_node = get_os_node_id(numa_node);
+#if defined(__linux__)
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t bytes = (size + page - 1) / page * page;
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return nullptr;
+    if (os_node >= 0 && os_node < 1024) {
+        // Before any page is touched, so every one is placed by the
+        // policy. MPOL_PREFERRED: spill to other nodes instead of failing.
+        constexpr int kMpolPreferred = 1;
+        unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+        mask[os_node / (8 * sizeof(unsigned long))] |= 1UL << (os_node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, ptr, bytes, kMpolPreferred, mask, 1024UL, 0U) != 0) {
+            static std::atomic<bool> reported{false};
+            if (!reported.exchange(true)) {
+                std::cerr << "[NUMA] mbind failed; node-local memory falls back to first touch" << std::endl;
+            }
+        }
+    }
+    return ptr;
+#elif defined(_WIN32)
+    if (os_node >= 0) {
+        return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                                  static_cast<DWORD>(os_node));
+    }
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    (void)os_node;
+    return std::malloc(size);
+#endif
+}
+
+void CoherentMemoryManager::free_numa_local(void* ptr, size_t size) {
+    if (!ptr) return;
+#if defined(__linux__)
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    munmap(ptr, (size + page - 1) / page * page);
+#elif defined(_WIN32)
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    (void)size;
+    std::free(ptr);
+#endif
+}
+
+int CoherentMemoryManager::get_current_numa_node() {
+    const topology_t& topology = current();
+#if defined(__linux__)
+    const int cpu = sched_getcpu();
+#elif defined(_WIN32)
+    const int cpu = static_cast<int>(GetCurrentProcessorNumber());
+#else
+    const int cpu = -1;
+#endif
+    if (cpu < 0 || cpu >= static_cast<int>(topology.node_of_cpu.size())) return 0;
+    return std::max(topology.node_of_cpu[cpu], 0);
+}
@@ -0,0 +1,61 @@
+#include "cpu_features.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LLAMASHIELD_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+namespace {
+
+struct cpu_features_t {
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512dq = false;
+};
+
+cpu_features_t detect() {
+    cpu_features_t features;
+#if defined(LLAMASHIELD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return features;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave) return features;
+    const unsigned long long xcr0 = _xgetbv(0);
+    // AVX2 needs XMM and YMM state OS-enabled; AVX-512 opmask and ZMM too
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xE6) == 0xE6;
+    __cpuidex(info, 7, 0);
+    features.avx2 = ymm && (info[1] & (1 << 5)) != 0;
+    features.avx512f = zmm && (info[1] & (1 << 16)) != 0;
+    features.avx512dq = zmm && (info[1] & (1 << 17)) != 0;
+#elif defined(LLAMASHIELD_X86)
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512f = __builtin_cpu_supports("avx512f");
+    features.avx512dq = __builtin_cpu_supports("avx512dq");
+#endif
+    return features;
+}
+
+const cpu_features_t& cpu_features() {
+    static const cpu_features_t features = detect();
+    return features;
+}
+
+} // namespace
+
+bool cpu_has_avx2() {
+    return cpu_features().avx2;
+}
+
+bool cpu_has_avx512f() {
+    return cpu_features().avx512f;
+}
+
+bool cpu_has_avx512dq() {
+    return cpu_features().avx512dq;
+}
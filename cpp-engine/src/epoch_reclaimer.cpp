@@ -0,0 +1,159 @@
+#include "epoch_reclaimer.hpp"
+#include <limits>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// Correctness argument, all epoch and pointer operations being seq_cst:
+// a writer exchanges the pointer and then advances the epoch from R to R+1,
+// tagging the old object with R. A reader that announces an epoch > R read
+// the counter after that advance, so its pointer load also follows the
+// exchange and cannot return the old object. A reader whose announcement
+// the scan missed performs its pointer load after the scan, hence after the
+// exchange as well. So an object tagged R is unreachable once no slot holds
+// a non-zero epoch <= R.
+//
+// A seq_cst store on every guard entry is a full fence and stops the CPU
+// overlapping the cache misses of back-to-back lookups. Where the OS offers
+// a process-wide barrier (membarrier, FlushProcessWriteBuffers) readers
+// announce with a plain store and the writer issues that barrier before
+// scanning, which restores the same ordering at the writer's expense.
+
+namespace {
+
+// Hands the thread's slot back for reuse when the thread exits
+struct slot_holder_t {
+    std::atomic<bool>* in_use = nullptr;
+
+    ~slot_holder_t() {
+        if (in_use) in_use->store(false, std::memory_order_release);
+    }
+};
+
+thread_local slot_holder_t tls_holder;
+
+} // namespace
+
+EpochReclaimer::EpochReclaimer() {
+#if defined(__linux__) && defined(SYS_membarrier)
+    asymmetric_ = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#elif defined(_WIN32)
+    asymmetric_ = true;
+#endif
+}
+
+void EpochReclaimer::heavy_barrier() const {
+    if (asymmetric_) {
+#if defined(__linux__) && defined(SYS_membarrier)
+        syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+#elif defined(_WIN32)
+        FlushProcessWriteBuffers();
+#endif
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+EpochReclaimer::slot_t& EpochReclaimer::register_thread() {
+    slot_t* slot = acquire_slot();
+    tls_holder.in_use = &slot->in_use;
+    tls_slot_ = slot;
+    return *slot;
+}
+
+EpochReclaimer::slot_t* EpochReclaimer::acquire_slot() {
+    // Reuse a slot left behind by an exited thread
+    for (slot_t* s = slots_.load(std::memory_order_acquire); s; s = s->next) {
+        bool expected = false;
+        if (!s->in_use.load(std::memory_order_relaxed) &&
+            s->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return s;
+        }
+    }
+
+    auto* s = new slot_t();
+    s->in_use.store(true, std::memory_order_relaxed);
+    slot_t* head = slots_.load(std::memory_order_relaxed);
+    do {
+        s->next = head;
+    } while (!slots_.compare_exchange_weak(head, s, std::memory_order_release, std::memory_order_relaxed));
+    return s;
+}
+
+uint64_t EpochReclaimer::oldest_active_epoch() const {
+    heavy_barrier();
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (slot_t* s = slots_.load(std::memory_order_acquire); s; s = s->next) {
+        uint64_t epoch = s->epoch.load();
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+size_t EpochReclaimer::reclaim_before(uint64_t epoch) {
+    std::vector<retired_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        auto it = retired_.begin();
+        while (it != retired_.end()) {
+            if (it->epoch < epoch) {
+                ready.push_back(*it);
+                *it = retired_.back();
+                retired_.pop_back();
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Deleters run outside the lock; they may be slow (unmapping, freeing GBs)
+    for (const retired_t& r : ready) {
+        r.deleter(r.ptr);
+    }
+    return ready.size();
+}
+
+void EpochReclaimer::retire(void* ptr, deleter_fn deleter) {
+    if (!ptr) return;
+
+    const uint64_t epoch = global_epoch_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        retired_.push_back({ptr, deleter, epoch});
+    }
+    try_reclaim();
+}
+
+size_t EpochReclaimer::try_reclaim() {
+    return reclaim_before(oldest_active_epoch());
+}
+
+void EpochReclaimer::synchronize() {
+    // Everything retired so far is tagged below this value
+    const uint64_t target = global_epoch_.fetch_add(1);
+    heavy_barrier();
+
+    for (slot_t* s = slots_.load(std::memory_order_acquire); s; s = s->next) {
+        for (;;) {
+            uint64_t epoch = s->epoch.load();
+            if (epoch == 0 || epoch >= target) break;
+            std::this_thread::yield();
+        }
+    }
+    reclaim_before(target);
+}
+
+bool EpochReclaimer::in_critical_section() const {
+    return tls_slot_ && tls_slot_->depth > 0;
+}
+
+size_t EpochReclaimer::pending() const {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    return retired_.size();
+}
@@ -0,0 +1,209 @@
+#include "fuse_build.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// binfuse's own filters keep their storage private; use the underlying
+// xor_singleheader filters directly so the arrays can be persisted.
+#include "binaryfusefilter.h"
+
+template <typename fp_t>
+fuse_array_t<fp_t>& fuse_array_t<fp_t>::operator=(fuse_array_t&& other) noexcept {
+    if (this != &other) {
+        reset();
+        seed = other.seed;
+        segment_length = other.segment_length;
+        segment_length_mask = other.segment_length_mask;
+        segment_count_length = other.segment_count_length;
+        array_length = other.array_length;
+        fingerprints = other.fingerprints;
+        other.fingerprints = nullptr;
+        other.array_length = 0;
+    }
+    return *this;
+}
+
+template <typename fp_t>
+bool fuse_array_t<fp_t>::allocate(uint32_t length) {
+    reset();
+    fingerprints = static_cast<fp_t*>(calloc(size_t{length} * sizeof(fp_t) + kGatherPadding, 1));
+    array_length = fingerprints ? length : 0;
+    return fingerprints != nullptr;
+}
+
+template <typename fp_t>
+void fuse_array_t<fp_t>::reset() {
+    free(fingerprints);
+    fingerprints = nullptr;
+    array_length = 0;
+}
+
+namespace {
+
+// Upstream populate fills a caller-described filter; these adapt our array
+// to the matching struct without copying it
+template <typename filter_t, typename fp_t>
+filter_t as_upstream(fuse_array_t<fp_t>& array, uint32_t segment_count) {
+    filter_t filter{};
+    filter.Seed = array.seed;
+    filter.SegmentLength = array.segment_length;
+    filter.SegmentLengthMask = array.segment_length_mask;
+    filter.SegmentCount = segment_count;
+    filter.SegmentCountLength = array.segment_count_length;
+    filter.ArrayLength = array.array_length;
+    filter.Fingerprints = array.fingerprints;
+    return filter;
+}
+
+template <typename fp_t>
+bool populate(const uint64_t* keys, uint32_t size, uint32_t segment_count, fuse_array_t<fp_t>& array);
+
+// Populate only reads the keys; older headers declare the pointer non-const
+template <>
+bool populate(const uint64_t* keys, uint32_t size, uint32_t segment_count, fuse_array_t<uint8_t>& array) {
+    binary_fuse8_t filter = as_upstream<binary_fuse8_t>(array, segment_count);
+    if (!binary_fuse8_populate(const_cast<uint64_t*>(keys), size, &filter)) return false;
+    array.seed = filter.Seed;
+    return true;
+}
+
+template <>
+bool populate(const uint64_t* keys, uint32_t size, uint32_t segment_count, fuse_array_t<uint16_t>& array) {
+    binary_fuse16_t filter = as_upstream<binary_fuse16_t>(array, segment_count);
+    if (!binary_fuse16_populate(const_cast<uint64_t*>(keys), size, &filter)) return false;
+    array.seed = filter.Seed;
+    return true;
+}
+
+// Hypergraph peeling as in binary_fuse8_populate, without its cache-blocking
+// of the hash pass: find a seed under which every key can be peeled off a
+// slot it alone occupies, then assign fingerprints in reverse peel order.
+template <>
+bool populate(const uint64_t* keys, uint32_t size, uint32_t, fuse_array_t<uint32_t>& array) {
+    constexpr int kMaxAttempts = 100;
+    const uint32_t capacity = array.array_length;
+
+    std::vector<uint8_t> t2count(capacity);      // (occupants << 2) | xor of slot indices
+    std::vector<uint64_t> t2hash(capacity);      // xor of occupant hashes
+    std::vector<uint32_t> alone(capacity);
+    std::vector<uint64_t> order(size);
+    std::vector<uint8_t> order_slot(size);
+    uint64_t rng = 0x726b2b9d438b9d4dULL;
+
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+        array.seed = binary_fuse_rng_splitmix64(&rng);
+        const fuse_view32_t view = array.view();
+        std::fill(t2count.begin(), t2count.end(), uint8_t{0});
+        std::fill(t2hash.begin(), t2hash.end(), uint64_t{0});
+
+        bool overflow = false;
+        for (uint32_t i = 0; i < size; ++i) {
+            const uint64_t hash = fuse_mix(keys[i], array.seed);
+            const basic_fuse_probe_t<uint32_t> p = fuse_probe_hash(view, hash);
+            const uint32_t slots[3] = {p.h0, p.h1, p.h2};
+            for (uint8_t j = 0; j < 3; ++j) {
+                overflow |= t2count[slots[j]] >= 0xFC;
+                t2count[slots[j]] = static_cast<uint8_t>((t2count[slots[j]] + 4) ^ j);
+                t2hash[slots[j]] ^= hash;
+            }
+        }
+        if (overflow) continue;
+
+        uint32_t queued = 0;
+        for (uint32_t i = 0; i < capacity; ++i) {
+            alone[queued] = i;
+            queued += (t2count[i] >> 2) == 1;
+        }
+
+        uint32_t peeled = 0;
+        while (queued > 0) {
+            const uint32_t index = alone[--queued];
+            if ((t2count[index] >> 2) != 1) continue;
+
+            const uint64_t hash = t2hash[index];
+            const basic_fuse_probe_t<uint32_t> p = fuse_probe_hash(view, hash);
+            const uint32_t slots[3] = {p.h0, p.h1, p.h2};
+            const uint8_t found = t2count[index] & 3;
+            order[peeled] = hash;
+            order_slot[peeled] = found;
+            ++peeled;
+            for (uint8_t j = 0; j < 3; ++j) {
+                const uint32_t slot = slots[j];
+                t2count[slot] = static_cast<uint8_t>((t2count[slot] - 4) ^ j);
+                t2hash[slot] ^= hash;
+                if (j != found && (t2count[slot] >> 2) == 1) alone[queued++] = slot;
+            }
+        }
+        if (peeled != size) continue;
+
+        for (uint32_t i = size; i-- > 0;) {
+            const basic_fuse_probe_t<uint32_t> p = fuse_probe_hash(view, order[i]);
+            const uint32_t slots[3] = {p.h0, p.h1, p.h2};
+            uint32_t* fp = array.fingerprints;
+            fp[slots[order_slot[i]]] = 0;
+            fp[slots[order_slot[i]]] = p.fingerprint ^ fp[p.h0] ^ fp[p.h1] ^ fp[p.h2];
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+template <typename fp_t>
+bool fuse_build(const uint64_t* keys, size_t n, fuse_array_t<fp_t>& out) {
+    if (n > UINT32_MAX) {
+        std::cerr << "[fuse_build] Too many keys for a single filter: " << n << std::endl;
+        return false;
+    }
+
+    if (n == 0) {
+        out = fuse_array_t<fp_t>{};
+        out.segment_length = 1;
+        return out.allocate(3);
+    }
+
+    // Sizing is width-independent, so it is taken from binary_fuse8_allocate
+    const uint32_t size = static_cast<uint32_t>(n);
+    binary_fuse8_t sizing{};
+    if (!binary_fuse8_allocate(size, &sizing)) {
+        std::cerr << "[fuse_build] Allocation failed for " << n << " keys" << std::endl;
+        return false;
+    }
+    const uint32_t segment_count = sizing.SegmentCount;
+    const uint32_t array_length = sizing.ArrayLength;
+    out = fuse_array_t<fp_t>{};
+    out.segment_length = sizing.SegmentLength;
+    out.segment_length_mask = sizing.SegmentLengthMask;
+    out.segment_count_length = sizing.SegmentCountLength;
+    binary_fuse8_free(&sizing);
+
+    if (!out.allocate(array_length)) {
+        std::cerr << "[fuse_build] Allocation failed for " << n << " keys" << std::endl;
+        return false;
+    }
+    if (populate(keys, size, segment_count, out)) {
+        return true;
+    }
+
+    // Duplicate keys make every seed fail; retry once without them
+    std::vector<uint64_t> unique(keys, keys + n);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    if (unique.size() == n ||
+        !populate(unique.data(), static_cast<uint32_t>(unique.size()), segment_count, out)) {
+        std::cerr << "[fuse_build] Construction failed for " << n << " keys" << std::endl;
+        out.reset();
+        return false;
+    }
+    return true;
+}
+
+template struct fuse_array_t<uint8_t>;
+template struct fuse_array_t<uint16_t>;
+template struct fuse_array_t<uint32_t>;
+
+template bool fuse_build(const uint64_t*, size_t, fuse_array_t<uint8_t>&);
+template bool fuse_build(const uint64_t*, size_t, fuse_array_t<uint16_t>&);
+template bool fuse_build(const uint64_t*, size_t, fuse_array_t<uint32_t>&);
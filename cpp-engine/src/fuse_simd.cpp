@@ -0,0 +1,277 @@
+#include "fuse_simd.hpp"
+#include "cpu_features.hpp"
+#include "prefetch.hpp"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LLAMASHIELD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang need per-function target attributes so the kernels build without
+// -mavx2; MSVC accepts the intrinsics as-is.
+#if defined(LLAMASHIELD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512dq")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace {
+
+// Keys in flight per window: enough to cover DRAM latency without the probe
+// arrays spilling out of L1.
+constexpr size_t kWindow = 32;
+
+constexpr uint64_t kMurmurC1 = 0xff51afd7ed558ccdULL;
+constexpr uint64_t kMurmurC2 = 0xc4ceb9fe1a85ec53ULL;
+
+} // namespace
+
+void fuse_contains_batch_scalar(const fuse_view_t& view, const uint64_t* keys, size_t n, uint8_t* out) {
+    fuse_probe_t probes[kWindow];
+
+    for (size_t base = 0; base < n; base += kWindow) {
+        const size_t count = std::min(kWindow, n - base);
+
+        // Pass 1: hash and issue all loads for the window
+        for (size_t i = 0; i < count; ++i) {
+            probes[i] = fuse_probe(view, keys[base + i]);
+            prefetch_read(view.fingerprints + probes[i].h0);
+            prefetch_read(view.fingerprints + probes[i].h1);
+            prefetch_read(view.fingerprints + probes[i].h2);
+        }
+
+        // Pass 2: the lines are arriving (or already here); resolve
+        for (size_t i = 0; i < count; ++i) {
+            out[base + i] = fuse_resolve(view, probes[i]) ? 1 : 0;
+        }
+    }
+}
+
+template <typename fp_t>
+void fuse_contains_batch_sharded(const basic_fuse_view_t<fp_t>* shards, uint32_t shard_bits,
+                                 const uint64_t* keys, size_t n, uint8_t* out) {
+    basic_fuse_probe_t<fp_t> probes[kWindow];
+    const basic_fuse_view_t<fp_t>* views[kWindow];
+
+    for (size_t base = 0; base < n; base += kWindow) {
+        const size_t count = std::min(kWindow, n - base);
+
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t key = keys[base + i];
+            views[i] = &shards[fuse_shard_index(key, shard_bits)];
+            probes[i] = fuse_probe(*views[i], key);
+            prefetch_read(views[i]->fingerprints + probes[i].h0);
+            prefetch_read(views[i]->fingerprints + probes[i].h1);
+            prefetch_read(views[i]->fingerprints + probes[i].h2);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            out[base + i] = fuse_resolve(*views[i], probes[i]) ? 1 : 0;
+        }
+    }
+}
+
+template void fuse_contains_batch_sharded(const fuse_view_t*, uint32_t, const uint64_t*, size_t, uint8_t*);
+template void fuse_contains_batch_sharded(const fuse_view16_t*, uint32_t, const uint64_t*, size_t, uint8_t*);
+template void fuse_contains_batch_sharded(const fuse_view32_t*, uint32_t, const uint64_t*, size_t, uint8_t*);
+
+#ifdef LLAMASHIELD_X86
+
+namespace {
+
+// Structure-of-arrays probe window shared by the vector kernels
+struct alignas(64) simd_window_t {
+    uint64_t h0[kWindow];
+    uint64_t h1[kWindow];
+    uint64_t h2[kWindow];
+    uint32_t fingerprint[kWindow];
+};
+
+void prefetch_window(const fuse_view_t& view, const simd_window_t& w, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        prefetch_read(view.fingerprints + w.h0[i]);
+        prefetch_read(view.fingerprints + w.h1[i]);
+        prefetch_read(view.fingerprints + w.h2[i]);
+    }
+}
+
+// ---- AVX2: 4 keys per vector ----
+
+// 64x64 -> low 64 bits from three 32x32 products (AVX2 has no vpmullq)
+TARGET_AVX2 inline __m256i mullo64_avx2(__m256i a, uint64_t c) {
+    const __m256i c_lo = _mm256_set1_epi64x(static_cast<int64_t>(c & 0xFFFFFFFFULL));
+    const __m256i c_hi = _mm256_set1_epi64x(static_cast<int64_t>(c >> 32));
+    __m256i lo_lo = _mm256_mul_epu32(a, c_lo);
+    __m256i hi_lo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), c_lo);
+    __m256i lo_hi = _mm256_mul_epu32(a, c_hi);
+    return _mm256_add_epi64(lo_lo, _mm256_slli_epi64(_mm256_add_epi64(hi_lo, lo_hi), 32));
+}
+
+TARGET_AVX2 inline __m256i mix_avx2(__m256i key, __m256i seed) {
+    __m256i h = _mm256_add_epi64(key, seed);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = mullo64_avx2(h, kMurmurC1);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = mullo64_avx2(h, kMurmurC2);
+    return _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+}
+
+// (h * m) >> 64 for m < 2^32: hi(h)*m + (lo(h)*m >> 32), shifted down 32
+TARGET_AVX2 inline __m256i mulhi32_avx2(__m256i h, __m256i m) {
+    __m256i lo = _mm256_mul_epu32(h, m);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(h, 32), m);
+    return _mm256_srli_epi64(_mm256_add_epi64(hi, _mm256_srli_epi64(lo, 32)), 32);
+}
+
+TARGET_AVX2 void fuse_contains_batch_avx2(const fuse_view_t& view, const uint64_t* keys, size_t n, uint8_t* out) {
+    const __m256i seed = _mm256_set1_epi64x(static_cast<int64_t>(view.seed));
+    const __m256i count_length = _mm256_set1_epi64x(view.segment_count_length);
+    const __m256i seg_length = _mm256_set1_epi64x(view.segment_length);
+    const __m256i seg_mask = _mm256_set1_epi64x(view.segment_length_mask);
+    const __m256i pack_even = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+    const __m128i byte_mask = _mm_set1_epi32(0xFF);
+    const int* base_ptr = reinterpret_cast<const int*>(view.fingerprints);
+
+    simd_window_t w;
+    size_t base = 0;
+    for (; base + 4 <= n; base += kWindow) {
+        const size_t count = std::min(kWindow, n - base) & ~size_t{3};
+
+        for (size_t i = 0; i < count; i += 4) {
+            __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + base + i));
+            __m256i h = mix_avx2(k, seed);
+            __m256i fp = _mm256_xor_si256(h, _mm256_srli_epi64(h, 32));
+            __m256i h0 = mulhi32_avx2(h, count_length);
+            __m256i h1 = _mm256_add_epi64(h0, seg_length);
+            __m256i h2 = _mm256_add_epi64(h1, seg_length);
+            h1 = _mm256_xor_si256(h1, _mm256_and_si256(_mm256_srli_epi64(h, 18), seg_mask));
+            h2 = _mm256_xor_si256(h2, _mm256_and_si256(h, seg_mask));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(w.h0 + i), h0);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(w.h1 + i), h1);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(w.h2 + i), h2);
+            _mm_store_si128(reinterpret_cast<__m128i*>(w.fingerprint + i),
+                            _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(fp, pack_even)));
+        }
+
+        prefetch_window(view, w, count);
+
+        for (size_t i = 0; i < count; i += 4) {
+            __m256i h0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w.h0 + i));
+            __m256i h1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w.h1 + i));
+            __m256i h2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w.h2 + i));
+            __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(w.fingerprint + i));
+            x = _mm_xor_si128(x, _mm256_i64gather_epi32(base_ptr, h0, 1));
+            x = _mm_xor_si128(x, _mm256_i64gather_epi32(base_ptr, h1, 1));
+            x = _mm_xor_si128(x, _mm256_i64gather_epi32(base_ptr, h2, 1));
+            x = _mm_and_si128(x, byte_mask);
+            int hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(x, _mm_setzero_si128())));
+            for (int lane = 0; lane < 4; ++lane) {
+                out[base + i + lane] = static_cast<uint8_t>((hits >> lane) & 1);
+            }
+        }
+
+        if (count < kWindow) {
+            base += count;
+            break;
+        }
+    }
+
+    if (base < n) {
+        fuse_contains_batch_scalar(view, keys + base, n - base, out + base);
+    }
+}
+
+// ---- AVX-512: 8 keys per vector ----
+
+TARGET_AVX512 inline __m512i mix_avx512(__m512i key, __m512i seed) {
+    __m512i h = _mm512_add_epi64(key, seed);
+    h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 33));
+    h = _mm512_mullo_epi64(h, _mm512_set1_epi64(static_cast<int64_t>(kMurmurC1)));
+    h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 33));
+    h = _mm512_mullo_epi64(h, _mm512_set1_epi64(static_cast<int64_t>(kMurmurC2)));
+    return _mm512_xor_si512(h, _mm512_srli_epi64(h, 33));
+}
+
+TARGET_AVX512 inline __m512i mulhi32_avx512(__m512i h, __m512i m) {
+    __m512i lo = _mm512_mul_epu32(h, m);
+    __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(h, 32), m);
+    return _mm512_srli_epi64(_mm512_add_epi64(hi, _mm512_srli_epi64(lo, 32)), 32);
+}
+
+TARGET_AVX512 void fuse_contains_batch_avx512(const fuse_view_t& view, const uint64_t* keys, size_t n, uint8_t* out) {
+    const __m512i seed = _mm512_set1_epi64(static_cast<int64_t>(view.seed));
+    const __m512i count_length = _mm512_set1_epi64(view.segment_count_length);
+    const __m512i seg_length = _mm512_set1_epi64(view.segment_length);
+    const __m512i seg_mask = _mm512_set1_epi64(view.segment_length_mask);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const void* base_ptr = view.fingerprints;
+
+    simd_window_t w;
+    size_t base = 0;
+    for (; base + 8 <= n; base += kWindow) {
+        const size_t count = std::min(kWindow, n - base) & ~size_t{7};
+
+        for (size_t i = 0; i < count; i += 8) {
+            __m512i k = _mm512_loadu_si512(keys + base + i);
+            __m512i h = mix_avx512(k, seed);
+            __m512i fp = _mm512_xor_si512(h, _mm512_srli_epi64(h, 32));
+            __m512i h0 = mulhi32_avx512(h, count_length);
+            __m512i h1 = _mm512_add_epi64(h0, seg_length);
+            __m512i h2 = _mm512_add_epi64(h1, seg_length);
+            h1 = _mm512_xor_si512(h1, _mm512_and_si512(_mm512_srli_epi64(h, 18), seg_mask));
+            h2 = _mm512_xor_si512(h2, _mm512_and_si512(h, seg_mask));
+            _mm512_store_si512(w.h0 + i, h0);
+            _mm512_store_si512(w.h1 + i, h1);
+            _mm512_store_si512(w.h2 + i, h2);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(w.fingerprint + i), _mm512_cvtepi64_epi32(fp));
+        }
+
+        prefetch_window(view, w, count);
+
+        for (size_t i = 0; i < count; i += 8) {
+            __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i*>(w.fingerprint + i));
+            x = _mm256_xor_si256(x, _mm512_i64gather_epi32(_mm512_load_si512(w.h0 + i), base_ptr, 1));
+            x = _mm256_xor_si256(x, _mm512_i64gather_epi32(_mm512_load_si512(w.h1 + i), base_ptr, 1));
+            x = _mm256_xor_si256(x, _mm512_i64gather_epi32(_mm512_load_si512(w.h2 + i), base_ptr, 1));
+            x = _mm256_and_si256(x, byte_mask);
+            int hits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, _mm256_setzero_si256())));
+            for (int lane = 0; lane < 8; ++lane) {
+                out[base + i + lane] = static_cast<uint8_t>((hits >> lane) & 1);
+            }
+        }
+
+        if (count < kWindow) {
+            base += count;
+            break;
+        }
+    }
+
+    if (base < n) {
+        fuse_contains_batch_scalar(view, keys + base, n - base, out + base);
+    }
+}
+
+} // namespace
+
+#endif // LLAMASHIELD_X86
+
+std::vector<fuse_batch_kernel_t> fuse_available_kernels() {
+    std::vector<fuse_batch_kernel_t> kernels;
+#ifdef LLAMASHIELD_X86
+    if (cpu_has_avx512f() && cpu_has_avx512dq()) kernels.push_back({"avx512", fuse_contains_batch_avx512});
+    if (cpu_has_avx2()) kernels.push_back({"avx2", fuse_contains_batch_avx2});
+#endif
+    kernels.push_back({"scalar", fuse_contains_batch_scalar});
+    return kernels;
+}
+
+const fuse_batch_kernel_t& fuse_best_kernel() {
+    static const fuse_batch_kernel_t best = fuse_available_kernels().front();
+    return best;
+}
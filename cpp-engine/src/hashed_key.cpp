@@ -0,0 +1,26 @@
+#include "hashed_key.hpp"
+#include "url_canonicalizer.hpp"
+#include <vector>
+#include <xxhash.h>
+
+HashedKey HashedKey::of(const char* data, size_t size) {
+    char canonical[kCanonicalUrlStackBytes];
+    size_t canonical_size = 0;
+    if (canonicalize_url(data, size, canonical, sizeof(canonical), canonical_size)) {
+        return of_raw(canonical, canonical_size);
+    }
+
+    // Too long for the stack buffer: rare enough to allocate
+    if (size > kCanonicalUrlStackBytes / 4) {
+        std::vector<char> buffer(size * 4 + 64);
+        if (canonicalize_url(data, size, buffer.data(), buffer.size(), canonical_size)) {
+            return of_raw(buffer.data(), canonical_size);
+        }
+    }
+    return of_raw(data, size);
+}
+
+HashedKey HashedKey::of_raw(const char* data, size_t size) {
+    const XXH128_hash_t h = XXH3_128bits(data, size);
+    return {h.low64, h.high64};
+}
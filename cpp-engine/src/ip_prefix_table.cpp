@@ -0,0 +1,725 @@
+#include "ip_prefix_table.hpp"
+#include "epoch_reclaimer.hpp"
+#include "mapped_file.hpp"
+#include <xxhash.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+constexpr uint32_t kChild = 0x80000000u;   // entry is a node index, else a result
+constexpr size_t kRootEntries = size_t{1} << 16;
+
+// Results are stored as length + 1, so 0 is "no prefix"
+inline int result_length(uint32_t result) {
+    return static_cast<int>(result) - 1;
+}
+
+} // namespace
+
+// Slot i of a node is a child if child_bits has bit i; otherwise its
+// result is the one at the last leaf_bits bit at or before i (a bit marks
+// where a run of equal results starts). Children and results of a node are
+// contiguous from child_base and leaf_base; the ranks are the bits in the
+// words before, so one popcount finds a slot's entry.
+struct ip_node_t {
+    uint64_t child_bits[4];
+    uint64_t leaf_bits[4];
+    uint32_t child_base;
+    uint32_t leaf_base;
+    uint8_t child_rank[4];
+    uint8_t leaf_rank[4];
+};
+
+struct ip_table_t {
+    // Owned storage when built here, or the mapping when loaded
+    std::vector<uint32_t> v4_root_storage;
+    std::vector<uint32_t> v6_root_storage;
+    std::vector<ip_node_t> node_storage;
+    std::vector<uint8_t> leaf_storage;
+    MappedFile mapping;
+
+    const uint32_t* v4_root = nullptr;     // null without IPv4 prefixes
+    const uint32_t* v6_root = nullptr;
+    const ip_node_t* nodes = nullptr;
+    const uint8_t* leaves = nullptr;
+    uint64_t node_count = 0;
+    uint64_t leaf_count = 0;
+    uint64_t prefix_count = 0;
+
+    void point_at_storage() {
+        v4_root = v4_root_storage.empty() ? nullptr : v4_root_storage.data();
+        v6_root = v6_root_storage.empty() ? nullptr : v6_root_storage.data();
+        nodes = node_storage.data();
+        leaves = leaf_storage.data();
+        node_count = node_storage.size();
+        leaf_count = leaf_storage.size();
+    }
+};
+
+namespace {
+
+// File layout (little-endian): header, then each present section 64-byte
+// aligned: IPv4 direct table (65536 uint32), IPv6 direct table, nodes,
+// results (uint8)
+namespace ip_format {
+constexpr char kMagic[8] = {'L', 'S', 'H', 'C', 'I', 'D', 'R', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 128;
+constexpr size_t kAlignment = 64;
+
+struct ip_file_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;          // sizeof(ip_node_t)
+    uint64_t prefix_count;
+    uint64_t v4_root_offset;     // 0 if absent
+    uint64_t v6_root_offset;     // 0 if absent
+    uint64_t node_offset;
+    uint64_t node_count;
+    uint64_t leaf_offset;
+    uint64_t leaf_count;
+    uint64_t reserved[5];
+    uint64_t body_checksum;      // XXH3-64 of every byte after the header
+    uint64_t header_checksum;    // XXH3-64 of all preceding header bytes
+};
+static_assert(sizeof(ip_file_header_t) == kHeaderSize, "prefix table header must stay 128 bytes");
+} // namespace ip_format
+
+using ip_format::ip_file_header_t;
+
+uint64_t header_checksum(const ip_file_header_t& header) {
+    return XXH3_64bits(&header, offsetof(ip_file_header_t, header_checksum));
+}
+
+// Builds the trie of one family from prefixes sorted by (address, length)
+class trie_builder_t {
+public:
+    explicit trie_builder_t(ip_table_t& table) : table_(table) {}
+
+    void build_root(const IpPrefix* begin, const IpPrefix* end, std::vector<uint32_t>& root) {
+        root.assign(kRootEntries, 0);
+        fill(begin, end, 0, 16, 0, root.data());
+        for (const IpPrefix* group = begin; group != end;) {
+            const IpPrefix* next = next_group(group, end, 16);
+            const IpPrefix* deeper = first_longer(group, next, 16);
+            if (deeper != next) {
+                const size_t slot = size_t{group->address[0]} << 8 | group->address[1];
+                const uint32_t node = allocate(1);
+                build_node(node, deeper, next, 16, root[slot]);
+                root[slot] = kChild | node;
+            }
+            group = next;
+        }
+    }
+
+private:
+    // Writes length + 1 over the slots (the bits address bits after
+    // depth) of every prefix with min_length <= length <= depth + bits,
+    // shortest first so longer ones win
+    static void fill(const IpPrefix* begin, const IpPrefix* end, uint32_t depth, uint32_t bits,
+                     uint32_t min_length, uint32_t* slots) {
+        std::vector<const IpPrefix*> ending;
+        for (const IpPrefix* p = begin; p != end; ++p) {
+            if (p->length >= min_length && p->length <= depth + bits) ending.push_back(p);
+        }
+        std::stable_sort(ending.begin(), ending.end(),
+                         [](const IpPrefix* a, const IpPrefix* b) { return a->length < b->length; });
+        for (const IpPrefix* p : ending) {
+            size_t slot = p->address[depth / 8];
+            if (bits == 16) slot = slot << 8 | p->address[depth / 8 + 1];
+            const size_t span = size_t{1} << (depth + bits - p->length);
+            uint32_t* first = slots + (slot & ~(span - 1));
+            std::fill(first, first + span, uint32_t{p->length} + 1);
+        }
+    }
+
+    // End of the run of prefixes whose first depth bits equal p's
+    static const IpPrefix* next_group(const IpPrefix* p, const IpPrefix* end, uint32_t depth) {
+        const IpPrefix* q = p + 1;
+        while (q != end && std::memcmp(q->address, p->address, depth / 8) == 0) ++q;
+        return q;
+    }
+
+    // A run is by address, so prefixes that end at depth may precede the
+    // longer ones that need a node below it
+    static const IpPrefix* first_longer(const IpPrefix* p, const IpPrefix* end, uint32_t depth) {
+        while (p != end && p->length <= depth) ++p;
+        return p;
+    }
+
+    uint32_t allocate(size_t count) {
+        const size_t first = table_.node_storage.size();
+        table_.node_storage.resize(first + count);
+        return static_cast<uint32_t>(first);
+    }
+
+    void build_node(uint32_t index, const IpPrefix* begin, const IpPrefix* end, uint32_t depth, uint32_t inherited) {
+        const uint32_t byte = depth / 8;
+        uint32_t slots[256];
+        std::fill(slots, slots + 256, inherited);
+        fill(begin, end, depth, 8, depth + 1, slots);
+
+        // Children: runs of prefixes longer than this node sharing a slot
+        bool child[256] = {};
+        uint32_t children = 0;
+        for (const IpPrefix* p = begin; p != end; ++p) {
+            if (p->length > depth + 8 && !child[p->address[byte]]) {
+                child[p->address[byte]] = true;
+                ++children;
+            }
+        }
+
+        ip_node_t node{};
+        node.child_base = children ? allocate(children) : 0;
+        node.leaf_base = static_cast<uint32_t>(table_.leaf_storage.size());
+        bool have_leaf = false;
+        uint32_t last = 0;
+        for (uint32_t i = 0; i < 256; ++i) {
+            if (child[i]) {
+                node.child_bits[i >> 6] |= uint64_t{1} << (i & 63);
+            } else if (!have_leaf || slots[i] != last) {
+                node.leaf_bits[i >> 6] |= uint64_t{1} << (i & 63);
+                table_.leaf_storage.push_back(static_cast<uint8_t>(slots[i]));
+                have_leaf = true;
+                last = slots[i];
+            }
+        }
+        for (uint32_t w = 1; w < 4; ++w) {
+            node.child_rank[w] = static_cast<uint8_t>(node.child_rank[w - 1] + std::popcount(node.child_bits[w - 1]));
+            node.leaf_rank[w] = static_cast<uint8_t>(node.leaf_rank[w - 1] + std::popcount(node.leaf_bits[w - 1]));
+        }
+        table_.node_storage[index] = node;
+
+        uint32_t next_child = node.child_base;
+        for (const IpPrefix* group = begin; group != end;) {
+            const IpPrefix* next = next_group(group, end, depth + 8);
+            const IpPrefix* deeper = first_longer(group, next, depth + 8);
+            if (deeper != next) {
+                build_node(next_child++, deeper, next, depth + 8, slots[group->address[byte]]);
+            }
+            group = next;
+        }
+    }
+
+    ip_table_t& table_;
+};
+
+// Longest prefix for a 16-byte address (IPv4 in the first four); depth is
+// bounded by the address even for a corrupt mapped file
+inline int lookup_in(const ip_table_t& t, const uint32_t* root, const uint8_t* address, uint32_t max_bytes) {
+    if (!root) return -1;
+    uint32_t entry = root[uint32_t{address[0]} << 8 | address[1]];
+    for (uint32_t byte = 2; (entry & kChild) && byte < max_bytes; ++byte) {
+        const ip_node_t& node = t.nodes[entry & ~kChild];
+        const uint32_t i = address[byte];
+        const uint32_t w = i >> 6;
+        const uint64_t bit = uint64_t{1} << (i & 63);
+        if (node.child_bits[w] & bit) {
+            entry = kChild | (node.child_base + node.child_rank[w] +
+                              static_cast<uint32_t>(std::popcount(node.child_bits[w] & (bit - 1))));
+        } else {
+            entry = t.leaves[node.leaf_base + node.leaf_rank[w] +
+                             static_cast<uint32_t>(std::popcount(node.leaf_bits[w] & (bit | (bit - 1)))) - 1];
+        }
+    }
+    return (entry & kChild) ? -1 : result_length(entry);
+}
+
+inline int lookup_prefix(const ip_table_t& t, const IpPrefix& address) {
+    return address.v6 ? lookup_in(t, t.v6_root, address.address, 16) : lookup_in(t, t.v4_root, address.address, 4);
+}
+
+bool parse_decimal(std::string_view text, uint32_t max, uint32_t& value) {
+    if (text.empty() || text.size() > 3 || (text.size() > 1 && text[0] == '0')) return false;
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return value <= max;
+}
+
+// Strict a.b.c.d, as in IPv6 tails and prefix lists
+bool parse_dotted_quad(std::string_view text, uint8_t* out) {
+    for (int i = 0; i < 4; ++i) {
+        const size_t dot = text.find('.');
+        if ((dot == std::string_view::npos) != (i == 3)) return false;
+        uint32_t part;
+        if (!parse_decimal(text.substr(0, dot), 255, part)) return false;
+        out[i] = static_cast<uint8_t>(part);
+        if (i < 3) text.remove_prefix(dot + 1);
+    }
+    return true;
+}
+
+// One part of a browser-style IPv4 host: decimal, 0-prefixed octal or
+// 0x-prefixed hex
+bool parse_ipv4_number(std::string_view part, uint64_t& value) {
+    if (part.empty()) return false;
+    uint32_t radix = 10;
+    if (part.size() >= 2 && part[0] == '0' && (part[1] == 'x' || part[1] == 'X')) {
+        radix = 16;
+        part.remove_prefix(2);
+    } else if (part.size() >= 2 && part[0] == '0') {
+        radix = 8;
+        part.remove_prefix(1);
+    }
+    value = 0;
+    for (char c : part) {
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') digit = static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') digit = static_cast<uint32_t>(c - 'A' + 10);
+        else return false;
+        if (digit >= radix) return false;
+        value = value * radix + digit;
+        if (value > 0xffffffffull) return false;
+    }
+    return true;
+}
+
+bool parse_ipv4_host(std::string_view text, uint8_t* out) {
+    if (!text.empty() && text.back() == '.') text.remove_suffix(1);
+    uint64_t parts[4];
+    size_t count = 0;
+    for (;;) {
+        const size_t dot = text.find('.');
+        if (count == 4 || !parse_ipv4_number(text.substr(0, dot), parts[count])) return false;
+        ++count;
+        if (dot == std::string_view::npos) break;
+        text.remove_prefix(dot + 1);
+    }
+    for (size_t i = 0; i + 1 < count; ++i) {
+        if (parts[i] > 255) return false;
+    }
+    if (parts[count - 1] >= (uint64_t{1} << (8 * (5 - count)))) return false;
+    uint32_t value = static_cast<uint32_t>(parts[count - 1]);
+    for (size_t i = 0; i + 1 < count; ++i) value += static_cast<uint32_t>(parts[i]) << (8 * (3 - i));
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (24 - 8 * i));
+    return true;
+}
+
+bool parse_ipv6(std::string_view text, uint8_t* out) {
+    uint16_t groups[8] = {};
+    int count = 0;
+    int compress = -1;
+    size_t i = 0;
+    if (text.size() >= 2 && text[0] == ':' && text[1] == ':') {
+        compress = 0;
+        i = 2;
+    }
+    while (i < text.size()) {
+        const size_t colon = text.find(':', i);
+        const std::string_view part = text.substr(i, colon == std::string_view::npos ? colon : colon - i);
+        if (part.find('.') != std::string_view::npos) {
+            // Trailing IPv4 form of the last two groups
+            uint8_t quad[4];
+            if (colon != std::string_view::npos || count > 6 || !parse_dotted_quad(part, quad)) return false;
+            groups[count++] = static_cast<uint16_t>(quad[0] << 8 | quad[1]);
+            groups[count++] = static_cast<uint16_t>(quad[2] << 8 | quad[3]);
+            break;
+        }
+        if (count == 8 || part.empty() || part.size() > 4) return false;
+        uint32_t value = 0;
+        for (char c : part) {
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') digit = static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') digit = static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+            value = value << 4 | digit;
+        }
+        groups[count++] = static_cast<uint16_t>(value);
+        if (colon == std::string_view::npos) break;
+        i = colon + 1;
+        if (i < text.size() && text[i] == ':') {
+            if (compress >= 0) return false;
+            compress = count;
+            ++i;
+        } else if (i == text.size()) {
+            return false;   // trailing single colon
+        }
+    }
+    if (compress < 0 ? count != 8 : count > 7) return false;
+
+    uint16_t expanded[8] = {};
+    const int tail = compress < 0 ? 0 : count - compress;
+    for (int g = 0; g < count - tail; ++g) expanded[g] = groups[g];
+    for (int g = 0; g < tail; ++g) expanded[8 - tail + g] = groups[compress + g];
+    for (int g = 0; g < 8; ++g) {
+        out[2 * g] = static_cast<uint8_t>(expanded[g] >> 8);
+        out[2 * g + 1] = static_cast<uint8_t>(expanded[g]);
+    }
+    return true;
+}
+
+bool is_ipv4_mapped(const uint8_t* address) {
+    static constexpr uint8_t kMapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return std::memcmp(address, kMapped, sizeof(kMapped)) == 0;
+}
+
+// Zeroes the bits past length
+void mask_host_bits(IpPrefix& prefix) {
+    const size_t bytes = prefix.v6 ? 16 : 4;
+    for (size_t i = 0; i < bytes; ++i) {
+        const int keep = std::clamp(static_cast<int>(prefix.length) - static_cast<int>(8 * i), 0, 8);
+        prefix.address[i] &= static_cast<uint8_t>(0xff00 >> keep);
+    }
+    std::fill(prefix.address + bytes, prefix.address + 16, uint8_t{0});
+}
+
+size_t align_up(size_t offset) {
+    return (offset + ip_format::kAlignment - 1) & ~(ip_format::kAlignment - 1);
+}
+
+// Every index the lookup can follow stays inside the table
+bool validate_structure(const ip_table_t& t) {
+    auto root_ok = [&](const uint32_t* root) {
+        if (!root) return true;
+        for (size_t i = 0; i < kRootEntries; ++i) {
+            if ((root[i] & kChild) && (root[i] & ~kChild) >= t.node_count) return false;
+        }
+        return true;
+    };
+    if (!root_ok(t.v4_root) || !root_ok(t.v6_root)) return false;
+    for (uint64_t n = 0; n < t.node_count; ++n) {
+        const ip_node_t& node = t.nodes[n];
+        uint64_t children = 0;
+        uint64_t leaves = 0;
+        for (int w = 0; w < 4; ++w) {
+            if (node.child_rank[w] != children || node.leaf_rank[w] != leaves) return false;
+            children += static_cast<uint64_t>(std::popcount(node.child_bits[w]));
+            leaves += static_cast<uint64_t>(std::popcount(node.leaf_bits[w]));
+            if (node.child_bits[w] & node.leaf_bits[w]) return false;
+        }
+        // A non-child slot needs a run started at or before it
+        const uint32_t first_leaf_slot = [&] {
+            for (uint32_t i = 0; i < 256; ++i) {
+                if (!((node.child_bits[i >> 6] >> (i & 63)) & 1)) return i;
+            }
+            return 256u;
+        }();
+        if (first_leaf_slot < 256 && !((node.leaf_bits[first_leaf_slot >> 6] >> (first_leaf_slot & 63)) & 1)) {
+            return false;
+        }
+        if ((children && node.child_base + children > t.node_count) || node.leaf_base + leaves > t.leaf_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool parse_ip_address(std::string_view text, IpPrefix& out) {
+    out = IpPrefix{};
+    if (text.size() >= 2 && text.front() == '[' && text.back() == ']') {
+        text = text.substr(1, text.size() - 2);
+        if (text.find(':') == std::string_view::npos) return false;
+    }
+    if (text.find(':') != std::string_view::npos) {
+        if (!parse_ipv6(text, out.address)) return false;
+        if (is_ipv4_mapped(out.address)) {
+            std::memmove(out.address, out.address + 12, 4);
+            std::fill(out.address + 4, out.address + 16, uint8_t{0});
+            out.length = 32;
+            return true;
+        }
+        out.v6 = true;
+        out.length = 128;
+        return true;
+    }
+    out.length = 32;
+    return parse_ipv4_host(text, out.address);
+}
+
+bool parse_ip_prefix(std::string_view text, IpPrefix& out) {
+    const size_t slash = text.find('/');
+    const std::string_view address = text.substr(0, slash);
+    const bool v6_text = address.find(':') != std::string_view::npos;
+    if (v6_text ? !parse_ip_address(address, out) : !parse_dotted_quad(address, out.address)) return false;
+    if (!v6_text) {
+        std::fill(out.address + 4, out.address + 16, uint8_t{0});
+        out.v6 = false;
+        out.length = 32;
+    }
+    if (slash != std::string_view::npos) {
+        uint32_t length;
+        if (!parse_decimal(text.substr(slash + 1), v6_text ? 128 : 32, length)) return false;
+        // An IPv4-mapped network counts its bits within the IPv4 space
+        if (v6_text && !out.v6) {
+            if (length < 96) return false;
+            length -= 96;
+        }
+        out.length = static_cast<uint8_t>(length);
+    }
+    mask_host_bits(out);
+    return true;
+}
+
+IpPrefixTable::IpPrefixTable() : table_(nullptr) {}
+
+IpPrefixTable::~IpPrefixTable() {
+    // As BinaryFuseWrapper: destroying the table mid-lookup is a caller bug
+    delete table_.exchange(nullptr);
+}
+
+void IpPrefixTable::publish(ip_table_t* table) {
+    ip_table_t* old = table_.exchange(table);
+    if (!old) return;
+
+    EpochReclaimer& reclaimer = EpochReclaimer::global();
+    reclaimer.retire(old, [](void* p) { delete static_cast<ip_table_t*>(p); });
+    if (!reclaimer.in_critical_section()) {
+        reclaimer.synchronize();
+    }
+}
+
+bool IpPrefixTable::build(std::vector<IpPrefix> prefixes) {
+    for (IpPrefix& prefix : prefixes) {
+        prefix.length = std::min<uint8_t>(prefix.length, prefix.v6 ? 128 : 32);
+        mask_host_bits(prefix);
+    }
+    // IPv4 first; within a family by address, then length
+    std::sort(prefixes.begin(), prefixes.end(), [](const IpPrefix& a, const IpPrefix& b) {
+        if (a.v6 != b.v6) return b.v6;
+        const int order = std::memcmp(a.address, b.address, sizeof(a.address));
+        return order != 0 ? order < 0 : a.length < b.length;
+    });
+    prefixes.erase(std::unique(prefixes.begin(), prefixes.end(), [](const IpPrefix& a, const IpPrefix& b) {
+        return a.v6 == b.v6 && a.length == b.length && std::memcmp(a.address, b.address, sizeof(a.address)) == 0;
+    }), prefixes.end());
+
+    if (prefixes.empty()) {
+        publish(nullptr);
+        return true;
+    }
+
+    auto table = std::make_unique<ip_table_t>();
+    const auto v6_begin = std::find_if(prefixes.begin(), prefixes.end(), [](const IpPrefix& p) { return p.v6; });
+    trie_builder_t builder(*table);
+    if (v6_begin != prefixes.begin()) {
+        builder.build_root(prefixes.data(), prefixes.data() + (v6_begin - prefixes.begin()), table->v4_root_storage);
+    }
+    if (v6_begin != prefixes.end()) {
+        builder.build_root(prefixes.data() + (v6_begin - prefixes.begin()), prefixes.data() + prefixes.size(),
+                           table->v6_root_storage);
+    }
+    if (table->node_storage.size() >= kChild) {
+        std::cerr << "[IpPrefixTable] Too many trie nodes: " << table->node_storage.size() << std::endl;
+        return false;
+    }
+    table->prefix_count = prefixes.size();
+    table->point_at_storage();
+
+    std::cout << "[IpPrefixTable] Built " << prefixes.size() << " prefixes (" << (v6_begin - prefixes.begin())
+              << " IPv4): " << table->node_count << " nodes, " << table->leaf_count << " results" << std::endl;
+    publish(table.release());
+    return true;
+}
+
+bool IpPrefixTable::build(const std::vector<std::string>& prefixes) {
+    std::vector<IpPrefix> parsed;
+    parsed.reserve(prefixes.size());
+    size_t rejected = 0;
+    for (const std::string& text : prefixes) {
+        IpPrefix prefix;
+        if (parse_ip_prefix(text, prefix)) parsed.push_back(prefix);
+        else ++rejected;
+    }
+    if (rejected > 0) {
+        std::cerr << "[IpPrefixTable] Skipped " << rejected << " invalid prefixes" << std::endl;
+    }
+    return build(std::move(parsed));
+}
+
+bool IpPrefixTable::load_list(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[IpPrefixTable] Cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::vector<IpPrefix> parsed;
+    size_t rejected = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        const size_t end = line.find_last_not_of(" \t\r");
+        IpPrefix prefix;
+        if (parse_ip_prefix(std::string_view(line).substr(begin, end - begin + 1), prefix)) parsed.push_back(prefix);
+        else ++rejected;
+    }
+    if (rejected > 0) {
+        std::cerr << "[IpPrefixTable] Skipped " << rejected << " invalid lines in " << path << std::endl;
+    }
+    return build(std::move(parsed));
+}
+
+bool IpPrefixTable::save_to_file(const std::string& path) const {
+    EpochGuard guard;
+    const ip_table_t* t = table_.load(std::memory_order_acquire);
+    if (!t) return false;
+
+    ip_file_header_t header{};
+    std::memcpy(header.magic, ip_format::kMagic, sizeof(header.magic));
+    header.version = ip_format::kVersion;
+    header.node_size = sizeof(ip_node_t);
+    header.prefix_count = t->prefix_count;
+    header.node_count = t->node_count;
+    header.leaf_count = t->leaf_count;
+
+    // Sections in file order, each aligned
+    struct section_t {
+        const void* data;
+        size_t bytes;
+        uint64_t* offset;
+    };
+    const section_t sections[] = {
+        {t->v4_root, t->v4_root ? kRootEntries * sizeof(uint32_t) : 0, &header.v4_root_offset},
+        {t->v6_root, t->v6_root ? kRootEntries * sizeof(uint32_t) : 0, &header.v6_root_offset},
+        {t->nodes, t->node_count * sizeof(ip_node_t), &header.node_offset},
+        {t->leaves, t->leaf_count, &header.leaf_offset},
+    };
+    std::vector<uint8_t> body;
+    for (const section_t& section : sections) {
+        if (section.bytes == 0) continue;
+        const size_t offset = align_up(ip_format::kHeaderSize + body.size());
+        body.resize(offset - ip_format::kHeaderSize);
+        *section.offset = offset;
+        const uint8_t* bytes = static_cast<const uint8_t*>(section.data);
+        body.insert(body.end(), bytes, bytes + section.bytes);
+    }
+    header.body_checksum = XXH3_64bits(body.data(), body.size());
+    header.header_checksum = header_checksum(header);
+
+    // Write next to the target and rename, as for L3
+    const std::string tmp_path = path + ".tmp";
+    try {
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+            out.flush();
+            if (!out.good()) return false;
+        }
+        std::filesystem::rename(tmp_path, path);
+        std::cout << "[IpPrefixTable] Saved " << t->prefix_count << " prefixes to: " << path << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "[IpPrefixTable] Save failed: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+}
+
+bool IpPrefixTable::load_from_file(const std::string& path, bool verify_checksum) {
+    auto table = std::make_unique<ip_table_t>();
+    MappedFile& file = table->mapping;
+    if (!file.open(path) || file.size() < ip_format::kHeaderSize) {
+        std::cerr << "[IpPrefixTable] Cannot map prefix table: " << path << std::endl;
+        return false;
+    }
+
+    ip_file_header_t header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, ip_format::kMagic, sizeof(header.magic)) != 0 ||
+        header.version != ip_format::kVersion || header.node_size != sizeof(ip_node_t) ||
+        header.header_checksum != header_checksum(header)) {
+        std::cerr << "[IpPrefixTable] Not a prefix table of this version, or a corrupt header: " << path << std::endl;
+        return false;
+    }
+
+    // Every section inside the file and aligned for in-place access
+    auto section = [&](uint64_t offset, uint64_t bytes) -> const uint8_t* {
+        if (offset == 0 && bytes == 0) return nullptr;
+        if (offset < ip_format::kHeaderSize || offset % ip_format::kAlignment != 0 ||
+            bytes > file.size() || offset > file.size() - bytes) {
+            return reinterpret_cast<const uint8_t*>(-1);
+        }
+        return file.data() + offset;
+    };
+    const uint8_t* bad = reinterpret_cast<const uint8_t*>(-1);
+    const uint8_t* v4 = section(header.v4_root_offset, header.v4_root_offset ? kRootEntries * sizeof(uint32_t) : 0);
+    const uint8_t* v6 = section(header.v6_root_offset, header.v6_root_offset ? kRootEntries * sizeof(uint32_t) : 0);
+    const uint8_t* nodes = header.node_count > file.size() / sizeof(ip_node_t)
+        ? bad : section(header.node_offset, header.node_count * sizeof(ip_node_t));
+    const uint8_t* leaves = section(header.leaf_offset, header.leaf_count);
+    if (v4 == bad || v6 == bad || nodes == bad || leaves == bad) {
+        std::cerr << "[IpPrefixTable] Prefix table sections out of bounds: " << path << std::endl;
+        return false;
+    }
+    if (verify_checksum &&
+        XXH3_64bits(file.data() + ip_format::kHeaderSize, file.size() - ip_format::kHeaderSize) != header.body_checksum) {
+        std::cerr << "[IpPrefixTable] Prefix table checksum mismatch: " << path << std::endl;
+        return false;
+    }
+
+    table->v4_root = reinterpret_cast<const uint32_t*>(v4);
+    table->v6_root = reinterpret_cast<const uint32_t*>(v6);
+    table->nodes = reinterpret_cast<const ip_node_t*>(nodes);
+    table->leaves = leaves;
+    table->node_count = header.node_count;
+    table->leaf_count = header.leaf_count;
+    table->prefix_count = header.prefix_count;
+    if (!validate_structure(*table)) {
+        std::cerr << "[IpPrefixTable] Prefix table structure is inconsistent: " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "[IpPrefixTable] Mapped " << table->prefix_count << " prefixes from " << path << std::endl;
+    publish(table.release());
+    return true;
+}
+
+int IpPrefixTable::lookup(const IpPrefix& address) const {
+    EpochGuard guard;
+    const ip_table_t* t = table_.load(std::memory_order_acquire);
+    return t ? lookup_prefix(*t, address) : -1;
+}
+
+int IpPrefixTable::lookup_v4(uint32_t address) const {
+    IpPrefix ip;
+    for (int i = 0; i < 4; ++i) ip.address[i] = static_cast<uint8_t>(address >> (24 - 8 * i));
+    return lookup(ip);
+}
+
+int IpPrefixTable::lookup_v6(const uint8_t address[16]) const {
+    IpPrefix ip;
+    std::memcpy(ip.address, address, sizeof(ip.address));
+    ip.v6 = true;
+    if (is_ipv4_mapped(ip.address)) {
+        std::memmove(ip.address, ip.address + 12, 4);
+        std::fill(ip.address + 4, ip.address + 16, uint8_t{0});
+        ip.v6 = false;
+    }
+    return lookup(ip);
+}
+
+int IpPrefixTable::lookup(std::string_view host) const {
+    IpPrefix ip;
+    return parse_ip_address(host, ip) ? lookup(ip) : -1;
+}
+
+size_t IpPrefixTable::size() const {
+    EpochGuard guard;
+    const ip_table_t* t = table_.load(std::memory_order_acquire);
+    return t ? t->prefix_count : 0;
+}
+
+size_t IpPrefixTable::get_memory_usage() const {
+    EpochGuard guard;
+    const ip_table_t* t = table_.load(std::memory_order_acquire);
+    if (!t) return 0;
+    return ((t->v4_root ? 1 : 0) + (t->v6_root ? 1 : 0)) * kRootEntries * sizeof(uint32_t) +
+           t->node_count * sizeof(ip_node_t) + t->leaf_count;
+}
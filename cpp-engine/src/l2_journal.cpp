@@ -0,0 +1,482 @@
+#include "l2_journal.hpp"
+#include <xxhash.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Both formats hold keys of canonical URLs. Frames have no version field,
+// so the format shows in their magic: segments framed with kStaleFrameMagic
+// (and version 1 snapshots) hash URLs as given and are refused.
+constexpr char kFrameMagic[4] = {'L', 'S', 'J', '2'};
+constexpr char kStaleFrameMagic[4] = {'L', 'S', 'J', 'F'};
+constexpr char kSnapshotMagic[8] = {'L', 'S', 'H', 'L', '2', 'S', 'N', '\0'};
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr const char* kSnapshotName = "snapshot.bin";
+// Sanity bound on a frame's record count, so a torn header cannot ask for
+// an absurd allocation; larger groups are split into several frames
+constexpr uint32_t kMaxFrameRecords = 1u << 24;
+
+// Precedes each group of records; a frame whose checksum does not match is
+// where a crash cut the segment off
+struct journal_frame_t {
+    char magic[4];
+    uint32_t count;
+    uint64_t first_seq;
+    uint64_t checksum;    // XXH3-64 of the records, seeded with first_seq
+};
+
+// Followed by count sorted keys
+struct snapshot_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t seq;         // the snapshot covers every record before it
+    uint64_t count;
+    uint64_t checksum;    // XXH3-64 of the keys, seeded with seq
+};
+
+std::string segment_name(uint64_t first_seq) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "journal-%016llx.log", static_cast<unsigned long long>(first_seq));
+    return name;
+}
+
+// First seq of a segment from its file name; false for other files
+bool parse_segment_name(const std::string& name, uint64_t& first_seq) {
+    unsigned long long seq;
+    char tail[8];
+    if (name.size() != 28 || std::sscanf(name.c_str(), "journal-%16llx.%3s", &seq, tail) != 2 ||
+        std::strcmp(tail, "log") != 0) {
+        return false;
+    }
+    first_seq = seq;
+    return true;
+}
+
+int open_append(const std::string& path) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+}
+
+bool write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+#ifdef _WIN32
+        const int n = _write(fd, p, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+        const ssize_t n = ::write(fd, p, size);
+#endif
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool sync_fd(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+void close_fd(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// Makes a rename or unlink in dir durable; NTFS has no equivalent step
+void sync_directory(const std::string& dir) {
+#ifndef _WIN32
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)dir;
+#endif
+}
+
+// Whether the segment at path was written in the earlier frame format
+bool is_stale_segment(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kStaleFrameMagic)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, kStaleFrameMagic, sizeof(magic)) == 0;
+}
+
+bool read_snapshot(const std::string& path, uint64_t& seq, std::vector<uint64_t>& keys) {
+    std::ifstream in(path, std::ios::binary);
+    snapshot_header_t header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+        return false;
+    }
+    if (header.version != kSnapshotVersion) {
+        std::cerr << "[L2Journal] Unsupported snapshot version " << header.version << " (expected "
+                  << kSnapshotVersion << "): " << path << std::endl;
+        return false;
+    }
+    keys.resize(header.count);
+    if (!in.read(reinterpret_cast<char*>(keys.data()), static_cast<std::streamsize>(keys.size() * sizeof(uint64_t))) ||
+        XXH3_64bits_withSeed(keys.data(), keys.size() * sizeof(uint64_t), header.seq) != header.checksum) {
+        return false;
+    }
+    seq = header.seq;
+    return true;
+}
+
+} // namespace
+
+L2Journal::L2Journal()
+    : L2Journal(Options{}) {}
+
+L2Journal::L2Journal(Options options)
+    : options_(options) {}
+
+L2Journal::~L2Journal() {
+    close();
+}
+
+bool L2Journal::open(const std::string& dir,
+                     const std::function<void(std::vector<uint64_t>&&)>& on_snapshot,
+                     const std::function<void(const JournalRecord&, bool covered)>& on_record) {
+    if (is_open()) return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "[L2Journal] Cannot create " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+    dir_ = dir;
+
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        uint64_t first_seq = 0;
+        if (parse_segment_name(entry.path().filename().string(), first_seq)) {
+            segments.emplace_back(first_seq, entry.path().string());
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    // Checked before anything is handed to the callbacks
+    for (const auto& segment : segments) {
+        if (is_stale_segment(segment.second)) {
+            std::cerr << "[L2Journal] Segment in an earlier format (keys of URLs as given): " << segment.second
+                      << std::endl;
+            return false;
+        }
+    }
+
+    uint64_t snapshot_seq = 1;
+    const std::string snapshot_path = (std::filesystem::path(dir) / kSnapshotName).string();
+    if (std::filesystem::exists(snapshot_path, ec)) {
+        std::vector<uint64_t> keys;
+        // Written via rename after a sync, so a bad one is not a crash artifact
+        if (!read_snapshot(snapshot_path, snapshot_seq, keys)) {
+            std::cerr << "[L2Journal] Cannot read snapshot: " << snapshot_path << std::endl;
+            return false;
+        }
+        std::cout << "[L2Journal] Loaded snapshot of " << keys.size() << " keys at seq " << snapshot_seq << std::endl;
+        on_snapshot(std::move(keys));
+    }
+
+    next_seq_ = snapshot_seq;
+    for (const auto& [first_seq, path] : segments) {
+        if (first_seq > next_seq_) {
+            std::cerr << "[L2Journal] Records " << next_seq_ << ".." << first_seq - 1
+                      << " missing before " << path << std::endl;
+        }
+        replay_segment(path, first_seq, snapshot_seq, on_record);
+    }
+
+    // Never appended to a replayed segment: it may end in a torn frame
+    if (!start_segment(next_seq_)) return false;
+    buffered_from_ = durable_seq_ = next_seq_;
+    failed_ = false;
+    running_ = true;
+    flusher_ = std::thread(&L2Journal::run, this);
+    return true;
+}
+
+bool L2Journal::replay_segment(const std::string& path, uint64_t first_seq, uint64_t snapshot_seq,
+                               const std::function<void(const JournalRecord&, bool covered)>& on_record) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    uint64_t expected = first_seq;
+    size_t replayed = 0;
+    bool torn = false;
+    std::vector<JournalRecord> records;
+    journal_frame_t frame{};
+    while (in.read(reinterpret_cast<char*>(&frame), sizeof(frame))) {
+        torn = std::memcmp(frame.magic, kFrameMagic, sizeof(frame.magic)) != 0 ||
+               frame.first_seq != expected || frame.count > kMaxFrameRecords;
+        if (torn) break;
+        records.resize(frame.count);
+        const size_t bytes = records.size() * sizeof(JournalRecord);
+        torn = !in.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(bytes)) ||
+               XXH3_64bits_withSeed(records.data(), bytes, frame.first_seq) != frame.checksum;
+        if (torn) break;
+        for (size_t i = 0; i < records.size(); ++i) {
+            on_record(records[i], frame.first_seq + i < snapshot_seq);
+        }
+        expected += frame.count;
+        replayed += frame.count;
+    }
+    if (torn || in.gcount() > 0) {
+        std::cerr << "[L2Journal] Torn frame after record " << expected - 1 << " in " << path
+                  << "; later records dropped" << std::endl;
+    }
+    next_seq_ = std::max(next_seq_, expected);
+    std::cout << "[L2Journal] Replayed " << replayed << " records from " << path << std::endl;
+    return true;
+}
+
+bool L2Journal::start_segment(uint64_t first_seq) {
+    const std::string path = (std::filesystem::path(dir_) / segment_name(first_seq)).string();
+    const int fd = open_append(path);
+    if (fd < 0) {
+        std::cerr << "[L2Journal] Cannot open segment " << path << std::endl;
+        return false;
+    }
+    if (fd_ >= 0) {
+        sync_fd(fd_);
+        close_fd(fd_);
+    }
+    fd_ = fd;
+    segment_seq_ = first_seq;
+    sync_directory(dir_);
+    return true;
+}
+
+void L2Journal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+
+    // The flusher's last pass wrote everything appended before close()
+    std::lock_guard<std::mutex> io_lock(io_mutex_);
+    flush_buffer();
+    if (fd_ >= 0) {
+        close_fd(fd_);
+        fd_ = -1;
+    }
+}
+
+uint64_t L2Journal::append(JournalOp op, uint64_t key) {
+    JournalRecord record{};
+    record.key = key;
+    record.unix_seconds = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    record.op = op;
+
+    uint64_t seq;
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seq = next_seq_++;
+        buffer_.push_back(record);
+        full = buffer_.size() >= options_.group_records;
+    }
+    if (full) wake_.notify_one();
+    if (options_.synchronous) wait_durable(seq);
+    return seq;
+}
+
+bool L2Journal::wait_durable(uint64_t seq) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (durable_seq_ > seq) return true;
+
+    // Whoever flushes next takes every record buffered so far with it
+    waiting_for_ = std::max(waiting_for_, seq);
+    wake_.notify_one();
+    synced_.wait(lock, [&] { return durable_seq_ > seq || failed_ || !running_; });
+    return durable_seq_ > seq;
+}
+
+bool L2Journal::flush() {
+    std::lock_guard<std::mutex> io_lock(io_mutex_);
+    return flush_buffer();
+}
+
+// Caller holds io_mutex_
+bool L2Journal::flush_buffer() {
+    std::vector<JournalRecord> records;
+    uint64_t first_seq = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records.swap(buffer_);
+        first_seq = buffered_from_;
+        buffered_from_ = next_seq_;
+    }
+    if (records.empty()) return !failed_;
+
+    // One write per frame and one sync for the whole group
+    bool ok = fd_ >= 0;
+    for (size_t i = 0; ok && i < records.size(); i += kMaxFrameRecords) {
+        const size_t n = std::min<size_t>(records.size() - i, kMaxFrameRecords);
+        ok = write_frame(records.data() + i, n, first_seq + i);
+    }
+    ok = ok && sync_fd(fd_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok) {
+            durable_seq_ = first_seq + records.size();
+            bytes_since_snapshot_ += sizeof(journal_frame_t) + records.size() * sizeof(JournalRecord);
+        } else if (!failed_) {
+            failed_ = true;
+            std::cerr << "[L2Journal] Write failed; records from " << first_seq << " on are not durable" << std::endl;
+        }
+    }
+    synced_.notify_all();
+    return ok;
+}
+
+bool L2Journal::write_frame(const JournalRecord* records, size_t n, uint64_t first_seq) {
+    const size_t bytes = n * sizeof(JournalRecord);
+    std::vector<char> out(sizeof(journal_frame_t) + bytes);
+
+    journal_frame_t frame{};
+    std::memcpy(frame.magic, kFrameMagic, sizeof(frame.magic));
+    frame.count = static_cast<uint32_t>(n);
+    frame.first_seq = first_seq;
+    frame.checksum = XXH3_64bits_withSeed(records, bytes, first_seq);
+    std::memcpy(out.data(), &frame, sizeof(frame));
+    std::memcpy(out.data() + sizeof(frame), records, bytes);
+    return write_all(fd_, out.data(), out.size());
+}
+
+void L2Journal::run() {
+    for (;;) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, options_.flush_interval, [this] {
+                return !running_ || buffer_.size() >= options_.group_records ||
+                       (waiting_for_ >= durable_seq_ && !buffer_.empty());
+            });
+            stopping = !running_;
+        }
+
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        flush_buffer();
+        if (stopping) return;
+    }
+}
+
+bool L2Journal::snapshot(const std::function<std::vector<uint64_t>()>& copy_keys) {
+    if (!is_open()) return false;
+    std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex_);
+
+    // Everything appended so far goes to the old segment, everything after
+    // this point to the new one
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        if (!flush_buffer()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            seq = buffered_from_;
+        }
+        // Nothing appended since the segment began: it stays current
+        if (seq != segment_seq_ && !start_segment(seq)) return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_since_snapshot_ = 0;
+    }
+
+    std::vector<uint64_t> keys = copy_keys();
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    snapshot_header_t header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.seq = seq;
+    header.count = keys.size();
+    header.checksum = XXH3_64bits_withSeed(keys.data(), keys.size() * sizeof(uint64_t), seq);
+
+    const std::filesystem::path path = std::filesystem::path(dir_) / kSnapshotName;
+    const std::string tmp_path = path.string() + ".tmp";
+    const int fd = open_append(tmp_path);
+    if (fd < 0) return false;
+    const bool written = write_all(fd, &header, sizeof(header)) &&
+                         write_all(fd, keys.data(), keys.size() * sizeof(uint64_t)) && sync_fd(fd);
+    close_fd(fd);
+
+    std::error_code ec;
+    if (written) {
+        std::filesystem::rename(tmp_path, path, ec);
+    }
+    if (!written || ec) {
+        std::cerr << "[L2Journal] Snapshot write failed: " << path.string() << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    sync_directory(dir_);
+    drop_segments(seq);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++snapshots_;
+    }
+    std::cout << "[L2Journal] Snapshot of " << keys.size() << " keys at seq " << seq << std::endl;
+    return true;
+}
+
+void L2Journal::drop_segments(uint64_t before_seq) {
+    const auto cutoff = std::filesystem::file_time_type::clock::now() - options_.retain;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        uint64_t first_seq = 0;
+        if (!parse_segment_name(entry.path().filename().string(), first_seq) || first_seq >= before_seq) {
+            continue;
+        }
+        // A retained segment goes once its newest record is past the TTL
+        std::error_code time_ec;
+        if (options_.retain.count() > 0 && entry.last_write_time(time_ec) > cutoff) continue;
+        std::filesystem::remove(entry.path(), ec);
+    }
+    sync_directory(dir_);
+}
+
+uint64_t L2Journal::get_durable_seq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durable_seq_;
+}
+
+uint64_t L2Journal::get_bytes_since_snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_since_snapshot_;
+}
+
+uint64_t L2Journal::get_snapshots() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return snapshots_;
+}
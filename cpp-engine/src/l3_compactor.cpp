@@ -0,0 +1,107 @@
+#include "l3_compactor.hpp"
+#include "coherent_memory_manager.hpp"
+#include <algorithm>
+#include <iostream>
+
+L3Compactor::L3Compactor(PerformanceOptimizedFilter& filter)
+    : L3Compactor(filter, Options{}) {}
+
+L3Compactor::L3Compactor(PerformanceOptimizedFilter& filter, Options options)
+    : filter_(filter), options_(options) {}
+
+L3Compactor::~L3Compactor() {
+    stop();
+}
+
+bool L3Compactor::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return false;
+
+    running_ = true;
+    thread_ = std::thread(&L3Compactor::run, this);
+    return true;
+}
+
+void L3Compactor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void L3Compactor::request_compaction() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requested_ = true;
+    }
+    wake_.notify_all();
+}
+
+bool L3Compactor::due(std::chrono::steady_clock::time_point last) const {
+    // Keys L2 rejects past its growth limit stay logged for compaction, so
+    // the log can outgrow L2 itself
+    const size_t count = std::max(filter_.get_l2_count(), filter_.get_l2_log_size());
+    if (count == 0 && filter_.get_l3_retracted_count() == 0) return false;
+
+    const size_t capacity = filter_.get_l2_capacity();
+    if (capacity > 0 && count >= options_.l2_fill_trigger * static_cast<double>(capacity)) {
+        return true;
+    }
+    return std::chrono::steady_clock::now() - last >= options_.interval;
+}
+
+bool L3Compactor::snapshot_due(std::chrono::steady_clock::time_point last) const {
+    if (!filter_.has_journal()) return false;
+
+    const uint64_t bytes = filter_.get_journal_bytes();
+    return bytes >= options_.snapshot_journal_bytes ||
+           (bytes > 0 && std::chrono::steady_clock::now() - last >= options_.snapshot_interval);
+}
+
+void L3Compactor::run() {
+    if (options_.numa_node >= 0) CoherentMemoryManager::pin_thread_to_numa(options_.numa_node);
+
+    auto last = std::chrono::steady_clock::now();
+    auto last_snapshot = last;
+
+    for (;;) {
+        bool requested;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, options_.poll, [this] { return !running_ || requested_; });
+            if (!running_) return;
+            requested = requested_;
+            requested_ = false;
+        }
+
+        // Lookups never rotate L2 generations, so expiry is driven from here
+        filter_.expire_l2();
+
+        if (snapshot_due(last_snapshot)) {
+            if (filter_.snapshot_journal()) snapshots_.fetch_add(1, std::memory_order_relaxed);
+            last_snapshot = std::chrono::steady_clock::now();
+        }
+
+        // A static L3 (see PerformanceOptimizedFilter::load_l3_replica) has
+        // nothing to compact into
+        if (filter_.is_l3_static() || (!requested && !due(last))) continue;
+
+        auto started = std::chrono::steady_clock::now();
+        CompactionResult result = filter_.compact_l2(options_.consolidate_l2);
+        last = std::chrono::steady_clock::now();
+        if (!result.ok) continue;
+
+        compactions_.fetch_add(1, std::memory_order_relaxed);
+        absorbed_.fetch_add(result.absorbed, std::memory_order_relaxed);
+        if (result.absorbed > 0) {
+            std::cout << "[L3Compactor] Absorbed " << result.absorbed << " L2 keys, L3 now "
+                      << result.l3_keys << " keys, L2 " << result.l2_remaining << " ("
+                      << std::chrono::duration<double, std::milli>(last - started).count() << " ms)" << std::endl;
+        }
+    }
+}
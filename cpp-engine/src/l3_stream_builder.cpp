@@ -0,0 +1,233 @@
+#include "l3_stream_builder.hpp"
+#include "fuse_layout.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+// Resident bytes per key while a shard is built: the key vector plus the
+// construction scratch of fuse_build and the fingerprint array (4.5 B/key
+// at 32 bits, still within this bound)
+constexpr size_t kBuildBytesPerKey = 40;
+
+constexpr size_t kReadChunkKeys = size_t{1} << 16;
+
+std::string spill_path(const std::string& prefix, size_t bucket) {
+    return prefix + std::to_string(bucket) + ".bin";
+}
+
+} // namespace
+
+L3StreamBuilder::L3StreamBuilder() : L3StreamBuilder(Options{}) {}
+
+L3StreamBuilder::L3StreamBuilder(Options options) : options_(std::move(options)) {
+    options_.spill_bits = std::min(options_.spill_bits, l3_format::kMaxShardBits);
+    options_.num_threads = std::max(1u, options_.num_threads);
+}
+
+L3StreamBuilder::~L3StreamBuilder() {
+    remove_spill_files();
+}
+
+bool L3StreamBuilder::open_spill_files() {
+    if (open_) return true;
+    if (finished_) {
+        std::cerr << "[L3StreamBuilder] Builder already used; create a new one" << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::path dir = options_.spill_dir.empty()
+        ? std::filesystem::temp_directory_path(ec) : std::filesystem::path(options_.spill_dir);
+    std::filesystem::create_directories(dir, ec);
+
+    std::ostringstream name;
+    name << "l3spill-" << std::hex << std::random_device{}() << std::random_device{}() << "-";
+    spill_prefix_ = (dir / name.str()).string();
+
+    const size_t buckets = size_t{1} << options_.spill_bits;
+    // A quarter of the budget for write buffers, within sensible bounds
+    buffer_keys_ = std::clamp<size_t>(options_.memory_budget / 4 / (buckets * sizeof(uint64_t)), 512, 8192);
+
+    spill_files_.resize(buckets);
+    buffers_.resize(buckets);
+    bucket_counts_.assign(buckets, 0);
+    open_ = true;   // so a partial open is cleaned up
+    for (size_t b = 0; b < buckets; ++b) {
+        spill_files_[b].open(spill_path(spill_prefix_, b), std::ios::binary | std::ios::trunc);
+        if (!spill_files_[b]) {
+            std::cerr << "[L3StreamBuilder] Cannot create spill file in " << dir.string() << std::endl;
+            remove_spill_files();
+            finished_ = true;
+            return false;
+        }
+        buffers_[b].reserve(buffer_keys_);
+    }
+    return true;
+}
+
+bool L3StreamBuilder::flush_bucket(size_t bucket) {
+    std::vector<uint64_t>& buffer = buffers_[bucket];
+    if (buffer.empty()) return true;
+
+    spill_files_[bucket].write(reinterpret_cast<const char*>(buffer.data()),
+                               static_cast<std::streamsize>(buffer.size() * sizeof(uint64_t)));
+    bucket_counts_[bucket] += buffer.size();
+    buffer.clear();
+    if (!spill_files_[bucket]) {
+        std::cerr << "[L3StreamBuilder] Spill write failed (disk full?)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool L3StreamBuilder::add_keys(const uint64_t* keys, size_t n) {
+    if (!open_spill_files()) return false;
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t bucket = fuse_shard_index(keys[i], options_.spill_bits);
+        buffers_[bucket].push_back(keys[i]);
+        if (buffers_[bucket].size() == buffer_keys_ && !flush_bucket(bucket)) {
+            return false;
+        }
+    }
+    input_keys_ += n;
+    return true;
+}
+
+bool L3StreamBuilder::add_key_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "[L3StreamBuilder] Cannot open key file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> chunk(kReadChunkKeys);
+    for (;;) {
+        in.read(reinterpret_cast<char*>(chunk.data()),
+                static_cast<std::streamsize>(chunk.size() * sizeof(uint64_t)));
+        const size_t bytes = static_cast<size_t>(in.gcount());
+        if (bytes % sizeof(uint64_t) != 0) {
+            std::cerr << "[L3StreamBuilder] Key file is not a whole number of 64-bit keys: " << path << std::endl;
+            return false;
+        }
+        if (!add_keys(chunk.data(), bytes / sizeof(uint64_t))) return false;
+        if (!in) break;
+    }
+    return in.eof();
+}
+
+bool L3StreamBuilder::add_url_file(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[L3StreamBuilder] Cannot open URL file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> chunk;
+    chunk.reserve(kReadChunkKeys);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        chunk.push_back(BinaryFuseWrapper::hash_url(line));
+        if (chunk.size() == kReadChunkKeys) {
+            if (!add_keys(chunk.data(), chunk.size())) return false;
+            chunk.clear();
+        }
+    }
+    return add_keys(chunk.data(), chunk.size()) && in.eof();
+}
+
+bool L3StreamBuilder::read_bucket(size_t bucket, std::vector<uint64_t>& keys) const {
+    const size_t base = keys.size();
+    keys.resize(base + bucket_counts_[bucket]);
+
+    std::ifstream in(spill_path(spill_prefix_, bucket), std::ios::binary);
+    in.read(reinterpret_cast<char*>(keys.data() + base),
+            static_cast<std::streamsize>(bucket_counts_[bucket] * sizeof(uint64_t)));
+    if (!in) {
+        std::cerr << "[L3StreamBuilder] Spill file truncated: bucket " << bucket << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Fewest shards whose largest member (pre-dedup) fits the per-thread budget.
+// Shards are unions of adjacent spill buckets, so this is exact, not an
+// estimate.
+uint32_t L3StreamBuilder::choose_shard_bits() const {
+    const size_t per_shard_budget = options_.memory_budget / options_.num_threads / kBuildBytesPerKey;
+
+    for (uint32_t bits = 0; bits < options_.spill_bits; ++bits) {
+        const size_t group = size_t{1} << (options_.spill_bits - bits);
+        bool fits = true;
+        for (size_t first = 0; first < bucket_counts_.size() && fits; first += group) {
+            uint64_t keys = 0;
+            for (size_t b = first; b < first + group; ++b) keys += bucket_counts_[b];
+            fits = keys <= per_shard_budget;
+        }
+        if (fits) return bits;
+    }
+
+    const uint64_t largest = *std::max_element(bucket_counts_.begin(), bucket_counts_.end());
+    if (largest > per_shard_budget) {
+        std::cerr << "[L3StreamBuilder] Largest spill bucket (" << largest << " keys) exceeds the memory "
+                  << "budget; raise spill_bits or memory_budget" << std::endl;
+    }
+    return options_.spill_bits;
+}
+
+bool L3StreamBuilder::build_to_file(const std::string& out_path) {
+    if (!open_spill_files()) return false;
+
+    for (size_t b = 0; b < spill_files_.size(); ++b) {
+        if (!flush_bucket(b)) return false;
+        spill_files_[b].close();
+    }
+    std::vector<std::vector<uint64_t>>().swap(buffers_);
+    finished_ = true;
+
+    const uint32_t shard_bits = choose_shard_bits();
+    const size_t group = size_t{1} << (options_.spill_bits - shard_bits);
+    unique_keys_ = 0;
+
+    auto source = [&](uint32_t shard, std::vector<uint64_t>& keys) {
+        for (size_t b = shard * group; b < (shard + 1) * group; ++b) {
+            if (!read_bucket(b, keys)) return false;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        unique_keys_ += keys.size();
+        return true;
+    };
+
+    bool ok = BinaryFuseWrapper::write_sharded_file(out_path, shard_bits, source, options_.num_threads,
+                                                    options_.exact_keys, options_.fingerprint_bits);
+    remove_spill_files();
+    if (ok) {
+        std::cout << "[L3StreamBuilder] " << input_keys_ << " input keys, " << unique_keys_
+                  << " unique, " << (size_t{1} << shard_bits) << " shards" << std::endl;
+    }
+    return ok;
+}
+
+bool L3StreamBuilder::build(BinaryFuseWrapper& filter, const std::string& out_path) {
+    return build_to_file(out_path) && filter.load_from_file(out_path);
+}
+
+void L3StreamBuilder::remove_spill_files() {
+    if (!open_) return;
+
+    for (size_t b = 0; b < spill_files_.size(); ++b) {
+        spill_files_[b].close();
+        std::error_code ec;
+        std::filesystem::remove(spill_path(spill_prefix_, b), ec);
+    }
+    spill_files_.clear();
+    open_ = false;
+}
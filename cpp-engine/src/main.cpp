@@ -2,10 +2,59 @@
 #include <vector>
 #include <string>
 #include "BinaryFuseWrapper.hpp"
+#include "fuse_build.hpp"
+#include "fuse_layout.hpp"
+#include "fuse_simd.hpp"
+#include "ip_prefix_table.hpp"
 #include "numa_optimized_filter.hpp"
+#include "pattern_matcher.hpp"
 #include "MortonFilterWrapper.hpp"  // Add this include
+#include "l3_stream_builder.hpp"
+#include "tiny_bloom_filter.hpp"
+#include "url_canonicalizer.hpp"
 #include <thread>
 #include <chrono>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <span>
+#include <string_view>
+#include <xxhash.h>
+
+// Heap allocations made so far, counted by the replaced global operator new
+// so run_zero_copy_benchmark can report allocations per query
+static std::atomic<uint64_t> g_heap_allocations{0};
+
+void* operator new(size_t size) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+// Used by std::stable_sort's temporary buffer; must pair with the free() below
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+// Out of line, so GCC does not pair the inlined free() with operator new
+// and warn about a mismatch
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
 
 void run_binary_fuse_test() {
     std::cout << "\n=== Testing Binary Fuse Filter (L3) ===" << std::endl;
@@ -41,6 +90,354 @@ void run_binary_fuse_test() {
     if (found_positive && !found_negative) {
          std::cout << "🎉 [SUCCESS] BinaryFuse filter working!" << std::endl;
     }
+
+    // Persist and map the filter back in
+    const std::string filter_path = "l3_test_filter.bin";
+    BinaryFuseWrapper loaded;
+    if (!filter.save_to_file(filter_path) || !loaded.load_from_file(filter_path)) {
+        std::cerr << "[FAIL] BinaryFuse save/load round trip failed!" << std::endl;
+        return;
+    }
+
+    bool loaded_positive = loaded.contains(BinaryFuseWrapper::hash_url(positive_test_url));
+    bool loaded_negative = loaded.contains(BinaryFuseWrapper::hash_url(negative_test_url));
+    std::cout << "[Mapped] '" << positive_test_url << "': "
+              << (loaded_positive ? "BLOCKED ✓" : "ALLOWED ✗") << std::endl;
+    std::cout << "[Mapped] '" << negative_test_url << "': "
+              << (loaded_negative ? "BLOCKED ✗" : "ALLOWED ✓") << std::endl;
+
+    // Offsets near 2^64 wrap around when added to; with the checksums
+    // recomputed, only the bounds checks stand between them and a wild read
+    std::vector<char> image;
+    {
+        std::ifstream in(filter_path, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto rejects = [&](auto corrupt) {
+        std::vector<char> bytes = image;
+        l3_format::l3_file_header_t header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        l3_format::l3_shard_desc_t desc;
+        std::memcpy(&desc, bytes.data() + header.shard_table_offset, sizeof(desc));
+        corrupt(header, desc);
+        std::memcpy(bytes.data() + l3_format::kHeaderSize, &desc, sizeof(desc));
+        header.shard_table_checksum = XXH3_64bits(&desc, sizeof(desc));
+        header.header_checksum = XXH3_64bits(&header, offsetof(l3_format::l3_file_header_t, header_checksum));
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        std::ofstream(filter_path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+        BinaryFuseWrapper tampered;
+        return !tampered.load_from_file(filter_path, false);
+    };
+    const uint64_t wrapping = ~uint64_t{0} - 63;
+    const bool rejected = rejects([&](auto& header, auto&) { header.shard_table_offset = wrapping; }) &&
+                          rejects([&](auto&, auto& desc) { desc.array_offset = wrapping; }) &&
+                          rejects([&](auto& header, auto& desc) {
+                              header.flags = l3_format::kFlagExactKeys;
+                              desc.exact_keys_offset = wrapping;
+                              desc.key_count = 8;
+                          });
+    std::cout << "[Mapped] Out-of-range offsets rejected: " << (rejected ? "✓" : "✗") << std::endl;
+    std::filesystem::remove(filter_path);
+}
+
+void run_l3_batch_benchmark() {
+    std::cout << "\n=== Benchmarking L3 single vs batched lookups ===" << std::endl;
+
+    // Large enough that the fingerprint array does not fit in the LLC
+    const size_t num_keys = 8'000'000;
+    const size_t num_queries = 4'000'000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) key = rng();
+
+    BinaryFuseWrapper filter;
+    if (!filter.build_from_keys(keys)) {
+        std::cerr << "[FAIL] Filter building failed!" << std::endl;
+        return;
+    }
+
+    // Half members, half random keys
+    std::vector<uint64_t> queries(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        queries[i] = (i & 1) ? keys[rng() % num_keys] : rng();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t single_hits = 0;
+    for (uint64_t q : queries) single_hits += filter.contains(q);
+    auto mid = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> results(num_queries);
+    filter.contains_batch(queries.data(), queries.size(), results.data());
+    auto end = std::chrono::steady_clock::now();
+
+    size_t batch_hits = 0;
+    for (uint8_t r : results) batch_hits += r;
+
+    auto ns_per_key = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / num_queries;
+    };
+    std::cout << "[Bench] contains():       " << ns_per_key(start, mid) << " ns/key" << std::endl;
+    std::cout << "[Bench] contains_batch(): " << ns_per_key(mid, end) << " ns/key ("
+              << fuse_best_kernel().name << " kernel)" << std::endl;
+    std::cout << "[Bench] hits single/batch: " << single_hits << "/" << batch_hits
+              << (single_hits == batch_hits ? " ✓" : " ✗") << std::endl;
+}
+
+void run_l3_kernel_equivalence_test() {
+    std::cout << "\n=== Testing L3 batch kernels against scalar ===" << std::endl;
+
+    std::mt19937_64 rng(4);
+    const std::vector<fuse_batch_kernel_t> kernels = fuse_available_kernels();
+    bool all_match = true;
+    // Empty, small and DRAM-sized filters; batch sizes around every vector
+    // width and an unaligned start, so the tails are covered too
+    for (size_t num_keys : {size_t{0}, size_t{100}, size_t{1'000'000}}) {
+        std::vector<uint64_t> keys(num_keys);
+        for (auto& key : keys) key = rng();
+        fuse_array_t<uint8_t> filter;
+        if (!fuse_build(keys.data(), keys.size(), filter)) {
+            std::cerr << "[FAIL] Filter building failed!" << std::endl;
+            return;
+        }
+
+        std::vector<uint64_t> queries(100'003);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            queries[i] = (i & 1) && num_keys > 0 ? keys[rng() % num_keys] : rng();
+        }
+        std::vector<uint8_t> expected(queries.size()), actual(queries.size());
+        for (const auto& kernel : kernels) {
+            for (size_t n : {size_t{1}, size_t{3}, size_t{7}, size_t{8}, size_t{9}, size_t{15}, size_t{17},
+                             queries.size() - 1}) {
+                fuse_contains_batch_scalar(filter.view(), queries.data() + 1, n, expected.data());
+                std::fill(actual.begin(), actual.end(), 2);
+                kernel.fn(filter.view(), queries.data() + 1, n, actual.data());
+                const bool match = std::equal(expected.begin(), expected.begin() + n, actual.begin()) &&
+                                   actual[n] == 2;
+                if (!match) {
+                    std::cout << "[Kernels] " << kernel.name << " differs from scalar (" << num_keys
+                              << " keys, batch of " << n << ") ✗" << std::endl;
+                }
+                all_match &= match;
+            }
+        }
+    }
+    std::cout << "[Kernels] " << kernels.size() << " kernel(s) (";
+    for (size_t i = 0; i < kernels.size(); ++i) std::cout << (i ? ", " : "") << kernels[i].name;
+    std::cout << ") match scalar: " << (all_match ? "✓" : "✗") << std::endl;
+}
+
+void run_l3_sharded_build_test() {
+    std::cout << "\n=== Testing sharded L3 build ===" << std::endl;
+
+    const size_t num_keys = 4'000'000;
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) key = rng();
+
+    for (unsigned threads : {1u, std::max(1u, std::thread::hardware_concurrency())}) {
+        BinaryFuseWrapper filter;
+        auto start = std::chrono::steady_clock::now();
+        if (!filter.build_sharded(keys, 4, threads)) {
+            std::cerr << "[FAIL] Sharded build failed!" << std::endl;
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        size_t missing = 0;
+        for (uint64_t key : keys) missing += !filter.contains(key);
+        std::cout << "[Build] " << filter.shard_count() << " shards, " << threads << " threads: "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms, "
+                  << missing << " false negatives" << (missing == 0 ? " ✓" : " ✗") << std::endl;
+    }
+}
+
+void run_l3_stream_build_test() {
+    std::cout << "\n=== Testing streaming L3 build from a URL feed ===" << std::endl;
+
+    // A feed with every URL listed twice, built under a small memory budget
+    const std::string feed_path = "l3_test_feed.txt";
+    const size_t num_urls = 500'000;
+    {
+        std::ofstream feed(feed_path);
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t i = 0; i < num_urls; ++i) {
+                feed << "https://feed-" << i << ".example/payload\n";
+            }
+        }
+    }
+
+    L3StreamBuilder::Options options;
+    options.memory_budget = size_t{8} << 20;
+    L3StreamBuilder builder(options);
+    BinaryFuseWrapper filter;
+    if (!builder.add_url_file(feed_path) || !builder.build(filter, "l3_test_stream.bin")) {
+        std::cerr << "[FAIL] Streaming build failed!" << std::endl;
+        return;
+    }
+
+    size_t missing = 0;
+    for (size_t i = 0; i < num_urls; ++i) {
+        missing += !filter.contains(BinaryFuseWrapper::hash_url(
+            "https://feed-" + std::to_string(i) + ".example/payload"));
+    }
+    std::cout << "[Stream] " << builder.get_input_keys() << " lines -> " << builder.get_unique_keys()
+              << " keys in " << filter.shard_count() << " shards, " << missing << " false negatives"
+              << (missing == 0 ? " ✓" : " ✗") << std::endl;
+}
+
+void run_l3_exact_verification_test() {
+    std::cout << "\n=== Testing L3 exact-match verification ===" << std::endl;
+
+    const size_t num_keys = 1'000'000;
+    const size_t num_queries = 2'000'000;
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) key = rng();
+
+    // Non-members only, so every hit is a false positive
+    std::vector<uint64_t> queries(num_queries);
+    for (auto& query : queries) query = rng();
+
+    for (bool exact : {false, true}) {
+        BinaryFuseWrapper filter;
+        filter.set_exact_verification(exact);
+        if (!filter.build_sharded(keys, 2)) {
+            std::cerr << "[FAIL] Filter building failed!" << std::endl;
+            return;
+        }
+
+        size_t missing = 0;
+        for (uint64_t key : keys) missing += !filter.contains(key);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t false_positives = 0;
+        for (uint64_t q : queries) false_positives += filter.contains(q);
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << "[Exact " << (exact ? "on] " : "off]") << " FP " << false_positives << "/" << num_queries
+                  << ", FN " << missing << ", filter " << filter.get_memory_usage() / 1024 << " KiB, verifier "
+                  << filter.get_verifier_memory_usage() / 1024 << " KiB, "
+                  << std::chrono::duration<double, std::nano>(end - start).count() / num_queries
+                  << " ns/lookup" << std::endl;
+
+        if (exact) {
+            // The keys travel with the file and are mapped like the fingerprints
+            BinaryFuseWrapper loaded;
+            if (!filter.save_to_file("l3_test_exact.bin") || !loaded.load_from_file("l3_test_exact.bin")) {
+                std::cerr << "[FAIL] Save/load with exact keys failed!" << std::endl;
+                return;
+            }
+            std::vector<uint8_t> hits(num_queries);
+            loaded.contains_batch(queries.data(), queries.size(), hits.data());
+            size_t batch_fp = 0;
+            for (uint8_t hit : hits) batch_fp += hit;
+            std::cout << "[Mapped] exact keys " << (loaded.has_exact_verification() ? "present" : "missing")
+                      << ", batch FP " << batch_fp << (batch_fp == 0 && missing == 0 ? " ✓" : " ✗") << std::endl;
+
+            // Rebuilding merges straight from the mapped keys: 1000 swapped
+            // for 1000 others, reshaped from 4 shards into one
+            std::vector<uint64_t> added(queries.begin(), queries.begin() + 1000);
+            std::vector<uint64_t> dropped(keys.begin(), keys.begin() + 1000);
+            std::sort(added.begin(), added.end());
+            std::sort(dropped.begin(), dropped.end());
+            if (!loaded.rebuild_exact(added, dropped)) {
+                std::cerr << "[FAIL] Merge rebuild failed!" << std::endl;
+                return;
+            }
+            size_t wrong = 0;
+            for (size_t i = 0; i < num_keys; ++i) wrong += loaded.contains(keys[i]) != (i >= 1000);
+            for (uint64_t key : added) wrong += !loaded.contains(key);
+            std::cout << "[Merge] " << loaded.key_count() << " keys in " << loaded.shard_count() << " shard(s), "
+                      << wrong << " wrong answers" << (wrong == 0 && loaded.key_count() == num_keys ? " ✓" : " ✗")
+                      << std::endl;
+        }
+    }
+}
+
+void run_l3_fingerprint_width_test() {
+    std::cout << "\n=== Comparing L3 fingerprint widths ===" << std::endl;
+
+    const size_t num_keys = 1'000'000;
+    const size_t num_queries = 4'000'000;
+    std::mt19937_64 rng(13);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) key = rng();
+    std::vector<uint64_t> queries(num_queries);
+    for (auto& query : queries) query = rng();
+
+    for (uint32_t bits : {8u, 16u, 32u}) {
+        BinaryFuseWrapper filter(bits);
+        if (!filter.build_from_keys(keys) || !filter.save_to_file("l3_test_width.bin")) {
+            std::cerr << "[FAIL] " << bits << "-bit build failed!" << std::endl;
+            return;
+        }
+
+        // The loader picks the width from the file header
+        BinaryFuseWrapper loaded;
+        if (!loaded.load_from_file("l3_test_width.bin")) {
+            std::cerr << "[FAIL] " << bits << "-bit load failed!" << std::endl;
+            return;
+        }
+
+        size_t missing = 0;
+        for (uint64_t key : keys) missing += !loaded.contains(key);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t false_positives = 0;
+        for (uint64_t q : queries) false_positives += loaded.contains(q);
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << "[Width " << loaded.fingerprint_bits() << "] "
+                  << 8.0 * loaded.get_memory_usage() / num_keys << " bits/key, FPR "
+                  << 100.0 * false_positives / num_queries << "%, "
+                  << std::chrono::duration<double, std::nano>(end - start).count() / num_queries
+                  << " ns/lookup, " << missing << " false negatives" << (missing == 0 ? " ✓" : " ✗") << std::endl;
+    }
+}
+
+void run_l3_hot_swap_test() {
+    std::cout << "\n=== Testing L3 hot swap under concurrent lookups ===" << std::endl;
+
+    // Every generation contains the core keys plus a fresh random tail
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> core(10'000);
+    for (auto& key : core) key = rng();
+
+    auto generation = [&](size_t extra) {
+        std::vector<uint64_t> keys = core;
+        for (size_t i = 0; i < extra; ++i) keys.push_back(rng());
+        return keys;
+    };
+
+    BinaryFuseWrapper filter;
+    filter.build_from_keys(generation(100'000));
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> misses{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&, t] {
+            uint64_t local = 0;
+            for (size_t i = t; !stop.load(std::memory_order_relaxed); i = (i + 7) % core.size()) {
+                if (!filter.contains(core[i])) misses.fetch_add(1, std::memory_order_relaxed);
+                ++local;
+            }
+            lookups.fetch_add(local);
+        });
+    }
+
+    const int swaps = 20;
+    for (int i = 0; i < swaps; ++i) {
+        filter.build_from_keys(generation(100'000 + i * 1'000));
+    }
+    stop = true;
+    for (auto& reader : readers) reader.join();
+
+    std::cout << "[Swap] " << swaps << " swaps during " << lookups.load() << " lookups, "
+              << misses.load() << " false negatives" << (misses.load() == 0 ? " ✓" : " ✗") << std::endl;
 }
 
 void run_morton_filter_test() {
@@ -104,8 +501,1152 @@ void run_morton_filter_test() {
     std::cout << "L2 memory: " << morton_filter.get_memory_usage() << " bytes" << std::endl;
 }
 
+void run_morton_expiry_test() {
+    std::cout << "\n=== Testing L2 Expiry and Retraction ===" << std::endl;
+
+    using namespace std::chrono;
+    const milliseconds ttl(300);
+    MortonFilterWrapper l2;
+    if (!l2.initialize(20000, 0.01, ttl, 4)) {
+        std::cerr << "[FAIL] Morton filter initialization with TTL failed!" << std::endl;
+        return;
+    }
+    const size_t memory = l2.get_memory_usage();
+
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> older(2000), newer(2000), absent(100000);
+    for (auto& k : older) k = rng();
+    for (auto& k : newer) k = rng();
+    for (auto& k : absent) k = rng();
+    auto count_hits = [&](const std::vector<uint64_t>& keys) {
+        size_t hits = 0;
+        for (uint64_t k : keys) hits += l2.contains_key(k);
+        return hits;
+    };
+
+    const auto start = steady_clock::now();
+    for (uint64_t k : older) l2.insert_key(k);
+    std::this_thread::sleep_until(start + ttl / 2);
+    for (uint64_t k : newer) l2.insert_key(k);
+    const size_t older_live = count_hits(older);
+
+    // Past the older keys' maximum lifetime (ttl * 4/3), short of the newer ones' minimum
+    std::this_thread::sleep_until(start + ttl * 3 / 2);
+    const size_t reclaimed = l2.expire();
+    const size_t older_expired = count_hits(older);
+    const size_t newer_live = count_hits(newer);
+
+    std::cout << "[Expiry] Before TTL: " << older_live << "/" << older.size() << " live"
+              << (older_live == older.size() ? " ✓" : " ✗") << std::endl;
+    std::cout << "[Expiry] After TTL: " << older_expired << "/" << older.size() << " older keys left ("
+              << reclaimed << " generations reclaimed), " << newer_live << "/" << newer.size()
+              << " newer keys live" << (newer_live == newer.size() ? " ✓" : " ✗") << std::endl;
+    std::cout << "[Expiry] FPR over " << absent.size() << " absent keys: "
+              << 100.0 * count_hits(absent) / absent.size() << "%, memory "
+              << l2.get_memory_usage() << " bytes (unchanged: "
+              << (l2.get_memory_usage() == memory ? "yes" : "no") << ")" << std::endl;
+
+    size_t retracted = 0;
+    for (size_t i = 0; i < 100; ++i) retracted += l2.remove_key(newer[i]);
+    size_t still_found = 0;
+    for (size_t i = 0; i < 100; ++i) still_found += l2.contains_key(newer[i]);
+    std::cout << "[Retract] Removed " << retracted << "/100, " << still_found << " still found" << std::endl;
+
+    MortonFilterWrapper loaded;
+    const bool round_trip = l2.save_to_file("l3_test_l2.bin") && loaded.load_from_file("l3_test_l2.bin");
+    size_t loaded_hits = 0;
+    for (size_t i = 100; i < newer.size(); ++i) loaded_hits += loaded.contains_key(newer[i]);
+    std::cout << "[Persist] " << (round_trip ? "OK" : "FAIL") << ", " << loaded.get_generations()
+              << " generations, " << loaded_hits << "/" << newer.size() - 100 << " keys found" << std::endl;
+
+    // Retraction through the layered filter reaches L3 as well
+    PerformanceOptimizedFilter filter;
+    filter.initialize(10000);
+    filter.insert("https://retracted-l2.example");
+    const bool l2_removed = filter.remove("https://retracted-l2.example");
+    const bool l3_removed = filter.remove("https://phishing.net");
+    std::cout << "[Retract] L2: " << (l2_removed ? "removed" : "FAIL") << ", L3: "
+              << (l3_removed ? "removed" : "FAIL") << std::endl;
+    filter.contains("https://retracted-l2.example");
+    filter.contains("https://phishing.net");
+    filter.contains("https://malicious.com");
+
+    // L3 retractions are only marked until compaction rebuilds L3 without
+    // them; a key inserted again after its retraction survives the rebuild
+    const size_t l3_marked = filter.get_l3_count();
+    filter.remove("https://malware.org");
+    filter.insert("https://malware.org");
+    filter.compact_l2();
+    const bool folded = filter.get_l3_retracted_count() == 0 && filter.get_l3_count() == l3_marked &&
+                        !filter.contains("https://phishing.net") && filter.contains("https://malware.org") &&
+                        filter.contains("https://malicious.com");
+    std::cout << "[Retract] L3 retractions folded at compaction: " << (folded ? "✓" : "✗") << std::endl;
+
+    // Retracting keys L2 never stored must not evict live keys sharing
+    // their fingerprints, and retracting live ones must not take others
+    // along; with and without a TTL
+    for (const milliseconds l2_ttl : {milliseconds(0), milliseconds(60000)}) {
+        PerformanceOptimizedFilter layered;
+        layered.initialize(100000);
+        if (l2_ttl.count() > 0) layered.set_l2_ttl(l2_ttl);
+        std::vector<uint64_t> live(8000);
+        for (auto& k : live) k = rng();
+        for (uint64_t k : live) layered.insert(HashedKey{k, 0});
+
+        size_t absent_removed = 0;
+        for (size_t i = 0; i < 20000; ++i) absent_removed += layered.remove(HashedKey{rng(), 0});
+        size_t live_removed = 0;
+        for (size_t i = 0; i < 1000; ++i) live_removed += layered.remove(HashedKey{live[i], 0});
+
+        size_t lost = 0;
+        for (size_t i = 1000; i < live.size(); ++i) lost += !layered.contains(HashedKey{live[i], 0});
+        size_t kept = 0;
+        for (size_t i = 0; i < 1000; ++i) kept += layered.contains(HashedKey{live[i], 0});
+        std::cout << "[Retract] " << (l2_ttl.count() > 0 ? "With" : "Without") << " TTL: 20000 absent keys "
+                  << "retracted (" << absent_removed << " reported), 1000 live ones (" << live_removed
+                  << " reported); " << lost << "/" << live.size() - 1000 << " other live keys lost "
+                  << (lost == 0 && absent_removed == 0 && live_removed == 1000 ? "✓" : "✗") << ", "
+                  << kept << " retracted still reported (false positives)" << std::endl;
+    }
+}
+
+void run_l2_concurrency_stress_test() {
+    std::cout << "\n=== Testing L2 Concurrent Writers and Readers ===" << std::endl;
+
+    MortonFilterWrapper l2;
+    if (!l2.initialize(200000, 0.01)) {
+        std::cerr << "[FAIL] Morton filter initialization failed!" << std::endl;
+        return;
+    }
+
+    // Keys stored before the readers start must be found on every probe,
+    // however the writers reshuffle the blocks around them
+    std::mt19937_64 rng(12);
+    std::vector<uint64_t> stable;
+    while (stable.size() < 50000) {
+        uint64_t key = rng();
+        if (l2.insert_key(key)) stable.push_back(key);
+    }
+
+    constexpr int kWriters = 4;
+    constexpr int kReaders = 4;
+    constexpr size_t kKeysPerWriter = 30000;
+    std::atomic<bool> writing{true};
+    std::atomic<uint64_t> lookups{0}, misses{0};
+    std::vector<std::vector<uint64_t>> stored(kWriters);
+    std::vector<uint64_t> churned(kWriters, 0);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; ++r) {
+        readers.emplace_back([&, r] {
+            uint64_t n = 0, missed = 0;
+            for (size_t i = static_cast<size_t>(r) * 7919; writing.load(std::memory_order_relaxed); ++i, ++n) {
+                missed += !l2.contains_key(stable[i % stable.size()]);
+            }
+            lookups.fetch_add(n);
+            misses.fetch_add(missed);
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; ++w) {
+        writers.emplace_back([&, w] {
+            std::mt19937_64 writer_rng(1000 + w);
+            for (size_t i = 0; i < kKeysPerWriter; ++i) {
+                // Only keys this insert stored: a duplicate's fingerprint
+                // may belong to a transient key removed below
+                uint64_t key = writer_rng();
+                bool placed = false;
+                if (l2.insert_key(key, &placed) && placed) stored[w].push_back(key);
+
+                // Retractions interleaved with the inserts
+                uint64_t transient = writer_rng();
+                if (l2.insert_key(transient, &placed) && placed && l2.remove_key(transient)) ++churned[w];
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    writing = false;
+    for (auto& reader : readers) reader.join();
+
+    size_t inserted = 0, lost = 0;
+    for (const auto& keys : stored) {
+        inserted += keys.size();
+        for (uint64_t key : keys) lost += !l2.contains_key(key);
+    }
+    size_t stable_lost = 0;
+    for (uint64_t key : stable) stable_lost += !l2.contains_key(key);
+    uint64_t churn_total = 0;
+    for (uint64_t c : churned) churn_total += c;
+
+    std::cout << "[Stress] " << kWriters << " writers stored " << inserted << " keys and retracted "
+              << churn_total << "; L2 " << l2.get_count() << " entries" << std::endl;
+    std::cout << "[Stress] " << kReaders << " readers: " << lookups.load() << " lookups, "
+              << misses.load() << " missed stable keys" << (misses.load() == 0 ? " ✓" : " ✗") << std::endl;
+    std::cout << "[Stress] Afterwards: " << lost << " written and " << stable_lost << " stable keys missing"
+              << (lost == 0 && stable_lost == 0 ? " ✓" : " ✗") << std::endl;
+
+    // Read throughput with one writer running, by reader count
+    std::cout << "[Scaling] " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    for (int threads : {1, 2, 4, 8}) {
+        std::atomic<bool> run{true};
+        std::atomic<uint64_t> total{0};
+        std::thread writer([&] {
+            std::mt19937_64 writer_rng(77);
+            while (run.load(std::memory_order_relaxed)) {
+                uint64_t key = writer_rng();
+                bool placed = false;
+                if (l2.insert_key(key, &placed) && placed) l2.remove_key(key);
+            }
+        });
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t] {
+                uint64_t n = 0;
+                for (size_t i = static_cast<size_t>(t) * 104729; run.load(std::memory_order_relaxed); ++i, ++n) {
+                    l2.contains_key(stable[i % stable.size()]);
+                }
+                total.fetch_add(n);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        run = false;
+        for (auto& t : pool) t.join();
+        writer.join();
+        std::cout << "[Scaling] " << threads << " readers: " << total.load() / 0.2 / 1e6 << " M lookups/s" << std::endl;
+    }
+}
+
+void run_l2_growth_test() {
+    std::cout << "\n=== Testing L2 Growth Past Capacity ===" << std::endl;
+
+    MortonFilterWrapper l2;
+    if (!l2.initialize(10000, 0.01)) {
+        std::cerr << "[FAIL] Morton filter initialization failed!" << std::endl;
+        return;
+    }
+
+    std::mt19937_64 rng(13);
+    std::vector<uint64_t> keys(80000), absent(200000);
+    for (auto& k : keys) k = rng();
+    for (auto& k : absent) k = rng();
+    auto fpr = [&](const MortonFilterWrapper& filter) {
+        size_t hits = 0;
+        for (uint64_t k : absent) hits += filter.contains_key(k);
+        return 100.0 * hits / absent.size();
+    };
+    auto missing = [&](const MortonFilterWrapper& filter) {
+        size_t n = 0;
+        for (uint64_t k : keys) n += !filter.contains_key(k);
+        return n;
+    };
+
+    // 8x the configured capacity; a key whose fingerprint is already
+    // there is not stored twice, but its insert still succeeds
+    size_t rejected = 0;
+    for (uint64_t k : keys) rejected += !l2.insert_key(k);
+    std::cout << "[Grow] " << keys.size() << " inserts into capacity 10000: " << rejected << " rejected "
+              << (rejected == 0 ? "✓" : "✗") << ", " << l2.get_stage_count() << " sub-filters, "
+              << missing(l2) << " keys missing, FPR " << fpr(l2) << "% (bound 2%), "
+              << l2.get_memory_usage() / 1024 << " KiB" << std::endl;
+
+    MortonFilterWrapper loaded;
+    const bool round_trip = l2.save_to_file("l3_test_grown.bin") && loaded.load_from_file("l3_test_grown.bin");
+    std::cout << "[Grow] Save/load: " << (round_trip ? "OK" : "FAIL") << ", " << loaded.get_stage_count()
+              << " sub-filters, " << missing(loaded) << " keys missing" << std::endl;
+
+    if (l2.consolidate(keys)) {
+        std::cout << "[Grow] Consolidated: " << l2.get_stage_count() << " sub-filter, " << missing(l2)
+                  << " keys missing, FPR " << fpr(l2) << "%, " << l2.get_memory_usage() / 1024 << " KiB" << std::endl;
+    }
+
+    // Through the layered filter: compaction moves the keys to L3 and folds
+    // the grown L2 back into one sub-filter
+    PerformanceOptimizedFilter filter;
+    filter.initialize(10000);
+    std::vector<std::string> urls;
+    for (int i = 0; i < 5000; ++i) urls.push_back("https://campaign-" + std::to_string(i) + ".example");
+    filter.insert_batch(urls);
+    filter.print_stats();
+    CompactionResult result = filter.compact_l2();
+    std::cout << "[Grow] Compaction absorbed " << result.absorbed << " keys, L3 " << result.l3_keys
+              << " keys" << std::endl;
+    filter.print_stats();
+}
+
+void run_hashed_key_benchmark() {
+    std::cout << "\n=== Benchmarking Hash-Once Ingress ===" << std::endl;
+
+    const size_t num_urls = 200000;
+    const size_t num_nodes = 4;
+    std::vector<std::string> urls;
+    urls.reserve(num_urls);
+    for (size_t i = 0; i < num_urls; ++i) urls.push_back("https://t" + std::to_string(i) + ".example/a");
+
+    // Even URLs go to L2, every fourth one to L3
+    MortonFilterWrapper l2;
+    l2.initialize(num_urls, 0.01);
+    std::vector<uint64_t> l3_keys;
+    for (size_t i = 0; i < num_urls; i += 2) l2.insert(urls[i]);
+    for (size_t i = 0; i < num_urls; i += 4) l3_keys.push_back(HashedKey::of(urls[i]).key);
+    BinaryFuseWrapper l3;
+    if (!l3.build_from_keys(l3_keys)) {
+        std::cerr << "[FAIL] Filter building failed!" << std::endl;
+        return;
+    }
+
+    // Before: std::hash to route, then one XXH3 per layer
+    auto start = std::chrono::steady_clock::now();
+    size_t rehash_hits = 0, rehash_route = 0;
+    for (const auto& url : urls) {
+        rehash_route += std::hash<std::string>{}(url) % num_nodes;
+        rehash_hits += l2.contains(url) || l3.contains(BinaryFuseWrapper::hash_url(url));
+    }
+    auto mid = std::chrono::steady_clock::now();
+
+    // After: one XXH3-128; the high half routes, the low half probes
+    size_t once_hits = 0, once_route = 0;
+    for (const auto& url : urls) {
+        const HashedKey hash = HashedKey::of(url);
+        once_route += hash.partition(num_nodes);
+        once_hits += l2.contains(hash) || l3.contains(hash);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns_per_url = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / num_urls;
+    };
+    std::cout << "[Bench] hash per layer: " << ns_per_url(start, mid) << " ns/url" << std::endl;
+    std::cout << "[Bench] hash once:      " << ns_per_url(mid, end) << " ns/url" << std::endl;
+    std::cout << "[Bench] hits " << rehash_hits << "/" << once_hits << (rehash_hits == once_hits ? " ✓" : " ✗")
+              << ", mean node " << double(rehash_route) / num_urls << "/" << double(once_route) / num_urls
+              << " (uniform " << (num_nodes - 1) / 2.0 << ")" << std::endl;
+}
+
+void run_url_canonicalizer_benchmark() {
+    std::cout << "\n=== Benchmarking URL Canonicalization ===" << std::endl;
+
+    // Spelling variants that must share a key
+    const std::pair<const char*, const char*> variants[] = {
+        {"HTTP://Evil.com:80/a#x", "http://evil.com/a"},
+        {"https://EVIL.com.:443//a//b/./c/../d?q=%7e#top", "https://evil.com/a/b/d?q=~"},
+        {"http://user:pw@evil.com", "http://evil.com/"},
+        {"http://evil.com/%41%2f%zz", "http://evil.com/A%2F%25zz"},
+        {"http://BÜCHER.de/", "http://xn--bcher-kva.de/"},
+        {"Evil.com:8080\\a b", "evil.com:8080/a%20b"},
+        {"http://a.com/%2e%2e/x", "http://a.com/x"},
+        {"http://evil.com/%2E/payload", "http://evil.com/payload"},
+        {"http://evil.com/a/.%2e/b/%2e%2E%2E/c", "http://evil.com/b/.../c"},
+    };
+    char canonical[kCanonicalUrlStackBytes];
+    size_t size = 0;
+    for (const auto& [url, expected] : variants) {
+        const bool ok = canonicalize_url(url, std::strlen(url), canonical, sizeof(canonical), size);
+        const std::string_view result = ok ? std::string_view(canonical, size) : std::string_view("(none)");
+        const bool same_key = HashedKey::of(url).key == HashedKey::of(expected).key;
+        std::cout << "[Canon] '" << url << "' -> '" << result << "'"
+                  << (result == expected && same_key ? " ✓" : " ✗") << std::endl;
+    }
+
+    // Canonical forms are fixed points: canonicalizing one changes nothing
+    const char* const idempotent[] = {
+        "http://a.com/%2e%2e/x", "http://evil.com/%2e/payload", "http://evil.com/x/%2e%2E/%2e./.%2e/y",
+        "https://e.com/%2e%2e%2e/z", "http://e.com/a%2e/b%2e%2e", "http://e.com/%252e%252e/q?%2e%2e",
+        "HTTP://E.com:80//a//b/./c/../d?q=%7e#top", "http://e.com/%41%2f%zz", "http://BÜCHER.de/a/../b",
+    };
+    size_t fixed_points = 0;
+    for (const char* url : idempotent) {
+        char again[kCanonicalUrlStackBytes];
+        size_t again_size = 0;
+        fixed_points += canonicalize_url(url, std::strlen(url), canonical, sizeof(canonical), size) &&
+                        canonicalize_url(canonical, size, again, sizeof(again), again_size) &&
+                        std::string_view(canonical, size) == std::string_view(again, again_size);
+    }
+    std::cout << "[Canon] canon(canon(x)) == canon(x) for " << fixed_points << "/" << std::size(idempotent)
+              << " tricky URLs" << (fixed_points == std::size(idempotent) ? " ✓" : " ✗") << std::endl;
+
+    // Throughput over a mix of already-canonical and messy URLs
+    const size_t num_urls = 200000;
+    std::vector<std::string> urls;
+    urls.reserve(num_urls);
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < num_urls; ++i) {
+        std::string id = std::to_string(i);
+        switch (i % 4) {
+            case 0: urls.push_back("https://cdn" + id + ".example.com/static/js/app.bundle.min.js?v=" + id); break;
+            case 1: urls.push_back("HTTPS://WWW.Example" + id + ".COM:443/Search?q=llama%20shield&lang=en#results"); break;
+            case 2: urls.push_back("http://news.example.org//2024/07/./article-" + id + "/../index.html"); break;
+            default: urls.push_back("http://shop" + id + ".example.net/%7Euser/cart%2Fitems?id=" + id); break;
+        }
+        total_bytes += urls.back().size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t canonical_bytes = 0;
+    for (const auto& url : urls) {
+        if (canonicalize_url(url.data(), url.size(), canonical, sizeof(canonical), size)) canonical_bytes += size;
+    }
+    auto mid = std::chrono::steady_clock::now();
+    uint64_t checksum = 0;
+    for (const auto& url : urls) checksum ^= HashedKey::of(url).key;
+    auto end = std::chrono::steady_clock::now();
+    for (const auto& url : urls) checksum ^= HashedKey::of_raw(url.data(), url.size()).key;
+    auto raw_end = std::chrono::steady_clock::now();
+
+    auto ns = [](auto from, auto to) { return std::chrono::duration<double, std::nano>(to - from).count(); };
+    std::cout << "[Bench] canonicalize:        " << total_bytes / ns(start, mid) << " bytes/ns, "
+              << ns(start, mid) / num_urls << " ns/url (" << canonical_bytes * 100 / total_bytes << "% of input size)"
+              << std::endl;
+    std::cout << "[Bench] canonicalize + hash: " << total_bytes / ns(mid, end) << " bytes/ns, "
+              << ns(mid, end) / num_urls << " ns/url" << std::endl;
+    std::cout << "[Bench] raw hash:            " << total_bytes / ns(end, raw_end) << " bytes/ns, "
+              << ns(end, raw_end) / num_urls << " ns/url (checksum " << (checksum & 0xff) << ")" << std::endl;
+}
+
+void run_l2_journal_test() {
+    std::cout << "\n=== Testing L2 Journal Recovery ===" << std::endl;
+
+    const std::string dir = "l3_test_journal";
+    std::filesystem::remove_all(dir);
+
+    std::vector<HashedKey> verdicts;
+    for (int i = 0; i < 20000; ++i) verdicts.push_back(HashedKey::of("https://verdict-" + std::to_string(i) + ".example"));
+    const std::vector<HashedKey> retracted(verdicts.begin(), verdicts.begin() + 50);
+
+    {
+        PerformanceOptimizedFilter filter;
+        filter.initialize(100000);
+        if (!filter.open_journal(dir)) {
+            std::cerr << "[FAIL] Journal open failed!" << std::endl;
+            return;
+        }
+
+        // Four writers; a snapshot and a compaction land mid-stream
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> writers;
+        for (size_t t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t] {
+                for (size_t i = t; i < verdicts.size(); i += 4) filter.insert(verdicts[i]);
+            });
+        }
+        filter.snapshot_journal();
+        filter.compact_l2();
+        for (auto& writer : writers) writer.join();
+        for (const auto& hash : retracted) filter.remove(hash);
+        filter.sync_journal();
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "[Journal] " << verdicts.size() << " journaled inserts in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms, "
+                  << filter.get_journal_bytes() << " bytes since snapshot" << std::endl;
+    }
+
+    // A crash mid-write leaves a torn frame at the end of the newest segment
+    std::vector<std::filesystem::path> segments;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ".log") segments.push_back(entry.path());
+    }
+    std::sort(segments.begin(), segments.end());
+    {
+        std::ofstream torn(segments.back(), std::ios::binary | std::ios::app);
+        torn << "LSJ2 partial frame";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    PerformanceOptimizedFilter recovered;
+    recovered.initialize(100000);
+    if (!recovered.open_journal(dir)) {
+        std::cerr << "[FAIL] Journal recovery failed!" << std::endl;
+        return;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    size_t missing = 0, resurrected = 0;
+    for (size_t i = retracted.size(); i < verdicts.size(); ++i) missing += !recovered.contains(verdicts[i]);
+    for (const auto& hash : retracted) resurrected += recovered.contains(hash);
+    std::cout << "[Journal] Recovered in " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms: " << missing << " verdicts missing" << (missing == 0 ? " ✓" : " ✗") << ", "
+              << resurrected << "/" << retracted.size() << " retracted ones reported (false positives)" << std::endl;
+
+    // After a snapshot the journal is back to empty, and so is the next replay
+    recovered.insert(HashedKey::of("https://after-recovery.example"));
+    recovered.snapshot_journal();
+    std::cout << "[Journal] After snapshot: " << recovered.get_journal_bytes() << " bytes of journal" << std::endl;
+
+    // Segments from before URL canonicalization hold other keys; replaying them would be silently wrong
+    const std::string stale_dir = "l3_test_journal_stale";
+    std::filesystem::remove_all(stale_dir);
+    std::filesystem::create_directories(stale_dir);
+    {
+        std::ofstream stale(std::filesystem::path(stale_dir) / "journal-0000000000000001.log", std::ios::binary);
+        stale << "LSJF stale frame";
+    }
+    PerformanceOptimizedFilter stale;
+    stale.initialize(1000);
+    bool opened = stale.open_journal(stale_dir);
+    std::cout << "[Journal] Earlier-format segment " << (opened ? "replayed ✗" : "rejected ✓") << std::endl;
+}
+
+void run_l1_bloom_benchmark() {
+    std::cout << "\n=== Benchmarking L1 Blocked Bloom ===" << std::endl;
+
+    std::mt19937_64 rng(16);
+    TinyBloomFilter l1;
+    if (!l1.initialize()) {
+        std::cerr << "[FAIL] L1 initialization failed!" << std::endl;
+        return;
+    }
+
+    // Fill to capacity, then measure misses and false positives
+    std::vector<uint64_t> hot(l1.get_capacity() - 1), absent(1000000);
+    for (auto& k : hot) k = rng();
+    for (auto& k : absent) k = rng();
+    for (uint64_t k : hot) l1.promote(k, l1.epoch());
+    size_t missing = 0, false_hits = 0;
+    for (uint64_t k : hot) missing += !l1.contains(k);
+    for (uint64_t k : absent) false_hits += l1.contains(k);
+    std::cout << "[L1] " << hot.size() << " keys in " << l1.get_memory_usage() / 1024 << " KiB: " << missing
+              << " missing, FPR " << 100.0 * false_hits / absent.size() << "%" << std::endl;
+
+    // Hot keys against an L3 far larger than the LLC: L1 answers them from
+    // cache, L3 goes to DRAM
+    std::vector<uint64_t> l3_keys(8000000);
+    for (auto& k : l3_keys) k = rng();
+    std::copy(hot.begin(), hot.begin() + 10000, l3_keys.begin());
+    BinaryFuseWrapper l3;
+    if (!l3.build_from_keys(l3_keys)) {
+        std::cerr << "[FAIL] Filter building failed!" << std::endl;
+        return;
+    }
+    std::vector<uint64_t> queries(2000000);
+    for (auto& q : queries) q = hot[rng() % 10000];
+
+    auto start = std::chrono::steady_clock::now();
+    size_t l1_hits = 0;
+    for (uint64_t q : queries) l1_hits += l1.contains(q);
+    auto mid = std::chrono::steady_clock::now();
+    size_t l3_hits = 0;
+    for (uint64_t q : queries) l3_hits += l3.contains(q);
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns_per_key = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / queries.size();
+    };
+    std::cout << "[Bench] L1 contains(): " << ns_per_key(start, mid) << " ns/key (" << l1.kernel_name()
+              << " probe), " << l1_hits << " hits" << std::endl;
+    std::cout << "[Bench] L3 contains(): " << ns_per_key(mid, end) << " ns/key, " << l3_hits << " hits" << std::endl;
+
+    // Through the layered filter: the first lookup promotes, the rest hit L1
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    filter.insert("https://hot-threat.example");
+    filter.contains("https://hot-threat.example");
+    filter.contains("https://hot-threat.example");
+    filter.remove("https://hot-threat.example");
+    filter.contains("https://hot-threat.example");
+}
+
+void run_negative_cache_benchmark() {
+    std::cout << "\n=== Benchmarking Negative Verdict Cache ===" << std::endl;
+
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    std::mt19937_64 rng(17);
+    std::vector<uint64_t> threats(4000000);
+    for (auto& k : threats) k = rng();
+    filter.set_l3_keys(threats);
+
+    // A few thousand benign sites make up the traffic
+    std::vector<HashedKey> benign;
+    for (int i = 0; i < 3000; ++i) benign.push_back(HashedKey::of("https://cdn-" + std::to_string(i) + ".example/"));
+    std::vector<HashedKey> unique(2000000);
+    for (auto& h : unique) h = {rng(), rng()};
+    std::vector<uint32_t> order(unique.size());
+    for (auto& o : order) o = static_cast<uint32_t>(rng() % benign.size());
+
+    // Distinct keys every time: each one walks L1, L2 and L3
+    auto start = std::chrono::steady_clock::now();
+    size_t walk_hits = 0;
+    for (const auto& h : unique) walk_hits += filter.contains(h);
+    auto mid = std::chrono::steady_clock::now();
+
+    // Repeat lookups of hot benign keys: answered by the cache
+    const NegativeVerdictCache& cache = NegativeVerdictCache::local();
+    const uint64_t hits_before = cache.get_hits();
+    size_t hot_hits = 0;
+    for (uint32_t o : order) hot_hits += filter.contains(benign[o]);
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns_per_key = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / order.size();
+    };
+    std::cout << "[Bench] distinct benign keys: " << ns_per_key(start, mid) << " ns/key (" << walk_hits
+              << " false positives)" << std::endl;
+    std::cout << "[Bench] hot benign keys:      " << ns_per_key(mid, end) << " ns/key, "
+              << 100.0 * (cache.get_hits() - hits_before) / order.size() << "% cache hits" << std::endl;
+
+    // Steady verdict ingest (a new threat every 16 lookups) only drops the
+    // new threats' entries, not every cached verdict
+    const uint64_t ingest_hits_before = cache.get_hits();
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i % 16 == 0) filter.insert(HashedKey{rng(), 0});
+        filter.contains(benign[order[i]]);
+    }
+    const double ingest_hit_rate = 100.0 * (cache.get_hits() - ingest_hits_before) / order.size();
+    std::cout << "[Bench] hot benign keys during ingest: " << ingest_hit_rate << "% cache hits "
+              << (ingest_hit_rate > 80.0 ? "✓" : "✗") << std::endl;
+
+    // A new verdict for a cached site takes effect on the next lookup
+    filter.insert(benign[0]);
+    std::cout << "[NegCache] Hot site blocked right after its verdict: "
+              << (filter.contains(benign[0]) ? "yes ✓" : "no ✗") << std::endl;
+}
+
+void run_hierarchical_match_test() {
+    std::cout << "\n=== Testing Hierarchical Host/Path Lookup ===" << std::endl;
+
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    filter.set_l3_keys({HashedKey::of("tracker.net").key});
+    filter.insert("evil.com");
+    filter.insert("phish.example.co.uk/login/");
+    filter.insert("https://exact.test/a?b=1");
+    filter.insert("evil.github.io");
+
+    const std::pair<const char*, MatchGranularity> checks[] = {
+        {"https://login.evil.com/x/y?z=1", MatchGranularity::kDomain},
+        {"http://EVIL.com:8080/", MatchGranularity::kHost},
+        {"https://phish.example.co.uk/login/step2.php", MatchGranularity::kPath},
+        {"https://example.co.uk/login/", MatchGranularity::kNone},
+        {"https://exact.test/a?b=1#frag", MatchGranularity::kUrl},
+        {"https://exact.test/a", MatchGranularity::kNone},
+        {"https://a.b.tracker.net/", MatchGranularity::kDomain},
+        {"https://x.evil.github.io/", MatchGranularity::kDomain},
+        {"https://other.github.io/", MatchGranularity::kNone},
+    };
+    for (const auto& [url, expected] : checks) {
+        const UrlMatch match = filter.match(url);
+        std::cout << "[Match] " << url << " -> " << granularity_name(match.granularity)
+                  << (match.granularity == expected ? " ✓" : " ✗") << std::endl;
+    }
+
+    // Cost of probing every candidate against one exact probe
+    const size_t num_urls = 200000;
+    std::vector<std::string> urls;
+    urls.reserve(num_urls);
+    for (size_t i = 0; i < num_urls; ++i) {
+        urls.push_back("https://www" + std::to_string(i % 997) + ".site" + std::to_string(i) +
+                       ".example.com/docs/v2/page" + std::to_string(i) + ".html?ref=" + std::to_string(i));
+    }
+    UrlCandidates candidates;
+    size_t total_candidates = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t exact_hits = 0;
+    for (const auto& url : urls) exact_hits += filter.contains(HashedKey::of(url));
+    auto mid = std::chrono::steady_clock::now();
+    size_t match_hits = 0;
+    for (const auto& url : urls) {
+        candidates.parse(url);
+        total_candidates += candidates.size();
+        match_hits += filter.match(candidates).layer != 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns_per_url = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / num_urls;
+    };
+    std::cout << "[Bench] exact lookup:        " << ns_per_url(start, mid) << " ns/url (" << exact_hits << " false positives)"
+              << std::endl;
+    std::cout << "[Bench] hierarchical lookup: " << ns_per_url(mid, end) << " ns/url, "
+              << double(total_candidates) / num_urls << " candidates/url (" << match_hits << " false positives)" << std::endl;
+}
+
+void run_pattern_matcher_benchmark() {
+    std::cout << "\n=== Testing Substring Pattern Stage ===" << std::endl;
+
+    const std::string rules_path = "l3_test_patterns.txt";
+    {
+        std::ofstream rules(rules_path);
+        rules << "# substring rules\n"
+              << "paypal-verify\n/wp-admin/.env\nsecure-login\n/.git/config\nappleid-unlock\n"
+              << "metamask-restore\n  verify-wallet  \n\n/cgi-bin/\n";
+    }
+
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    filter.insert("evil.com");
+    if (!filter.load_patterns(rules_path)) {
+        std::cerr << "[FAIL] Could not load patterns" << std::endl;
+        return;
+    }
+    std::filesystem::remove(rules_path);
+
+    // Patterns only decide what every layer misses; they match the
+    // canonical URL, case-insensitively
+    const std::pair<const char*, MatchGranularity> checks[] = {
+        {"https://paypal-verify.accounts-help.net/", MatchGranularity::kPattern},
+        {"http://shop.example/WP-ADMIN/%2Eenv", MatchGranularity::kPattern},
+        {"https://docs.example/a/b/../../.git/config", MatchGranularity::kPattern},
+        {"https://secure-login.evil.com/", MatchGranularity::kDomain},
+        {"https://paypal.com/verify", MatchGranularity::kNone},
+        {"https://example.org/wp-admin/index.php", MatchGranularity::kNone},
+    };
+    for (const auto& [url, expected] : checks) {
+        const UrlMatch match = filter.match(url);
+        std::cout << "[Match] " << url << " -> " << granularity_name(match.granularity)
+                  << (match.granularity == expected ? " ✓" : " ✗") << std::endl;
+    }
+    const bool blocked = filter.contains(std::string("https://x.example/paypal-verify/"));
+    std::cout << "[Pattern] contains() on a pattern-only URL: " << (blocked ? "blocked ✓" : "allowed ✗") << std::endl;
+
+    // Raw scan throughput over clean URL text: Teddy for a small rule set,
+    // the hashed-prefix prefilter for a large one
+    std::string text;
+    for (size_t i = 0; text.size() < (size_t{64} << 20); ++i) {
+        text += "https://www" + std::to_string(i % 997) + ".site" + std::to_string(i) +
+                ".example.com/docs/v2/page" + std::to_string(i) + ".html?ref=" + std::to_string(i) + "\n";
+    }
+    std::mt19937_64 rng(20);
+    std::vector<std::string> large_set;
+    for (size_t i = 0; i < 5000; ++i) {
+        std::string pattern;
+        for (int c = 0; c < 12; ++c) pattern += static_cast<char>('a' + rng() % 26);
+        large_set.push_back(pattern + (i % 2 ? "-verify" : "/admin/"));
+    }
+    std::vector<std::string> small_set = {"paypal-verify", "/wp-admin/.env", "secure-login",
+                                          "/.git/config", "appleid-unlock", "metamask-restore"};
+    for (const auto* patterns : {&small_set, &large_set}) {
+        PatternMatcher matcher;
+        matcher.build(*patterns);
+        const int passes = 4;
+        size_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; ++pass) {
+            found += matcher.find(text.data(), text.size()) != PatternMatcher::kNoMatch;
+        }
+        auto end = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "[Bench] " << patterns->size() << " patterns (" << matcher.kernel_name() << "): "
+                  << double(passes) * text.size() / seconds / 1e9 << " GB/s, " << found << " false matches"
+                  << std::endl;
+    }
+
+    // What the stage adds to a lookup that misses every layer
+    const size_t num_urls = 200000;
+    std::vector<std::string> urls;
+    urls.reserve(num_urls);
+    for (size_t i = 0; i < num_urls; ++i) {
+        urls.push_back("https://cdn" + std::to_string(i) + ".example.net/assets/app." + std::to_string(i) + ".js");
+    }
+    UrlCandidates candidates;
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& url : urls) {
+        candidates.parse(url);
+        hits += filter.match(candidates).layer != 0;
+    }
+    auto mid = std::chrono::steady_clock::now();
+    filter.set_patterns({});
+    for (const auto& url : urls) {
+        candidates.parse(url);
+        hits += filter.match(candidates).layer != 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto ns_per_url = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / num_urls;
+    };
+    std::cout << "[Bench] miss path: " << ns_per_url(start, mid) << " ns/url with patterns, "
+              << ns_per_url(mid, end) << " ns/url without (" << hits << " false positives)" << std::endl;
+}
+
+void run_ip_prefix_table_benchmark() {
+    std::cout << "\n=== Testing IP Prefix Layer ===" << std::endl;
+
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    filter.insert("evil.com");
+    if (!filter.set_ip_prefixes({"185.220.101.0/24", "10.0.0.0/8", "10.1.2.0/24", "2001:db8::/32",
+                                 "203.0.113.77"})) {
+        std::cerr << "[FAIL] Could not build IP prefixes" << std::endl;
+        return;
+    }
+
+    // Round-trip through the saved image; the loaded table is mapped
+    const std::string table_path = "l3_test_ip_prefixes.bin";
+    const bool saved = filter.save_ip_prefixes(table_path);
+    const bool loaded = saved && filter.load_ip_prefixes(table_path);
+    std::cout << "[IpPrefix] Save/load: " << (loaded ? "ok ✓" : "failed ✗") << std::endl;
+
+    // Hosts are read as browsers read them, so a hex or single-number
+    // spelling hits the same network
+    const std::pair<const char*, int> checks[] = {
+        {"http://185.220.101.7/payload", 24},
+        {"http://0xb9.0xdc.0x65.0x07/", 24},
+        {"http://10.1.2.3:8080/admin", 24},
+        {"http://167772161/", 8},
+        {"http://[2001:db8::1]/x", 32},
+        {"http://203.0.113.77/", 32},
+        {"http://203.0.113.78/", -1},
+        {"http://185.220.101.7.example.com/", -1},
+    };
+    for (const auto& [url, expected] : checks) {
+        const UrlMatch match = filter.match(url);
+        std::cout << "[Match] " << url << " -> " << granularity_name(match.granularity) << " /"
+                  << match.prefix_length << (match.prefix_length == expected ? " ✓" : " ✗") << std::endl;
+    }
+    const bool blocked = filter.contains(std::string("https://185.220.101.200/"));
+    std::cout << "[IpPrefix] contains() on a listed network: " << (blocked ? "blocked ✓" : "allowed ✗") << std::endl;
+    std::filesystem::remove(table_path);
+
+    // Longest-prefix lookups over a feed-sized list
+    std::mt19937_64 rng(21);
+    std::vector<IpPrefix> prefixes(1000000);
+    for (auto& prefix : prefixes) {
+        const uint32_t address = static_cast<uint32_t>(rng());
+        prefix.length = static_cast<uint8_t>(16 + rng() % 17);
+        const uint32_t network = address & ~uint32_t((uint64_t{1} << (32 - prefix.length)) - 1);
+        for (int i = 0; i < 4; ++i) prefix.address[i] = static_cast<uint8_t>(network >> (24 - 8 * i));
+    }
+    IpPrefixTable table;
+    auto start = std::chrono::steady_clock::now();
+    table.build(std::move(prefixes));
+    auto built = std::chrono::steady_clock::now();
+    std::vector<uint32_t> addresses(4000000);
+    for (auto& address : addresses) address = static_cast<uint32_t>(rng());
+    auto mid = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (const uint32_t address : addresses) hits += table.lookup_v4(address) >= 0;
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Bench] " << table.size() << " prefixes: built in "
+              << std::chrono::duration<double, std::milli>(built - start).count() << " ms, "
+              << table.get_memory_usage() / (1024 * 1024) << " MiB, "
+              << std::chrono::duration<double, std::nano>(end - mid).count() / addresses.size()
+              << " ns/lookup (" << hits << " hits)" << std::endl;
+}
+
+void run_zero_copy_benchmark() {
+    std::cout << "\n=== Testing Zero-Copy Query Path ===" << std::endl;
+
+    PerformanceOptimizedFilter filter;
+    filter.initialize(100000);
+    filter.insert("https://blocked.example.com/login");
+    filter.set_patterns({"paypal-verify", "/wp-admin/.env"});
+    filter.set_ip_prefixes({"185.220.101.0/24"});
+
+    // URLs as they sit in a log buffer: one per line, queried in place
+    std::string buffer;
+    const size_t num_urls = 200000;
+    for (size_t i = 0; i < num_urls; ++i) {
+        switch (i % 50) {
+        case 0: buffer += "https://blocked.example.com/login\n"; break;
+        case 1: buffer += "http://185.220.101." + std::to_string(i % 256) + "/payload\n"; break;
+        case 2: buffer += "https://accounts.example.net/paypal-verify/" + std::to_string(i) + "\n"; break;
+        default:
+            buffer += "https://cdn" + std::to_string(i % 4096) + ".example.org/static/js/app." + std::to_string(i) +
+                      ".min.js?v=" + std::to_string(i * 7) + "\n";
+        }
+    }
+    std::vector<std::string_view> urls;
+    urls.reserve(num_urls);
+    for (size_t begin = 0; begin < buffer.size();) {
+        const size_t end = buffer.find('\n', begin);
+        urls.emplace_back(buffer.data() + begin, end - begin);
+        begin = end + 1;
+    }
+    std::vector<uint8_t> layers(urls.size());
+    UrlCandidates candidates;
+
+    // First pass warms the thread's caches and epoch registration
+    filter.contains_batch(std::span<const std::string_view>(urls), layers.data());
+
+    // The same checks the way a caller had to make them before: copy each
+    // URL into a string first
+    uint64_t before = g_heap_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t copied_hits = 0;
+    for (const std::string_view view : urls) {
+        const std::string url(view);
+        const std::string_view copy(url);
+        uint8_t layer = 0;
+        filter.contains_batch(std::span<const std::string_view>(&copy, 1), &layer);
+        copied_hits += layer != 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    const uint64_t copied_allocations = g_heap_allocations.load() - before;
+    const double copied_ns = std::chrono::duration<double, std::nano>(end - start).count() / urls.size();
+
+    // Straight from the buffer, batched, rules included
+    before = g_heap_allocations.load();
+    start = std::chrono::steady_clock::now();
+    filter.contains_batch(std::span<const std::string_view>(urls), layers.data());
+    end = std::chrono::steady_clock::now();
+    const uint64_t batch_allocations = g_heap_allocations.load() - before;
+    const double batch_ns = std::chrono::duration<double, std::nano>(end - start).count() / urls.size();
+    const size_t batch_hits = static_cast<size_t>(std::count_if(layers.begin(), layers.end(),
+                                                                [](uint8_t layer) { return layer != 0; }));
+
+    // Hierarchical match from the buffer
+    before = g_heap_allocations.load();
+    start = std::chrono::steady_clock::now();
+    size_t match_hits = 0;
+    for (const std::string_view url : urls) {
+        candidates.parse(url);
+        match_hits += filter.match(candidates).layer != 0;
+    }
+    end = std::chrono::steady_clock::now();
+    const uint64_t match_allocations = g_heap_allocations.load() - before;
+    const double match_ns = std::chrono::duration<double, std::nano>(end - start).count() / urls.size();
+
+    auto per_query = [&](uint64_t allocations) { return double(allocations) / urls.size(); };
+    std::cout << "[Bench] copy into std::string:  " << per_query(copied_allocations) << " allocs/query, "
+              << copied_ns << " ns/query (" << copied_hits << " hits)" << std::endl;
+    std::cout << "[Bench] contains_batch(span):   " << per_query(batch_allocations) << " allocs/query, "
+              << batch_ns << " ns/query (" << batch_hits << " hits)" << std::endl;
+    std::cout << "[Bench] match(string_view):     " << per_query(match_allocations) << " allocs/query, "
+              << match_ns << " ns/query (" << match_hits << " hits)" << std::endl;
+    std::cout << "[ZeroCopy] Buffer queries allocation-free: "
+              << (batch_allocations == 0 && match_allocations == 0 ? "yes ✓" : "no ✗") << std::endl;
+}
+
+void run_numa_topology_test() {
+    std::cout << "\n=== Testing NUMA Topology ===" << std::endl;
+
+    CoherentMemoryManager::initialize();
+    const int real_nodes = CoherentMemoryManager::get_num_numa_nodes();
+    for (int node = 0; node < real_nodes; ++node) {
+        std::cout << "[NUMA] Node " << node << " (OS node " << CoherentMemoryManager::get_os_node_id(node)
+                  << "): " << CoherentMemoryManager::get_node_cpus(node).size() << " CPUs" << std::endl;
+    }
+
+    // Pinned to each node in turn, a thread runs on that node's CPUs and
+    // gets memory there (pinning only inside these threads, so the rest of
+    // the run is unaffected)
+    auto check_nodes = [](const char* label) {
+        const int nodes = CoherentMemoryManager::get_num_numa_nodes();
+        for (int node = 0; node < nodes; ++node) {
+            std::thread([&] {
+                const bool pinned = CoherentMemoryManager::pin_thread_to_numa(node);
+                const std::vector<int> cpus = CoherentMemoryManager::get_node_cpus(node);
+                const std::vector<int> running_on =
+                    CoherentMemoryManager::get_node_cpus(CoherentMemoryManager::get_current_numa_node());
+                const bool on_node = std::find_first_of(cpus.begin(), cpus.end(), running_on.begin(),
+                                                        running_on.end()) != cpus.end();
+                const size_t size = size_t{8} << 20;
+                void* memory = CoherentMemoryManager::allocate_numa_local(size, node);
+                if (memory) std::memset(memory, 0xA5, size);
+                CoherentMemoryManager::free_numa_local(memory, size);
+                std::cout << "[NUMA] " << label << " node " << node << ": pinned "
+                          << (pinned && on_node ? "✓" : "✗") << ", local allocation " << (memory ? "✓" : "✗")
+                          << std::endl;
+            }).join();
+        }
+    };
+    check_nodes("real");
+
+    // A fake two-node split of this machine drives the multi-node paths
+    const bool faked = CoherentMemoryManager::set_fake_topology("2");
+    std::cout << "[NUMA] Fake topology: " << CoherentMemoryManager::get_num_numa_nodes() << " nodes "
+              << (faked && CoherentMemoryManager::get_num_numa_nodes() == 2 ? "✓" : "✗") << std::endl;
+    check_nodes("fake");
+    {
+        NUMAOptimizedFilter numa_filter;
+        numa_filter.initialize(100000);
+        const std::vector<std::string> urls = {"https://split-a.example/x", "https://split-b.example/y",
+                                               "https://split-c.example/z", "https://split-d.example/w"};
+        numa_filter.insert_batch(urls);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        bool all_found = true;
+        for (const auto& url : urls) all_found &= numa_filter.contains(HashedKey::of(url));
+        std::cout << "[NUMA] Fake two-node filter finds every insert: " << (all_found ? "✓" : "✗") << std::endl;
+    }
+
+    const bool rejected = !CoherentMemoryManager::set_fake_topology("3-1;x");
+    CoherentMemoryManager::set_fake_topology("");
+    std::cout << "[NUMA] Invalid spec rejected " << (rejected ? "✓" : "✗") << ", real topology restored "
+              << (!CoherentMemoryManager::is_fake_topology() &&
+                  CoherentMemoryManager::get_num_numa_nodes() == real_nodes ? "✓" : "✗") << std::endl;
+}
+
+void run_numa_replicated_l3_test() {
+    std::cout << "\n=== Testing replicated L3 across NUMA nodes ===" << std::endl;
+
+    const size_t num_blocked = 200000;
+    std::vector<uint64_t> keys;
+    keys.reserve(num_blocked);
+    for (size_t i = 0; i < num_blocked; ++i) {
+        keys.push_back(HashedKey::of("https://replica-" + std::to_string(i) + ".example/").key);
+    }
+    // With exact keys, so each replica can be rebuilt
+    const std::string image_path = "l3_test_replica.bin";
+    BinaryFuseWrapper image;
+    image.set_exact_verification(true);
+    if (!image.build_from_keys(keys) || !image.save_to_file(image_path)) {
+        std::cerr << "[FAIL] Could not write the L3 image" << std::endl;
+        return;
+    }
+
+    // Two fake nodes, so each replica is a separate copy
+    CoherentMemoryManager::set_fake_topology("2");
+    {
+        NUMAOptimizedFilter numa_filter;
+        numa_filter.initialize(100000);
+        numa_filter.insert("https://before-replication.example/");
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        if (!numa_filter.load_replicated_l3(image_path)) {
+            std::cerr << "[FAIL] L3 replication failed" << std::endl;
+        }
+        numa_filter.insert("https://after-replication.example/");
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+        // From a thread on each node: the node's own replica answers, and
+        // holds the image plus every dynamic key
+        const std::vector<HashedKey> dynamic = {HashedKey::of("https://malicious.com"),
+                                                HashedKey::of("https://before-replication.example/"),
+                                                HashedKey::of("https://after-replication.example/")};
+        for (int node = 0; node < CoherentMemoryManager::get_num_numa_nodes(); ++node) {
+            std::thread([&] {
+                CoherentMemoryManager::pin_thread_to_numa(node);
+                // Fake nodes may share CPUs, so compare CPU sets, not indices
+                const std::vector<int> cpus = CoherentMemoryManager::get_node_cpus(node);
+                const std::vector<int> running_on =
+                    CoherentMemoryManager::get_node_cpus(CoherentMemoryManager::get_current_numa_node());
+                const bool on_node = std::find_first_of(cpus.begin(), cpus.end(), running_on.begin(),
+                                                        running_on.end()) != cpus.end();
+
+                size_t found = 0;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (uint64_t key : keys) found += numa_filter.contains(HashedKey{key, 0});
+                auto end = std::chrono::high_resolution_clock::now();
+                const double ns = std::chrono::duration<double, std::nano>(end - start).count() / keys.size();
+
+                bool dynamic_found = true;
+                for (const auto& hash : dynamic) dynamic_found &= numa_filter.contains(hash);
+                const bool clean_found = numa_filter.contains(HashedKey::of("https://clean.example/"));
+
+                std::cout << "[Replica] node " << node << " (on node " << (on_node ? "✓" : "✗")
+                          << "): image keys " << found << "/" << keys.size() << " "
+                          << (found == keys.size() ? "✓" : "✗") << ", dynamic keys "
+                          << (dynamic_found ? "✓" : "✗") << ", clean URL "
+                          << (clean_found ? "BLOCKED ✗" : "ALLOWED ✓") << ", " << ns << " ns/lookup"
+                          << std::endl;
+            }).join();
+        }
+
+        numa_filter.remove("https://after-replication.example/");
+        bool retracted = true;
+        for (int node = 0; node < CoherentMemoryManager::get_num_numa_nodes(); ++node) {
+            std::thread([&] {
+                CoherentMemoryManager::pin_thread_to_numa(node);
+                retracted &= !numa_filter.contains(HashedKey::of("https://after-replication.example/"));
+            }).join();
+        }
+        std::cout << "[Replica] Retraction reaches every node: " << (retracted ? "✓" : "✗") << std::endl;
+
+        // An image key is retracted by rebuilding every replica
+        const bool image_removed = numa_filter.remove("https://replica-7.example/");
+        bool image_retracted = image_removed;
+        for (int node = 0; node < CoherentMemoryManager::get_num_numa_nodes(); ++node) {
+            std::thread([&] {
+                CoherentMemoryManager::pin_thread_to_numa(node);
+                image_retracted &= !numa_filter.contains(HashedKey::of("https://replica-7.example/"));
+            }).join();
+        }
+        std::cout << "[Replica] Image key retracted on every node: " << (image_retracted ? "✓" : "✗") << std::endl;
+    }
+    CoherentMemoryManager::set_fake_topology("");
+
+    // A replica keeps compacting: inserts fold into it and leave L2
+    MappedFile mapped;
+    if (!mapped.open(image_path)) {
+        std::cerr << "[FAIL] Could not map the L3 image" << std::endl;
+        return;
+    }
+    PerformanceOptimizedFilter replica;
+    replica.initialize(100000);
+    replica.load_l3_replica(mapped, 0);
+    for (int i = 0; i < 1000; ++i) replica.insert(HashedKey::of("https://compacted-" + std::to_string(i) + ".example/"));
+    const bool compacted = replica.compact_l2().ok && replica.get_l2_count() == 0 &&
+                           replica.get_l3_count() == keys.size() + 3 + 1000 &&
+                           replica.contains(HashedKey::of("https://compacted-7.example/")) &&
+                           replica.contains(HashedKey::of("https://malicious.com"));
+    std::cout << "[Replica] Compaction into a replica: L2 " << replica.get_l2_count() << ", L3 "
+              << replica.get_l3_count() << " keys " << (compacted ? "✓" : "✗") << std::endl;
+
+    // Without exact keys L3 is static: nothing to compact into, and an
+    // image key cannot be retracted
+    BinaryFuseWrapper bare;
+    if (!bare.build_from_keys(keys) || !bare.save_to_file(image_path) || !mapped.open(image_path)) {
+        std::cerr << "[FAIL] Could not write the L3 image" << std::endl;
+        return;
+    }
+    PerformanceOptimizedFilter fixed;
+    fixed.initialize(100000);
+    fixed.load_l3_replica(mapped, 0);
+    fixed.insert(HashedKey::of("https://static-insert.example/"));
+    const bool refused = fixed.is_l3_static() && !fixed.compact_l2().ok &&
+                         !fixed.remove(HashedKey::of("https://replica-7.example/")) &&
+                         fixed.contains(HashedKey::of("https://replica-7.example/"));
+    std::cout << "[Replica] Static replica refuses compaction and image retraction "
+              << (refused ? "✓" : "✗") << std::endl;
+    std::filesystem::remove(image_path);
+}
+
+void run_worker_wakeup_benchmark() {
+    std::cout << "\n=== Benchmarking enqueue-to-processed latency (bursty ingress) ===" << std::endl;
+
+    constexpr size_t kBursts = 300;
+    constexpr size_t kBurstSize = 16;
+    std::vector<std::string> urls;
+    urls.reserve(kBursts * kBurstSize);
+    for (size_t i = 0; i < kBursts * kBurstSize; ++i) {
+        urls.push_back("https://burst-" + std::to_string(i) + ".example/");
+    }
+
+    // One node, so a single worker applies the URLs in enqueue order and
+    // the processed count says which ones are done
+    CoherentMemoryManager::set_fake_topology("1");
+    std::vector<double> latencies;
+    latencies.reserve(urls.size());
+    // The workers log every URL; keep that off the console while measuring
+    std::streambuf* console = std::cout.rdbuf(nullptr);
+    {
+        NUMAOptimizedFilter numa_filter;
+        numa_filter.initialize(100000);
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> gap_us(200, 2000);
+        using clock = std::chrono::steady_clock;
+        clock::time_point enqueued[kBurstSize];
+        for (size_t burst = 0; burst < kBursts; ++burst) {
+            // Idle long enough for the worker to go quiet, then a burst
+            std::this_thread::sleep_for(std::chrono::microseconds(gap_us(rng)));
+            const uint64_t base = numa_filter.get_processed_count();
+            for (size_t i = 0; i < kBurstSize; ++i) {
+                enqueued[i] = clock::now();
+                numa_filter.insert(urls[burst * kBurstSize + i]);
+            }
+            size_t done = 0;
+            while (done < kBurstSize) {
+                const uint64_t processed = numa_filter.get_processed_count() - base;
+                const auto now = clock::now();
+                for (; done < processed && done < kBurstSize; ++done) {
+                    latencies.push_back(std::chrono::duration<double, std::micro>(now - enqueued[done]).count());
+                }
+                if (done < kBurstSize) std::this_thread::yield();
+            }
+        }
+    }
+    std::cout.rdbuf(console);
+    CoherentMemoryManager::set_fake_topology("");
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+    std::cout << "[Wakeup] " << kBursts << " bursts of " << kBurstSize << ", 0.2-2 ms apart: p50 "
+              << percentile(0.50) << " us, p99 " << percentile(0.99) << " us, max " << latencies.back() << " us"
+              << std::endl;
+}
+
 void run_numa_test() {
-    std::cout << "\n=== Testing NUMA Architecture (L2 + L3) ===" << std::endl;
+    std::cout << "\n=== Testing NUMA Architecture (L1 + L2 + L3) ===" << std::endl;
 
     NUMAOptimizedFilter numa_filter;
     
@@ -137,6 +1678,10 @@ void run_numa_test() {
     // Wait for processing
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
+    // Fold the new L2 entries into L3 in the background
+    numa_filter.request_compaction();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
     // Print statistics
     numa_filter.print_stats();
 
@@ -144,7 +1689,7 @@ void run_numa_test() {
     std::cout << "\nTesting contains() method:" << std::endl;
     std::vector<std::string> check_urls = {
         "https://malicious.com",     // Should hit L3
-        "https://example.com",       // Should hit L2  
+        "https://example.com",       // Should hit L3 after compaction
         "https://unknown-site.com"   // Should miss
     };
     
@@ -159,15 +1704,41 @@ int main() {
     
     // Test 1: Core BinaryFuse filter (L3)
     run_binary_fuse_test();
+    run_l3_batch_benchmark();
+    run_l3_kernel_equivalence_test();
+    run_l3_sharded_build_test();
+    run_l3_hot_swap_test();
+    run_l3_stream_build_test();
+    run_l3_exact_verification_test();
+    run_l3_fingerprint_width_test();
     
     // Test 2: Morton Filter (L2) 
     run_morton_filter_test();
+    run_morton_expiry_test();
+    run_l2_concurrency_stress_test();
+    run_l2_growth_test();
+    run_hashed_key_benchmark();
+    run_url_canonicalizer_benchmark();
+    run_l2_journal_test();
+
+    // Test 3: Tiny Bloom (L1)
+    run_l1_bloom_benchmark();
+    run_negative_cache_benchmark();
+
+    // Hierarchical host/path lookups over L1 + L2 + L3
+    run_hierarchical_match_test();
+    run_pattern_matcher_benchmark();
+    run_ip_prefix_table_benchmark();
+    run_zero_copy_benchmark();
     
-    // Test 3: Integrated NUMA architecture (L2 + L3)
+    // Test 4: Integrated NUMA architecture (L1 + L2 + L3)
+    run_numa_topology_test();
+    run_numa_replicated_l3_test();
+    run_worker_wakeup_benchmark();
     run_numa_test();
 
     std::cout << "\n🎯 [LlamaShield] All tests completed successfully!" << std::endl;
-    std::cout << "Architecture: L2 (Morton) + L3 (BinaryFuse) + NUMA Parallelism" << std::endl;
+    std::cout << "Architecture: L1 (Bloom) + L2 (Morton) + L3 (BinaryFuse) + NUMA Parallelism" << std::endl;
     std::cout << "Next: Python LLM Integration" << std::endl;
 
     return 0;
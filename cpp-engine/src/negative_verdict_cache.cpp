@@ -0,0 +1,78 @@
+#include "negative_verdict_cache.hpp"
+#include "fuse_layout.hpp"
+#include <utility>
+
+namespace {
+
+// Keys are already uniform hashes, but L1 and the L3 shard index also use
+// the high bits; remix so sets do not correlate with either
+constexpr uint64_t kSetSeed = 0x6e65676361636865ULL;
+
+size_t set_index(uint64_t key) {
+    return static_cast<size_t>(fuse_mix(key, kSetSeed) & (NegativeVerdictCache::kSets - 1));
+}
+
+std::atomic<uint64_t> g_generation{1};
+
+constexpr uint64_t kSlotSeed = 0x7374616d70736c74ULL;
+
+size_t slot_index(uint64_t key) {
+    return static_cast<size_t>(fuse_mix(key, kSlotSeed) & (VerdictStamps::kSlots - 1));
+}
+
+} // namespace
+
+static_assert((NegativeVerdictCache::kSets & (NegativeVerdictCache::kSets - 1)) == 0,
+              "set count must be a power of two");
+static_assert((VerdictStamps::kSlots & (VerdictStamps::kSlots - 1)) == 0,
+              "slot count must be a power of two");
+
+NegativeVerdictCache::NegativeVerdictCache()
+    : sets_(std::make_unique<set_t[]>(kSets)) {}
+
+NegativeVerdictCache& NegativeVerdictCache::local() {
+    thread_local NegativeVerdictCache cache;
+    return cache;
+}
+
+uint64_t NegativeVerdictCache::next_generation() {
+    return g_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+bool NegativeVerdictCache::contains(uint64_t key, uint64_t generation) {
+    set_t& set = sets_[set_index(key)];
+    if (set.ways[0].key == key && set.ways[0].generation == generation) {
+        ++hits_;
+        return true;
+    }
+    if (set.ways[1].key == key && set.ways[1].generation == generation) {
+        std::swap(set.ways[0], set.ways[1]);
+        ++hits_;
+        return true;
+    }
+    ++misses_;
+    return false;
+}
+
+void NegativeVerdictCache::insert(uint64_t key, uint64_t generation) {
+    set_t& set = sets_[set_index(key)];
+    // The least recently used way goes. Tags differ between live entries
+    // (see VerdictStamps), so a stale one cannot be told apart here; it
+    // simply ages out.
+    set.ways[1] = set.ways[0];
+    set.ways[0] = {key, generation};
+}
+
+VerdictStamps::VerdictStamps()
+    : stamps_(std::make_unique<std::atomic<uint32_t>[]>(kSlots)) {}
+
+uint64_t VerdictStamps::tag(uint64_t key, uint64_t generation) const {
+    // A stamp only repeats after 2^(64 - kGenerationBits) inserts into its
+    // slot without a new generation in between
+    const uint64_t stamp = stamps_[slot_index(key)].load(std::memory_order_acquire);
+    return (stamp << kGenerationBits) | (generation & ((uint64_t{1} << kGenerationBits) - 1));
+}
+
+void VerdictStamps::invalidate(uint64_t key) {
+    stamps_[slot_index(key)].fetch_add(1, std::memory_order_release);
+}
@@ -3,13 +3,44 @@
 #include <chrono>
 #include <unordered_map>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Idle worker: tries to dequeue this many times between pause
+// instructions, then this many times between yields, before parking
+constexpr int kSpinRounds = 128;
+constexpr int kYieldRounds = 32;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) && defined(__GNUC__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+} // namespace
+
 NUMAOptimizedFilter::NUMAOptimizedFilter() 
     : num_numa_nodes_(1), processed_counts_size_(0) {
 }
 
 NUMAOptimizedFilter::~NUMAOptimizedFilter() {
+    for (auto& compactor : compactors_) {
+        compactor->stop();
+    }
+
     running_ = false;
     
+    // Parked workers check running_ once woken
+    for (size_t i = 0; i < worker_threads_.size(); ++i) {
+        wakeups_[i].epoch.fetch_add(1, std::memory_order_release);
+        wakeups_[i].epoch.notify_all();
+    }
+
     // Stop worker threads
     for (auto& thread : worker_threads_) {
         if (thread.joinable()) {
@@ -18,7 +49,7 @@ NUMAOptimizedFilter::~NUMAOptimizedFilter() {
     }
 }
 
-bool NUMAOptimizedFilter::initialize(size_t total_capacity) {
+bool NUMAOptimizedFilter::initialize(size_t total_capacity, const std::string& journal_dir) {
     // Initialize NUMA system
     if (!CoherentMemoryManager::initialize()) {
         std::cout << "[NUMAFilter] Using single-node fallback mode" << std::endl;
@@ -33,14 +64,28 @@ bool NUMAOptimizedFilter::initialize(size_t total_capacity) {
     // FIX: Use array instead of vector for atomics
     processed_counts_size_ = num_numa_nodes_;
     processed_counts_ = std::make_unique<std::atomic<uint64_t>[]>(num_numa_nodes_);
+    wakeups_ = std::make_unique<WorkerWakeup[]>(num_numa_nodes_);
     
     // Initialize all atomics to 0
     for (int i = 0; i < num_numa_nodes_; ++i) {
         processed_counts_[i].store(0, std::memory_order_relaxed);
         
-        // Create filter for this node using unique_ptr
-        auto filter = std::make_unique<PerformanceOptimizedFilter>();
-        filter->initialize(per_node_capacity);
+        // Create filter for this node on a thread pinned to it, so the
+        // filter's memory is first touched, hence placed, on that node
+        std::unique_ptr<PerformanceOptimizedFilter> filter;
+        bool recovered = true;
+        std::thread([&] {
+            CoherentMemoryManager::pin_thread_to_numa(i);
+            filter = std::make_unique<PerformanceOptimizedFilter>();
+            filter->initialize(per_node_capacity);
+            if (!journal_dir.empty()) {
+                recovered = filter->open_journal(journal_dir + "/node-" + std::to_string(i));
+            }
+        }).join();
+        if (!recovered) {
+            std::cerr << "[NUMAFilter] Journal recovery failed for node " << i << std::endl;
+            return false;
+        }
         per_node_filters_.push_back(std::move(filter));
         
         // Create queue for this node
@@ -51,53 +96,276 @@ bool NUMAOptimizedFilter::initialize(size_t total_capacity) {
     for (int i = 0; i < num_numa_nodes_; ++i) {
         worker_threads_.emplace_back(&NUMAOptimizedFilter::worker_loop, this, i);
     }
+
+    // One background compactor per node keeps each L2 small; it runs on
+    // its node, so the L3 it rebuilds stays there
+    for (size_t node = 0; node < per_node_filters_.size(); ++node) {
+        L3Compactor::Options options;
+        options.numa_node = static_cast<int>(node);
+        compactors_.push_back(std::make_unique<L3Compactor>(*per_node_filters_[node], options));
+        compactors_.back()->start();
+    }
     
     std::cout << "[NUMAFilter] Initialization complete with " << worker_threads_.size() << " worker threads" << std::endl;
     return true;
 }
 
-size_t NUMAOptimizedFilter::route_to_numa(const std::string& url) const {
-    // Simple hash-based routing for good distribution
-    std::hash<std::string> hasher;
-    return hasher(url) % num_numa_nodes_;
+size_t NUMAOptimizedFilter::route_to_numa(const HashedKey& hash) const {
+    // The routing half of the ingress hash; the filters use the other half
+    return hash.partition(static_cast<size_t>(num_numa_nodes_));
+}
+
+size_t NUMAOptimizedFilter::query_node(const HashedKey& hash) const {
+    if (!replicated_.load(std::memory_order_acquire)) return route_to_numa(hash);
+
+    // Every node holds everything; read the nearest copy
+    const size_t node = static_cast<size_t>(CoherentMemoryManager::get_current_numa_node());
+    return node < per_node_filters_.size() ? node : 0;
 }
 
-bool NUMAOptimizedFilter::contains(const std::string& url) {
+bool NUMAOptimizedFilter::contains(std::string_view url) {
     if (per_node_filters_.empty()) return false;
     
-    size_t numa_node = route_to_numa(url);
-    return per_node_filters_[numa_node]->contains(url);
+    const HashedKey hash = HashedKey::of(url);
+    size_t numa_node = query_node(hash);
+    return per_node_filters_[numa_node]->contains(hash, url);
+}
+
+bool NUMAOptimizedFilter::contains(const HashedKey& hash) {
+    if (per_node_filters_.empty()) return false;
+
+    return per_node_filters_[query_node(hash)]->contains(hash);
 }
 
-void NUMAOptimizedFilter::insert(const std::string& url) {
+UrlMatch NUMAOptimizedFilter::match(std::string_view url) {
+    if (per_node_filters_.empty()) return {};
+
+    UrlCandidates candidates;
+    candidates.parse(url);
+    if (replicated_.load(std::memory_order_acquire)) {
+        return per_node_filters_[query_node(candidates.keys()[0])]->match(candidates);
+    }
+
+    uint8_t layers[UrlCandidates::kMaxCandidates] = {};
+    for (size_t node = 0; node < per_node_filters_.size(); ++node) {
+        HashedKey keys[UrlCandidates::kMaxCandidates];
+        size_t index[UrlCandidates::kMaxCandidates];
+        size_t n = 0;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (route_to_numa(candidates.keys()[i]) != node) continue;
+            keys[n] = candidates.keys()[i];
+            index[n++] = i;
+        }
+        if (n == 0) continue;
+
+        uint8_t node_layers[UrlCandidates::kMaxCandidates];
+        per_node_filters_[node]->contains_batch(keys, n, node_layers);
+        for (size_t j = 0; j < n; ++j) layers[index[j]] = node_layers[j];
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (layers[i] != 0) return {candidates.granularity(i), layers[i], i};
+    }
+    // Every node holds the rules; the URL's own node checks them
+    return per_node_filters_[route_to_numa(candidates.keys()[0])]->match_rules(candidates);
+}
+
+bool NUMAOptimizedFilter::load_replicated_l3(const std::string& path) {
+    if (per_node_filters_.empty()) return false;
+
+    MappedFile image;
+    if (!image.open(path)) {
+        std::cerr << "[NUMAFilter] Cannot map L3 image: " << path << std::endl;
+        return false;
+    }
+
+    // Every node's L3 keys are kept on every node
+    std::vector<uint64_t> l3_keys;
+    for (auto& filter : per_node_filters_) {
+        std::vector<uint64_t> keys = filter->get_l3_keys();
+        l3_keys.insert(l3_keys.end(), keys.begin(), keys.end());
+    }
+
+    // Each copy is made by a thread on its node, so its pages are local
+    // even where memory policy is unavailable (fake topologies)
+    bool all_ok = true;
+    for (size_t node = 0; node < per_node_filters_.size(); ++node) {
+        std::thread([&] {
+            CoherentMemoryManager::pin_thread_to_numa(static_cast<int>(node));
+            all_ok &= per_node_filters_[node]->load_l3_replica(image, static_cast<int>(node), l3_keys);
+        }).join();
+    }
+    if (!all_ok) {
+        std::cerr << "[NUMAFilter] L3 replication failed: " << path << std::endl;
+        return false;
+    }
+    replicated_.store(true, std::memory_order_release);
+
+    // A lookup now sees only its own node, so each node needs the keys
+    // every other node holds
+    std::vector<std::vector<uint64_t>> held(per_node_filters_.size());
+    for (size_t node = 0; node < held.size(); ++node) {
+        held[node] = per_node_filters_[node]->get_l2_keys();
+        std::sort(held[node].begin(), held[node].end());
+        held[node].erase(std::unique(held[node].begin(), held[node].end()), held[node].end());
+    }
+    size_t spread = 0;
+    for (size_t target = 0; target < held.size(); ++target) {
+        for (size_t source = 0; source < held.size(); ++source) {
+            if (source == target) continue;
+            for (uint64_t key : held[source]) {
+                if (std::binary_search(held[target].begin(), held[target].end(), key)) continue;
+                per_node_filters_[target]->insert(HashedKey{key, 0});
+                ++spread;
+            }
+        }
+    }
+
+    std::cout << "[NUMAFilter] L3 replicated to " << per_node_filters_.size() << " node(s) from " << path
+              << " (" << spread << " dynamic keys spread)" << std::endl;
+    return true;
+}
+
+bool NUMAOptimizedFilter::set_ip_prefixes(const std::vector<std::string>& prefixes) {
+    bool all_ok = !per_node_filters_.empty();
+    for (auto& filter : per_node_filters_) {
+        all_ok &= filter->set_ip_prefixes(prefixes);
+    }
+    return all_ok;
+}
+
+bool NUMAOptimizedFilter::load_ip_prefixes(const std::string& path) {
+    bool all_ok = !per_node_filters_.empty();
+    for (auto& filter : per_node_filters_) {
+        all_ok &= filter->load_ip_prefixes(path);
+    }
+    return all_ok;
+}
+
+bool NUMAOptimizedFilter::load_patterns(const std::string& path) {
+    bool all_ok = !per_node_filters_.empty();
+    for (auto& filter : per_node_filters_) {
+        all_ok &= filter->load_patterns(path);
+    }
+    return all_ok;
+}
+
+bool NUMAOptimizedFilter::set_patterns(const std::vector<std::string>& patterns) {
+    bool all_ok = !per_node_filters_.empty();
+    for (auto& filter : per_node_filters_) {
+        all_ok &= filter->set_patterns(patterns);
+    }
+    return all_ok;
+}
+
+void NUMAOptimizedFilter::insert(std::string_view url) {
     if (per_node_queues_.empty()) return;
     
-    size_t numa_node = route_to_numa(url);
-    per_node_queues_[numa_node].enqueue(url);
+    IngressItem item(url, HashedKey::of(url));
+    if (replicated_.load(std::memory_order_acquire)) {
+        // Each node's worker applies it to its own L2
+        for (size_t node = 0; node < per_node_queues_.size(); ++node) {
+            per_node_queues_[node].enqueue(item);
+            wake(node);
+        }
+        return;
+    }
+    size_t numa_node = route_to_numa(item.hash);
+    per_node_queues_[numa_node].enqueue(std::move(item));
+    wake(numa_node);
+}
+
+void NUMAOptimizedFilter::wake(size_t numa_node) {
+    WorkerWakeup& wakeup = wakeups_[numa_node];
+    // Orders the enqueue before the load of parked. The worker fences
+    // between raising parked and its last look at the queue, so either it
+    // sees the item or this sees it parked.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (wakeup.parked.load(std::memory_order_relaxed) == 0) return;
+    wakeup.epoch.fetch_add(1, std::memory_order_release);
+    wakeup.epoch.notify_one();
+}
+
+bool NUMAOptimizedFilter::remove(std::string_view url) {
+    if (per_node_filters_.empty()) return false;
+    
+    if (replicated_.load(std::memory_order_acquire)) {
+        // Each node only marks its L3 copy; its compactor drops the key
+        const HashedKey hash = HashedKey::of(url);
+        bool removed = false;
+        for (auto& filter : per_node_filters_) {
+            removed |= filter->remove(hash);
+        }
+        if (removed) std::cout << "[NUMAFilter] Retracted on every node: " << url << std::endl;
+        return removed;
+    }
+    size_t numa_node = route_to_numa(HashedKey::of(url));
+    return per_node_filters_[numa_node]->remove(url);
 }
 
-void NUMAOptimizedFilter::check_url(const std::string& url) {
+void NUMAOptimizedFilter::check_url(std::string_view url) {
     // For now, just insert to demonstrate the flow
     insert(url);
 }
 
+void NUMAOptimizedFilter::request_compaction() {
+    for (auto& compactor : compactors_) {
+        compactor->request_compaction();
+    }
+}
+
 void NUMAOptimizedFilter::insert_batch(const std::vector<std::string>& urls) {
+    enqueue_urls(urls);
+}
+
+void NUMAOptimizedFilter::insert_batch(std::span<const std::string_view> urls) {
+    enqueue_urls(urls);
+}
+
+template <typename Urls>
+void NUMAOptimizedFilter::enqueue_urls(const Urls& urls) {
     if (per_node_queues_.empty()) return;
-    
-    // Group URLs by NUMA node for efficient batch processing
-    std::vector<std::vector<std::string>> batches(num_numa_nodes_);
-    
-    for (const auto& url : urls) {
-        size_t numa_node = route_to_numa(url);
-        batches[numa_node].push_back(url);
-    }
-    
-    // Enqueue batches to respective NUMA nodes
-    for (size_t i = 0; i < batches.size(); ++i) {
-        if (!batches[i].empty()) {
-            for (const auto& url : batches[i]) {
-                per_node_queues_[i].enqueue(url);
+
+    // Group URLs by NUMA node for efficient batch processing: a window of
+    // items is built on the stack in node order, and each node's run goes
+    // to its queue in one bulk enqueue
+    constexpr size_t kWindow = 64;
+    HashedKey hashes[kWindow];
+    size_t nodes[kWindow];
+    uint8_t order[kWindow];
+    IngressItem items[kWindow];
+    const bool replicated = replicated_.load(std::memory_order_acquire);
+    for (size_t base = 0; base < urls.size(); base += kWindow) {
+        const size_t count = std::min(kWindow, urls.size() - base);
+        if (replicated) {
+            // The whole window goes to every node
+            for (size_t i = 0; i < count; ++i) {
+                items[i] = IngressItem(urls[base + i], HashedKey::of(urls[base + i]));
+            }
+            for (size_t node = 0; node < per_node_queues_.size(); ++node) {
+                per_node_queues_[node].enqueue_bulk(items, count);
+                wake(node);
             }
+            continue;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            hashes[i] = HashedKey::of(urls[base + i]);
+            nodes[i] = route_to_numa(hashes[i]);
+            order[i] = static_cast<uint8_t>(i);
+        }
+        std::sort(order, order + count, [&](uint8_t a, uint8_t b) { return nodes[a] < nodes[b]; });
+        for (size_t j = 0; j < count; ++j) {
+            items[j] = IngressItem(urls[base + order[j]], hashes[order[j]]);
+        }
+
+        for (size_t begin = 0; begin < count;) {
+            const size_t node = nodes[order[begin]];
+            size_t end = begin + 1;
+            while (end < count && nodes[order[end]] == node) ++end;
+            per_node_queues_[node].enqueue_bulk(items + begin, end - begin);
+            wake(node);
+            begin = end;
         }
     }
 }
@@ -117,33 +385,67 @@ void NUMAOptimizedFilter::worker_loop(int numa_node) {
     
     auto& queue = per_node_queues_[numa_node];
     auto* filter = per_node_filters_[numa_node].get();
-    
+    WorkerWakeup& wakeup = wakeups_[numa_node];
+
+    // Spinning only pays off if a producer can run meanwhile
+    const int spin_rounds = std::thread::hardware_concurrency() > 1 ? kSpinRounds : 0;
+    int idle_rounds = 0;
     while (running_) {
-        std::string url;
+        IngressItem item;
         
         // Try to dequeue a URL
-        if (queue.try_dequeue(url)) {
-            // Process the URL
-            filter->insert(url);
+        if (queue.try_dequeue(item)) {
+            // Process the URL; the hash was computed at ingress
+            filter->insert(item.hash);
             processed_counts_[numa_node].fetch_add(1, std::memory_order_relaxed);
             
-            std::cout << "[Worker " << numa_node << "] Processed: " << url << std::endl;
+            std::cout << "[Worker " << numa_node << "] Processed: " << item.logged_url()
+                      << (item.truncated() ? "..." : "") << std::endl;
+            idle_rounds = 0;
+        } else if (idle_rounds < spin_rounds) {
+            cpu_relax();
+            ++idle_rounds;
+        } else if (idle_rounds < spin_rounds + kYieldRounds) {
+            std::this_thread::yield();
+            ++idle_rounds;
         } else {
-            // Brief sleep to avoid busy-waiting when queue is empty
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            // Park until a producer, or shutdown, moves the epoch on. The
+            // epoch is read first, so a wake after it returns at once.
+            const uint32_t epoch = wakeup.epoch.load(std::memory_order_acquire);
+            wakeup.parked.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (running_ && queue.size_approx() == 0) {
+                wakeup.parks.fetch_add(1, std::memory_order_relaxed);
+                wakeup.epoch.wait(epoch, std::memory_order_acquire);
+            }
+            wakeup.parked.fetch_sub(1, std::memory_order_relaxed);
+            idle_rounds = 0;
         }
     }
 }
 
+uint64_t NUMAOptimizedFilter::get_processed_count() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < processed_counts_size_; ++i) {
+        total += processed_counts_[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
 void NUMAOptimizedFilter::print_stats() const {
     std::cout << "\n=== NUMA Filter Statistics ===" << std::endl;
-    std::cout << "NUMA Nodes: " << num_numa_nodes_ << std::endl;
+    std::cout << "NUMA Nodes: " << num_numa_nodes_ << (replicated_.load() ? " (replicated L3)" : "") << std::endl;
     
     uint64_t total_processed = 0;
     for (size_t i = 0; i < processed_counts_size_; ++i) {
         uint64_t count = processed_counts_[i].load(std::memory_order_relaxed);
         total_processed += count;
-        std::cout << "Node " << i << " processed: " << count << " URLs" << std::endl;
+        std::cout << "Node " << i << " processed: " << count << " URLs, worker parked "
+                  << wakeups_[i].parks.load(std::memory_order_relaxed) << " times" << std::endl;
+        if (i < compactors_.size()) {
+            std::cout << "Node " << i << " compactions: " << compactors_[i]->get_compactions()
+                      << " (" << compactors_[i]->get_absorbed() << " keys moved to L3)" << std::endl;
+        }
     }
     
     std::cout << "Total processed: " << total_processed << " URLs" << std::endl;
@@ -0,0 +1,455 @@
+#include "pattern_matcher.hpp"
+#include "cpu_features.hpp"
+#include "epoch_reclaimer.hpp"
+#include "url_canonicalizer.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LLAMASHIELD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(LLAMASHIELD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+using scan_fn = uint32_t (*)(const pattern_set_t& set, const uint8_t* text, size_t size);
+
+struct pattern_set_t {
+    std::vector<std::string> patterns;
+    size_t max_length = 0;
+
+    // Aho-Corasick DFA, complete over byte classes (class 0: bytes in no
+    // pattern; a letter's two cases share one). Entry [row + class] is the
+    // next state's row (state * classes), kMatchFlag set if a pattern ends
+    // there; output[state] names it.
+    std::array<uint8_t, 256> byte_class{};
+    uint32_t classes = 1;
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> output;
+
+    // Teddy: for fingerprint byte j, bit b of lo[j][byte & 15] and of
+    // hi[j][byte >> 4] is set if a pattern in bucket b has that byte there.
+    // Each 16-entry table is repeated in both 128-bit lanes for vpshufb.
+    uint32_t fingerprint_bytes = 0;
+    alignas(32) uint8_t lo[3][32] = {};
+    alignas(32) uint8_t hi[3][32] = {};
+
+    // Larger sets: bit per hash of every pattern's first (up to four)
+    // bytes with 0x20 ORed in, a cheap fold letters and the text share
+    std::vector<uint64_t> prefix_bits;
+    uint32_t prefix_shift = 0;
+    uint32_t prefix_mask = 0;
+
+    scan_fn scan = nullptr;
+    const char* kernel = "";
+};
+
+namespace {
+
+constexpr uint32_t kMatchFlag = 0x80000000u;
+constexpr uint32_t kNoState = UINT32_MAX;
+constexpr uint32_t kBuckets = 8;
+
+inline uint8_t fold(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c | 0x20) : c;
+}
+
+inline bool is_lower_letter(uint8_t c) {
+    return c >= 'a' && c <= 'z';
+}
+
+// Runs the DFA from the root over [p, end); the first pattern to end wins
+uint32_t run_dfa(const pattern_set_t& set, const uint8_t* p, const uint8_t* end) {
+    const uint32_t* next = set.next.data();
+    const uint8_t* byte_class = set.byte_class.data();
+    uint32_t row = 0;
+    for (; p < end; ++p) {
+        const uint32_t entry = next[row + byte_class[*p]];
+        if (entry & kMatchFlag) return set.output[(entry & ~kMatchFlag) / set.classes];
+        row = entry;
+    }
+    return PatternMatcher::kNoMatch;
+}
+
+// Any pattern starting at pos ends within max_length bytes of it
+inline uint32_t verify(const pattern_set_t& set, const uint8_t* text, size_t size, size_t pos) {
+    return run_dfa(set, text + pos, text + std::min(size, pos + set.max_length));
+}
+
+inline uint32_t prefix_slot(const pattern_set_t& set, uint32_t word) {
+    return ((word | 0x20202020u) & set.prefix_mask) * 0x9e3779b1u >> set.prefix_shift;
+}
+
+inline bool prefix_may_match(const pattern_set_t& set, uint32_t word) {
+    const uint32_t slot = prefix_slot(set, word);
+    return (set.prefix_bits[slot >> 6] >> (slot & 63)) & 1;
+}
+
+// One hash and bit test per position, independent of the pattern count;
+// scan_prefix_bitmap_avx2 does eight at a time and leaves the tail here
+uint32_t scan_prefix_bitmap_from(const pattern_set_t& set, const uint8_t* text, size_t size, size_t i) {
+    for (; i + 4 <= size; ++i) {
+        uint32_t word;
+        std::memcpy(&word, text + i, 4);
+        if (prefix_may_match(set, word)) {
+            const uint32_t found = verify(set, text, size, i);
+            if (found != PatternMatcher::kNoMatch) return found;
+        }
+    }
+    for (; i < size; ++i) {
+        uint32_t word = 0;
+        std::memcpy(&word, text + i, size - i);
+        if (prefix_may_match(set, word)) {
+            const uint32_t found = verify(set, text, size, i);
+            if (found != PatternMatcher::kNoMatch) return found;
+        }
+    }
+    return PatternMatcher::kNoMatch;
+}
+
+uint32_t scan_prefix_bitmap(const pattern_set_t& set, const uint8_t* text, size_t size) {
+    return scan_prefix_bitmap_from(set, text, size, 0);
+}
+
+#ifdef LLAMASHIELD_X86
+
+// Bit k set if position k of the 32 at p may start a pattern; reads
+// 32 + M - 1 bytes
+template <uint32_t M>
+TARGET_AVX2 inline uint32_t teddy_window(const __m256i* lo, const __m256i* hi, const uint8_t* p) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    __m256i buckets = _mm256_set1_epi8(-1);
+    for (uint32_t j = 0; j < M; ++j) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j));
+        const __m256i l = _mm256_shuffle_epi8(lo[j], _mm256_and_si256(v, low_nibble));
+        const __m256i h = _mm256_shuffle_epi8(hi[j], _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+        buckets = _mm256_and_si256(buckets, _mm256_and_si256(l, h));
+    }
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, _mm256_setzero_si256())));
+}
+
+template <uint32_t M>
+TARGET_AVX2 uint32_t scan_teddy_avx2(const pattern_set_t& set, const uint8_t* text, size_t size) {
+    __m256i lo[M], hi[M];
+    for (uint32_t j = 0; j < M; ++j) {
+        lo[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(set.lo[j]));
+        hi[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(set.hi[j]));
+    }
+
+    size_t i = 0;
+    for (; i + 32 + M - 1 <= size; i += 32) {
+        for (uint32_t mask = teddy_window<M>(lo, hi, text + i); mask != 0; mask &= mask - 1) {
+            const uint32_t found = verify(set, text, size, i + static_cast<size_t>(__builtin_ctz(mask)));
+            if (found != PatternMatcher::kNoMatch) return found;
+        }
+    }
+
+    // The last (up to 32 + M - 2) bytes, zero-padded so every load is in
+    // bounds; candidates past the end are dropped
+    if (i < size) {
+        alignas(32) uint8_t tail[96] = {};
+        const size_t rest = size - i;
+        std::memcpy(tail, text + i, rest);
+        for (size_t offset = 0; offset < rest; offset += 32) {
+            uint32_t mask = teddy_window<M>(lo, hi, tail + offset);
+            if (rest - offset < 32) mask &= (uint32_t{1} << (rest - offset)) - 1;
+            for (; mask != 0; mask &= mask - 1) {
+                const uint32_t found = verify(set, text, size, i + offset + static_cast<size_t>(__builtin_ctz(mask)));
+                if (found != PatternMatcher::kNoMatch) return found;
+            }
+        }
+    }
+    return PatternMatcher::kNoMatch;
+}
+
+// The four-byte words at eight consecutive positions come from one 16-byte
+// load, hashed in 32-bit lanes and tested with one gather
+TARGET_AVX2 uint32_t scan_prefix_bitmap_avx2(const pattern_set_t& set, const uint8_t* text, size_t size) {
+    const __m256i windows = _mm256_setr_epi8(0, 1, 2, 3, 1, 2, 3, 4, 2, 3, 4, 5, 3, 4, 5, 6,
+                                             4, 5, 6, 7, 5, 6, 7, 8, 6, 7, 8, 9, 7, 8, 9, 10);
+    const __m256i fold = _mm256_set1_epi32(0x20202020);
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(set.prefix_mask));
+    const __m256i multiplier = _mm256_set1_epi32(static_cast<int>(0x9e3779b1u));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(set.prefix_shift));
+    const __m256i low_five = _mm256_set1_epi32(31);
+    const int* words = reinterpret_cast<const int*>(set.prefix_bits.data());
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 8) {
+        const __m256i bytes = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+        const __m256i word = _mm256_and_si256(_mm256_or_si256(_mm256_shuffle_epi8(bytes, windows), fold), mask);
+        const __m256i slot = _mm256_srl_epi32(_mm256_mullo_epi32(word, multiplier), shift);
+        const __m256i bits = _mm256_i32gather_epi32(words, _mm256_srli_epi32(slot, 5), 4);
+        const __m256i hit = _mm256_sllv_epi32(bits, _mm256_sub_epi32(low_five, _mm256_and_si256(slot, low_five)));
+        for (uint32_t m = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(hit))); m != 0; m &= m - 1) {
+            const uint32_t found = verify(set, text, size, i + static_cast<size_t>(__builtin_ctz(m)));
+            if (found != PatternMatcher::kNoMatch) return found;
+        }
+    }
+    return scan_prefix_bitmap_from(set, text, size, i);
+}
+
+#endif // LLAMASHIELD_X86
+
+bool build_dfa(pattern_set_t& set) {
+    // Byte classes over the folded bytes patterns use
+    for (const std::string& pattern : set.patterns) {
+        for (char ch : pattern) {
+            const uint8_t c = fold(static_cast<uint8_t>(ch));
+            if (set.byte_class[c] == 0) {
+                set.byte_class[c] = static_cast<uint8_t>(set.classes++);
+                if (is_lower_letter(c)) set.byte_class[c & ~0x20] = set.byte_class[c];
+            }
+        }
+    }
+    const uint32_t classes = set.classes;
+
+    // Trie, with state numbers as entries until the end
+    set.next.assign(classes, kNoState);
+    set.output.assign(1, PatternMatcher::kNoMatch);
+    for (uint32_t p = 0; p < set.patterns.size(); ++p) {
+        uint32_t state = 0;
+        for (char ch : set.patterns[p]) {
+            const size_t slot = static_cast<size_t>(state) * classes + set.byte_class[static_cast<uint8_t>(ch)];
+            if (set.next[slot] == kNoState) {
+                set.next[slot] = static_cast<uint32_t>(set.output.size());
+                set.next.resize(set.next.size() + classes, kNoState);
+                set.output.push_back(PatternMatcher::kNoMatch);
+            }
+            state = set.next[slot];
+        }
+        if (set.output[state] == PatternMatcher::kNoMatch) set.output[state] = p;
+    }
+
+    const size_t states = set.output.size();
+    if (states * classes >= kMatchFlag) {
+        std::cerr << "[PatternMatcher] Automaton too large: " << states << " states x "
+                  << classes << " byte classes" << std::endl;
+        return false;
+    }
+
+    // Breadth-first, so a state's failure link is complete before its
+    // children's missing transitions are copied from it
+    std::vector<uint32_t> fail(states, 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(states);
+    for (uint32_t c = 0; c < classes; ++c) {
+        uint32_t& child = set.next[c];
+        if (child == kNoState) child = 0;
+        else queue.push_back(child);
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const uint32_t s = queue[head];
+        if (set.output[s] == PatternMatcher::kNoMatch) set.output[s] = set.output[fail[s]];
+        const size_t row = static_cast<size_t>(s) * classes;
+        const size_t fail_row = static_cast<size_t>(fail[s]) * classes;
+        for (uint32_t c = 0; c < classes; ++c) {
+            uint32_t& child = set.next[row + c];
+            if (child == kNoState) {
+                child = set.next[fail_row + c];
+            } else {
+                fail[child] = set.next[fail_row + c];
+                queue.push_back(child);
+            }
+        }
+    }
+
+    for (uint32_t& entry : set.next) {
+        entry = entry * classes | (set.output[entry] != PatternMatcher::kNoMatch ? kMatchFlag : 0);
+    }
+    return true;
+}
+
+// Buckets patterns sorted by fingerprint, so patterns sharing leading
+// bytes share a bucket and its nibble tables stay sparse
+void build_teddy(pattern_set_t& set) {
+    size_t shortest = SIZE_MAX;
+    for (const std::string& pattern : set.patterns) shortest = std::min(shortest, pattern.size());
+    const uint32_t m = static_cast<uint32_t>(std::min<size_t>(3, shortest));
+    set.fingerprint_bytes = m;
+
+    std::vector<std::string> prints;
+    prints.reserve(set.patterns.size());
+    for (const std::string& pattern : set.patterns) {
+        std::string print = pattern.substr(0, m);
+        for (char& c : print) c = static_cast<char>(fold(static_cast<uint8_t>(c)));
+        prints.push_back(std::move(print));
+    }
+    std::vector<uint32_t> order(set.patterns.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return prints[a] < prints[b]; });
+
+    for (size_t rank = 0; rank < order.size(); ++rank) {
+        const uint8_t bit = static_cast<uint8_t>(1u << (rank * kBuckets / order.size()));
+        const std::string& print = prints[order[rank]];
+        for (uint32_t j = 0; j < m; ++j) {
+            const uint8_t c = static_cast<uint8_t>(print[j]);
+            for (uint8_t v : {c, static_cast<uint8_t>(is_lower_letter(c) ? c & ~0x20 : c)}) {
+                set.lo[j][v & 15] |= bit;
+                set.lo[j][16 + (v & 15)] |= bit;
+                set.hi[j][v >> 4] |= bit;
+                set.hi[j][16 + (v >> 4)] |= bit;
+            }
+        }
+    }
+}
+
+// About 256 bits per pattern, at most 512 KiB so the gathers stay in L2;
+// a clean position passes with odds near 1/256
+void build_prefix_bitmap(pattern_set_t& set) {
+    size_t shortest = SIZE_MAX;
+    for (const std::string& pattern : set.patterns) shortest = std::min(shortest, pattern.size());
+    const uint32_t m = static_cast<uint32_t>(std::min<size_t>(4, shortest));
+    set.prefix_mask = m == 4 ? 0xffffffffu : (1u << (8 * m)) - 1;
+
+    uint32_t bits = 16;
+    while (bits < 22 && (size_t{1} << bits) < set.patterns.size() * 256) ++bits;
+    set.prefix_shift = 32 - bits;
+    set.prefix_bits.assign((size_t{1} << bits) / 64, 0);
+    for (const std::string& pattern : set.patterns) {
+        uint32_t word = 0;
+        std::memcpy(&word, pattern.data(), m);
+        const uint32_t slot = prefix_slot(set, word);
+        set.prefix_bits[slot >> 6] |= uint64_t{1} << (slot & 63);
+    }
+}
+
+void choose_kernel(pattern_set_t& set) {
+#ifdef LLAMASHIELD_X86
+    const bool teddy = set.patterns.size() <= PatternMatcher::kTeddyMaxPatterns && cpu_has_avx2();
+#else
+    const bool teddy = false;
+#endif
+    if (!teddy) {
+        build_prefix_bitmap(set);
+        set.scan = scan_prefix_bitmap;
+        set.kernel = "prefix-bitmap";
+#ifdef LLAMASHIELD_X86
+        if (cpu_has_avx2()) {
+            set.scan = scan_prefix_bitmap_avx2;
+            set.kernel = "prefix-bitmap-avx2";
+        }
+#endif
+        return;
+    }
+#ifdef LLAMASHIELD_X86
+    build_teddy(set);
+    switch (set.fingerprint_bytes) {
+    case 1: set.scan = scan_teddy_avx2<1>; break;
+    case 2: set.scan = scan_teddy_avx2<2>; break;
+    default: set.scan = scan_teddy_avx2<3>; break;
+    }
+    set.kernel = "teddy-avx2";
+#endif
+}
+
+} // namespace
+
+PatternMatcher::PatternMatcher() : set_(nullptr) {}
+
+PatternMatcher::~PatternMatcher() {
+    // As BinaryFuseWrapper: destroying the matcher mid-lookup is a caller bug
+    delete set_.exchange(nullptr);
+}
+
+void PatternMatcher::publish(pattern_set_t* set) {
+    pattern_set_t* old = set_.exchange(set);
+    if (!old) return;
+    EpochReclaimer::global().retire(old, [](void* p) { delete static_cast<pattern_set_t*>(p); });
+}
+
+bool PatternMatcher::build(const std::vector<std::string>& patterns) {
+    auto set = std::make_unique<pattern_set_t>();
+    for (const std::string& pattern : patterns) {
+        if (pattern.empty()) continue;
+        set->patterns.push_back(pattern);
+        set->max_length = std::max(set->max_length, pattern.size());
+    }
+    if (set->patterns.empty()) {
+        publish(nullptr);
+        return true;
+    }
+
+    if (!build_dfa(*set)) return false;
+    choose_kernel(*set);
+    std::cout << "[PatternMatcher] Compiled " << set->patterns.size() << " patterns: "
+              << set->output.size() << " states x " << set->classes << " byte classes ("
+              << set->kernel << ")" << std::endl;
+    publish(set.release());
+    return true;
+}
+
+bool PatternMatcher::load_from_file(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[PatternMatcher] Cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> patterns;
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        const size_t end = line.find_last_not_of(" \t\r");
+        patterns.push_back(line.substr(begin, end - begin + 1));
+    }
+    std::cout << "[PatternMatcher] Read " << patterns.size() << " patterns from " << path << std::endl;
+    return build(patterns);
+}
+
+uint32_t PatternMatcher::find(const char* text, size_t size) const {
+    EpochGuard guard;
+    const pattern_set_t* set = set_.load(std::memory_order_acquire);
+    if (!set) return kNoMatch;
+    return set->scan(*set, reinterpret_cast<const uint8_t*>(text), size);
+}
+
+uint32_t PatternMatcher::find_in_url(const char* url, size_t size) const {
+    char canonical[kCanonicalUrlStackBytes];
+    size_t canonical_size = 0;
+    if (canonicalize_url(url, size, canonical, sizeof(canonical), canonical_size)) {
+        return find(canonical, canonical_size);
+    }
+    return find(url, size);
+}
+
+std::string PatternMatcher::get_pattern(uint32_t index) const {
+    EpochGuard guard;
+    const pattern_set_t* set = set_.load(std::memory_order_acquire);
+    return set && index < set->patterns.size() ? set->patterns[index] : std::string();
+}
+
+size_t PatternMatcher::size() const {
+    EpochGuard guard;
+    const pattern_set_t* set = set_.load(std::memory_order_acquire);
+    return set ? set->patterns.size() : 0;
+}
+
+size_t PatternMatcher::get_memory_usage() const {
+    EpochGuard guard;
+    const pattern_set_t* set = set_.load(std::memory_order_acquire);
+    if (!set) return 0;
+    size_t bytes = sizeof(pattern_set_t) + (set->next.size() + set->output.size()) * sizeof(uint32_t) +
+                   set->prefix_bits.size() * sizeof(uint64_t);
+    for (const std::string& pattern : set->patterns) bytes += pattern.size();
+    return bytes;
+}
+
+const char* PatternMatcher::kernel_name() const {
+    EpochGuard guard;
+    const pattern_set_t* set = set_.load(std::memory_order_acquire);
+    return set ? set->kernel : "none";
+}
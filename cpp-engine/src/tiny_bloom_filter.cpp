@@ -0,0 +1,160 @@
+#include "tiny_bloom_filter.hpp"
+#include "cpu_features.hpp"
+#include "fuse_layout.hpp"
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LLAMASHIELD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(LLAMASHIELD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace {
+
+constexpr uint64_t kL1Seed = 0x4c31b100d5eed001ULL;
+
+using block_t = TinyBloomFilter::block_t;
+
+// Word i of a key's mask has bit (hash >> 6i) & 63 set; the block comes from
+// the high bits of the same hash
+inline uint64_t l1_hash(uint64_t key) {
+    return fuse_mix(key, kL1Seed);
+}
+
+inline size_t l1_block(uint64_t hash, size_t block_count) {
+    return static_cast<size_t>(fuse_mulhi(hash, block_count));
+}
+
+inline uint64_t l1_bit(uint64_t hash, int word) {
+    return uint64_t{1} << ((hash >> (6 * word)) & 63);
+}
+
+bool probe_scalar(const block_t& block, uint64_t hash) {
+    uint64_t missing = 0;
+    for (int i = 0; i < 8; ++i) {
+        missing |= l1_bit(hash, i) & ~block.words[i];
+    }
+    return missing == 0;
+}
+
+#ifdef LLAMASHIELD_X86
+
+TARGET_AVX2 bool probe_avx2(const block_t& block, uint64_t hash) {
+    const __m256i h = _mm256_set1_epi64x(static_cast<long long>(hash));
+    const __m256i six_bits = _mm256_set1_epi64x(63);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i lo = _mm256_sllv_epi64(one, _mm256_and_si256(
+        _mm256_srlv_epi64(h, _mm256_setr_epi64x(0, 6, 12, 18)), six_bits));
+    const __m256i hi = _mm256_sllv_epi64(one, _mm256_and_si256(
+        _mm256_srlv_epi64(h, _mm256_setr_epi64x(24, 30, 36, 42)), six_bits));
+
+    // Mask bits the block lacks, over both halves, in one test
+    const __m256i* words = reinterpret_cast<const __m256i*>(block.words);
+    const __m256i missing = _mm256_or_si256(_mm256_andnot_si256(_mm256_load_si256(words), lo),
+                                            _mm256_andnot_si256(_mm256_load_si256(words + 1), hi));
+    return _mm256_testz_si256(missing, missing) != 0;
+}
+
+TARGET_AVX512 bool probe_avx512(const block_t& block, uint64_t hash) {
+    const __m512i mask = _mm512_sllv_epi64(_mm512_set1_epi64(1), _mm512_and_si512(
+        _mm512_srlv_epi64(_mm512_set1_epi64(static_cast<long long>(hash)),
+                          _mm512_setr_epi64(0, 6, 12, 18, 24, 30, 36, 42)),
+        _mm512_set1_epi64(63)));
+    const __m512i words = _mm512_load_si512(block.words);
+    return _mm512_cmpneq_epi64_mask(_mm512_and_si512(words, mask), mask) == 0;
+}
+
+#endif // LLAMASHIELD_X86
+
+TinyBloomFilter::probe_fn best_probe() {
+#ifdef LLAMASHIELD_X86
+    if (cpu_has_avx512f()) return probe_avx512;
+    if (cpu_has_avx2()) return probe_avx2;
+#endif
+    return probe_scalar;
+}
+
+} // namespace
+
+TinyBloomFilter::TinyBloomFilter() = default;
+TinyBloomFilter::~TinyBloomFilter() = default;
+
+bool TinyBloomFilter::initialize(size_t bytes, size_t bits_per_key) {
+    block_count_ = bytes / kBlockBytes;
+    if (block_count_ == 0 || bits_per_key == 0) {
+        std::cerr << "[TinyBloom] Invalid size: " << bytes << " bytes, " << bits_per_key << " bits/key" << std::endl;
+        return false;
+    }
+
+    blocks_ = std::make_unique<block_t[]>(block_count_);
+    capacity_ = block_count_ * kBlockBytes * 8 / bits_per_key;
+    probe_ = best_probe();
+    count_.store(0, std::memory_order_relaxed);
+
+    std::cout << "[TinyBloom] Initialized " << get_memory_usage() / 1024 << " KiB, capacity " << capacity_
+              << " keys (" << kernel_name() << " probe)" << std::endl;
+    return true;
+}
+
+bool TinyBloomFilter::contains(uint64_t key) const {
+    if (block_count_ == 0) return false;
+
+    const uint64_t hash = l1_hash(key);
+    return probe_(blocks_[l1_block(hash, block_count_)], hash);
+}
+
+void TinyBloomFilter::promote(uint64_t key, uint64_t seen_epoch) {
+    if (block_count_ == 0) return;
+
+    // The promotion that fills L1 starts it over; later ones land in the
+    // fresh filter
+    if (count_.fetch_add(1, std::memory_order_relaxed) == capacity_) {
+        reset();
+        resets_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const uint64_t hash = l1_hash(key);
+    block_t& block = blocks_[l1_block(hash, block_count_)];
+    for (int i = 0; i < 8; ++i) {
+        std::atomic_ref<uint64_t>(block.words[i]).fetch_or(l1_bit(hash, i), std::memory_order_seq_cst);
+    }
+
+    // The key was found below before an invalidation that may have run
+    // after those bits were cleared; start over rather than keep it
+    if (epoch_.load(std::memory_order_seq_cst) != seen_epoch) {
+        reset();
+    }
+}
+
+void TinyBloomFilter::invalidate() {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    reset();
+}
+
+void TinyBloomFilter::reset() {
+    for (size_t b = 0; b < block_count_; ++b) {
+        for (uint64_t& word : blocks_[b].words) {
+            std::atomic_ref<uint64_t>(word).store(0, std::memory_order_relaxed);
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    count_.store(0, std::memory_order_relaxed);
+}
+
+const char* TinyBloomFilter::kernel_name() const {
+#ifdef LLAMASHIELD_X86
+    if (probe_ == probe_avx512) return "avx512";
+    if (probe_ == probe_avx2) return "avx2";
+#endif
+    return "scalar";
+}
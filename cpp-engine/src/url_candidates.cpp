@@ -0,0 +1,239 @@
+#include "url_candidates.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Multi-label suffixes from the public suffix list: the ICANN second-level
+// domains of the largest ccTLDs and the shared-hosting domains where
+// customers register subdomains
+constexpr const char* kBuiltinRules[] = {
+    // ICANN
+    "ac.uk", "co.uk", "gov.uk", "ltd.uk", "me.uk", "net.uk", "nhs.uk", "org.uk", "plc.uk", "sch.uk",
+    "com.au", "edu.au", "gov.au", "id.au", "net.au", "org.au",
+    "ac.nz", "co.nz", "geek.nz", "govt.nz", "net.nz", "org.nz",
+    "ac.jp", "co.jp", "ed.jp", "go.jp", "gr.jp", "lg.jp", "ne.jp", "or.jp", "*.kawasaki.jp", "!city.kawasaki.jp",
+    "ac.kr", "co.kr", "go.kr", "ne.kr", "or.kr", "re.kr",
+    "com.cn", "edu.cn", "gov.cn", "net.cn", "org.cn",
+    "com.hk", "edu.hk", "gov.hk", "net.hk", "org.hk",
+    "com.tw", "edu.tw", "gov.tw", "net.tw", "org.tw",
+    "com.sg", "edu.sg", "gov.sg", "net.sg", "org.sg",
+    "com.my", "edu.my", "gov.my", "net.my", "org.my",
+    "ac.id", "co.id", "go.id", "or.id", "web.id",
+    "ac.in", "co.in", "edu.in", "firm.in", "gen.in", "gov.in", "ind.in", "net.in", "org.in",
+    "ac.th", "co.th", "go.th", "in.th", "or.th",
+    "com.vn", "edu.vn", "gov.vn", "net.vn", "org.vn",
+    "com.ph", "edu.ph", "gov.ph", "net.ph", "org.ph",
+    "com.pk", "edu.pk", "gov.pk", "net.pk", "org.pk",
+    "*.bd", "*.np", "*.ck", "!www.ck", "*.er", "*.fk", "*.jm", "*.kh", "*.mm", "*.pg",
+    "ac.il", "co.il", "gov.il", "net.il", "org.il",
+    "com.tr", "edu.tr", "gen.tr", "gov.tr", "net.tr", "org.tr",
+    "com.sa", "edu.sa", "gov.sa", "net.sa", "org.sa",
+    "ac.ae", "co.ae", "gov.ae", "net.ae", "org.ae",
+    "com.eg", "edu.eg", "gov.eg", "net.eg", "org.eg",
+    "ac.za", "co.za", "gov.za", "net.za", "org.za", "web.za",
+    "co.ke", "go.ke", "ne.ke", "or.ke",
+    "com.ng", "edu.ng", "gov.ng", "net.ng", "org.ng",
+    "com.br", "edu.br", "gov.br", "net.br", "org.br",
+    "com.ar", "edu.ar", "gob.ar", "net.ar", "org.ar",
+    "com.mx", "edu.mx", "gob.mx", "net.mx", "org.mx",
+    "com.co", "edu.co", "gov.co", "net.co", "org.co",
+    "com.pe", "edu.pe", "gob.pe", "net.pe", "org.pe",
+    "gob.cl",
+    "com.ua", "in.ua", "kiev.ua", "net.ua", "org.ua",
+    "com.ru", "msk.ru", "net.ru", "org.ru", "spb.ru",
+    "com.pl", "net.pl", "org.pl", "waw.pl",
+    "co.at", "or.at", "ac.at", "gv.at",
+    "com.es", "edu.es", "gob.es", "nom.es", "org.es",
+    "com.pt", "edu.pt", "gov.pt", "org.pt",
+    "com.gr", "edu.gr", "gov.gr", "net.gr", "org.gr",
+    "co.hu", "org.hu",
+    "com.de",
+    "us.com", "uk.com", "eu.com", "cn.com", "de.com", "za.com",
+    // Shared hosting and dynamic DNS
+    "appspot.com", "blogspot.com", "cloudfront.net", "azurewebsites.net", "cloudapp.net",
+    "herokuapp.com", "firebaseapp.com", "web.app", "netlify.app", "vercel.app", "pages.dev",
+    "workers.dev", "github.io", "gitlab.io", "glitch.me", "repl.co", "fly.dev", "onrender.com",
+    "s3.amazonaws.com", "elasticbeanstalk.com", "*.compute.amazonaws.com", "blob.core.windows.net",
+    "web.core.windows.net", "000webhostapp.com", "weebly.com", "wixsite.com", "myshopify.com",
+    "duckdns.org", "no-ip.org", "ddns.net", "hopto.org", "dyndns.org", "ngrok.io", "ngrok-free.app",
+    "trycloudflare.com", "r2.dev", "sharepoint.com", "translate.goog",
+};
+
+uint64_t rule_hash(std::string_view text) {
+    return HashedKey::of_raw(text.data(), text.size()).key;
+}
+
+// Start of the label that ends at end (host[end] is '.' or end == size)
+size_t label_start(std::string_view host, size_t end) {
+    const size_t dot = end == 0 ? std::string_view::npos : host.rfind('.', end - 1);
+    return dot == std::string_view::npos ? 0 : dot + 1;
+}
+
+bool is_ip_literal(std::string_view host) {
+    if (!host.empty() && host[0] == '[') return true;
+    for (char c : host) {
+        if ((c < '0' || c > '9') && c != '.') return false;
+    }
+    return true;
+}
+
+} // namespace
+
+const char* granularity_name(MatchGranularity granularity) {
+    switch (granularity) {
+    case MatchGranularity::kUrl: return "URL";
+    case MatchGranularity::kPath: return "PATH";
+    case MatchGranularity::kHost: return "HOST";
+    case MatchGranularity::kDomain: return "DOMAIN";
+    case MatchGranularity::kIpPrefix: return "CIDR";
+    case MatchGranularity::kPattern: return "PATTERN";
+    default: return "NONE";
+    }
+}
+
+const PublicSuffixTable& PublicSuffixTable::builtin() {
+    static const PublicSuffixTable table = [] {
+        PublicSuffixTable t;
+        for (const char* rule : kBuiltinRules) t.add_rule(rule);
+        return t;
+    }();
+    return table;
+}
+
+bool PublicSuffixTable::add_rule(std::string_view rule) {
+    std::unordered_set<uint64_t>* set = &rules_;
+    if (!rule.empty() && rule[0] == '!') {
+        set = &exceptions_;
+        rule.remove_prefix(1);
+    } else if (rule.size() > 2 && rule[0] == '*' && rule[1] == '.') {
+        set = &wildcards_;
+        rule.remove_prefix(2);
+    }
+
+    // Same canonical form as hosts: lowercase, IDNA, trailing '/' dropped
+    char canonical[kCanonicalUrlStackBytes];
+    size_t size = 0;
+    if (rule.empty() || rule.find_first_of("*!:/") != std::string_view::npos ||
+        !canonicalize_url(rule.data(), rule.size(), canonical, sizeof(canonical), size) || size < 2) {
+        return false;
+    }
+    set->insert(rule_hash(std::string_view(canonical, size - 1)));
+    return true;
+}
+
+bool PublicSuffixTable::load_from_file(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[PublicSuffix] Cannot open " << path << std::endl;
+        return false;
+    }
+
+    size_t added = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        // A rule is the first whitespace-delimited token; "//" starts a comment
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line.compare(begin, 2, "//") == 0) continue;
+        const size_t end = line.find_first_of(" \t\r", begin);
+        added += add_rule(std::string_view(line).substr(begin, end == std::string::npos ? end : end - begin));
+    }
+    std::cout << "[PublicSuffix] Loaded " << added << " rules from " << path << std::endl;
+    return true;
+}
+
+size_t PublicSuffixTable::registrable_offset(std::string_view host) const {
+    if (host.empty()) return std::string_view::npos;
+
+    // Longest matching rule, walking suffixes one label longer at a time;
+    // an exception makes the public suffix the one label shorter
+    size_t suffix = std::string_view::npos;
+    size_t shorter = host.size();
+    for (size_t start = label_start(host, host.size());; start = label_start(host, start - 1)) {
+        const uint64_t h = rule_hash(host.substr(start));
+        if (exceptions_.count(h)) {
+            suffix = shorter;
+            break;
+        }
+        if (shorter == host.size() || rules_.count(h) || wildcards_.count(rule_hash(host.substr(shorter)))) {
+            suffix = start;
+        }
+        if (start == 0) break;
+        shorter = start;
+    }
+
+    if (suffix == 0 || suffix == std::string_view::npos) return std::string_view::npos;
+    return label_start(host, suffix - 1);
+}
+
+void UrlCandidates::add(std::string_view text, MatchGranularity granularity) {
+    keys_[count_] = HashedKey::of_raw(text.data(), text.size());
+    granularities_[count_] = granularity;
+    texts_[count_] = text;
+    ++count_;
+}
+
+bool UrlCandidates::parse(const char* url, size_t size, const PublicSuffixTable& suffixes) {
+    count_ = 0;
+    host_ = {};
+    size_t canonical_size = 0;
+    if (!canonicalize_url(url, size, canonical_, sizeof(canonical_), canonical_size)) {
+        add(std::string_view(url, size), MatchGranularity::kUrl);
+        keys_[0] = HashedKey::of(url, size);   // long URLs still canonicalize there
+        return false;
+    }
+    const std::string_view canonical(canonical_, canonical_size);
+    add(canonical, MatchGranularity::kUrl);
+
+    // Canonical form: [scheme://]host[:port]/path[?query]
+    const std::string_view canonical_host_view = canonical_host(canonical);
+    const size_t host_begin = static_cast<size_t>(canonical_host_view.data() - canonical.data());
+    const size_t host_end = host_begin + canonical_host_view.size();
+    const size_t path_begin = canonical.find('/', host_end);
+    const size_t path_end = std::min(canonical.find('?', path_begin), canonical.size());
+
+    const size_t host_size = host_end - host_begin;
+    const size_t path_size = path_end - path_begin;
+    std::memcpy(scoped_, canonical_ + host_begin, host_size);
+    std::memcpy(scoped_ + host_size, canonical_ + path_begin, path_size);
+    const std::string_view scoped(scoped_, host_size + path_size);
+
+    // Path, then its directory prefixes above the root
+    if (path_size > 1) {
+        if (scoped != canonical) add(scoped, MatchGranularity::kPath);
+        size_t end = scoped.size() - (scoped.back() == '/' ? 1 : 0);
+        for (size_t prefixes = 0; prefixes < kMaxPathPrefixes; ++prefixes) {
+            const size_t slash = scoped.rfind('/', end - 1);
+            if (slash <= host_size) break;
+            add(scoped.substr(0, slash + 1), MatchGranularity::kPath);
+            end = slash;
+        }
+    }
+
+    // Input without a scheme or query is itself one of the coarser keys
+    const std::string_view host_key = scoped.substr(0, host_size + 1);
+    if (host_key != canonical) add(host_key, MatchGranularity::kHost);
+    else granularities_[0] = MatchGranularity::kHost;
+    if (scoped == canonical && path_size > 1) granularities_[0] = MatchGranularity::kPath;
+
+    // Parent domains, nearest first, ending at the registrable domain
+    const std::string_view host = scoped.substr(0, host_size);
+    host_ = host;
+    if (is_ip_literal(host)) return true;
+    const size_t registrable = suffixes.registrable_offset(host);
+    if (registrable == std::string_view::npos || registrable == 0) return true;
+
+    size_t parents = 0;
+    for (size_t dot = host.find('.'); dot < registrable; dot = host.find('.', dot + 1)) ++parents;
+    size_t skip = parents > kMaxParentDomains ? parents - kMaxParentDomains : 0;
+    for (size_t dot = host.find('.'); dot < registrable; dot = host.find('.', dot + 1)) {
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+        add(host_key.substr(dot + 1), MatchGranularity::kDomain);
+    }
+    return true;
+}
@@ -0,0 +1,579 @@
+#include "url_canonicalizer.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LLAMASHIELD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kMaxHostBytes = 1024;           // host after decoding escapes
+constexpr size_t kMaxLabelCodePoints = 256;
+constexpr char kHexUpper[] = "0123456789ABCDEF";
+
+// Bounds-checked writer over the caller's buffer; a failed write sticks
+class out_buffer_t {
+public:
+    out_buffer_t(char* data, size_t capacity) : data_(data), capacity_(capacity) {}
+
+    void put(char c) {
+        if (size_ < capacity_) data_[size_++] = c;
+        else ok_ = false;
+    }
+    void put(const char* s, size_t n) {
+        if (capacity_ - size_ >= n) {
+            std::memcpy(data_ + size_, s, n);
+            size_ += n;
+        } else {
+            ok_ = false;
+        }
+    }
+    // n bytes to fill in place, or nullptr
+    char* extend(size_t n) {
+        if (capacity_ - size_ < n) {
+            ok_ = false;
+            return nullptr;
+        }
+        size_ += n;
+        return data_ + size_ - n;
+    }
+    void put_escaped(unsigned char c) {
+        const char escape[3] = {'%', kHexUpper[c >> 4], kHexUpper[c & 15]};
+        put(escape, 3);
+    }
+
+    char back() const { return size_ > 0 ? data_[size_ - 1] : '\0'; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    void truncate(size_t size) { size_ = size; }
+    bool ok() const { return ok_; }
+
+private:
+    char* data_;
+    size_t capacity_;
+    size_t size_ = 0;
+    bool ok_ = true;
+};
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+char ascii_lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c; }
+
+bool is_unreserved(unsigned char c) {
+    return is_alpha(static_cast<char>(c)) || is_digit(static_cast<char>(c)) ||
+           c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// Bytes no host may contain, even decoded from an escape
+constexpr std::array<bool, 256> kForbiddenInHost = [] {
+    std::array<bool, 256> table{};
+    for (int c = 0; c <= 0x20; ++c) table[c] = true;
+    for (unsigned char c : std::string_view("#%/:<>?@[\\]^|\x7f")) table[c] = true;
+    return table;
+}();
+
+bool is_forbidden_in_host(unsigned char c) { return kForbiddenInHost[c]; }
+
+// Path and query bytes the copy loop must look at: escapes, the fragment,
+// spaces, controls, DEL and non-ASCII; in the path also '?', backslashes and
+// slashes that may start an empty or dot segment (escaped dots included)
+bool is_special(const char* p, const char* end, bool path) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '%' || c == '#' || c <= 0x20 || c >= 0x7F) return true;
+    if (!path) return false;
+    if (c == '?' || c == '\\') return true;
+    return c == '/' && p + 1 < end && (p[1] == '/' || p[1] == '\\' || p[1] == '.' || p[1] == '%');
+}
+
+// Length of the prefix of [p, end) without special bytes. Sixteen bytes are
+// classified per step, so a typical path is copied in one or two runs.
+size_t plain_run(const char* p, const char* end, bool path) {
+    const char* start = p;
+#ifdef LLAMASHIELD_SSE2
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i fragment = _mm_set1_epi8('#');
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i printable = _mm_set1_epi8(0x21);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i query = _mm_set1_epi8('?');
+    while (end - p >= 17) {                     // one byte of lookahead for slashes
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // Signed compare: below '!' also catches every byte >= 0x80
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, fragment)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, del), _mm_cmplt_epi8(v, printable)));
+        if (path) {
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+            const __m128i segment_start = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(next, slash), _mm_cmpeq_epi8(next, backslash)),
+                _mm_or_si128(_mm_cmpeq_epi8(next, dot), _mm_cmpeq_epi8(next, percent)));
+            special = _mm_or_si128(special, _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, query), _mm_cmpeq_epi8(v, backslash)),
+                _mm_and_si128(_mm_cmpeq_epi8(v, slash), segment_start)));
+        }
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+        if (mask != 0) return static_cast<size_t>(p - start) + std::countr_zero(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !is_special(p, end, path)) ++p;
+    return static_cast<size_t>(p - start);
+}
+
+// Length of the authority at p: up to the first '/', '\\', '?' or '#'
+size_t authority_run(const char* p, const char* end) {
+    const char* start = p;
+#ifdef LLAMASHIELD_SSE2
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i query = _mm_set1_epi8('?');
+    const __m128i fragment = _mm_set1_epi8('#');
+    while (end - p >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i delimiter = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, backslash)),
+                                               _mm_or_si128(_mm_cmpeq_epi8(v, query), _mm_cmpeq_epi8(v, fragment)));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(delimiter));
+        if (mask != 0) return static_cast<size_t>(p - start) + std::countr_zero(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '/' && *p != '\\' && *p != '?' && *p != '#') ++p;
+    return static_cast<size_t>(p - start);
+}
+
+// Length of the prefix of [p, p + n) that is ASCII without escapes
+size_t ascii_run(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef LLAMASHIELD_SSE2
+    const __m128i percent = _mm_set1_epi8('%');
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, percent))));
+        if (mask != 0) return i + std::countr_zero(mask);
+    }
+#endif
+    while (i < n && static_cast<unsigned char>(p[i]) < 0x80 && p[i] != '%') ++i;
+    return i;
+}
+
+void copy_lower(const char* src, size_t n, char* dst) {
+    size_t i = 0;
+#ifdef LLAMASHIELD_SSE2
+    const __m128i before_a = _mm_set1_epi8('A' - 1);
+    const __m128i after_z = _mm_set1_epi8('Z' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(v, _mm_and_si128(upper, case_bit)));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = ascii_lower(src[i]);
+}
+
+// Escape at p (p[0] == '%'): unreserved characters decoded, others kept in
+// upper-case hex, a malformed one escaped itself. Advances p.
+void put_escape(out_buffer_t& out, const char*& p, const char* end) {
+    const int hi = end - p >= 3 ? hex_value(p[1]) : -1;
+    const int lo = end - p >= 3 ? hex_value(p[2]) : -1;
+    if (hi < 0 || lo < 0) {
+        out.put_escaped('%');
+        p += 1;
+        return;
+    }
+    const unsigned char c = static_cast<unsigned char>(hi << 4 | lo);
+    if (is_unreserved(c)) out.put(static_cast<char>(c));
+    else out.put_escaped(c);
+    p += 3;
+}
+
+// ---- IDNA ----
+
+// Decodes one UTF-8 sequence at p; false if invalid (overlong, surrogate,
+// out of range or truncated)
+bool next_code_point(const char*& p, const char* end, uint32_t& cp) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    size_t length;
+    uint32_t min;
+    if (c < 0x80) { cp = c; length = 1; min = 0; }
+    else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; length = 2; min = 0x80; }
+    else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; length = 3; min = 0x800; }
+    else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; length = 4; min = 0x10000; }
+    else return false;
+
+    if (static_cast<size_t>(end - p) < length) return false;
+    for (size_t i = 1; i < length; ++i) {
+        const unsigned char continuation = static_cast<unsigned char>(p[i]);
+        if ((continuation & 0xC0) != 0x80) return false;
+        cp = cp << 6 | (continuation & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+    p += length;
+    return true;
+}
+
+// Simple lowercase mapping for the scripts most hosts use
+uint32_t fold_case(uint32_t cp) {
+    if (cp < 0x80) return static_cast<uint32_t>(ascii_lower(static_cast<char>(cp)));
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 0x20;                   // Latin-1
+    if ((cp >= 0x100 && cp <= 0x12F) || (cp >= 0x132 && cp <= 0x137) ||
+        (cp >= 0x14A && cp <= 0x177)) return cp | 1;                                // Latin Extended-A
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return cp + (cp & 1);
+    if (cp == 0x178) return 0xFF;
+    if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) return cp + 0x20;                // Greek
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;                               // Cyrillic
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+    return cp;
+}
+
+// RFC 3492 parameters
+constexpr uint32_t kBase = 36, kTMin = 1, kTMax = 26, kSkew = 38, kDamp = 700;
+constexpr uint32_t kInitialBias = 72, kInitialN = 128;
+
+uint32_t punycode_adapt(uint32_t delta, uint32_t points, bool first) {
+    delta = first ? delta / kDamp : delta / 2;
+    delta += delta / points;
+    uint32_t k = 0;
+    while (delta > ((kBase - kTMin) * kTMax) / 2) {
+        delta /= kBase - kTMin;
+        k += kBase;
+    }
+    return k + (kBase - kTMin + 1) * delta / (delta + kSkew);
+}
+
+char punycode_digit(uint32_t d) {
+    return static_cast<char>(d < 26 ? 'a' + d : '0' + (d - 26));
+}
+
+bool punycode_encode(const uint32_t* cps, size_t n, out_buffer_t& out) {
+    uint32_t basic = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (cps[i] < 0x80) {
+            out.put(static_cast<char>(cps[i]));
+            ++basic;
+        }
+    }
+    if (basic > 0) out.put('-');
+
+    uint32_t code = kInitialN, delta = 0, bias = kInitialBias;
+    for (uint32_t handled = basic; handled < n;) {
+        uint32_t next = UINT32_MAX;
+        for (size_t i = 0; i < n; ++i) {
+            if (cps[i] >= code && cps[i] < next) next = cps[i];
+        }
+        // Labels are short; this only guards against overflow
+        if ((next - code) > (UINT32_MAX - delta) / (handled + 1)) return false;
+        delta += (next - code) * (handled + 1);
+        code = next;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (cps[i] < code && ++delta == 0) return false;
+            if (cps[i] != code) continue;
+            uint32_t q = delta;
+            for (uint32_t k = kBase;; k += kBase) {
+                const uint32_t t = k <= bias ? kTMin : (k >= bias + kTMax ? kTMax : k - bias);
+                if (q < t) break;
+                out.put(punycode_digit(t + (q - t) % (kBase - t)));
+                q = (q - t) / (kBase - t);
+            }
+            out.put(punycode_digit(q));
+            bias = punycode_adapt(delta, handled + 1, handled == basic);
+            delta = 0;
+            ++handled;
+        }
+        ++delta;
+        ++code;
+    }
+    return true;
+}
+
+// A label with non-ASCII bytes, as its A-label
+bool put_idna_label(out_buffer_t& out, const char* p, const char* end) {
+    uint32_t cps[kMaxLabelCodePoints];
+    size_t n = 0;
+    while (p < end) {
+        uint32_t cp;
+        if (n == kMaxLabelCodePoints || !next_code_point(p, end, cp)) return false;
+        if (cp < 0x80 && is_forbidden_in_host(static_cast<unsigned char>(cp))) return false;
+        cps[n++] = fold_case(cp);
+    }
+    out.put("xn--", 4);
+    return punycode_encode(cps, n, out);
+}
+
+// ---- URL parts ----
+
+bool put_host(out_buffer_t& out, const char* host, const char* end) {
+    size_t n = static_cast<size_t>(end - host);
+    if (host[0] == '[') {                       // IPv6 literal
+        if (n < 3 || end[-1] != ']') return false;
+        for (const char* p = host + 1; p < end - 1; ++p) {
+            if (hex_value(*p) < 0 && *p != ':' && *p != '.') return false;
+        }
+        char* dst = out.extend(n);
+        if (dst) copy_lower(host, n, dst);
+        return true;
+    }
+
+    // Common case: ASCII without escapes, empty labels or forbidden bytes
+    if (ascii_run(host, n) == n && host[0] != '.' && end[-1] != '.') {
+        bool clean = true;
+        for (const char* p = host; p < end && clean; ++p) {
+            clean = !is_forbidden_in_host(static_cast<unsigned char>(*p)) && !(p[0] == '.' && p[1] == '.');
+        }
+        if (clean) {
+            char* dst = out.extend(n);
+            if (dst) copy_lower(host, n, dst);
+            return true;
+        }
+    }
+
+    // Escapes in hosts are rare; decode them into a copy first
+    char decoded[kMaxHostBytes];
+    const size_t plain = ascii_run(host, n);
+    if (plain < n && std::memchr(host + plain, '%', n - plain)) {
+        if (n > kMaxHostBytes) return false;
+        size_t d = 0;
+        for (const char* p = host; p < end;) {
+            if (*p != '%') {
+                decoded[d++] = *p++;
+                continue;
+            }
+            const int hi = end - p >= 3 ? hex_value(p[1]) : -1;
+            const int lo = end - p >= 3 ? hex_value(p[2]) : -1;
+            if (hi < 0 || lo < 0) return false;
+            decoded[d++] = static_cast<char>(hi << 4 | lo);
+            p += 3;
+        }
+        host = decoded;
+        n = d;
+        end = decoded + d;
+    }
+
+    // Labels, without empty ones
+    bool first = true;
+    for (const char* label = host; label < end;) {
+        const char* dot = static_cast<const char*>(std::memchr(label, '.', static_cast<size_t>(end - label)));
+        const char* label_end = dot ? dot : end;
+        const size_t length = static_cast<size_t>(label_end - label);
+        if (length > 0) {
+            if (!first) out.put('.');
+            first = false;
+            if (ascii_run(label, length) == length) {
+                for (const char* p = label; p < label_end; ++p) {
+                    if (is_forbidden_in_host(static_cast<unsigned char>(*p))) return false;
+                }
+                char* dst = out.extend(length);
+                if (dst) copy_lower(label, length, dst);
+            } else if (!put_idna_label(out, label, label_end)) {
+                return false;
+            }
+        }
+        label = label_end + (dot ? 1 : 0);
+    }
+    return !first;
+}
+
+const char* default_port(const char* scheme, size_t n) {
+    if (n == 4 && std::memcmp(scheme, "http", 4) == 0) return "80";
+    if (n == 5 && std::memcmp(scheme, "https", 5) == 0) return "443";
+    if (n == 2 && std::memcmp(scheme, "ws", 2) == 0) return "80";
+    if (n == 3 && std::memcmp(scheme, "wss", 3) == 0) return "443";
+    if (n == 3 && std::memcmp(scheme, "ftp", 3) == 0) return "21";
+    return nullptr;
+}
+
+// ':' ending a scheme ([A-Za-z][A-Za-z0-9+.-]*), or nullptr
+const char* find_scheme_end(const char* p, const char* end) {
+    if (p == end || !is_alpha(*p)) return nullptr;
+    for (const char* q = p + 1; q < end; ++q) {
+        if (*q == ':') return q;
+        if (!is_alpha(*q) && !is_digit(*q) && *q != '+' && *q != '-' && *q != '.') return nullptr;
+    }
+    return nullptr;
+}
+
+// Output ends in '/' right after a segment; drops that segment unless it is
+// the root (or a failed write left no path)
+void pop_segment(out_buffer_t& out, size_t path_begin) {
+    if (out.size() <= path_begin + 1) return;
+    size_t i = out.size() - 1;
+    while (i > path_begin && out.data()[i - 1] != '/') --i;
+    out.truncate(i);
+}
+
+// Bytes taken by a '.' at p: 1, or 3 for "%2e" (an unreserved escape,
+// which would be decoded to '.' anyway); 0 if there is none
+size_t dot_length(const char* p, const char* end) {
+    if (p < end && *p == '.') return 1;
+    if (end - p >= 3 && p[0] == '%' && p[1] == '2' && (p[2] == 'e' || p[2] == 'E')) return 3;
+    return 0;
+}
+
+// At a run of separators: one '/' out, then "." and ".." segments resolved,
+// escaped dots included as in WHATWG URL parsing ("%2e%2e" is ".."), so
+// the output has none left to resolve. Leaves p at the next segment.
+void put_separator(out_buffer_t& out, const char*& p, const char* end, size_t path_begin) {
+    if (out.back() != '/') out.put('/');
+    for (;;) {
+        while (p < end && (*p == '/' || *p == '\\')) ++p;
+        size_t dots = 0;
+        const char* after = p;
+        while (dots < 3) {
+            const size_t length = dot_length(after, end);
+            if (length == 0) break;
+            after += length;
+            ++dots;
+        }
+        const bool segment_end = after == end || *after == '/' || *after == '\\' || *after == '?' || *after == '#';
+        if ((dots != 1 && dots != 2) || !segment_end) return;
+        if (dots == 2) pop_segment(out, path_begin);
+        p = after;
+    }
+}
+
+// Path from p (at '/', '\\', '?', '#' or end), then the query; stops at '#'
+void put_path_and_query(out_buffer_t& out, const char* p, const char* end) {
+    const size_t path_begin = out.size();
+    out.put('/');
+    if (p < end && (*p == '/' || *p == '\\')) put_separator(out, p, end, path_begin);
+
+    while (p < end) {
+        const size_t run = plain_run(p, end, true);
+        if (run > 0) {
+            out.put(p, run);
+            p += run;
+            if (p == end) break;
+        }
+
+        const char c = *p;
+        if (c == '/' || c == '\\') {
+            put_separator(out, p, end, path_begin);
+        } else if (c == '?' || c == '#') {
+            break;
+        } else if (c == '%') {
+            put_escape(out, p, end);
+        } else {
+            out.put_escaped(static_cast<unsigned char>(c));
+            ++p;
+        }
+    }
+
+    if (p == end || *p != '?') return;
+    const char* query_end = static_cast<const char*>(std::memchr(p, '#', static_cast<size_t>(end - p)));
+    if (!query_end) query_end = end;
+    if (query_end - p == 1) return;    // a bare '?'
+
+    out.put('?');
+    ++p;
+    while (p < query_end) {
+        const size_t run = plain_run(p, query_end, false);
+        out.put(p, run);
+        p += run;
+        if (p == query_end) break;
+        if (*p == '%') {
+            put_escape(out, p, query_end);
+        } else {
+            out.put_escaped(static_cast<unsigned char>(*p));
+            ++p;
+        }
+    }
+}
+
+} // namespace
+
+bool canonicalize_url(const char* url, size_t size, char* out_data, size_t capacity, size_t& out_size) {
+    const char* p = url;
+    const char* end = url + size;
+    while (p < end && static_cast<unsigned char>(*p) <= 0x20) ++p;
+    while (end > p && static_cast<unsigned char>(end[-1]) <= 0x20) --end;
+    if (p == end) return false;
+
+    out_buffer_t out(out_data, capacity);
+
+    // Scheme, if followed by "//"; opaque ones (mailto:, data:) are not
+    // handled, but host:port without a scheme is
+    const char* port_default = nullptr;
+    const char* colon = find_scheme_end(p, end);
+    if (colon && end - colon >= 3 && colon[1] == '/' && colon[2] == '/') {
+        const size_t scheme_size = static_cast<size_t>(colon - p);
+        char* dst = out.extend(scheme_size);
+        if (!dst) return false;
+        copy_lower(p, scheme_size, dst);
+        port_default = default_port(dst, scheme_size);
+        out.put("://", 3);
+        p = colon + 3;
+    } else if (colon && !(colon + 1 < end && is_digit(colon[1]))) {
+        return false;
+    }
+
+    // Authority: [userinfo@]host[:port]
+    const char* authority_end = p + authority_run(p, end);
+    const char* host = p;
+    while (const void* at = std::memchr(host, '@', static_cast<size_t>(authority_end - host))) {
+        host = static_cast<const char*>(at) + 1;
+    }
+    const char* host_end = authority_end;
+    const char* port = nullptr;
+    if (host < authority_end && *host == '[') {
+        const char* close = static_cast<const char*>(std::memchr(host, ']', static_cast<size_t>(authority_end - host)));
+        if (!close) return false;
+        host_end = close + 1;
+        if (host_end < authority_end) {
+            if (*host_end != ':') return false;
+            port = host_end + 1;
+        }
+    } else if (const char* c = static_cast<const char*>(std::memchr(host, ':', static_cast<size_t>(authority_end - host)))) {
+        host_end = c;
+        port = c + 1;
+    }
+    if (host == host_end || !put_host(out, host, host_end)) return false;
+
+    // Port: digits without leading zeros, dropped if empty or the default
+    if (port && port < authority_end) {
+        for (const char* q = port; q < authority_end; ++q) {
+            if (!is_digit(*q)) return false;
+        }
+        while (port + 1 < authority_end && *port == '0') ++port;
+        const size_t digits = static_cast<size_t>(authority_end - port);
+        if (!port_default || std::strlen(port_default) != digits || std::memcmp(port, port_default, digits) != 0) {
+            out.put(':');
+            out.put(port, digits);
+        }
+    }
+
+    put_path_and_query(out, authority_end, end);
+    if (!out.ok()) return false;
+    out_size = out.size();
+    return true;
+}
+
+std::string_view canonical_host(std::string_view canonical) {
+    size_t begin = 0;
+    const size_t first_slash = canonical.find('/');
+    if (first_slash != std::string_view::npos && first_slash > 0 && canonical[first_slash - 1] == ':' &&
+        canonical.compare(first_slash, 2, "//") == 0) {
+        begin = first_slash + 2;
+    }
+    const size_t path = std::min(canonical.find('/', begin), canonical.size());
+    size_t end = std::min(canonical.find(':', begin), path);
+    if (begin < canonical.size() && canonical[begin] == '[') {
+        const size_t close = canonical.find(']', begin);
+        end = close < path ? close + 1 : path;
+    }
+    return canonical.substr(begin, end - begin);
+}